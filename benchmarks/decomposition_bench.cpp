@@ -0,0 +1,406 @@
+// Copyright (C) Tommy Hinks <tommy.hinks@gmail.com>
+// This file is subject to the license terms in the LICENSE file
+// found in the top-level directory of this distribution.
+
+// Throughput and accuracy of the branch-free 3x3 decompositions, the scalar functions called in a
+// loop against the batch versions that solve one problem per SIMD lane (tph_linalg_batch.hpp). The
+// inputs are random matrices with a share of (nearly) degenerate ones, which is where data-dependent
+// branches would otherwise diverge. The array fits in the L2 cache, so the arithmetic rather than
+// memory bandwidth is measured. Results are written as JSON, with the largest error of each path
+// relative to the magnitude of the input. Build in Release.
+//
+// Usage: decomposition_bench [--count N] [--min-ms T] [--out FILE]
+
+#include <algorithm> // std::max
+#include <chrono>
+#include <cmath> // std::abs
+#include <cstdio>
+#include <cstdlib> // std::strtoul, std::strtod
+#include <cstring> // std::memcpy, std::strcmp
+#include <random>
+#include <string>
+#include <vector>
+
+#include <tph/tph_linalg_batch.hpp>
+
+namespace {
+
+struct Options {
+  std::size_t count = std::size_t{1} << 14; // Matrices per array.
+  double min_ms = 200.0;                     // Minimum time spent on each measurement.
+  const char* out = nullptr;
+};
+
+struct Result {
+  std::string op;
+  std::string type;
+  std::string path; // "scalar" or "batch".
+  double ns_per_elem;
+  double speedup;   // Over the scalar path.
+  double max_error; // Relative to the largest input magnitude.
+};
+
+// Best time of repeated calls to f, in nanoseconds.
+template <typename F>
+auto Measure(const Options& opts, F&& f) -> double {
+  using Clock = std::chrono::steady_clock;
+  f(); // Warm-up.
+  auto best = 1e30;
+  auto total = 0.0;
+  int reps = 0;
+  while (reps < 3 || total < opts.min_ms * 1e6) {
+    const auto t0 = Clock::now();
+    f();
+    const auto t1 = Clock::now();
+    const auto ns = std::chrono::duration<double, std::nano>(t1 - t0).count();
+    best = ns < best ? ns : best;
+    total += ns;
+    ++reps;
+  }
+  return best;
+}
+
+template <typename T>
+auto TypeName() -> const char* {
+  return sizeof(T) == 4 ? "float" : "double";
+}
+
+template <typename T>
+auto MaxAbs(const tph::Mat<T, 3, 3>& a) -> double {
+  auto r = 0.0;
+  for (int j = 0; j < 3; ++j) {
+    r = std::max(r, static_cast<double>(std::abs(tph::Comp(a.x, j))));
+    r = std::max(r, static_cast<double>(std::abs(tph::Comp(a.y, j))));
+    r = std::max(r, static_cast<double>(std::abs(tph::Comp(a.z, j))));
+  }
+  return r > 0.0 ? r : 1.0;
+}
+
+// Random symmetric matrices, every fourth one with a double or triple eigenvalue.
+template <typename T>
+auto SymmetricMatrices(const std::size_t n) -> std::vector<tph::Mat<T, 3, 3>> {
+  std::mt19937 rng(12345);
+  std::uniform_real_distribution<T> u(T(-1), T(1));
+  std::vector<tph::Mat<T, 3, 3>> r(n);
+  for (std::size_t i = 0; i < n; ++i) {
+    const auto a01 = u(rng);
+    const auto a02 = u(rng);
+    const auto a12 = u(rng);
+    if (i % 4 == 3) {
+      // Rank one plus a multiple of the identity.
+      const auto v = tph::Vec<T, 3>{a01, a02, a12};
+      const auto d = u(rng);
+      r[i] = tph::MakeMat3x3<T>(v.x * v.x + d, v.x * v.y, v.x * v.z, //
+                                v.y * v.x, v.y * v.y + d, v.y * v.z, //
+                                v.z * v.x, v.z * v.y, v.z * v.z + d);
+    } else {
+      r[i] = tph::MakeMat3x3<T>(u(rng), a01, a02, //
+                                a01, u(rng), a12, //
+                                a02, a12, u(rng));
+    }
+  }
+  return r;
+}
+
+// Largest of the residual |a * v - lambda * v| and the orthogonality error |v^T * v - I|.
+template <typename T>
+auto EigenError(const tph::Mat<T, 3, 3>& a, const tph::EigenDecomposition<T, 3>& e) -> double {
+  const auto& v = e.vectors;
+  const auto av = tph::Mul(a, v);
+  const double residual[] = {tph::Length(av.x - v.x * e.values.x),
+                             tph::Length(av.y - v.y * e.values.y),
+                             tph::Length(av.z - v.z * e.values.z)};
+  auto r = 0.0;
+  for (const auto x : residual) {
+    r = std::max(r, x / MaxAbs(a));
+  }
+  const auto vtv = tph::Mul(tph::Transpose(v), v);
+  const auto id = tph::Identity3x3<T>();
+  r = std::max(r, static_cast<double>(tph::Length(vtv.x - id.x)));
+  r = std::max(r, static_cast<double>(tph::Length(vtv.y - id.y)));
+  r = std::max(r, static_cast<double>(tph::Length(vtv.z - id.z)));
+  return r;
+}
+
+// Random matrices, every fourth one nearly singular and every fourth one a reflection.
+template <typename T>
+auto GeneralMatrices(const std::size_t n) -> std::vector<tph::Mat<T, 3, 3>> {
+  std::mt19937 rng(54321);
+  std::uniform_real_distribution<T> u(T(-1), T(1));
+  std::vector<tph::Mat<T, 3, 3>> r(n);
+  for (std::size_t i = 0; i < n; ++i) {
+    const auto x = tph::Vec<T, 3>{u(rng), u(rng), u(rng)};
+    const auto y = tph::Vec<T, 3>{u(rng), u(rng), u(rng)};
+    const auto z = tph::Vec<T, 3>{u(rng), u(rng), u(rng)};
+    if (i % 4 == 1) {
+      r[i] = tph::Mat<T, 3, 3>{x, y, x * T(0.5) - y + z * T(1e-5)};
+    } else if (i % 4 == 3) {
+      const auto c = tph::Normalized(tph::Cross(x, y));
+      r[i] = tph::Mat<T, 3, 3>{tph::Normalized(x), tph::Normalized(tph::Cross(c, x)), -c};
+    } else {
+      r[i] = tph::Mat<T, 3, 3>{x, y, z};
+    }
+  }
+  return r;
+}
+
+// Largest element of |a - b|, relative to the largest element of a.
+template <typename T>
+auto MaxDiff(const tph::Mat<T, 3, 3>& a, const tph::Mat<T, 3, 3>& b) -> double {
+  auto r = 0.0;
+  for (int j = 0; j < 3; ++j) {
+    r = std::max(r, static_cast<double>(std::abs(tph::Comp(a.x, j) - tph::Comp(b.x, j))));
+    r = std::max(r, static_cast<double>(std::abs(tph::Comp(a.y, j) - tph::Comp(b.y, j))));
+    r = std::max(r, static_cast<double>(std::abs(tph::Comp(a.z, j) - tph::Comp(b.z, j))));
+  }
+  return r / MaxAbs(a);
+}
+
+// Distance of r from the rotations, |r^T * r - I| and |det(r) - 1|.
+template <typename T>
+auto RotationError(const tph::Mat<T, 3, 3>& r) -> double {
+  return std::max(MaxDiff(tph::Identity3x3<T>(), tph::Mul(tph::Transpose(r), r)),
+                  std::abs(static_cast<double>(tph::Determinant(r)) - 1.0));
+}
+
+// Largest of the reconstruction error |a - u * diag(values) * v^T| and the rotation errors.
+template <typename T>
+auto SvdError(const tph::Mat<T, 3, 3>& a, const tph::SingularValueDecomposition<T, 3>& d)
+    -> double {
+  const auto us = tph::Mat<T, 3, 3>{d.u.x * d.values.x, d.u.y * d.values.y, d.u.z * d.values.z};
+  return std::max(MaxDiff(a, tph::Mul(us, tph::Transpose(d.v))),
+                  std::max(RotationError(d.u), RotationError(d.v)));
+}
+
+template <typename T>
+auto PolarError(const tph::Mat<T, 3, 3>& a, const tph::PolarDecomposition<T, 3>& p) -> double {
+  return std::max(MaxDiff(a, tph::Mul(p.rotation, p.stretch)), RotationError(p.rotation));
+}
+
+// Times the scalar function in a loop and the batch function, and the largest error of each.
+template <typename SrcT, typename DstT, typename Scalar, typename Batch, typename Error>
+void Compare(const Options& opts,
+             const char* op,
+             const char* type,
+             const std::vector<SrcT>& src,
+             Scalar scalar_fn,
+             Batch batch_fn,
+             Error error,
+             std::vector<Result>* results) {
+  const auto n = src.size();
+  std::vector<DstT> scalar(n);
+  std::vector<DstT> batch(n);
+  const auto scalar_ns = Measure(opts, [&] {
+    for (std::size_t i = 0; i < n; ++i) {
+      scalar[i] = scalar_fn(src[i]);
+    }
+  });
+  const auto batch_ns = Measure(opts, [&] { batch_fn(src.data(), batch.data(), n); });
+
+  auto scalar_error = 0.0;
+  auto batch_error = 0.0;
+  for (std::size_t i = 0; i < n; ++i) {
+    scalar_error = std::max(scalar_error, error(src[i], scalar[i]));
+    batch_error = std::max(batch_error, error(src[i], batch[i]));
+  }
+  const auto nd = static_cast<double>(n);
+  results->push_back({op, type, "scalar", scalar_ns / nd, 1.0, scalar_error});
+  results->push_back({op, type, "batch", batch_ns / nd, scalar_ns / batch_ns, batch_error});
+}
+
+template <typename T>
+void Decompositions(const Options& opts, std::vector<Result>* results) {
+  using M3 = tph::Mat<T, 3, 3>;
+  const auto sym = SymmetricMatrices<T>(opts.count);
+  Compare<M3, tph::EigenDecomposition<T, 3>>(
+      opts, "EigenSymmetric", TypeName<T>(), sym,
+      [](const M3& a) { return tph::EigenSymmetric(a); },
+      [](const M3* a, tph::EigenDecomposition<T, 3>* d, std::size_t n) {
+        tph::EigenSymmetricMany(a, d, n);
+      },
+      EigenError<T>, results);
+
+  const auto general = GeneralMatrices<T>(opts.count);
+  Compare<M3, tph::SingularValueDecomposition<T, 3>>(
+      opts, "Svd", TypeName<T>(), general, [](const M3& a) { return tph::Svd(a); },
+      [](const M3* a, tph::SingularValueDecomposition<T, 3>* d, std::size_t n) {
+        tph::SvdMany(a, d, n);
+      },
+      SvdError<T>, results);
+  Compare<M3, tph::PolarDecomposition<T, 3>>(
+      opts, "PolarDecompose", TypeName<T>(), general,
+      [](const M3& a) { return tph::PolarDecompose(a); },
+      [](const M3* a, tph::PolarDecomposition<T, 3>* d, std::size_t n) {
+        tph::PolarDecomposeMany(a, d, n);
+      },
+      PolarError<T>, results);
+}
+
+// Random systems a * x = b with M unknowns, a general (LU) or positive definite (Cholesky).
+template <typename T, int M>
+struct Systems {
+  std::vector<tph::Mat<T, M, M>> a;
+  std::vector<tph::Vec<T, M>> b;
+};
+
+template <typename T, int M>
+auto RandomSystems(const std::size_t n, const bool positive_definite) -> Systems<T, M> {
+  std::mt19937 rng(999);
+  std::uniform_real_distribution<T> u(T(-1), T(1));
+  Systems<T, M> r{std::vector<tph::Mat<T, M, M>>(n), std::vector<tph::Vec<T, M>>(n)};
+  for (std::size_t i = 0; i < n; ++i) {
+    T e[M * M];
+    T f[M];
+    for (auto& x : e) {
+      x = u(rng);
+    }
+    for (auto& x : f) {
+      x = u(rng);
+    }
+    std::memcpy(&r.a[i], e, sizeof(e));
+    std::memcpy(&r.b[i], f, sizeof(f));
+    if (positive_definite) {
+      r.a[i] = tph::Mul(tph::Transpose(r.a[i]), r.a[i]);
+    }
+  }
+  return r;
+}
+
+// Residual |a * x - b| relative to |a| * |x|, or zero for an unsolved system.
+template <typename T, int M>
+auto SolveError(const tph::Mat<T, M, M>& a,
+                const tph::Vec<T, M>& b,
+                const tph::LinearSolution<T, M>& s) -> double {
+  const auto r = tph::Mul(a, s.x) - b;
+  auto a_max = 0.0;
+  auto r_max = 0.0;
+  auto x_max = 0.0;
+  for (int j = 0; j < M; ++j) {
+    a_max = std::max(a_max, static_cast<double>(tph::Length(tph::Row(a, j))));
+    r_max = std::max(r_max, static_cast<double>(std::abs(tph::Comp(r, j))));
+    x_max = std::max(x_max, static_cast<double>(std::abs(tph::Comp(s.x, j))));
+  }
+  return s.solved ? r_max / (a_max * x_max) : 0.0;
+}
+
+template <typename T, int M, typename Scalar, typename Batch>
+void Solve(const Options& opts,
+           const char* op,
+           const bool positive_definite,
+           Scalar scalar_fn,
+           Batch batch_fn,
+           std::vector<Result>* results) {
+  const auto sys = RandomSystems<T, M>(opts.count, positive_definite);
+  const auto n = sys.a.size();
+  std::vector<tph::LinearSolution<T, M>> scalar(n);
+  std::vector<tph::LinearSolution<T, M>> batch(n);
+  const auto scalar_ns = Measure(opts, [&] {
+    for (std::size_t i = 0; i < n; ++i) {
+      scalar[i] = scalar_fn(sys.a[i], sys.b[i]);
+    }
+  });
+  const auto batch_ns =
+      Measure(opts, [&] { batch_fn(sys.a.data(), sys.b.data(), batch.data(), n); });
+
+  auto scalar_error = 0.0;
+  auto batch_error = 0.0;
+  for (std::size_t i = 0; i < n; ++i) {
+    scalar_error = std::max(scalar_error, SolveError(sys.a[i], sys.b[i], scalar[i]));
+    batch_error = std::max(batch_error, SolveError(sys.a[i], sys.b[i], batch[i]));
+  }
+  const auto name = std::string(op) + std::to_string(M) + "x" + std::to_string(M);
+  const auto nd = static_cast<double>(n);
+  results->push_back({name, TypeName<T>(), "scalar", scalar_ns / nd, 1.0, scalar_error});
+  results->push_back(
+      {name, TypeName<T>(), "batch", batch_ns / nd, scalar_ns / batch_ns, batch_error});
+}
+
+template <typename T, int M>
+void Solvers(const Options& opts, std::vector<Result>* results) {
+  using MatT = tph::Mat<T, M, M>;
+  using VecT = tph::Vec<T, M>;
+  using SolutionT = tph::LinearSolution<T, M>;
+  Solve<T, M>(
+      opts, "SolveLU", false, [](const MatT& a, const VecT& b) { return tph::SolveLU(a, b); },
+      [](const MatT* a, const VecT* b, SolutionT* x, std::size_t n) {
+        tph::SolveLUMany(a, b, x, n);
+      },
+      results);
+  Solve<T, M>(
+      opts, "SolveCholesky", true,
+      [](const MatT& a, const VecT& b) { return tph::SolveCholesky(a, b); },
+      [](const MatT* a, const VecT* b, SolutionT* x, std::size_t n) {
+        tph::SolveCholeskyMany(a, b, x, n);
+      },
+      results);
+}
+
+void Run(const Options& opts, std::vector<Result>* results) {
+  Decompositions<float>(opts, results);
+  Decompositions<double>(opts, results);
+  Solvers<float, 3>(opts, results);
+  Solvers<float, 4>(opts, results);
+  Solvers<double, 3>(opts, results);
+  Solvers<double, 4>(opts, results);
+}
+
+void PrintJson(std::FILE* f, const Options& opts, const std::vector<Result>& results) {
+  std::fprintf(f, "{\n");
+  std::fprintf(f, "  \"benchmark\": \"decomposition_bench\",\n");
+  std::fprintf(f, "  \"count\": %zu,\n", opts.count);
+  std::fprintf(f, "  \"results\": [\n");
+  for (std::size_t i = 0; i < results.size(); ++i) {
+    const auto& r = results[i];
+    std::fprintf(f,
+                 "    {\"op\": \"%s\", \"type\": \"%s\", \"path\": \"%s\", \"ns_per_elem\": %.4f, "
+                 "\"speedup\": %.3f, \"max_error\": %.3e}%s\n",
+                 r.op.c_str(),
+                 r.type.c_str(),
+                 r.path.c_str(),
+                 r.ns_per_elem,
+                 r.speedup,
+                 r.max_error,
+                 i + 1 < results.size() ? "," : "");
+  }
+  std::fprintf(f, "  ]\n}\n");
+}
+
+auto ParseOptions(const int argc, char* argv[], Options* opts) -> bool {
+  for (int i = 1; i < argc; ++i) {
+    const bool has_value = i + 1 < argc;
+    if (std::strcmp(argv[i], "--count") == 0 && has_value) {
+      opts->count = std::strtoul(argv[++i], nullptr, 10);
+    } else if (std::strcmp(argv[i], "--min-ms") == 0 && has_value) {
+      opts->min_ms = std::strtod(argv[++i], nullptr);
+    } else if (std::strcmp(argv[i], "--out") == 0 && has_value) {
+      opts->out = argv[++i];
+    } else {
+      return false;
+    }
+  }
+  return opts->count > 0;
+}
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+  Options opts;
+  if (!ParseOptions(argc, argv, &opts)) {
+    std::fprintf(stderr, "usage: %s [--count N] [--min-ms T] [--out FILE]\n", argv[0]);
+    return 1;
+  }
+
+  std::vector<Result> results;
+  Run(opts, &results);
+
+  auto* f = opts.out != nullptr ? std::fopen(opts.out, "w") : stdout;
+  if (f == nullptr) {
+    std::fprintf(stderr, "cannot open %s\n", opts.out);
+    return 1;
+  }
+  PrintJson(f, opts, results);
+  if (f != stdout) {
+    std::fclose(f);
+  }
+  return 0;
+}
@@ -0,0 +1,348 @@
+// Copyright (C) Tommy Hinks <tommy.hinks@gmail.com>
+// This file is subject to the license terms in the LICENSE file
+// found in the top-level directory of this distribution.
+
+// Scaling of the parallel batch operations (tph_linalg_parallel.hpp) from 1 to N threads, on arrays
+// much larger than the caches. Each operation is timed with the sequential batch function and with
+// a ThreadPool of 1, 2, 4, ... N threads. Results are written as JSON, with the speedup over the
+// sequential function and the memory bandwidth used (bytes read and written per second), so that
+// the point where the memory bandwidth limits the scaling can be seen. Build in Release.
+//
+// Usage: parallel_bench [--count N] [--threads N] [--min-ms T] [--out FILE]
+
+#include <algorithm> // std::fill
+#include <chrono>
+#include <cmath> // std::cbrt
+#include <cstdint> // std::uint32_t
+#include <cstdio>
+#include <cstdlib> // std::strtoul, std::strtod
+#include <cstring> // std::strcmp
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <tph/tph_linalg_parallel.hpp>
+#include <tph/tph_linalg_spatial.hpp>
+#include <tph/tph_linalg_stream.hpp>
+
+namespace {
+
+struct Options {
+  std::size_t count = std::size_t{1} << 24; // Points per array, 192 MiB for float3.
+  unsigned threads = std::thread::hardware_concurrency();
+  double min_ms = 200.0; // Minimum time spent on each measurement.
+  const char* out = nullptr;
+};
+
+struct Result {
+  std::string op;
+  unsigned threads; // 0 for the sequential function.
+  double ns_per_elem;
+  double gbytes_per_s;
+  double speedup;
+};
+
+// Best time of repeated calls to f, in nanoseconds.
+template <typename F>
+auto Measure(const Options& opts, F&& f) -> double {
+  using Clock = std::chrono::steady_clock;
+  f(); // Warm-up.
+  auto best = 1e30;
+  auto total = 0.0;
+  int reps = 0;
+  while (reps < 3 || total < opts.min_ms * 1e6) {
+    const auto t0 = Clock::now();
+    f();
+    const auto t1 = Clock::now();
+    const auto ns = std::chrono::duration<double, std::nano>(t1 - t0).count();
+    best = ns < best ? ns : best;
+    total += ns;
+    ++reps;
+  }
+  return best;
+}
+
+// 1, 2, 4, ... up to and including max.
+auto ThreadCounts(const unsigned max) -> std::vector<unsigned> {
+  std::vector<unsigned> t;
+  for (unsigned n = 1; n < max; n *= 2) {
+    t.push_back(n);
+  }
+  t.push_back(max);
+  return t;
+}
+
+// Times the sequential function and then the parallel one for each thread count.
+template <typename Seq, typename Par>
+void Scaling(const Options& opts,
+             const char* op,
+             const double bytes_per_elem,
+             Seq seq,
+             Par par,
+             std::vector<Result>* results) {
+  const auto n = static_cast<double>(opts.count);
+  const auto seq_ns = Measure(opts, seq);
+  results->push_back({op, 0, seq_ns / n, bytes_per_elem * n / seq_ns, 1.0});
+  for (const auto t : ThreadCounts(opts.threads)) {
+    tph::ThreadPool pool(t);
+    const auto ns = Measure(opts, [&pool, &par] { par(pool); });
+    results->push_back({op, t, ns / n, bytes_per_elem * n / ns, seq_ns / ns});
+  }
+}
+
+void Run(const Options& opts, std::vector<Result>* results) {
+  const auto n = opts.count;
+  std::vector<tph::float3> src(n);
+  for (std::size_t i = 0; i < n; ++i) {
+    const auto f = static_cast<float>(i % 1009);
+    src[i] = {1.0F + f, 2.0F - f * 0.5F, 0.25F * f};
+  }
+  std::vector<tph::float3> dst(n);
+  const auto m = tph::MakeMat4x4<float>(0.5F, -1.0F, 2.0F, 3.0F,   //
+                                        1.5F, 0.25F, -2.0F, -4.0F, //
+                                        1.0F, 2.0F, 0.75F, 5.0F,   //
+                                        0.0F, 0.0F, 0.0F, 1.0F);
+
+  Scaling(
+      opts, "TransformPoints", 2.0 * sizeof(tph::float3),
+      [&] { tph::TransformPoints(m, src.data(), dst.data(), n); },
+      [&](tph::Scheduler& s) { tph::TransformPoints(s, m, src.data(), dst.data(), n); }, results);
+
+  const auto a = tph::ToSoA(src.data(), n);
+  tph::float3SoA out;
+  tph::Resize(out, n);
+  Scaling(
+      opts, "Normalized", 2.0 * sizeof(tph::float3), [&] { tph::Normalized(a, out); },
+      [&](tph::Scheduler& s) { tph::Normalized(s, a, out); }, results);
+
+  // Reduction, sum of the squared lengths.
+  volatile float sink = 0.0F;
+  const auto sum = [&a](const std::size_t begin, const std::size_t end) {
+    auto r = 0.0F;
+    for (std::size_t i = begin; i < end; ++i) {
+      r += a.x[i] * a.x[i] + a.y[i] * a.y[i] + a.z[i] * a.z[i];
+    }
+    return r;
+  };
+  const auto add = [](const float x, const float y) { return x + y; };
+  const std::size_t chunk = 1 << 14;
+  tph::SerialScheduler serial;
+  Scaling(
+      opts, "ParallelReduce(Length2)", sizeof(tph::float3),
+      [&] { sink = tph::ParallelReduce(serial, n, chunk, 0.0F, sum, add); },
+      [&](tph::Scheduler& s) { sink = tph::ParallelReduce(s, n, chunk, 0.0F, sum, add); },
+      results);
+
+  // Transform, normalize and bounds as three passes over the arrays, and as a streaming pipeline
+  // (tph_linalg_stream.hpp) running all three on each tile while it is in the cache, with reading
+  // overlapped by a second thread. The pipeline does not use the thread pool, so its speedup is
+  // that of fusing the passes whatever the thread count.
+  const auto stride = sizeof(tph::float3);
+  const auto dst_view = tph::MakeStridedView<float, 3>(dst.data(), 0, stride, n);
+  const auto dst_span = tph::MakeStridedSpan<float, 3>(dst.data(), 0, stride, n);
+  volatile float bounds_sink = 0.0F;
+  Scaling(
+      opts, "Stream(TransformPoints,Normalized,ComputeBounds)", 2.0 * sizeof(tph::float3),
+      [&] {
+        tph::TransformPoints(m, src.data(), dst.data(), n);
+        tph::Normalized(dst_view, dst_span);
+        bounds_sink = tph::ComputeBounds(dst.data(), n).max.x;
+      },
+      [&](tph::Scheduler&) {
+        auto bounds = tph::ComputeBounds(src.data(), 0);
+        tph::RunStream(tph::ArraySource(src.data(), n),
+                       {tph::TransformPointsStage(m), tph::NormalizedStage<float, 3>(),
+                        tph::BoundsStage(&bounds)},
+                       tph::ArraySink(dst.data()));
+        bounds_sink = bounds.max.x;
+      },
+      results);
+
+  // Spatial indices (tph_linalg_spatial.hpp) over 1/64 as many points, uniform in a cube with about
+  // 8 points per unit cell, and as many queries, since each query visits dozens of points.
+  auto sopts = opts;
+  sopts.count = n / 64 > 0 ? n / 64 : 1;
+  std::vector<tph::float3> cloud(sopts.count);
+  const auto side = std::cbrt(static_cast<float>(sopts.count) / 8.0F);
+  std::uint32_t seed = 1;
+  for (auto& p : cloud) {
+    for (auto* c : {&p.x, &p.y, &p.z}) {
+      seed = seed * 1664525U + 1013904223U;
+      *c = static_cast<float>(seed >> 8U) * side / static_cast<float>(1U << 24U);
+    }
+  }
+  std::vector<tph::float3> queries(cloud.rbegin(), cloud.rend());
+  for (auto& q : queries) {
+    q += tph::float3{0.25F, 0.5F, 0.75F};
+  }
+  const std::size_t k = 8;
+  std::vector<tph::Neighbor<float>> nearest(sopts.count * k);
+  volatile std::size_t index_sink = 0;
+  Scaling(
+      sopts, "MakeKdTree", sizeof(tph::float3),
+      [&] { index_sink = tph::MakeKdTree(cloud.data(), sopts.count).index[0]; },
+      [&](tph::Scheduler& s) {
+        index_sink = tph::MakeKdTree(s, cloud.data(), sopts.count).index[0];
+      },
+      results);
+  Scaling(
+      sopts, "MakeHashedGrid", sizeof(tph::float3),
+      [&] { index_sink = tph::MakeHashedGrid(cloud.data(), sopts.count, 1.0F).index[0]; },
+      [&](tph::Scheduler& s) {
+        index_sink = tph::MakeHashedGrid(s, cloud.data(), sopts.count, 1.0F).index[0];
+      },
+      results);
+  const auto tree = tph::MakeKdTree(cloud.data(), sopts.count);
+  const auto grid = tph::MakeHashedGrid(cloud.data(), sopts.count, 1.0F);
+  const auto query_bytes = sizeof(tph::float3) + k * sizeof(tph::Neighbor<float>);
+  Scaling(
+      sopts, "KNearestMany(KdTree,k=8)", query_bytes,
+      [&] { tph::KNearestMany(tree, queries.data(), sopts.count, k, nearest.data()); },
+      [&](tph::Scheduler& s) {
+        tph::KNearestMany(s, tree, queries.data(), sopts.count, k, nearest.data());
+      },
+      results);
+  Scaling(
+      sopts, "KNearestMany(HashedGrid,k=8)", query_bytes,
+      [&] { tph::KNearestMany(grid, queries.data(), sopts.count, k, nearest.data()); },
+      [&](tph::Scheduler& s) {
+        tph::KNearestMany(s, grid, queries.data(), sopts.count, k, nearest.data());
+      },
+      results);
+
+  // The same queries in Hilbert curve order, so that consecutive queries visit the same leaves and
+  // buckets, and the sort itself.
+  const auto order = tph::SpatialSort(queries.data(), sopts.count);
+  std::vector<tph::float3> sorted_queries(sopts.count);
+  tph::ApplyPermutation(order, queries.data(), sorted_queries.data());
+  Scaling(
+      sopts, "KNearestMany(KdTree,k=8,sorted)", query_bytes,
+      [&] { tph::KNearestMany(tree, sorted_queries.data(), sopts.count, k, nearest.data()); },
+      [&](tph::Scheduler& s) {
+        tph::KNearestMany(s, tree, sorted_queries.data(), sopts.count, k, nearest.data());
+      },
+      results);
+  Scaling(
+      sopts, "KNearestMany(HashedGrid,k=8,sorted)", query_bytes,
+      [&] { tph::KNearestMany(grid, sorted_queries.data(), sopts.count, k, nearest.data()); },
+      [&](tph::Scheduler& s) {
+        tph::KNearestMany(s, grid, sorted_queries.data(), sopts.count, k, nearest.data());
+      },
+      results);
+  Scaling(
+      sopts, "SpatialSort(Hilbert)", sizeof(tph::float3) + sizeof(std::size_t),
+      [&] { index_sink = tph::SpatialSort(cloud.data(), sopts.count)[0]; },
+      [&](tph::Scheduler& s) { index_sink = tph::SpatialSort(s, cloud.data(), sopts.count)[0]; },
+      results);
+
+  // Transform hierarchy with 1/16 as many nodes as points, since each node has three matrices.
+  // Fan-outs of 1 to 4, as in skeletons, and all nodes dirty, or every 64th node of the deeper half
+  // of the levels, with their subtrees.
+  auto hopts = opts;
+  hopts.count = n / 16 > 0 ? n / 16 : 1;
+  std::vector<std::size_t> parents(hopts.count);
+  for (std::size_t i = 0; i < hopts.count; ++i) {
+    parents[i] = i == 0 ? tph::kNoParent : (i - 1) / (1 + i % 4);
+  }
+  const std::vector<tph::float4x4> local(hopts.count, m);
+  auto h = tph::MakeTransformHierarchy(parents.data(), local.data(), hopts.count);
+  const auto dirty_all = [&h] { std::fill(h.dirty.begin(), h.dirty.end(), 1); };
+  const auto dirty_some = [&h] {
+    for (auto i = h.levels[h.levels.size() / 2]; i < h.dirty.size(); i += 64) {
+      h.dirty[i] = 1;
+    }
+  };
+  const auto node_bytes = 3.0 * sizeof(tph::float4x4);
+  Scaling(
+      hopts, "UpdateWorld", node_bytes,
+      [&] {
+        dirty_all();
+        tph::UpdateWorld(h);
+      },
+      [&](tph::Scheduler& s) {
+        dirty_all();
+        tph::UpdateWorld(s, h);
+      },
+      results);
+  Scaling(
+      hopts, "UpdateWorld(incremental)", node_bytes,
+      [&] {
+        dirty_some();
+        tph::UpdateWorld(h);
+      },
+      [&](tph::Scheduler& s) {
+        dirty_some();
+        tph::UpdateWorld(s, h);
+      },
+      results);
+}
+
+void PrintJson(std::FILE* f, const Options& opts, const std::vector<Result>& results) {
+  std::fprintf(f, "{\n");
+  std::fprintf(f, "  \"benchmark\": \"parallel_bench\",\n");
+  std::fprintf(f, "  \"count\": %zu,\n", opts.count);
+  std::fprintf(f, "  \"hardware_threads\": %u,\n", std::thread::hardware_concurrency());
+  std::fprintf(f, "  \"results\": [\n");
+  for (std::size_t i = 0; i < results.size(); ++i) {
+    const auto& r = results[i];
+    std::fprintf(f, "    {\"op\": \"%s\", \"threads\": ", r.op.c_str());
+    if (r.threads == 0) {
+      std::fprintf(f, "\"sequential\"");
+    } else {
+      std::fprintf(f, "%u", r.threads);
+    }
+    std::fprintf(f,
+                 ", \"ns_per_elem\": %.4f, \"gbytes_per_s\": %.3f, \"speedup\": %.3f}%s\n",
+                 r.ns_per_elem,
+                 r.gbytes_per_s,
+                 r.speedup,
+                 i + 1 < results.size() ? "," : "");
+  }
+  std::fprintf(f, "  ]\n}\n");
+}
+
+auto ParseOptions(const int argc, char* argv[], Options* opts) -> bool {
+  for (int i = 1; i < argc; ++i) {
+    const bool has_value = i + 1 < argc;
+    if (std::strcmp(argv[i], "--count") == 0 && has_value) {
+      opts->count = std::strtoul(argv[++i], nullptr, 10);
+    } else if (std::strcmp(argv[i], "--threads") == 0 && has_value) {
+      opts->threads = static_cast<unsigned>(std::strtoul(argv[++i], nullptr, 10));
+    } else if (std::strcmp(argv[i], "--min-ms") == 0 && has_value) {
+      opts->min_ms = std::strtod(argv[++i], nullptr);
+    } else if (std::strcmp(argv[i], "--out") == 0 && has_value) {
+      opts->out = argv[++i];
+    } else {
+      return false;
+    }
+  }
+  if (opts->threads == 0) {
+    opts->threads = 1;
+  }
+  return opts->count > 0;
+}
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+  Options opts;
+  if (!ParseOptions(argc, argv, &opts)) {
+    std::fprintf(
+        stderr, "usage: %s [--count N] [--threads N] [--min-ms T] [--out FILE]\n", argv[0]);
+    return 1;
+  }
+
+  std::vector<Result> results;
+  Run(opts, &results);
+
+  auto* f = opts.out != nullptr ? std::fopen(opts.out, "w") : stdout;
+  if (f == nullptr) {
+    std::fprintf(stderr, "cannot open %s\n", opts.out);
+    return 1;
+  }
+  PrintJson(f, opts, results);
+  if (f != stdout) {
+    std::fclose(f);
+  }
+  return 0;
+}
@@ -0,0 +1,64 @@
+// Copyright (C) Tommy Hinks <tommy.hinks@gmail.com>
+// This file is subject to the license terms in the LICENSE file
+// found in the top-level directory of this distribution.
+
+// Compares the constexpr Newton-Raphson sqrt with the run-time hardware paths used by Length,
+// Normalized and NormalizedFast. Build in Release.
+
+#include <chrono>
+#include <cstdio>
+#include <vector>
+
+#include <tph/tph_linalg.hpp>
+
+namespace {
+
+// Normalized as implemented before the hardware sqrt path, for reference.
+auto NormalizedNewton(const tph::float3& a) noexcept -> tph::float3 {
+  return a * (1.0F / tph::tph_linalg_internal::SqrtCheck(tph::Length2(a), 1.0F));
+}
+
+template <typename F>
+auto TimeNs(const std::vector<tph::float3>& in, std::vector<tph::float3>& out, F&& f) -> double {
+  constexpr int kReps = 20;
+  auto best = 1e30;
+  for (int r = 0; r < kReps; ++r) {
+    const auto t0 = std::chrono::steady_clock::now();
+    for (std::size_t i = 0; i < in.size(); ++i) {
+      out[i] = f(in[i]);
+    }
+    const auto t1 = std::chrono::steady_clock::now();
+    const auto ns = std::chrono::duration<double, std::nano>(t1 - t0).count();
+    best = ns < best ? ns : best;
+  }
+  return best / static_cast<double>(in.size());
+}
+
+} // namespace
+
+int main(int /*argc*/, char* /*argv*/[]) {
+  constexpr std::size_t kCount = 1 << 16;
+  std::vector<tph::float3> in(kCount);
+  std::vector<tph::float3> out(kCount);
+  for (std::size_t i = 0; i < kCount; ++i) {
+    const auto f = static_cast<float>(i);
+    in[i] = {1.0F + f * 0.25F, 2.0F - f * 0.5F, 0.5F + f};
+  }
+
+  const auto newton = TimeNs(in, out, NormalizedNewton);
+  const auto hw = TimeNs(in, out, [](const tph::float3& a) { return tph::Normalized(a); });
+  const auto fast = TimeNs(in, out, [](const tph::float3& a) { return tph::NormalizedFast(a); });
+
+  auto max_err = 0.0F;
+  for (std::size_t i = 0; i < kCount; ++i) {
+    const auto n = tph::NormalizedFast(in[i]);
+    const auto e = tph::tph_linalg_internal::abs(tph::Length(n) - 1.0F);
+    max_err = e > max_err ? e : max_err;
+  }
+
+  std::printf("Normalized (Newton-Raphson): %7.3f ns/op\n", newton);
+  std::printf("Normalized (hardware sqrt):  %7.3f ns/op (%.1fx)\n", hw, newton / hw);
+  std::printf("NormalizedFast (rsqrt):      %7.3f ns/op (%.1fx)\n", fast, newton / fast);
+  std::printf("NormalizedFast max |Length - 1|: %g\n", static_cast<double>(max_err));
+  return 0;
+}
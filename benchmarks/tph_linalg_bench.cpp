@@ -0,0 +1,563 @@
+// Copyright (C) Tommy Hinks <tommy.hinks@gmail.com>
+// This file is subject to the license terms in the LICENSE file
+// found in the top-level directory of this distribution.
+
+// Throughput of the Vec/Mat operators and free functions, for float and double and sizes 2, 3 and
+// 4. Each operation is timed scalar-in-loop (the scalar function called for every element of an
+// array of vectors) and, where a batch version exists, batch (the SoA function from
+// tph_linalg_batch.hpp). Results are written as JSON, to stdout or to the file given with --out, so
+// that runs can be diffed across releases. Build in Release.
+//
+// Usage: tph_linalg_bench [--count N] [--min-ms T] [--out FILE]
+//
+// GFLOP/s counts each add, subtract, multiply, divide and square root as one operation.
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib> // std::strtoul, std::strtod
+#include <cstring> // std::strcmp
+#include <string>
+#include <type_traits> // std::integral_constant
+#include <vector>
+
+#include <tph/tph_linalg.hpp>
+#include <tph/tph_linalg_batch.hpp>
+
+namespace {
+
+struct Options {
+  std::size_t count = 4096; // Vectors per array, small enough to stay in cache.
+  double min_ms = 20.0;     // Minimum time spent on each measurement.
+  const char* out = nullptr;
+};
+
+struct Timing {
+  double ns_per_op;
+  double gflops;
+};
+
+struct Result {
+  std::string op;
+  const char* type;
+  int size;
+  double flops_per_op;
+  Timing scalar;
+  bool has_batch;
+  Timing batch;
+};
+
+// Results are folded into this so that the timed loops cannot be optimized away.
+volatile double g_sink = 0.0;
+
+template <typename ArithT>
+auto Sum(const ArithT x) -> double {
+  return static_cast<double>(x);
+}
+
+template <typename ArithT, int M>
+auto Sum(const tph::Vec<ArithT, M>& v) -> double {
+  auto s = 0.0;
+  for (int i = 0; i < M; ++i) {
+    s += static_cast<double>(tph::Comp(v, i));
+  }
+  return s;
+}
+
+template <typename ArithT, int M, int N>
+auto Sum(const tph::Mat<ArithT, M, N>& m) -> double {
+  auto s = 0.0;
+  for (int i = 0; i < M; ++i) {
+    s += Sum(tph::Row(m, i));
+  }
+  return s;
+}
+
+template <typename ArithT>
+auto Sum(const tph::Quat<ArithT>& q) -> double {
+  return Sum(q.v) + static_cast<double>(q.w);
+}
+
+template <typename T>
+void Consume(const std::vector<T>& out) {
+  auto s = 0.0;
+  for (const auto& x : out) {
+    s += Sum(x);
+  }
+  g_sink = g_sink + s;
+}
+
+template <typename ArithT, int M>
+void Consume(const tph::VecArraySoA<ArithT, M>& out) {
+  Consume(std::vector<ArithT>{out.x.begin(), out.x.end()});
+}
+
+// Best time of repeated calls to f, each processing n elements, until opts.min_ms has passed.
+template <typename F>
+auto Measure(const Options& opts, const std::size_t n, const double flops_per_op, F&& f) -> Timing {
+  using Clock = std::chrono::steady_clock;
+  f(); // Warm-up.
+  auto best = 1e30;
+  auto total = 0.0;
+  int reps = 0;
+  while (reps < 5 || total < opts.min_ms * 1e6) {
+    const auto t0 = Clock::now();
+    f();
+    const auto t1 = Clock::now();
+    const auto ns = std::chrono::duration<double, std::nano>(t1 - t0).count();
+    best = ns < best ? ns : best;
+    total += ns;
+    ++reps;
+  }
+  const auto ns_per_op = best / static_cast<double>(n);
+  return {ns_per_op, flops_per_op / ns_per_op};
+}
+
+template <typename ArithT>
+auto TypeName() -> const char*;
+template <>
+auto TypeName<float>() -> const char* {
+  return "float";
+}
+template <>
+auto TypeName<double>() -> const char* {
+  return "double";
+}
+
+template <typename ArithT, int M>
+auto MakeVecs(const std::size_t n, const ArithT offset) -> std::vector<tph::Vec<ArithT, M>> {
+  std::vector<tph::Vec<ArithT, M>> v(n);
+  for (std::size_t i = 0; i < n; ++i) {
+    const auto f = static_cast<ArithT>(i % 97);
+    for (int j = 0; j < M; ++j) {
+      tph::tph_linalg_internal::CompRef(v[i], j) =
+          offset + ArithT(0.25) * f - ArithT(0.5) * static_cast<ArithT>(j);
+    }
+  }
+  return v;
+}
+
+// Matrix from its columns.
+template <typename ArithT, int M>
+auto FromCols(const tph::Vec<tph::Vec<ArithT, M>, 2>& c) -> tph::Mat<ArithT, M, 2> {
+  return {c.x, c.y};
+}
+template <typename ArithT, int M>
+auto FromCols(const tph::Vec<tph::Vec<ArithT, M>, 3>& c) -> tph::Mat<ArithT, M, 3> {
+  return {c.x, c.y, c.z};
+}
+template <typename ArithT, int M>
+auto FromCols(const tph::Vec<tph::Vec<ArithT, M>, 4>& c) -> tph::Mat<ArithT, M, 4> {
+  return {c.x, c.y, c.z, c.w};
+}
+
+template <typename ArithT, int M>
+auto MakeMat() -> tph::Mat<ArithT, M, M> {
+  tph::Vec<tph::Vec<ArithT, M>, M> cols{};
+  for (int c = 0; c < M; ++c) {
+    for (int r = 0; r < M; ++r) {
+      tph::tph_linalg_internal::CompRef(tph::tph_linalg_internal::CompRef(cols, c), r) =
+          ArithT(1) / static_cast<ArithT>(1 + r + 2 * c);
+    }
+  }
+  return FromCols(cols);
+}
+
+// All measurements for one element type and size.
+template <typename ArithT, int M>
+class Suite {
+ public:
+  using VecT = tph::Vec<ArithT, M>;
+
+  Suite(const Options& opts, std::vector<Result>* results)
+      : opts_(opts),
+        results_(results),
+        n_(opts.count),
+        a_(MakeVecs<ArithT, M>(n_, ArithT(1))),
+        b_(MakeVecs<ArithT, M>(n_, ArithT(-2))),
+        soa_a_(tph::ToSoA(a_.data(), n_)),
+        soa_b_(tph::ToSoA(b_.data(), n_)),
+        soa_acc_(soa_a_),
+        mats_(n_, MakeMat<ArithT, M>()),
+        out_scalar_(n_),
+        out_vec_(n_),
+        out_mats_(n_) {}
+
+  void Run() {
+    const double m = M;
+    const auto s = ArithT(1.0001);
+
+    // Operators.
+    Vec("operator+", m, [](const VecT& a, const VecT& b) { return a + b; });
+    Vec("operator-", m, [](const VecT& a, const VecT& b) { return a - b; });
+    Vec("operator*", m, [s](const VecT& a, const VecT&) { return a * s; });
+    Vec("operator-(unary)", m, [](const VecT& a, const VecT&) { return -a; });
+    Scalar("operator==", m, [](const VecT& a, const VecT& b) { return ArithT(a == b); });
+    Scalar("operator!=", m, [](const VecT& a, const VecT& b) { return ArithT(a != b); });
+    Vec("operator+=", m, [](const VecT& a, const VecT& b) {
+      auto r = a;
+      r += b;
+      return r;
+    });
+    Vec("operator-=", m, [](const VecT& a, const VecT& b) {
+      auto r = a;
+      r -= b;
+      return r;
+    });
+    Vec("operator*=", m, [s](const VecT& a, const VecT&) {
+      auto r = a;
+      r *= s;
+      return r;
+    });
+    // Batch operators are timed with the compound assignments, so that no array is allocated in the
+    // timed loop.
+    Batch("operator+", [this] { soa_acc_ += soa_b_; });
+    Batch("operator-", [this] { soa_acc_ -= soa_b_; });
+    Batch("operator*", [this, s] { soa_acc_ *= s; });
+    Batch("operator+=", [this] { soa_acc_ += soa_b_; });
+    Batch("operator-=", [this] { soa_acc_ -= soa_b_; });
+    Batch("operator*=", [this, s] { soa_acc_ *= s; });
+
+    // Free functions.
+    Scalar("Dot", 2 * m - 1, [](const VecT& a, const VecT& b) { return tph::Dot(a, b); });
+    Batch("Dot", [this] { tph::Dot(soa_a_, soa_b_, out_scalar_.data()); });
+    RunCross(std::integral_constant<int, M>{});
+    Scalar("Length2", 2 * m - 1, [](const VecT& a, const VecT&) { return tph::Length2(a); });
+    Batch("Length2", [this] { tph::Length2(soa_a_, out_scalar_.data()); });
+    Scalar("Length", 2 * m, [](const VecT& a, const VecT&) { return tph::Length(a); });
+    Batch("Length", [this] { tph::Length(soa_a_, out_scalar_.data()); });
+    Scalar("Distance2", 3 * m - 1, [](const VecT& a, const VecT& b) {
+      return tph::Distance2(a, b);
+    });
+    Batch("Distance2", [this] { tph::Distance2(soa_a_, soa_b_, out_scalar_.data()); });
+    Scalar("Distance", 3 * m, [](const VecT& a, const VecT& b) { return tph::Distance(a, b); });
+    Vec("Normalized", 3 * m + 1, [](const VecT& a, const VecT&) { return tph::Normalized(a); });
+    Batch("Normalized", [this] { tph::Normalized(soa_a_, soa_out_); });
+    Scalar("InvLength", 2 * m + 1, [](const VecT& a, const VecT&) { return tph::InvLength(a); });
+    Vec("NormalizedFast", 3 * m + 1, [](const VecT& a, const VecT&) {
+      return tph::NormalizedFast(a);
+    });
+    Scalar("Comp", 0, [this](const VecT& a, const VecT&) { return tph::Comp(a, Index()); });
+
+    // Matrix-vector functions, each element has its own matrix in the scalar loop.
+    Measured("Mul", M * (2 * m - 1), [this] {
+      for (std::size_t i = 0; i < n_; ++i) {
+        out_vec_[i] = tph::Mul(mats_[i], a_[i]);
+      }
+    });
+    Batch("Mul", [this] { tph::Mul(mats_[0], soa_a_, soa_out_); });
+    // Matrix-matrix product, scalar-in-loop is the column-by-column constexpr Mul.
+    Measured("Mul(mat)", M * M * (2 * m - 1), [this] {
+      for (std::size_t i = 0; i < n_; ++i) {
+        out_mats_[i] = tph::Mul(mats_[i], mats_[i]);
+      }
+    });
+    Measured("Row", 0, [this] {
+      for (std::size_t i = 0; i < n_; ++i) {
+        out_vec_[i] = tph::Row(mats_[i], static_cast<int>(i % M));
+      }
+    });
+
+    // Square matrix functions.
+    Measured("Transpose", 0, [this] {
+      for (std::size_t i = 0; i < n_; ++i) {
+        out_mats_[i] = tph::Transpose(mats_[i]);
+      }
+    });
+    Measured("Determinant", DeterminantFlops(), [this] {
+      for (std::size_t i = 0; i < n_; ++i) {
+        out_scalar_[i] = tph::Determinant(mats_[i]);
+      }
+    });
+    Measured("Inverse", InverseFlops(), [this] {
+      for (std::size_t i = 0; i < n_; ++i) {
+        out_mats_[i] = tph::Inverse(mats_[i]);
+      }
+    });
+    RunMany(std::integral_constant<int, M>{});
+    RunQuat(std::integral_constant<int, M>{});
+    RunStrided(std::integral_constant<int, M>{});
+    RunClosest(std::integral_constant<int, M>{});
+
+    Consume(out_scalar_);
+    Consume(out_vec_);
+    Consume(out_mats_);
+    Consume(soa_acc_);
+    Consume(soa_out_);
+  }
+
+ private:
+  // Cross is defined for sizes 2 (scalar-valued) and 3.
+  void RunCross(std::integral_constant<int, 2> /*size*/) {
+    Scalar("Cross", 3, [](const VecT& a, const VecT& b) { return tph::Cross(a, b); });
+  }
+  void RunCross(std::integral_constant<int, 3> /*size*/) {
+    Vec("Cross", 9, [](const VecT& a, const VecT& b) { return tph::Cross(a, b); });
+    Batch("Cross", [this] { tph::Cross(soa_a_, soa_b_, soa_out_); });
+  }
+  void RunCross(std::integral_constant<int, 4> /*size*/) {}
+
+  // MulMany and InverseMany are defined for 4x4 matrices.
+  template <int N>
+  void RunMany(std::integral_constant<int, N> /*size*/) {}
+  void RunMany(std::integral_constant<int, 4> /*size*/) {
+    Batch("Mul(mat)", [this] { tph::MulMany(mats_.data(), mats_.data(), out_mats_.data(), n_); });
+    Batch("Inverse", [this] { tph::InverseMany(mats_.data(), out_mats_.data(), n_); });
+  }
+
+  // Quaternions, with a, b normalized as rotations and the vectors of size 3 to rotate. Each
+  // element has its own rotation in both loops. The Slerp count is approximate, 10 operations per
+  // term of the series for each of the two weights.
+  template <int N>
+  void RunQuat(std::integral_constant<int, N> /*size*/) {}
+  void RunQuat(std::integral_constant<int, 3> /*size*/) {
+    using QuatT = tph::Quat<ArithT>;
+    std::vector<QuatT> qa(n_);
+    std::vector<QuatT> qb(n_);
+    std::vector<QuatT> out(n_);
+    for (std::size_t i = 0; i < n_; ++i) {
+      qa[i] = tph::Normalized(QuatT{a_[i], ArithT(0.5)});
+      qb[i] = tph::Normalized(QuatT{b_[i], ArithT(-0.25)});
+    }
+    const auto t = ArithT(0.3);
+    const double slerp_terms = sizeof(ArithT) > 4 ? 17 : 7;
+    Measured("Rotate", 30, [this, &qa] {
+      for (std::size_t i = 0; i < n_; ++i) {
+        out_vec_[i] = tph::Rotate(qa[i], a_[i]);
+      }
+    });
+    Batch("Rotate", [this, &qa] { tph::RotateMany(qa.data(), a_.data(), out_vec_.data(), n_); });
+    Measured("Nlerp", 33, [this, &qa, &qb, &out, t] {
+      for (std::size_t i = 0; i < n_; ++i) {
+        out[i] = tph::Nlerp(qa[i], qb[i], t);
+      }
+    });
+    Batch("Nlerp", [this, &qa, &qb, &out, t] {
+      tph::NlerpMany(qa.data(), qb.data(), t, out.data(), n_);
+    });
+    Measured("Slerp", 38 + 20 * slerp_terms, [this, &qa, &qb, &out, t] {
+      for (std::size_t i = 0; i < n_; ++i) {
+        out[i] = tph::Slerp(qa[i], qb[i], t);
+      }
+    });
+    Batch("Slerp", [this, &qa, &qb, &out, t] {
+      tph::SlerpMany(qa.data(), qb.data(), t, out.data(), n_);
+    });
+    Consume(out);
+  }
+
+  // Positions and normals of interleaved vertices of 32 or 64 bytes, through strided views. The
+  // scalar loops read and write the vertex members.
+  template <int N>
+  void RunStrided(std::integral_constant<int, N> /*size*/) {}
+  void RunStrided(std::integral_constant<int, 3> /*size*/) {
+    struct Vertex {
+      VecT position;
+      VecT normal;
+      tph::Vec<ArithT, 2> uv;
+    };
+    std::vector<Vertex> vertices(n_);
+    for (std::size_t i = 0; i < n_; ++i) {
+      vertices[i] = {a_[i], b_[i], tph::Vec<ArithT, 2>{}};
+    }
+    const auto m34 = tph::Mat<ArithT, 3, 4>{mats_[0].x, mats_[0].y, mats_[0].z, a_[0]};
+    const auto positions = tph::MakeStridedSpan(vertices.data(), n_, &Vertex::position);
+    const auto normals = tph::MakeStridedSpan(vertices.data(), n_, &Vertex::normal);
+    Measured("TransformPoints(strided)", 18, [this, &vertices, &m34] {
+      for (std::size_t i = 0; i < n_; ++i) {
+        const auto& p = vertices[i].position;
+        vertices[i].normal = m34.x * p.x + m34.y * p.y + m34.z * p.z + m34.w;
+      }
+    });
+    Batch("TransformPoints(strided)", [&positions, &normals, &m34] {
+      tph::TransformPoints(m34, tph::ToView(positions), normals);
+    });
+    Measured("Normalized(strided)", 10, [this, &vertices] {
+      for (std::size_t i = 0; i < n_; ++i) {
+        vertices[i].normal = tph::Normalized(vertices[i].normal);
+      }
+    });
+    Batch("Normalized(strided)",
+          [&normals] { tph::Normalized(tph::ToView(normals), normals); });
+    for (std::size_t i = 0; i < n_; ++i) {
+      out_vec_[i] = vertices[i].normal;
+    }
+  }
+
+  // Closest points and box distances for the points a, with one segment, triangle and box per
+  // point placed around b. The triangle count includes every region, since all are computed. Run
+  // with a larger --count for queries that do not fit in the cache.
+  template <int N>
+  void RunClosest(std::integral_constant<int, N> /*size*/) {}
+  void RunClosest(std::integral_constant<int, 3> /*size*/) {
+    using BoxT = tph::Aabb<ArithT, 3>;
+    std::vector<VecT> tb(n_);
+    std::vector<VecT> tc(n_);
+    std::vector<BoxT> boxes(n_);
+    for (std::size_t i = 0; i < n_; ++i) {
+      tb[i] = b_[i] + VecT{ArithT(2), ArithT(0), ArithT(0.5)};
+      tc[i] = b_[i] + VecT{ArithT(0), ArithT(3), ArithT(-1)};
+      boxes[i] = BoxT{b_[i], tb[i] + VecT{ArithT(0), ArithT(1), ArithT(0)}};
+    }
+    Measured("ClosestPointOnSegment", 23, [this, &tb] {
+      for (std::size_t i = 0; i < n_; ++i) {
+        out_vec_[i] = tph::ClosestPointOnSegment(a_[i], b_[i], tb[i]);
+      }
+    });
+    Batch("ClosestPointOnSegment", [this, &tb] {
+      tph::ClosestPointsOnSegments(a_.data(), b_.data(), tb.data(), out_vec_.data(), n_);
+    });
+    Measured("ClosestPointOnTriangle", 100, [this, &tb, &tc] {
+      for (std::size_t i = 0; i < n_; ++i) {
+        out_vec_[i] = tph::ClosestPointOnTriangle(a_[i], b_[i], tb[i], tc[i]);
+      }
+    });
+    Batch("ClosestPointOnTriangle", [this, &tb, &tc] {
+      tph::ClosestPointsOnTriangles(a_.data(), b_.data(), tb.data(), tc.data(), out_vec_.data(),
+                                    n_);
+    });
+    Measured("DistanceToBox", 9, [this, &boxes] {
+      for (std::size_t i = 0; i < n_; ++i) {
+        out_scalar_[i] = tph::DistanceToBox(a_[i], boxes[i]);
+      }
+    });
+    Batch("DistanceToBox", [this, &boxes] {
+      tph::DistancesToBoxes(a_.data(), boxes.data(), out_scalar_.data(), n_);
+    });
+  }
+
+  // Operation counts of the cofactor expansions in tph_linalg.hpp.
+  static constexpr auto DeterminantFlops() -> double { return M == 2 ? 3 : M == 3 ? 14 : 47; }
+  static constexpr auto InverseFlops() -> double { return M == 2 ? 8 : M == 3 ? 42 : 144; }
+
+  auto Index() const -> int { return static_cast<int>(index_++ % M); }
+
+  // Scalar-in-loop measurement of f(a[i], b[i]), scalar-valued.
+  template <typename F>
+  void Scalar(const char* op, const double flops, F f) {
+    Measured(op, flops, [this, f] {
+      for (std::size_t i = 0; i < n_; ++i) {
+        out_scalar_[i] = f(a_[i], b_[i]);
+      }
+    });
+  }
+
+  // Scalar-in-loop measurement of f(a[i], b[i]), vector-valued.
+  template <typename F>
+  void Vec(const char* op, const double flops, F f) {
+    Measured(op, flops, [this, f] {
+      for (std::size_t i = 0; i < n_; ++i) {
+        out_vec_[i] = f(a_[i], b_[i]);
+      }
+    });
+  }
+
+  template <typename F>
+  void Measured(const char* op, const double flops, F f) {
+    results_->push_back(
+        {op, TypeName<ArithT>(), M, flops, Measure(opts_, n_, flops, f), false, Timing{0.0, 0.0}});
+  }
+
+  // Batch measurement, added to the scalar result of op for this type and size.
+  template <typename F>
+  void Batch(const char* op, F f) {
+    for (auto& r : *results_) {
+      if (r.op == op && r.type == TypeName<ArithT>() && r.size == M) {
+        r.has_batch = true;
+        r.batch = Measure(opts_, n_, r.flops_per_op, f);
+      }
+    }
+  }
+
+  const Options& opts_;
+  std::vector<Result>* results_;
+  std::size_t n_;
+  std::vector<VecT> a_;
+  std::vector<VecT> b_;
+  tph::VecArraySoA<ArithT, M> soa_a_;
+  tph::VecArraySoA<ArithT, M> soa_b_;
+  tph::VecArraySoA<ArithT, M> soa_acc_;
+  tph::VecArraySoA<ArithT, M> soa_out_;
+  std::vector<tph::Mat<ArithT, M, M>> mats_;
+  std::vector<ArithT> out_scalar_;
+  std::vector<VecT> out_vec_;
+  std::vector<tph::Mat<ArithT, M, M>> out_mats_;
+  mutable std::size_t index_ = 0;
+};
+
+void PrintTiming(std::FILE* f, const Timing& t) {
+  std::fprintf(f, "{\"ns_per_op\": %.4f, \"gflops\": %.4f}", t.ns_per_op, t.gflops);
+}
+
+void PrintJson(std::FILE* f, const Options& opts, const std::vector<Result>& results) {
+  std::fprintf(f, "{\n");
+  std::fprintf(f, "  \"benchmark\": \"tph_linalg_bench\",\n");
+#if defined(__VERSION__)
+  std::fprintf(f, "  \"compiler\": \"%s\",\n", __VERSION__);
+#elif defined(_MSC_FULL_VER)
+  std::fprintf(f, "  \"compiler\": \"MSVC %d\",\n", _MSC_FULL_VER);
+#endif
+  std::fprintf(f, "  \"count\": %zu,\n", opts.count);
+  std::fprintf(f, "  \"results\": [\n");
+  for (std::size_t i = 0; i < results.size(); ++i) {
+    const auto& r = results[i];
+    std::fprintf(f,
+                 "    {\"op\": \"%s\", \"type\": \"%s\", \"size\": %d, \"scalar\": ",
+                 r.op.c_str(),
+                 r.type,
+                 r.size);
+    PrintTiming(f, r.scalar);
+    std::fprintf(f, ", \"batch\": ");
+    if (r.has_batch) {
+      PrintTiming(f, r.batch);
+    } else {
+      std::fprintf(f, "null");
+    }
+    std::fprintf(f, "}%s\n", i + 1 < results.size() ? "," : "");
+  }
+  std::fprintf(f, "  ]\n}\n");
+}
+
+auto ParseOptions(const int argc, char* argv[], Options* opts) -> bool {
+  for (int i = 1; i < argc; ++i) {
+    const bool has_value = i + 1 < argc;
+    if (std::strcmp(argv[i], "--count") == 0 && has_value) {
+      opts->count = std::strtoul(argv[++i], nullptr, 10);
+    } else if (std::strcmp(argv[i], "--min-ms") == 0 && has_value) {
+      opts->min_ms = std::strtod(argv[++i], nullptr);
+    } else if (std::strcmp(argv[i], "--out") == 0 && has_value) {
+      opts->out = argv[++i];
+    } else {
+      return false;
+    }
+  }
+  return opts->count > 0;
+}
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+  Options opts;
+  if (!ParseOptions(argc, argv, &opts)) {
+    std::fprintf(stderr, "usage: %s [--count N] [--min-ms T] [--out FILE]\n", argv[0]);
+    return 1;
+  }
+
+  std::vector<Result> results;
+  Suite<float, 2>(opts, &results).Run();
+  Suite<float, 3>(opts, &results).Run();
+  Suite<float, 4>(opts, &results).Run();
+  Suite<double, 2>(opts, &results).Run();
+  Suite<double, 3>(opts, &results).Run();
+  Suite<double, 4>(opts, &results).Run();
+
+  auto* f = opts.out != nullptr ? std::fopen(opts.out, "w") : stdout;
+  if (f == nullptr) {
+    std::fprintf(stderr, "cannot open %s\n", opts.out);
+    return 1;
+  }
+  PrintJson(f, opts, results);
+  if (f != stdout) {
+    std::fclose(f);
+  }
+  return 0;
+}
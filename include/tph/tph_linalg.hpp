@@ -6,10 +6,85 @@
 #define TPH_NODISCARD
 #endif
 
+// Detect if the compiler lets us ask whether we are currently being evaluated in a constant
+// expression. If not, the (slow) constexpr code paths are used also at run-time.
+#if defined(__has_builtin)
+#if __has_builtin(__builtin_is_constant_evaluated)
+#define TPH_HAS_IS_CONSTANT_EVALUATED 1
+#endif
+#elif defined(__GNUC__) && __GNUC__ >= 9
+#define TPH_HAS_IS_CONSTANT_EVALUATED 1
+#elif defined(_MSC_VER) && _MSC_VER >= 1925
+#define TPH_HAS_IS_CONSTANT_EVALUATED 1
+#endif
+#ifndef TPH_HAS_IS_CONSTANT_EVALUATED
+#define TPH_HAS_IS_CONSTANT_EVALUATED 0
+#endif
+
+// Non-const member functions are implicitly const if constexpr in C++11, so the mutable accessors
+// are only constexpr from C++14.
+#if __cplusplus >= 201402L || (defined(_MSVC_LANG) && _MSVC_LANG >= 201402L)
+#define TPH_CONSTEXPR14 constexpr
+#else
+#define TPH_CONSTEXPR14 inline
+#endif
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define TPH_HAS_SSE2 1
+#include <emmintrin.h>
+#else
+#define TPH_HAS_SSE2 0
+#endif
+
+// F16C converts between half and float in a single instruction. MSVC does not define __F16C__, but
+// every processor with AVX2 has F16C.
+#if defined(__F16C__) || (defined(_MSC_VER) && defined(__AVX2__))
+#define TPH_HAS_F16C 1
+#include <immintrin.h>
+#else
+#define TPH_HAS_F16C 0
+#endif
+
+#include <cstdint>     // std::uint16_t, std::uint32_t
+#include <cstring>     // std::memcpy
+#include <limits>      // std::numeric_limits
+#include <type_traits> // std::is_standard_layout
+
 namespace tph {
 
+namespace tph_linalg_internal {
+
+// Returns true if evaluated in a constant expression, e.g. inside a static_assert. Without compiler
+// support this always returns true, which is safe but means run-time code uses the constexpr paths.
+TPH_NODISCARD constexpr auto is_constant_evaluated() noexcept -> bool {
+#if TPH_HAS_IS_CONSTANT_EVALUATED
+  return __builtin_is_constant_evaluated();
+#else
+  return true;
+#endif
+}
+
+// Pointer to first, the first of the N members of type E that make up t. At run time operator[]
+// and data() of Vec and Mat index the members as an array through this pointer, which is only
+// defined for actual arrays but relies on nothing more than the members being laid out like one.
+// That is checked here for every indexed type: standard layout puts the first member at offset 0
+// and the others after it in order, and a size of exactly N members leaves no room for padding.
+template <int N, typename E, typename T>
+constexpr auto ContiguousMembers(const T& /*t*/, E& first) noexcept -> E* {
+  static_assert(std::is_standard_layout<T>::value, "members must be laid out in order");
+  static_assert(sizeof(T) == N * sizeof(E), "members must be contiguous");
+  return &first;
+}
+
+} // namespace tph_linalg_internal
+
 // Small, fixed-length vector type, consisting of exactly M elements of type T, and presumed to be a
 // column-vector unless otherwise noted.
+//
+// The components are contiguous, like an array of M elements, and can be indexed with operator[]
+// or through data(). At run time a[i] is a single indexed load or store, see ContiguousMembers for
+// the layout that relies on. The members are not an array in constant expressions, so there
+// operator[] selects the member instead.
 template <typename ArithT, int M>
 struct Vec;
 
@@ -17,6 +92,19 @@ template <typename ArithT>
 struct Vec<ArithT, 2> {
   ArithT x;
   ArithT y;
+
+  constexpr auto operator[](const int i) const noexcept -> const ArithT& {
+    return tph_linalg_internal::is_constant_evaluated() ? (i == 0 ? x : y) : data()[i];
+  }
+  TPH_CONSTEXPR14 auto operator[](const int i) noexcept -> ArithT& {
+    return tph_linalg_internal::is_constant_evaluated() ? (i == 0 ? x : y) : data()[i];
+  }
+  constexpr auto data() const noexcept -> const ArithT* {
+    return tph_linalg_internal::ContiguousMembers<2>(*this, x);
+  }
+  TPH_CONSTEXPR14 auto data() noexcept -> ArithT* {
+    return tph_linalg_internal::ContiguousMembers<2>(*this, x);
+  }
 };
 
 template <typename ArithT>
@@ -24,6 +112,21 @@ struct Vec<ArithT, 3> {
   ArithT x;
   ArithT y;
   ArithT z;
+
+  constexpr auto operator[](const int i) const noexcept -> const ArithT& {
+    return tph_linalg_internal::is_constant_evaluated() ? (i == 0 ? x : i == 1 ? y : z)
+                                                        : data()[i];
+  }
+  TPH_CONSTEXPR14 auto operator[](const int i) noexcept -> ArithT& {
+    return tph_linalg_internal::is_constant_evaluated() ? (i == 0 ? x : i == 1 ? y : z)
+                                                        : data()[i];
+  }
+  constexpr auto data() const noexcept -> const ArithT* {
+    return tph_linalg_internal::ContiguousMembers<3>(*this, x);
+  }
+  TPH_CONSTEXPR14 auto data() noexcept -> ArithT* {
+    return tph_linalg_internal::ContiguousMembers<3>(*this, x);
+  }
 };
 
 template <typename ArithT>
@@ -32,6 +135,104 @@ struct Vec<ArithT, 4> {
   ArithT y;
   ArithT z;
   ArithT w;
+
+  constexpr auto operator[](const int i) const noexcept -> const ArithT& {
+    return tph_linalg_internal::is_constant_evaluated() ? (i == 0 ? x : i == 1 ? y : i == 2 ? z : w)
+                                                        : data()[i];
+  }
+  TPH_CONSTEXPR14 auto operator[](const int i) noexcept -> ArithT& {
+    return tph_linalg_internal::is_constant_evaluated() ? (i == 0 ? x : i == 1 ? y : i == 2 ? z : w)
+                                                        : data()[i];
+  }
+  constexpr auto data() const noexcept -> const ArithT* {
+    return tph_linalg_internal::ContiguousMembers<4>(*this, x);
+  }
+  TPH_CONSTEXPR14 auto data() noexcept -> ArithT* {
+    return tph_linalg_internal::ContiguousMembers<4>(*this, x);
+  }
+};
+
+namespace tph_linalg_internal {
+
+// IEEE 754 binary16 conversions, used when F16C is not available. Round to nearest even, overflow
+// gives infinity and NaN gives a quiet NaN. From:
+// https://gist.github.com/rygorous/2156668 (float_to_half_fast3_rtne and half_to_float)
+inline auto FloatToHalfBits(const float f) noexcept -> std::uint16_t {
+#if TPH_HAS_F16C
+  return static_cast<std::uint16_t>(_cvtss_sh(f, _MM_FROUND_TO_NEAREST_INT));
+#else
+  std::uint32_t u = 0;
+  std::memcpy(&u, &f, sizeof(u));
+  const auto sign = u & 0x80000000U;
+  u ^= sign;
+  std::uint32_t h = 0;
+  if (u >= (127U + 16U) << 23) {
+    // Infinity or NaN, including float values that overflow half.
+    h = u > 255U << 23 ? 0x7e00U : 0x7c00U;
+  } else if (u < 113U << 23) {
+    // Subnormal half or zero, adding 0.5 aligns the 10 mantissa bits at the bottom and rounds.
+    const std::uint32_t magic_bits = 126U << 23;
+    float magic = 0.0F;
+    std::memcpy(&magic, &magic_bits, sizeof(magic));
+    float g = 0.0F;
+    std::memcpy(&g, &u, sizeof(g));
+    g += magic;
+    std::memcpy(&u, &g, sizeof(u));
+    h = u - magic_bits;
+  } else {
+    // Normal half, rebias the exponent and round the 13 dropped mantissa bits to nearest even.
+    const auto mant_odd = (u >> 13) & 1U;
+    u += (static_cast<std::uint32_t>(15 - 127) << 23) + 0xfffU + mant_odd;
+    h = u >> 13;
+  }
+  return static_cast<std::uint16_t>(h | sign >> 16);
+#endif
+}
+
+inline auto HalfBitsToFloat(const std::uint16_t h) noexcept -> float {
+#if TPH_HAS_F16C
+  return _cvtsh_ss(h);
+#else
+  const std::uint32_t shifted_exp = 0x7c00U << 13;
+  std::uint32_t u = (h & 0x7fffU) << 13;
+  const auto exp = shifted_exp & u;
+  u += static_cast<std::uint32_t>(127 - 15) << 23;
+  float f = 0.0F;
+  if (exp == shifted_exp) {
+    // Infinity or NaN.
+    u += static_cast<std::uint32_t>(128 - 16) << 23;
+    std::memcpy(&f, &u, sizeof(f));
+  } else if (exp == 0) {
+    // Zero or subnormal, renormalize.
+    u += 1U << 23;
+    const std::uint32_t magic_bits = 113U << 23;
+    float magic = 0.0F;
+    std::memcpy(&magic, &magic_bits, sizeof(magic));
+    std::memcpy(&f, &u, sizeof(f));
+    f -= magic;
+  } else {
+    std::memcpy(&f, &u, sizeof(f));
+  }
+  std::memcpy(&u, &f, sizeof(u));
+  u |= static_cast<std::uint32_t>(h & 0x8000U) << 16;
+  std::memcpy(&f, &u, sizeof(f));
+  return f;
+#endif
+}
+
+} // namespace tph_linalg_internal
+
+// IEEE 754 half-precision (binary16) storage type. Converts implicitly to and from float, so that
+// arithmetic on half values, and on Vec<half, M>, is done in float, e.g. Dot(a, b) of two half3
+// vectors is a float. Conversion from float rounds to nearest even. Meant for storage, halving the
+// memory traffic of large arrays, see Widen and Narrow in tph_linalg_batch.hpp. Not usable in
+// constant expressions.
+struct half {
+  std::uint16_t bits; // Sign, 5 exponent bits and 10 mantissa bits.
+
+  half() = default;
+  half(const float f) noexcept : bits(tph_linalg_internal::FloatToHalfBits(f)) {}
+  operator float() const noexcept { return tph_linalg_internal::HalfBitsToFloat(bits); }
 };
 
 // Convenient type aliases.
@@ -41,6 +242,9 @@ using float4 = Vec<float, 4>;
 using double2 = Vec<double, 2>;
 using double3 = Vec<double, 3>;
 using double4 = Vec<double, 4>;
+using half2 = Vec<half, 2>;
+using half3 = Vec<half, 3>;
+using half4 = Vec<half, 4>;
 
 namespace tph_linalg_internal {
 template <class T>
@@ -50,18 +254,20 @@ struct dependent_false {
 } // namespace tph_linalg_internal
 
 template <typename ArithT, int M>
-TPH_NODISCARD constexpr auto Comp(const Vec<ArithT, M>& a, const int i) noexcept -> decltype(a.x) {
-  if constexpr (M == 2) {
-    return i == 0 ? a.x : a.y;
-  } else if constexpr (M == 3) {
-    return i == 0 ? a.x : i == 1 ? a.y : a.z;
-  } else if constexpr (M == 4) {
-    return i == 0 ? a.x : i == 1 ? a.y : i == 2 ? a.z : a.w;
-  } else {
-    static_assert(tph_linalg_internal::dependent_false<ArithT>::value, "");
-  }
+TPH_NODISCARD constexpr auto Comp(const Vec<ArithT, M>& a, const int i) noexcept -> ArithT {
+  return a[i];
+}
+
+namespace tph_linalg_internal {
+
+// Mutable reference to component i.
+template <typename ArithT, int M>
+TPH_CONSTEXPR14 auto CompRef(Vec<ArithT, M>& a, const int i) noexcept -> ArithT& {
+  return a[i];
 }
 
+} // namespace tph_linalg_internal
+
 // operator==(a, b)
 template <typename ArithT, typename ArithT2>
 TPH_NODISCARD constexpr auto operator==(const Vec<ArithT, 2>& a, const Vec<ArithT2, 2>& b) noexcept
@@ -310,12 +516,96 @@ TPH_NODISCARD constexpr auto SqrtCheck(const FloatT x, const FloatT m_val) noexc
                             : m_val * SqrtRecur(x, x / FloatT(2), 0));
 }
 
-// Computes sqrt(x) using a Newton-Raphson approach.
+// The scalar type of an arithmetic type, the lane type for SIMD packets (see tph_linalg_simd.hpp).
+template <typename ArithT>
+struct scalar_type {
+  using type = ArithT;
+};
+
+// The result type of comparing two values of an arithmetic type, a lane mask for SIMD packets.
+template <typename ArithT>
+struct mask_type {
+  using type = bool;
+};
+
+// m ? a : b. For SIMD packets m is a lane mask and the overload found by argument-dependent lookup
+// (simd::Select) is branch-free, so code written with Select runs lane-wise on packets.
+template <typename T>
+TPH_NODISCARD constexpr auto Select(const bool m, const T& a, const T& b) noexcept -> T {
+  return m ? a : b;
+}
+
+// |x| and max(a, b) by Select, see above.
+template <typename ArithT>
+TPH_NODISCARD constexpr auto SelectAbs(const ArithT x) noexcept -> ArithT {
+  return Select(x < ArithT(0), -x, x);
+}
+
+template <typename ArithT>
+TPH_NODISCARD constexpr auto SelectMax(const ArithT a, const ArithT b) noexcept -> ArithT {
+  return Select(a < b, b, a);
+}
+
+// Run-time sqrt, lowers to a single hardware instruction (e.g. sqrtss/sqrtsd) for float and double.
+// Other types fall back to Newton-Raphson.
 template <typename FloatT>
-TPH_NODISCARD constexpr auto sqrt(const FloatT x) noexcept -> FloatT {
+TPH_NODISCARD constexpr auto HardwareSqrt(const FloatT x) noexcept -> FloatT {
   return SqrtCheck(x, FloatT(1));
 }
 
+TPH_NODISCARD inline auto HardwareSqrt(const float x) noexcept -> float {
+#if defined(__GNUC__) || defined(__clang__)
+  return __builtin_sqrtf(x);
+#elif TPH_HAS_SSE2
+  return _mm_cvtss_f32(_mm_sqrt_ss(_mm_set_ss(x)));
+#else
+  return SqrtCheck(x, 1.0F);
+#endif
+}
+
+TPH_NODISCARD inline auto HardwareSqrt(const double x) noexcept -> double {
+#if defined(__GNUC__) || defined(__clang__)
+  return __builtin_sqrt(x);
+#elif TPH_HAS_SSE2
+  return _mm_cvtsd_f64(_mm_sqrt_sd(_mm_setzero_pd(), _mm_set_sd(x)));
+#else
+  return SqrtCheck(x, 1.0);
+#endif
+}
+
+// Run-time reciprocal sqrt. For float this is the hardware estimate (rsqrtss, relative error at most
+// 1.5 * 2^-12) refined by one Newton-Raphson step, y' = y * (1.5 - 0.5 * x * y^2), which brings the
+// relative error below 2^-21 (about 4.8e-7). Zero, infinite and NaN input produce NaN. Double
+// precision has no hardware estimate, so it is computed as 1 / sqrt(x).
+template <typename FloatT>
+TPH_NODISCARD constexpr auto HardwareRsqrt(const FloatT x) noexcept -> FloatT {
+  return FloatT(1) / HardwareSqrt(x);
+}
+
+TPH_NODISCARD inline auto HardwareRsqrt(const float x) noexcept -> float {
+#if TPH_HAS_SSE2
+  const float y = _mm_cvtss_f32(_mm_rsqrt_ss(_mm_set_ss(x)));
+  return y * (1.5F - 0.5F * x * y * y);
+#else
+  return 1.0F / HardwareSqrt(x);
+#endif
+}
+
+// Computes sqrt(x). In constant expressions a Newton-Raphson approach is used, at run-time the
+// hardware instruction. Other arithmetic types (e.g. tph::simd packets) can provide SqrtCheck,
+// HardwareSqrt and HardwareRsqrt overloads that are found by argument-dependent lookup.
+template <typename FloatT>
+TPH_NODISCARD constexpr auto sqrt(const FloatT x) noexcept -> FloatT {
+  return is_constant_evaluated() ? SqrtCheck(x, FloatT(1)) : HardwareSqrt(x);
+}
+
+// Computes 1 / sqrt(x). In constant expressions this is exact up to the Newton-Raphson sqrt, at
+// run-time see HardwareRsqrt for error bounds.
+template <typename FloatT>
+TPH_NODISCARD constexpr auto rsqrt(const FloatT x) noexcept -> FloatT {
+  return is_constant_evaluated() ? FloatT(1) / SqrtCheck(x, FloatT(1)) : HardwareRsqrt(x);
+}
+
 } // namespace tph_linalg_internal
 
 // Cross product.
@@ -384,8 +674,107 @@ TPH_NODISCARD constexpr auto Normalized(const Vec<FloatT, M>& a) noexcept
   return a * (FloatT(1) / Length(a));
 }
 
+// Reciprocal length, 1 / Length(a). Faster than Length at run-time for float vectors, at the cost of
+// a relative error up to about 4.8e-7 (see tph_linalg_internal::HardwareRsqrt). The zero vector is
+// not supported.
+template <typename FloatT, int M>
+TPH_NODISCARD constexpr auto InvLength(const Vec<FloatT, M>& a) noexcept
+    -> decltype(tph_linalg_internal::rsqrt(Length2(a))) {
+  return tph_linalg_internal::rsqrt(Length2(a));
+}
+
+// Normalized, using InvLength. The length of the result differs from one by at most about 5e-7 for
+// float vectors, compared to about 1.2e-7 for Normalized. The zero vector is not supported.
+template <typename FloatT, int M>
+TPH_NODISCARD constexpr auto NormalizedFast(const Vec<FloatT, M>& a) noexcept
+    -> Vec<decltype(a.x * InvLength(a)), M> {
+  return a * InvLength(a);
+}
+
+// Half vector to float vector, exact.
+TPH_NODISCARD inline auto Widen(const Vec<half, 2>& a) noexcept -> Vec<float, 2> {
+  return {a.x, a.y};
+}
+
+TPH_NODISCARD inline auto Widen(const Vec<half, 3>& a) noexcept -> Vec<float, 3> {
+  return {a.x, a.y, a.z};
+}
+
+TPH_NODISCARD inline auto Widen(const Vec<half, 4>& a) noexcept -> Vec<float, 4> {
+  return {a.x, a.y, a.z, a.w};
+}
+
+// Float vector to half vector, rounded to nearest even.
+TPH_NODISCARD inline auto Narrow(const Vec<float, 2>& a) noexcept -> Vec<half, 2> {
+  return {a.x, a.y};
+}
+
+TPH_NODISCARD inline auto Narrow(const Vec<float, 3>& a) noexcept -> Vec<half, 3> {
+  return {a.x, a.y, a.z};
+}
+
+TPH_NODISCARD inline auto Narrow(const Vec<float, 4>& a) noexcept -> Vec<half, 4> {
+  return {a.x, a.y, a.z, a.w};
+}
+
+// Component-wise minimum, as std::min for each component.
+template <typename ArithT>
+TPH_NODISCARD constexpr auto Min(const Vec<ArithT, 2>& a, const Vec<ArithT, 2>& b) noexcept
+    -> Vec<ArithT, 2> {
+  return {b.x < a.x ? b.x : a.x, b.y < a.y ? b.y : a.y};
+}
+
+template <typename ArithT>
+TPH_NODISCARD constexpr auto Min(const Vec<ArithT, 3>& a, const Vec<ArithT, 3>& b) noexcept
+    -> Vec<ArithT, 3> {
+  return {b.x < a.x ? b.x : a.x, b.y < a.y ? b.y : a.y, b.z < a.z ? b.z : a.z};
+}
+
+template <typename ArithT>
+TPH_NODISCARD constexpr auto Min(const Vec<ArithT, 4>& a, const Vec<ArithT, 4>& b) noexcept
+    -> Vec<ArithT, 4> {
+  return {b.x < a.x ? b.x : a.x, b.y < a.y ? b.y : a.y, b.z < a.z ? b.z : a.z,
+          b.w < a.w ? b.w : a.w};
+}
+
+// Component-wise maximum, as std::max for each component.
+template <typename ArithT>
+TPH_NODISCARD constexpr auto Max(const Vec<ArithT, 2>& a, const Vec<ArithT, 2>& b) noexcept
+    -> Vec<ArithT, 2> {
+  return {a.x < b.x ? b.x : a.x, a.y < b.y ? b.y : a.y};
+}
+
+template <typename ArithT>
+TPH_NODISCARD constexpr auto Max(const Vec<ArithT, 3>& a, const Vec<ArithT, 3>& b) noexcept
+    -> Vec<ArithT, 3> {
+  return {a.x < b.x ? b.x : a.x, a.y < b.y ? b.y : a.y, a.z < b.z ? b.z : a.z};
+}
+
+template <typename ArithT>
+TPH_NODISCARD constexpr auto Max(const Vec<ArithT, 4>& a, const Vec<ArithT, 4>& b) noexcept
+    -> Vec<ArithT, 4> {
+  return {a.x < b.x ? b.x : a.x, a.y < b.y ? b.y : a.y, a.z < b.z ? b.z : a.z,
+          a.w < b.w ? b.w : a.w};
+}
+
+// Axis-aligned box, the points p with min <= p <= max. A box with min > max in any component is
+// empty.
+template <typename ArithT, int M>
+struct Aabb {
+  Vec<ArithT, M> min;
+  Vec<ArithT, M> max;
+};
+
+// Smallest box containing both boxes.
+template <typename ArithT, int M>
+TPH_NODISCARD constexpr auto Union(const Aabb<ArithT, M>& a, const Aabb<ArithT, M>& b) noexcept
+    -> Aabb<ArithT, M> {
+  return {Min(a.min, b.min), Max(a.max, b.max)};
+}
+
 // Small, fixed-size matrix type, consisting of exactly M rows and N columns of type T, stored in
-// column-major order.
+// column-major order. a[j] is column j and data() points to the M * N components, contiguous as
+// for Vec.
 template <typename ArithT, int M, int N>
 struct Mat;
 
@@ -393,6 +782,23 @@ template <typename ArithT, int M>
 struct Mat<ArithT, M, 2> {
   Vec<ArithT, M> x; // Column 0.
   Vec<ArithT, M> y; // Column 1.
+
+  constexpr auto operator[](const int j) const noexcept -> const Vec<ArithT, M>& {
+    return tph_linalg_internal::is_constant_evaluated()
+               ? (j == 0 ? x : y)
+               : tph_linalg_internal::ContiguousMembers<2>(*this, x)[j];
+  }
+  TPH_CONSTEXPR14 auto operator[](const int j) noexcept -> Vec<ArithT, M>& {
+    return tph_linalg_internal::is_constant_evaluated()
+               ? (j == 0 ? x : y)
+               : tph_linalg_internal::ContiguousMembers<2>(*this, x)[j];
+  }
+  constexpr auto data() const noexcept -> const ArithT* {
+    return tph_linalg_internal::ContiguousMembers<2>(*this, x)->data();
+  }
+  TPH_CONSTEXPR14 auto data() noexcept -> ArithT* {
+    return tph_linalg_internal::ContiguousMembers<2>(*this, x)->data();
+  }
 };
 
 template <typename ArithT, int M>
@@ -400,6 +806,23 @@ struct Mat<ArithT, M, 3> {
   Vec<ArithT, M> x; // Column 0.
   Vec<ArithT, M> y; // Column 1.
   Vec<ArithT, M> z; // Column 2.
+
+  constexpr auto operator[](const int j) const noexcept -> const Vec<ArithT, M>& {
+    return tph_linalg_internal::is_constant_evaluated()
+               ? (j == 0 ? x : j == 1 ? y : z)
+               : tph_linalg_internal::ContiguousMembers<3>(*this, x)[j];
+  }
+  TPH_CONSTEXPR14 auto operator[](const int j) noexcept -> Vec<ArithT, M>& {
+    return tph_linalg_internal::is_constant_evaluated()
+               ? (j == 0 ? x : j == 1 ? y : z)
+               : tph_linalg_internal::ContiguousMembers<3>(*this, x)[j];
+  }
+  constexpr auto data() const noexcept -> const ArithT* {
+    return tph_linalg_internal::ContiguousMembers<3>(*this, x)->data();
+  }
+  TPH_CONSTEXPR14 auto data() noexcept -> ArithT* {
+    return tph_linalg_internal::ContiguousMembers<3>(*this, x)->data();
+  }
 };
 
 template <typename ArithT, int M>
@@ -408,6 +831,23 @@ struct Mat<ArithT, M, 4> {
   Vec<ArithT, M> y; // Column 1.
   Vec<ArithT, M> z; // Column 2.
   Vec<ArithT, M> w; // Column 3.
+
+  constexpr auto operator[](const int j) const noexcept -> const Vec<ArithT, M>& {
+    return tph_linalg_internal::is_constant_evaluated()
+               ? (j == 0 ? x : j == 1 ? y : j == 2 ? z : w)
+               : tph_linalg_internal::ContiguousMembers<4>(*this, x)[j];
+  }
+  TPH_CONSTEXPR14 auto operator[](const int j) noexcept -> Vec<ArithT, M>& {
+    return tph_linalg_internal::is_constant_evaluated()
+               ? (j == 0 ? x : j == 1 ? y : j == 2 ? z : w)
+               : tph_linalg_internal::ContiguousMembers<4>(*this, x)[j];
+  }
+  constexpr auto data() const noexcept -> const ArithT* {
+    return tph_linalg_internal::ContiguousMembers<4>(*this, x)->data();
+  }
+  TPH_CONSTEXPR14 auto data() noexcept -> ArithT* {
+    return tph_linalg_internal::ContiguousMembers<4>(*this, x)->data();
+  }
 };
 
 // Convenient type aliases.
@@ -487,22 +927,30 @@ MakeMat4x4(const ArithT a, const ArithT b, const ArithT c, const ArithT d,
 }
 // clang-format on
 
-// Return a row from a matrix.
+// Return a row from a matrix, one indexed load per column.
+template <typename ArithT, int M>
+TPH_NODISCARD constexpr auto Row(const Mat<ArithT, M, 2>& a, const int i) noexcept
+    -> Vec<ArithT, 2> {
+  return {a.x[i], a.y[i]};
+}
+
+template <typename ArithT, int M>
+TPH_NODISCARD constexpr auto Row(const Mat<ArithT, M, 3>& a, const int i) noexcept
+    -> Vec<ArithT, 3> {
+  return {a.x[i], a.y[i], a.z[i]};
+}
+
+template <typename ArithT, int M>
+TPH_NODISCARD constexpr auto Row(const Mat<ArithT, M, 4>& a, const int i) noexcept
+    -> Vec<ArithT, 4> {
+  return {a.x[i], a.y[i], a.z[i], a.w[i]};
+}
+
+// Return a column from a matrix, the same as a[j].
 template <typename ArithT, int M, int N>
-TPH_NODISCARD constexpr auto Row(const Mat<ArithT, M, N>& a, const int i) noexcept
-    -> Vec<ArithT, N> {
-  if constexpr (N == 2) {
-    return {Comp(a.x, i), Comp(a.y, i)};
-  }
-  else if constexpr (N == 3) {
-    return {Comp(a.x, i), Comp(a.y, i), Comp(a.z, i)};
-  }
-  else if constexpr (N == 4) {
-    return {Comp(a.x, i), Comp(a.y, i), Comp(a.z, i), Comp(a.w, i)};
-  }
-  else {
-    static_assert(tph_linalg_internal::dependent_false<ArithT>::value, "");
-  }
+TPH_NODISCARD constexpr auto Col(const Mat<ArithT, M, N>& a, const int j) noexcept
+    -> Vec<ArithT, M> {
+  return a[j];
 }
 
 // Identity.
@@ -555,30 +1003,1674 @@ constexpr auto Mul(const Mat<ArithT, M, 4>& a, const Vec<ArithT, 4>& b) noexcept
   return a.x * b.x + a.y * b.y + a.z * b.z + a.w * b.w;
 }
 
-// template <typename ArithT, int M, int N>
-// constexpr auto Mul(const Mat<ArithT, M, N>& a, const Mat<ArithT, N, 1>& b) noexcept
-//     -> Mat<ArithT, M, 1> {
-//   return {Mul(a, b.x)};
-// }
-
-template <typename ArithT, int M, int N>
-constexpr auto Mul(const Mat<ArithT, M, N>& a, const Mat<ArithT, N, 2>& b) noexcept
+// Matrix/matrix multiplication, Mat<M, K> * Mat<K, N> for all sizes. Column j of the product is a
+// times column j of b. See also MulMany in tph_linalg_batch.hpp (SIMD, arrays of 4x4 matrices).
+template <typename ArithT, int M, int K>
+constexpr auto Mul(const Mat<ArithT, M, K>& a, const Mat<ArithT, K, 2>& b) noexcept
     -> Mat<ArithT, M, 2> {
   return {Mul(a, b.x), Mul(a, b.y)};
 }
 
-template <typename ArithT, int M, int N>
-constexpr auto mul(const Mat<ArithT, M, N>& a, const Mat<ArithT, N, 3>& b) noexcept
+template <typename ArithT, int M, int K>
+constexpr auto Mul(const Mat<ArithT, M, K>& a, const Mat<ArithT, K, 3>& b) noexcept
     -> Mat<ArithT, M, 3> {
   return {Mul(a, b.x), Mul(a, b.y), Mul(a, b.z)};
 }
 
-template <typename ArithT, int M, int N>
-constexpr auto Mul(const Mat<ArithT, M, N>& a, const Mat<ArithT, N, 4>& b) noexcept
+template <typename ArithT, int M, int K>
+constexpr auto Mul(const Mat<ArithT, M, K>& a, const Mat<ArithT, K, 4>& b) noexcept
     -> Mat<ArithT, M, 4> {
-  return {mul(a, b.x), mul(a, b.y), mul(a, b.z), mul(a, b.w)};
+  return {Mul(a, b.x), Mul(a, b.y), Mul(a, b.z), Mul(a, b.w)};
+}
+
+// Transpose.
+template <typename ArithT, int N>
+TPH_NODISCARD constexpr auto Transpose(const Mat<ArithT, 2, N>& a) noexcept -> Mat<ArithT, N, 2> {
+  return {Row(a, 0), Row(a, 1)};
+}
+
+template <typename ArithT, int N>
+TPH_NODISCARD constexpr auto Transpose(const Mat<ArithT, 3, N>& a) noexcept -> Mat<ArithT, N, 3> {
+  return {Row(a, 0), Row(a, 1), Row(a, 2)};
+}
+
+template <typename ArithT, int N>
+TPH_NODISCARD constexpr auto Transpose(const Mat<ArithT, 4, N>& a) noexcept -> Mat<ArithT, N, 4> {
+  return {Row(a, 0), Row(a, 1), Row(a, 2), Row(a, 3)};
+}
+
+namespace tph_linalg_internal {
+
+// Matrix times scalar.
+template <typename ArithT, int M>
+constexpr auto Scaled(const Mat<ArithT, M, 2>& a, const ArithT s) noexcept -> Mat<ArithT, M, 2> {
+  return {a.x * s, a.y * s};
+}
+
+template <typename ArithT, int M>
+constexpr auto Scaled(const Mat<ArithT, M, 3>& a, const ArithT s) noexcept -> Mat<ArithT, M, 3> {
+  return {a.x * s, a.y * s, a.z * s};
+}
+
+template <typename ArithT, int M>
+constexpr auto Scaled(const Mat<ArithT, M, 4>& a, const ArithT s) noexcept -> Mat<ArithT, M, 4> {
+  return {a.x * s, a.y * s, a.z * s, a.w * s};
+}
+
+// 2x2 minors of a 4x4 matrix from the upper two rows (s) and the lower two rows (c), used for the
+// Laplace expansion of the determinant and the adjugate. In the comments mRC is row R, column C.
+template <typename ArithT>
+struct Minors4x4 {
+  ArithT s0, s1, s2, s3, s4, s5;
+  ArithT c0, c1, c2, c3, c4, c5;
+};
+
+template <typename ArithT>
+constexpr auto Minors(const Mat<ArithT, 4, 4>& m) noexcept -> Minors4x4<ArithT> {
+  return {m.x.x * m.y.y - m.y.x * m.x.y,  // m00 m11 - m01 m10
+          m.x.x * m.z.y - m.z.x * m.x.y,  // m00 m12 - m02 m10
+          m.x.x * m.w.y - m.w.x * m.x.y,  // m00 m13 - m03 m10
+          m.y.x * m.z.y - m.z.x * m.y.y,  // m01 m12 - m02 m11
+          m.y.x * m.w.y - m.w.x * m.y.y,  // m01 m13 - m03 m11
+          m.z.x * m.w.y - m.w.x * m.z.y,  // m02 m13 - m03 m12
+          m.x.z * m.y.w - m.y.z * m.x.w,  // m20 m31 - m21 m30
+          m.x.z * m.z.w - m.z.z * m.x.w,  // m20 m32 - m22 m30
+          m.x.z * m.w.w - m.w.z * m.x.w,  // m20 m33 - m23 m30
+          m.y.z * m.z.w - m.z.z * m.y.w,  // m21 m32 - m22 m31
+          m.y.z * m.w.w - m.w.z * m.y.w,  // m21 m33 - m23 m31
+          m.z.z * m.w.w - m.w.z * m.z.w}; // m22 m33 - m23 m32
+}
+
+template <typename ArithT>
+constexpr auto Determinant(const Minors4x4<ArithT>& k) noexcept -> ArithT {
+  return k.s0 * k.c5 - k.s1 * k.c4 + k.s2 * k.c3 + k.s3 * k.c2 - k.s4 * k.c1 + k.s5 * k.c0;
+}
+
+// clang-format off
+template <typename ArithT>
+constexpr auto Adjugate(const Mat<ArithT, 4, 4>& m, const Minors4x4<ArithT>& k) noexcept
+    -> Mat<ArithT, 4, 4> {
+  return {
+    { m.y.y * k.c5 - m.z.y * k.c4 + m.w.y * k.c3,
+     -m.x.y * k.c5 + m.z.y * k.c2 - m.w.y * k.c1,
+      m.x.y * k.c4 - m.y.y * k.c2 + m.w.y * k.c0,
+     -m.x.y * k.c3 + m.y.y * k.c1 - m.z.y * k.c0}, // Column 0.
+    {-m.y.x * k.c5 + m.z.x * k.c4 - m.w.x * k.c3,
+      m.x.x * k.c5 - m.z.x * k.c2 + m.w.x * k.c1,
+     -m.x.x * k.c4 + m.y.x * k.c2 - m.w.x * k.c0,
+      m.x.x * k.c3 - m.y.x * k.c1 + m.z.x * k.c0}, // Column 1.
+    { m.y.w * k.s5 - m.z.w * k.s4 + m.w.w * k.s3,
+     -m.x.w * k.s5 + m.z.w * k.s2 - m.w.w * k.s1,
+      m.x.w * k.s4 - m.y.w * k.s2 + m.w.w * k.s0,
+     -m.x.w * k.s3 + m.y.w * k.s1 - m.z.w * k.s0}, // Column 2.
+    {-m.y.z * k.s5 + m.z.z * k.s4 - m.w.z * k.s3,
+      m.x.z * k.s5 - m.z.z * k.s2 + m.w.z * k.s1,
+     -m.x.z * k.s4 + m.y.z * k.s2 - m.w.z * k.s0,
+      m.x.z * k.s3 - m.y.z * k.s1 + m.z.z * k.s0}  // Column 3.
+  };
+}
+// clang-format on
+
+template <typename ArithT>
+constexpr auto Inverse(const Mat<ArithT, 4, 4>& m, const Minors4x4<ArithT>& k) noexcept
+    -> Mat<ArithT, 4, 4> {
+  return Scaled(Adjugate(m, k), ArithT(1) / Determinant(k));
+}
+
+// The inverse of a 3x3 matrix with columns a, b, c has rows (b x c, c x a, a x b) / det, where
+// det = a . (b x c).
+template <typename ArithT>
+constexpr auto InverseFromRows(const Vec<ArithT, 3>& r0,
+                               const Vec<ArithT, 3>& r1,
+                               const Vec<ArithT, 3>& r2,
+                               const Vec<ArithT, 3>& a) noexcept -> Mat<ArithT, 3, 3> {
+  return Transpose(Scaled(Mat<ArithT, 3, 3>{r0, r1, r2}, ArithT(1) / Dot(a, r0)));
+}
+
+// Linear (upper-left 3x3) part of an affine transform.
+template <typename ArithT>
+constexpr auto Linear(const Mat<ArithT, 3, 4>& a) noexcept -> Mat<ArithT, 3, 3> {
+  return {a.x, a.y, a.z};
+}
+
+// The upper three rows of a matrix.
+template <typename ArithT>
+constexpr auto UpperRows(const Mat<ArithT, 4, 4>& m) noexcept -> Mat<ArithT, 3, 4> {
+  return {
+      {m.x.x, m.x.y, m.x.z}, {m.y.x, m.y.y, m.y.z}, {m.z.x, m.z.y, m.z.z}, {m.w.x, m.w.y, m.w.z}};
+}
+
+// Affine 4x4 matrix with the fourth row (0, 0, 0, 1).
+template <typename ArithT>
+constexpr auto Expand(const Mat<ArithT, 3, 4>& a) noexcept -> Mat<ArithT, 4, 4> {
+  return {{a.x.x, a.x.y, a.x.z, ArithT(0)},
+          {a.y.x, a.y.y, a.y.z, ArithT(0)},
+          {a.z.x, a.z.y, a.z.z, ArithT(0)},
+          {a.w.x, a.w.y, a.w.z, ArithT(1)}};
+}
+
+// Inverse of the affine transform x -> Lx + t, given the inverse of L.
+template <typename ArithT>
+constexpr auto InverseAffine(const Mat<ArithT, 3, 3>& inv_l, const Vec<ArithT, 3>& t) noexcept
+    -> Mat<ArithT, 3, 4> {
+  return {inv_l.x, inv_l.y, inv_l.z, -Mul(inv_l, t)};
+}
+
+} // namespace tph_linalg_internal
+
+// Determinant.
+template <typename ArithT>
+TPH_NODISCARD constexpr auto Determinant(const Mat<ArithT, 2, 2>& a) noexcept -> ArithT {
+  return a.x.x * a.y.y - a.y.x * a.x.y;
+}
+
+template <typename ArithT>
+TPH_NODISCARD constexpr auto Determinant(const Mat<ArithT, 3, 3>& a) noexcept -> ArithT {
+  return Dot(a.x, Cross(a.y, a.z));
+}
+
+template <typename ArithT>
+TPH_NODISCARD constexpr auto Determinant(const Mat<ArithT, 4, 4>& a) noexcept -> ArithT {
+  return tph_linalg_internal::Determinant(tph_linalg_internal::Minors(a));
+}
+
+// Inverse, by the adjugate divided by the determinant. The matrix must be invertible, otherwise the
+// result is not finite. See also InverseMany in tph_linalg_batch.hpp (SIMD, float4x4).
+template <typename FloatT>
+TPH_NODISCARD constexpr auto Inverse(const Mat<FloatT, 2, 2>& a) noexcept -> Mat<FloatT, 2, 2> {
+  return tph_linalg_internal::Scaled(Mat<FloatT, 2, 2>{{a.y.y, -a.x.y}, {-a.y.x, a.x.x}},
+                                     FloatT(1) / Determinant(a));
+}
+
+template <typename FloatT>
+TPH_NODISCARD constexpr auto Inverse(const Mat<FloatT, 3, 3>& a) noexcept -> Mat<FloatT, 3, 3> {
+  return tph_linalg_internal::InverseFromRows(
+      Cross(a.y, a.z), Cross(a.z, a.x), Cross(a.x, a.y), a.x);
+}
+
+template <typename FloatT>
+TPH_NODISCARD constexpr auto Inverse(const Mat<FloatT, 4, 4>& a) noexcept -> Mat<FloatT, 4, 4> {
+  return tph_linalg_internal::Inverse(a, tph_linalg_internal::Minors(a));
+}
+
+// Inverse of an affine transform, i.e. a 3x4 matrix or a 4x4 matrix with the fourth row
+// (0, 0, 0, 1) (which is not checked). Costs a 3x3 inverse and a matrix/vector multiplication.
+template <typename FloatT>
+TPH_NODISCARD constexpr auto InverseAffine(const Mat<FloatT, 3, 4>& a) noexcept
+    -> Mat<FloatT, 3, 4> {
+  return tph_linalg_internal::InverseAffine(Inverse(tph_linalg_internal::Linear(a)), a.w);
+}
+
+template <typename FloatT>
+TPH_NODISCARD constexpr auto InverseAffine(const Mat<FloatT, 4, 4>& a) noexcept
+    -> Mat<FloatT, 4, 4> {
+  return tph_linalg_internal::Expand(InverseAffine(tph_linalg_internal::UpperRows(a)));
+}
+
+// Inverse of a rigid transform, i.e. an affine transform (see InverseAffine) whose upper-left 3x3
+// part is orthonormal (rotation, possibly with reflection). Costs a transpose and a matrix/vector
+// multiplication.
+template <typename ArithT>
+TPH_NODISCARD constexpr auto InverseRigid(const Mat<ArithT, 3, 4>& a) noexcept
+    -> Mat<ArithT, 3, 4> {
+  return tph_linalg_internal::InverseAffine(Transpose(tph_linalg_internal::Linear(a)), a.w);
+}
+
+template <typename ArithT>
+TPH_NODISCARD constexpr auto InverseRigid(const Mat<ArithT, 4, 4>& a) noexcept
+    -> Mat<ArithT, 4, 4> {
+  return tph_linalg_internal::Expand(InverseRigid(tph_linalg_internal::UpperRows(a)));
+}
+
+// Eigendecomposition of a symmetric matrix a, a = vectors * diag(values) * Transpose(vectors).
+template <typename ArithT, int M>
+struct EigenDecomposition {
+  Vec<ArithT, M> values;     // Eigenvalues in ascending order.
+  Mat<ArithT, M, M> vectors; // Column i is the unit eigenvector of eigenvalue i.
+};
+
+namespace tph_linalg_internal {
+
+// Tag for a fixed number of iterations.
+template <int N>
+struct Iterations {};
+
+// Cyclic Jacobi iteration for symmetric 3x3 matrices, see "Numerical Recipes" (Press et al.),
+// section 11.1. The matrix is held as its diagonal (a00, a11, a22) and off-diagonal
+// (a01, a02, a12), v is the product of the rotations so far. Each rotation zeroes one off-diagonal
+// element, a sweep rotates in the (0, 1), (0, 2) and (1, 2) planes. The iteration count is fixed
+// and the rotations are computed without branches, so that the same code runs lane-wise on SIMD
+// packets.
+template <typename ArithT>
+struct Jacobi3 {
+  Vec<ArithT, 3> diag;
+  Vec<ArithT, 3> off;
+  Mat<ArithT, 3, 3> v;
+};
+
+// Sweeps for about full precision, convergence is quadratic once the off-diagonal is small.
+template <typename ArithT>
+struct JacobiSweeps {
+  static constexpr int value = sizeof(typename scalar_type<ArithT>::type) > 4 ? 5 : 4;
+};
+
+// The entries of a rotation in the (p, q) plane changed by it, r is the third index.
+template <typename ArithT>
+struct JacobiRotation {
+  ArithT app;
+  ArithT aqq;
+  ArithT arp;
+  ArithT arq;
+  Vec<ArithT, 3> vp;
+  Vec<ArithT, 3> vq;
+};
+
+// Rotation by the angle with tangent t, cosine c and sine s that zeroes apq.
+template <typename ArithT>
+constexpr auto JacobiRotate(const ArithT app,
+                            const ArithT aqq,
+                            const ArithT apq,
+                            const ArithT arp,
+                            const ArithT arq,
+                            const Vec<ArithT, 3>& vp,
+                            const Vec<ArithT, 3>& vq,
+                            const ArithT t,
+                            const ArithT c,
+                            const ArithT s) noexcept -> JacobiRotation<ArithT> {
+  return {app - t * apq, aqq + t * apq, c * arp - s * arq, s * arp + c * arq, vp * c - vq * s,
+          vp * s + vq * c};
+}
+
+template <typename ArithT>
+constexpr auto JacobiRotate(const ArithT app,
+                            const ArithT aqq,
+                            const ArithT apq,
+                            const ArithT arp,
+                            const ArithT arq,
+                            const Vec<ArithT, 3>& vp,
+                            const Vec<ArithT, 3>& vq,
+                            const ArithT t,
+                            const ArithT c) noexcept -> JacobiRotation<ArithT> {
+  return JacobiRotate(app, aqq, apq, arp, arq, vp, vq, t, c, t * c);
+}
+
+// The smaller angle, t = sign(d) * 2 * apq / (|d| + sqrt(d^2 + 4 * apq^2)) where d = aqq - app,
+// so |t| <= 1. The matrix is scaled to at most one in magnitude, where the small constant in the
+// denominator only matters if apq and d are both zero, and then gives t = 0 instead of NaN.
+template <typename ArithT>
+constexpr auto JacobiTangent(const ArithT d, const ArithT apq) noexcept -> ArithT {
+  return ArithT(2) * Select(d < ArithT(0), -apq, apq) /
+         (SelectAbs(d) + sqrt(d * d + ArithT(4) * apq * apq) + ArithT(1e-30));
+}
+
+template <typename ArithT>
+constexpr auto JacobiRotate(const ArithT app,
+                            const ArithT aqq,
+                            const ArithT apq,
+                            const ArithT arp,
+                            const ArithT arq,
+                            const Vec<ArithT, 3>& vp,
+                            const Vec<ArithT, 3>& vq,
+                            const ArithT t) noexcept -> JacobiRotation<ArithT> {
+  return JacobiRotate(app, aqq, apq, arp, arq, vp, vq, t, ArithT(1) / sqrt(ArithT(1) + t * t));
+}
+
+template <typename ArithT>
+constexpr auto JacobiRotate(const ArithT app,
+                            const ArithT aqq,
+                            const ArithT apq,
+                            const ArithT arp,
+                            const ArithT arq,
+                            const Vec<ArithT, 3>& vp,
+                            const Vec<ArithT, 3>& vq) noexcept -> JacobiRotation<ArithT> {
+  return JacobiRotate(app, aqq, apq, arp, arq, vp, vq, JacobiTangent(aqq - app, apq));
+}
+
+// x, or zero if |x| < 1e-18. Converged off-diagonal elements are flushed to zero, since their
+// squares and products would otherwise become subnormal, which is many times slower on most
+// processors. The matrix is scaled to at most one in magnitude, so the flushed elements are below
+// the rounding error even in double precision.
+template <typename ArithT>
+constexpr auto FlushTiny(const ArithT x) noexcept -> ArithT {
+  return Select(SelectAbs(x) < ArithT(1e-18), ArithT(0), x);
+}
+
+// Rotations in the (0, 1), (0, 2) and (1, 2) planes.
+template <typename ArithT>
+constexpr auto Jacobi01(const Jacobi3<ArithT>& a, const JacobiRotation<ArithT>& r) noexcept
+    -> Jacobi3<ArithT> {
+  return {{r.app, r.aqq, a.diag.z}, {ArithT(0), r.arp, r.arq}, {r.vp, r.vq, a.v.z}};
+}
+
+template <typename ArithT>
+constexpr auto Jacobi02(const Jacobi3<ArithT>& a, const JacobiRotation<ArithT>& r) noexcept
+    -> Jacobi3<ArithT> {
+  return {{r.app, a.diag.y, r.aqq}, {r.arp, ArithT(0), r.arq}, {r.vp, a.v.y, r.vq}};
+}
+
+template <typename ArithT>
+constexpr auto Jacobi12(const Jacobi3<ArithT>& a, const JacobiRotation<ArithT>& r) noexcept
+    -> Jacobi3<ArithT> {
+  return {{a.diag.x, r.app, r.aqq}, {r.arp, r.arq, ArithT(0)}, {a.v.x, r.vp, r.vq}};
+}
+
+template <typename ArithT>
+constexpr auto Jacobi01(const Jacobi3<ArithT>& a) noexcept -> Jacobi3<ArithT> {
+  return Jacobi01(a,
+                  JacobiRotate(a.diag.x,
+                               a.diag.y,
+                               FlushTiny(a.off.x),
+                               FlushTiny(a.off.y),
+                               FlushTiny(a.off.z),
+                               a.v.x,
+                               a.v.y));
+}
+
+template <typename ArithT>
+constexpr auto Jacobi02(const Jacobi3<ArithT>& a) noexcept -> Jacobi3<ArithT> {
+  return Jacobi02(a,
+                  JacobiRotate(a.diag.x,
+                               a.diag.z,
+                               FlushTiny(a.off.y),
+                               FlushTiny(a.off.x),
+                               FlushTiny(a.off.z),
+                               a.v.x,
+                               a.v.z));
+}
+
+template <typename ArithT>
+constexpr auto Jacobi12(const Jacobi3<ArithT>& a) noexcept -> Jacobi3<ArithT> {
+  return Jacobi12(a,
+                  JacobiRotate(a.diag.y,
+                               a.diag.z,
+                               FlushTiny(a.off.z),
+                               FlushTiny(a.off.x),
+                               FlushTiny(a.off.y),
+                               a.v.y,
+                               a.v.z));
+}
+
+template <typename ArithT>
+constexpr auto JacobiSweep(const Jacobi3<ArithT>& a, Iterations<0> /*n*/) noexcept
+    -> Jacobi3<ArithT> {
+  return a;
+}
+
+template <typename ArithT, int N>
+constexpr auto JacobiSweep(const Jacobi3<ArithT>& a, Iterations<N> /*n*/) noexcept
+    -> Jacobi3<ArithT> {
+  return JacobiSweep(Jacobi12(Jacobi02(Jacobi01(a))), Iterations<N - 1>{});
+}
+
+// Largest magnitude of the diagonal and upper triangle.
+template <typename ArithT>
+constexpr auto MaxAbsUpper(const Mat<ArithT, 3, 3>& a) noexcept -> ArithT {
+  return SelectMax(SelectMax(SelectMax(SelectAbs(a.x.x), SelectAbs(a.y.y)),
+                             SelectMax(SelectAbs(a.z.z), SelectAbs(a.y.x))),
+                   SelectMax(SelectAbs(a.z.x), SelectAbs(a.z.y)));
+}
+
+// s, or one for the zero matrix.
+template <typename ArithT>
+constexpr auto NonZeroScale(const ArithT s) noexcept -> ArithT {
+  return Select(ArithT(0) < s, s, ArithT(1));
+}
+
+template <typename ArithT>
+constexpr auto JacobiStart(const Mat<ArithT, 3, 3>& a, const ArithT inv_scale) noexcept
+    -> Jacobi3<ArithT> {
+  return {Vec<ArithT, 3>{a.x.x, a.y.y, a.z.z} * inv_scale,
+          Vec<ArithT, 3>{a.y.x, a.z.x, a.z.y} * inv_scale, Identity3x3<ArithT>()};
+}
+
+// Per lane m ? a : b for vectors.
+template <typename MaskT, typename ArithT>
+constexpr auto SelectVec(const MaskT& m, const Vec<ArithT, 2>& a, const Vec<ArithT, 2>& b) noexcept
+    -> Vec<ArithT, 2> {
+  return {Select(m, a.x, b.x), Select(m, a.y, b.y)};
+}
+
+template <typename MaskT, typename ArithT>
+constexpr auto SelectVec(const MaskT& m, const Vec<ArithT, 3>& a, const Vec<ArithT, 3>& b) noexcept
+    -> Vec<ArithT, 3> {
+  return {Select(m, a.x, b.x), Select(m, a.y, b.y), Select(m, a.z, b.z)};
+}
+
+template <typename MaskT, typename ArithT>
+constexpr auto SelectVec(const MaskT& m, const Vec<ArithT, 4>& a, const Vec<ArithT, 4>& b) noexcept
+    -> Vec<ArithT, 4> {
+  return {Select(m, a.x, b.x), Select(m, a.y, b.y), Select(m, a.z, b.z), Select(m, a.w, b.w)};
+}
+
+// Swap the eigenpairs 0 and 1 (1 and 2) where swap is set.
+template <typename ArithT, typename MaskT>
+constexpr auto SwapEigen01(const EigenDecomposition<ArithT, 3>& e, const MaskT& swap) noexcept
+    -> EigenDecomposition<ArithT, 3> {
+  return {{Select(swap, e.values.y, e.values.x), Select(swap, e.values.x, e.values.y), e.values.z},
+          {SelectVec(swap, e.vectors.y, e.vectors.x), SelectVec(swap, e.vectors.x, e.vectors.y),
+           e.vectors.z}};
+}
+
+template <typename ArithT, typename MaskT>
+constexpr auto SwapEigen12(const EigenDecomposition<ArithT, 3>& e, const MaskT& swap) noexcept
+    -> EigenDecomposition<ArithT, 3> {
+  return {{e.values.x, Select(swap, e.values.z, e.values.y), Select(swap, e.values.y, e.values.z)},
+          {e.vectors.x, SelectVec(swap, e.vectors.z, e.vectors.y),
+           SelectVec(swap, e.vectors.y, e.vectors.z)}};
+}
+
+template <typename ArithT>
+constexpr auto SortEigen01(const EigenDecomposition<ArithT, 3>& e) noexcept
+    -> EigenDecomposition<ArithT, 3> {
+  return SwapEigen01(e, e.values.y < e.values.x);
+}
+
+template <typename ArithT>
+constexpr auto SortEigen12(const EigenDecomposition<ArithT, 3>& e) noexcept
+    -> EigenDecomposition<ArithT, 3> {
+  return SwapEigen12(e, e.values.z < e.values.y);
+}
+
+// The third eigenvector replaced by the cross product of the first two, which makes the
+// eigenvectors a rotation (determinant one) whatever the swaps.
+template <typename ArithT>
+constexpr auto Oriented(const EigenDecomposition<ArithT, 3>& e) noexcept
+    -> EigenDecomposition<ArithT, 3> {
+  return {e.values, {e.vectors.x, e.vectors.y, Cross(e.vectors.x, e.vectors.y)}};
+}
+
+// Eigenvalues in ascending order by a sorting network.
+template <typename ArithT>
+constexpr auto EigenFromJacobi(const Jacobi3<ArithT>& j, const ArithT scale) noexcept
+    -> EigenDecomposition<ArithT, 3> {
+  return Oriented(SortEigen01(SortEigen12(SortEigen01(EigenDecomposition<ArithT, 3>{
+      j.diag * scale, j.v}))));
+}
+
+template <typename ArithT>
+constexpr auto EigenSymmetric(const Mat<ArithT, 3, 3>& a, const ArithT scale) noexcept
+    -> EigenDecomposition<ArithT, 3> {
+  return EigenFromJacobi(
+      JacobiSweep(JacobiStart(a, ArithT(1) / scale), Iterations<JacobiSweeps<ArithT>::value>{}),
+      scale);
+}
+
+} // namespace tph_linalg_internal
+
+// Eigendecomposition of a symmetric matrix, only the diagonal and the upper triangle are read. The
+// eigenvalues are in ascending order, e.g. for the covariance matrix of a neighbourhood of points
+// (see Covariance in tph_linalg_batch.hpp), the first eigenvector is the normal and the first
+// eigenvalue the variance along it. The eigenvectors form a rotation matrix (orthonormal,
+// determinant one).
+//
+// Computed by a fixed number of cyclic Jacobi sweeps on the matrix scaled to at most one in
+// magnitude, without data-dependent branches, so that a matrix of SIMD packets
+// (tph_linalg_simd.hpp) solves one problem per lane. The residual |a * v - lambda * v| and the
+// orthogonality error are within about ten ulps of the largest eigenvalue magnitude. See also
+// EigenSymmetricMany in tph_linalg_batch.hpp.
+template <typename FloatT>
+TPH_NODISCARD constexpr auto EigenSymmetric(const Mat<FloatT, 3, 3>& a) noexcept
+    -> EigenDecomposition<FloatT, 3> {
+  return tph_linalg_internal::EigenSymmetric(
+      a, tph_linalg_internal::NonZeroScale(tph_linalg_internal::MaxAbsUpper(a)));
+}
+
+// Singular value decomposition, a = u * diag(values) * Transpose(v).
+template <typename ArithT, int M>
+struct SingularValueDecomposition {
+  Mat<ArithT, M, M> u; // Rotation, the left singular vectors.
+  Vec<ArithT, M> values;
+  Mat<ArithT, M, M> v; // Rotation, the right singular vectors.
+};
+
+// Polar decomposition, a = rotation * stretch.
+template <typename ArithT, int M>
+struct PolarDecomposition {
+  Mat<ArithT, M, M> rotation;
+  Mat<ArithT, M, M> stretch; // Symmetric.
+};
+
+namespace tph_linalg_internal {
+
+// Largest magnitude of the elements.
+template <typename ArithT>
+constexpr auto MaxAbs(const Vec<ArithT, 2>& a) noexcept -> ArithT {
+  return SelectMax(SelectAbs(a.x), SelectAbs(a.y));
+}
+
+template <typename ArithT>
+constexpr auto MaxAbs(const Vec<ArithT, 3>& a) noexcept -> ArithT {
+  return SelectMax(SelectMax(SelectAbs(a.x), SelectAbs(a.y)), SelectAbs(a.z));
+}
+
+template <typename ArithT>
+constexpr auto MaxAbs(const Vec<ArithT, 4>& a) noexcept -> ArithT {
+  return SelectMax(SelectMax(SelectAbs(a.x), SelectAbs(a.y)),
+                   SelectMax(SelectAbs(a.z), SelectAbs(a.w)));
+}
+
+template <typename ArithT, int M>
+constexpr auto MaxAbs(const Mat<ArithT, M, 2>& a) noexcept -> ArithT {
+  return SelectMax(MaxAbs(a.x), MaxAbs(a.y));
+}
+
+template <typename ArithT, int M>
+constexpr auto MaxAbs(const Mat<ArithT, M, 3>& a) noexcept -> ArithT {
+  return SelectMax(SelectMax(MaxAbs(a.x), MaxAbs(a.y)), MaxAbs(a.z));
+}
+
+template <typename ArithT, int M>
+constexpr auto MaxAbs(const Mat<ArithT, M, 4>& a) noexcept -> ArithT {
+  return SelectMax(SelectMax(MaxAbs(a.x), MaxAbs(a.y)), SelectMax(MaxAbs(a.z), MaxAbs(a.w)));
+}
+
+// a / |a| where |a|^2 = len2, or fallback if a is (nearly) zero.
+template <typename ArithT>
+constexpr auto NormalizedOr(const Vec<ArithT, 3>& a,
+                            const Vec<ArithT, 3>& fallback,
+                            const ArithT len2) noexcept -> Vec<ArithT, 3> {
+  return SelectVec(len2 < ArithT(1e-30), fallback, a * (ArithT(1) / sqrt(NonZeroScale(len2))));
+}
+
+template <typename ArithT>
+constexpr auto NormalizedOr(const Vec<ArithT, 3>& a, const Vec<ArithT, 3>& fallback) noexcept
+    -> Vec<ArithT, 3> {
+  return NormalizedOr(a, fallback, Dot(a, a));
+}
+
+// A unit vector orthogonal to the unit vector a, the cross product with the x or y axis, whichever
+// is further from a.
+template <typename ArithT>
+constexpr auto AnyOrthogonal(const Vec<ArithT, 3>& a) noexcept -> Vec<ArithT, 3> {
+  return Normalized(SelectVec(SelectAbs(a.x) < ArithT(0.5),
+                              Vec<ArithT, 3>{ArithT(0), a.z, -a.y},
+                              Vec<ArithT, 3>{-a.z, ArithT(0), a.x}));
+}
+
+// One-sided Jacobi iteration, see "Jacobi's method is more accurate than QR" (Demmel and Veselic,
+// 1992). The columns of b = a * v are rotated in pairs until they are orthogonal, which is the
+// Jacobi iteration on a^T * a without forming it, so that small singular values keep their
+// accuracy. The rotations are the same as in the eigenvalue iteration above, and accumulate in v.
+template <typename ArithT>
+struct OneSidedJacobi3 {
+  Mat<ArithT, 3, 3> b;
+  Mat<ArithT, 3, 3> v;
+};
+
+// The rotated columns (p, q) of b and v.
+template <typename ArithT>
+struct ColumnRotation {
+  Vec<ArithT, 3> bp;
+  Vec<ArithT, 3> bq;
+  Vec<ArithT, 3> vp;
+  Vec<ArithT, 3> vq;
+};
+
+// Rotation by the angle with cosine c and sine s.
+template <typename ArithT>
+constexpr auto RotateColumnsBy(const Vec<ArithT, 3>& bp,
+                               const Vec<ArithT, 3>& bq,
+                               const Vec<ArithT, 3>& vp,
+                               const Vec<ArithT, 3>& vq,
+                               const ArithT c,
+                               const ArithT s) noexcept -> ColumnRotation<ArithT> {
+  return {bp * c - bq * s, bp * s + bq * c, vp * c - vq * s, vp * s + vq * c};
+}
+
+template <typename ArithT>
+constexpr auto RotateColumns(const Vec<ArithT, 3>& bp,
+                             const Vec<ArithT, 3>& bq,
+                             const Vec<ArithT, 3>& vp,
+                             const Vec<ArithT, 3>& vq,
+                             const ArithT t,
+                             const ArithT c) noexcept -> ColumnRotation<ArithT> {
+  return RotateColumnsBy(bp, bq, vp, vq, c, t * c);
+}
+
+// The rotation that diagonalizes the 2x2 Gram matrix of columns p and q.
+template <typename ArithT>
+constexpr auto RotateColumns(const Vec<ArithT, 3>& bp,
+                             const Vec<ArithT, 3>& bq,
+                             const Vec<ArithT, 3>& vp,
+                             const Vec<ArithT, 3>& vq,
+                             const ArithT t) noexcept -> ColumnRotation<ArithT> {
+  return RotateColumns(bp, bq, vp, vq, t, ArithT(1) / sqrt(ArithT(1) + t * t));
+}
+
+template <typename ArithT>
+constexpr auto RotateColumns(const Vec<ArithT, 3>& bp,
+                             const Vec<ArithT, 3>& bq,
+                             const Vec<ArithT, 3>& vp,
+                             const Vec<ArithT, 3>& vq) noexcept -> ColumnRotation<ArithT> {
+  return RotateColumns(
+      bp, bq, vp, vq, JacobiTangent(Dot(bq, bq) - Dot(bp, bp), FlushTiny(Dot(bp, bq))));
+}
+
+template <typename ArithT>
+constexpr auto OneSided01(const OneSidedJacobi3<ArithT>& a,
+                          const ColumnRotation<ArithT>& r) noexcept -> OneSidedJacobi3<ArithT> {
+  return {{r.bp, r.bq, a.b.z}, {r.vp, r.vq, a.v.z}};
+}
+
+template <typename ArithT>
+constexpr auto OneSided02(const OneSidedJacobi3<ArithT>& a,
+                          const ColumnRotation<ArithT>& r) noexcept -> OneSidedJacobi3<ArithT> {
+  return {{r.bp, a.b.y, r.bq}, {r.vp, a.v.y, r.vq}};
+}
+
+template <typename ArithT>
+constexpr auto OneSided12(const OneSidedJacobi3<ArithT>& a,
+                          const ColumnRotation<ArithT>& r) noexcept -> OneSidedJacobi3<ArithT> {
+  return {{a.b.x, r.bp, r.bq}, {a.v.x, r.vp, r.vq}};
+}
+
+template <typename ArithT>
+constexpr auto OneSided01(const OneSidedJacobi3<ArithT>& a) noexcept -> OneSidedJacobi3<ArithT> {
+  return OneSided01(a, RotateColumns(a.b.x, a.b.y, a.v.x, a.v.y));
+}
+
+template <typename ArithT>
+constexpr auto OneSided02(const OneSidedJacobi3<ArithT>& a) noexcept -> OneSidedJacobi3<ArithT> {
+  return OneSided02(a, RotateColumns(a.b.x, a.b.z, a.v.x, a.v.z));
+}
+
+template <typename ArithT>
+constexpr auto OneSided12(const OneSidedJacobi3<ArithT>& a) noexcept -> OneSidedJacobi3<ArithT> {
+  return OneSided12(a, RotateColumns(a.b.y, a.b.z, a.v.y, a.v.z));
+}
+
+template <typename ArithT>
+constexpr auto OneSidedSweep(const OneSidedJacobi3<ArithT>& a, Iterations<0> /*n*/) noexcept
+    -> OneSidedJacobi3<ArithT> {
+  return a;
+}
+
+template <typename ArithT, int N>
+constexpr auto OneSidedSweep(const OneSidedJacobi3<ArithT>& a, Iterations<N> /*n*/) noexcept
+    -> OneSidedJacobi3<ArithT> {
+  return OneSidedSweep(OneSided12(OneSided02(OneSided01(a))), Iterations<N - 1>{});
+}
+
+// Swap columns 0 and 1 (1 and 2) of b and v where swap is set, negating one of them so that the
+// determinant of v stays one.
+template <typename ArithT, typename MaskT>
+constexpr auto SwapColumns01(const OneSidedJacobi3<ArithT>& a, const MaskT& swap) noexcept
+    -> OneSidedJacobi3<ArithT> {
+  return {{SelectVec(swap, a.b.y, a.b.x), SelectVec(swap, -a.b.x, a.b.y), a.b.z},
+          {SelectVec(swap, a.v.y, a.v.x), SelectVec(swap, -a.v.x, a.v.y), a.v.z}};
+}
+
+template <typename ArithT, typename MaskT>
+constexpr auto SwapColumns12(const OneSidedJacobi3<ArithT>& a, const MaskT& swap) noexcept
+    -> OneSidedJacobi3<ArithT> {
+  return {{a.b.x, SelectVec(swap, a.b.z, a.b.y), SelectVec(swap, -a.b.y, a.b.z)},
+          {a.v.x, SelectVec(swap, a.v.z, a.v.y), SelectVec(swap, -a.v.y, a.v.z)}};
+}
+
+// Columns by descending length.
+template <typename ArithT>
+constexpr auto SortColumns01(const OneSidedJacobi3<ArithT>& a) noexcept -> OneSidedJacobi3<ArithT> {
+  return SwapColumns01(a, Dot(a.b.x, a.b.x) < Dot(a.b.y, a.b.y));
+}
+
+template <typename ArithT>
+constexpr auto SortColumns12(const OneSidedJacobi3<ArithT>& a) noexcept -> OneSidedJacobi3<ArithT> {
+  return SwapColumns12(a, Dot(a.b.y, a.b.y) < Dot(a.b.z, a.b.z));
+}
+
+template <typename ArithT>
+constexpr auto SvdFromColumns(const Vec<ArithT, 3>& u0,
+                              const Vec<ArithT, 3>& u1,
+                              const Mat<ArithT, 3, 3>& b,
+                              const Mat<ArithT, 3, 3>& v,
+                              const ArithT scale) noexcept
+    -> SingularValueDecomposition<ArithT, 3> {
+  return {{u0, u1, Cross(u0, u1)},
+          Vec<ArithT, 3>{Dot(u0, b.x), Dot(u1, b.y), Dot(Cross(u0, u1), b.z)} * scale,
+          v};
+}
+
+// u1 by Gram-Schmidt against u0, or any unit vector orthogonal to u0 if rank(a) < 2.
+template <typename ArithT>
+constexpr auto SvdFromColumns(const Vec<ArithT, 3>& u0,
+                              const Mat<ArithT, 3, 3>& b,
+                              const Mat<ArithT, 3, 3>& v,
+                              const ArithT scale) noexcept
+    -> SingularValueDecomposition<ArithT, 3> {
+  return SvdFromColumns(u0, NormalizedOr(b.y - u0 * Dot(u0, b.y), AnyOrthogonal(u0)), b, v, scale);
+}
+
+// The columns of b = a * v are orthogonal with lengths equal to the singular values. u is their
+// QR factorization, with the third column from the cross product so that u is a rotation and the
+// last singular value carries the sign of the determinant.
+template <typename ArithT>
+constexpr auto SvdFromColumns(const OneSidedJacobi3<ArithT>& j, const ArithT scale) noexcept
+    -> SingularValueDecomposition<ArithT, 3> {
+  return SvdFromColumns(
+      NormalizedOr(j.b.x, Vec<ArithT, 3>{ArithT(1), ArithT(0), ArithT(0)}), j.b, j.v, scale);
+}
+
+// a is scaled to at most one in magnitude, so that the squared column lengths neither overflow nor
+// underflow.
+template <typename ArithT>
+constexpr auto Svd(const Mat<ArithT, 3, 3>& a, const ArithT scale) noexcept
+    -> SingularValueDecomposition<ArithT, 3> {
+  return SvdFromColumns(SortColumns01(SortColumns12(SortColumns01(OneSidedSweep(
+                            OneSidedJacobi3<ArithT>{Scaled(a, ArithT(1) / scale),
+                                                    Identity3x3<ArithT>()},
+                            Iterations<JacobiSweeps<ArithT>::value>{})))),
+                        scale);
+}
+
+template <typename ArithT>
+constexpr auto ScaledColumns(const Mat<ArithT, 3, 3>& a, const Vec<ArithT, 3>& s) noexcept
+    -> Mat<ArithT, 3, 3> {
+  return {a.x * s.x, a.y * s.y, a.z * s.z};
+}
+
+template <typename ArithT>
+constexpr auto PolarFromSvd(const SingularValueDecomposition<ArithT, 3>& d) noexcept
+    -> PolarDecomposition<ArithT, 3> {
+  return {Mul(d.u, Transpose(d.v)), Mul(ScaledColumns(d.v, d.values), Transpose(d.v))};
+}
+
+} // namespace tph_linalg_internal
+
+// Singular value decomposition, a = u * diag(values) * Transpose(v), with u and v rotations
+// (determinant one) rather than just orthogonal. The singular values are in descending order of
+// magnitude, values.x >= values.y >= |values.z|, and the last one is negative if the determinant
+// of a is, e.g. for a reflection. This "signed" form is what deformation code usually needs,
+// where an inverted element should map to a rotation and a negative stretch.
+//
+// v is computed by a fixed number of one-sided Jacobi sweeps, which orthogonalize the columns of
+// a * v, and u is the QR factorization of a * v. The singular vectors of a rank deficient a are
+// completed to a rotation. Like EigenSymmetric there are no data-dependent branches, so a matrix
+// of SIMD packets solves one problem per lane, see SvdMany in tph_linalg_batch.hpp. The
+// reconstruction error is within a few ulps of the largest singular value, singular values much
+// smaller than the largest one have a relative error that grows with the condition number.
+template <typename FloatT>
+TPH_NODISCARD constexpr auto Svd(const Mat<FloatT, 3, 3>& a) noexcept
+    -> SingularValueDecomposition<FloatT, 3> {
+  return tph_linalg_internal::Svd(
+      a, tph_linalg_internal::NonZeroScale(tph_linalg_internal::MaxAbs(a)));
+}
+
+// Polar decomposition, a = rotation * stretch, where rotation is the rotation closest to a and
+// stretch is symmetric. Computed from the signed Svd, rotation = u * Transpose(v) and
+// stretch = v * diag(values) * Transpose(v), so for a reflection (negative determinant) the
+// rotation is still proper and stretch has a negative eigenvalue. This is the rotation used by
+// shape matching and as-rigid-as-possible deformation. See also PolarDecomposeMany in
+// tph_linalg_batch.hpp.
+template <typename FloatT>
+TPH_NODISCARD constexpr auto PolarDecompose(const Mat<FloatT, 3, 3>& a) noexcept
+    -> PolarDecomposition<FloatT, 3> {
+  return tph_linalg_internal::PolarFromSvd(Svd(a));
+}
+
+// Solution of the linear system a * x = b. solved is false if a is singular, or so close to
+// singular that a pivot is lost in rounding, and x is then zero. For SIMD packets solved is a lane
+// mask.
+template <typename ArithT, int M>
+struct LinearSolution {
+  Vec<ArithT, M> x;
+  typename tph_linalg_internal::mask_type<ArithT>::type solved;
+};
+
+namespace tph_linalg_internal {
+
+// Column I of a matrix, and a matrix (vector) with column (component) I replaced. The index is a
+// template argument so that the selection folds away even where the call is not inlined.
+template <int I, typename ArithT, int M>
+constexpr auto Col(const Mat<ArithT, M, 2>& a) noexcept -> Vec<ArithT, M> {
+  return I == 0 ? a.x : a.y;
+}
+
+template <int I, typename ArithT, int M>
+constexpr auto Col(const Mat<ArithT, M, 3>& a) noexcept -> Vec<ArithT, M> {
+  return I == 0 ? a.x : I == 1 ? a.y : a.z;
+}
+
+template <int I, typename ArithT, int M>
+constexpr auto Col(const Mat<ArithT, M, 4>& a) noexcept -> Vec<ArithT, M> {
+  return I == 0 ? a.x : I == 1 ? a.y : I == 2 ? a.z : a.w;
+}
+
+template <int I, typename ArithT, int M>
+constexpr auto WithCol(const Mat<ArithT, M, 2>& a, const Vec<ArithT, M>& c) noexcept
+    -> Mat<ArithT, M, 2> {
+  return {I == 0 ? c : a.x, I == 1 ? c : a.y};
+}
+
+template <int I, typename ArithT, int M>
+constexpr auto WithCol(const Mat<ArithT, M, 3>& a, const Vec<ArithT, M>& c) noexcept
+    -> Mat<ArithT, M, 3> {
+  return {I == 0 ? c : a.x, I == 1 ? c : a.y, I == 2 ? c : a.z};
+}
+
+template <int I, typename ArithT, int M>
+constexpr auto WithCol(const Mat<ArithT, M, 4>& a, const Vec<ArithT, M>& c) noexcept
+    -> Mat<ArithT, M, 4> {
+  return {I == 0 ? c : a.x, I == 1 ? c : a.y, I == 2 ? c : a.z, I == 3 ? c : a.w};
+}
+
+template <int I, typename ArithT>
+constexpr auto WithComp(const Vec<ArithT, 2>& a, const ArithT s) noexcept -> Vec<ArithT, 2> {
+  return {I == 0 ? s : a.x, I == 1 ? s : a.y};
+}
+
+template <int I, typename ArithT>
+constexpr auto WithComp(const Vec<ArithT, 3>& a, const ArithT s) noexcept -> Vec<ArithT, 3> {
+  return {I == 0 ? s : a.x, I == 1 ? s : a.y, I == 2 ? s : a.z};
+}
+
+template <int I, typename ArithT>
+constexpr auto WithComp(const Vec<ArithT, 4>& a, const ArithT s) noexcept -> Vec<ArithT, 4> {
+  return {I == 0 ? s : a.x, I == 1 ? s : a.y, I == 2 ? s : a.z, I == 3 ? s : a.w};
+}
+
+// Gaussian elimination of [a | b] to an upper triangular system. The rows of a are kept as the
+// columns of rows, so that a row operation is a vector operation. The loops over rows are unrolled
+// by recursion on Iterations, with the row indices as template arguments.
+template <typename ArithT, int M>
+struct RowReduction {
+  Mat<ArithT, M, M> rows;
+  Vec<ArithT, M> b;
+  Vec<ArithT, M> inv_pivots; // Reciprocals of the pivots, one where a pivot is zero.
+  ArithT min_pivot;          // Smallest pivot so far, by magnitude unless positive definite.
+  ArithT tol;                // Pivots up to tol count as zero.
+};
+
+// LU factorization, the row with the largest magnitude in the pivot column is swapped into place.
+struct PartialPivoting {};
+
+// LDL^T (square root free Cholesky) factorization of a symmetric positive definite matrix, which is
+// elimination in the given row order. The pivots are the diagonal of D and must be positive.
+struct PositiveDefinite {};
+
+template <typename ArithT>
+constexpr auto PivotSize(const ArithT p, PartialPivoting) noexcept -> ArithT {
+  return SelectAbs(p);
+}
+
+template <typename ArithT>
+constexpr auto PivotSize(const ArithT p, PositiveDefinite) noexcept -> ArithT {
+  return p;
+}
+
+// Element (I, K) of a.
+template <int I, int K, typename ArithT, int M>
+constexpr auto Elem(const RowReduction<ArithT, M>& s) noexcept -> ArithT {
+  return Comp(Col<I>(s.rows), K);
+}
+
+// Swap rows K and I where swap is set.
+template <int K, int I, typename ArithT, int M, typename MaskT>
+constexpr auto SwapRows(const RowReduction<ArithT, M>& s, const MaskT& swap) noexcept
+    -> RowReduction<ArithT, M> {
+  return {WithCol<I>(WithCol<K>(s.rows, SelectVec(swap, Col<I>(s.rows), Col<K>(s.rows))),
+                     SelectVec(swap, Col<K>(s.rows), Col<I>(s.rows))),
+          WithComp<I>(WithComp<K>(s.b, Select(swap, Comp(s.b, I), Comp(s.b, K))),
+                      Select(swap, Comp(s.b, K), Comp(s.b, I))),
+          s.inv_pivots, s.min_pivot, s.tol};
+}
+
+// Rows I, I + 1, ... are compared in turn with row K, which ends up with the largest magnitude in
+// column K.
+template <int K, int I, typename ArithT, int M>
+constexpr auto PivotRows(const RowReduction<ArithT, M>& s, PartialPivoting, Iterations<0>) noexcept
+    -> RowReduction<ArithT, M> {
+  return s;
+}
+
+template <int K, int I, typename ArithT, int M, int N>
+constexpr auto PivotRows(const RowReduction<ArithT, M>& s,
+                         const PartialPivoting p,
+                         Iterations<N>) noexcept -> RowReduction<ArithT, M> {
+  return PivotRows<K, I + 1>(
+      SwapRows<K, I>(s, SelectAbs(Elem<K, K>(s)) < SelectAbs(Elem<I, K>(s))), p,
+      Iterations<N - 1>{});
+}
+
+template <int K, int I, typename ArithT, int M, int N>
+constexpr auto PivotRows(const RowReduction<ArithT, M>& s, PositiveDefinite, Iterations<N>) noexcept
+    -> RowReduction<ArithT, M> {
+  return s;
+}
+
+// Records the pivot p of row K. A pivot that counts as zero is replaced by one, so that the
+// elimination stays finite.
+template <int K, typename ArithT, int M, typename PivotingT>
+constexpr auto WithPivot(const RowReduction<ArithT, M>& s,
+                         const ArithT p,
+                         const PivotingT pivoting) noexcept -> RowReduction<ArithT, M> {
+  return {s.rows, s.b,
+          WithComp<K>(s.inv_pivots, ArithT(1) / Select(SelectAbs(p) <= s.tol, ArithT(1), p)),
+          Select(PivotSize(p, pivoting) < s.min_pivot, PivotSize(p, pivoting), s.min_pivot),
+          s.tol};
+}
+
+// Row I -= l * row K.
+template <int K, int I, typename ArithT, int M>
+constexpr auto EliminateRow(const RowReduction<ArithT, M>& s, const ArithT l) noexcept
+    -> RowReduction<ArithT, M> {
+  return {WithCol<I>(s.rows, Col<I>(s.rows) - Col<K>(s.rows) * l),
+          WithComp<I>(s.b, Comp(s.b, I) - Comp(s.b, K) * l), s.inv_pivots, s.min_pivot, s.tol};
+}
+
+template <int K, int I, typename ArithT, int M>
+constexpr auto EliminateRows(const RowReduction<ArithT, M>& s, Iterations<0>) noexcept
+    -> RowReduction<ArithT, M> {
+  return s;
+}
+
+template <int K, int I, typename ArithT, int M, int N>
+constexpr auto EliminateRows(const RowReduction<ArithT, M>& s, Iterations<N>) noexcept
+    -> RowReduction<ArithT, M> {
+  return EliminateRows<K, I + 1>(
+      EliminateRow<K, I>(s, Elem<I, K>(s) * Comp(s.inv_pivots, K)), Iterations<N - 1>{});
+}
+
+template <typename ArithT, int M, typename PivotingT>
+constexpr auto Eliminate(const RowReduction<ArithT, M>& s, PivotingT, Iterations<0>) noexcept
+    -> RowReduction<ArithT, M> {
+  return s;
+}
+
+// Pivot and eliminate column K = M - N, then the remaining N - 1 columns. The pivot is computed
+// from the state after the row exchanges, hence the extra call.
+template <int K, typename ArithT, int M, typename PivotingT, int N>
+constexpr auto EliminateColumn(const RowReduction<ArithT, M>& s,
+                               const PivotingT pivoting,
+                               Iterations<N>) noexcept -> RowReduction<ArithT, M> {
+  return EliminateRows<K, K + 1>(WithPivot<K>(s, Elem<K, K>(s), pivoting), Iterations<N>{});
+}
+
+template <typename ArithT, int M, typename PivotingT, int N>
+constexpr auto Eliminate(const RowReduction<ArithT, M>& s,
+                         const PivotingT pivoting,
+                         Iterations<N>) noexcept -> RowReduction<ArithT, M> {
+  return Eliminate(
+      EliminateColumn<M - N>(PivotRows<M - N, M - N + 1>(s, pivoting, Iterations<N - 1>{}),
+                             pivoting, Iterations<N - 1>{}),
+      pivoting, Iterations<N - 1>{});
+}
+
+// x[i] = (b[i] - row i . x) / pivot i for i = N - 1, ..., 0. The components of x from i down are
+// still zero, so the dot product only picks up the solved ones.
+template <typename ArithT, int M>
+constexpr auto BackSubstitute(const RowReduction<ArithT, M>&,
+                              const Vec<ArithT, M>& x,
+                              Iterations<0>) noexcept -> Vec<ArithT, M> {
+  return x;
+}
+
+template <typename ArithT, int M, int N>
+constexpr auto BackSubstitute(const RowReduction<ArithT, M>& s,
+                              const Vec<ArithT, M>& x,
+                              Iterations<N>) noexcept -> Vec<ArithT, M> {
+  return BackSubstitute(
+      s,
+      WithComp<N - 1>(x, (Comp(s.b, N - 1) - Dot(Col<N - 1>(s.rows), x)) *
+                             Comp(s.inv_pivots, N - 1)),
+      Iterations<N - 1>{});
+}
+
+template <typename ArithT, int M, typename MaskT>
+constexpr auto Solution(const Vec<ArithT, M>& x, const MaskT& solved) noexcept
+    -> LinearSolution<ArithT, M> {
+  return {SelectVec(solved, x, Vec<ArithT, M>{}), solved};
+}
+
+template <typename ArithT, int M>
+constexpr auto Solution(const RowReduction<ArithT, M>& s) noexcept -> LinearSolution<ArithT, M> {
+  return Solution(BackSubstitute(s, Vec<ArithT, M>{}, Iterations<M>{}), s.tol < s.min_pivot);
+}
+
+// Pivots up to a few rounding errors of the largest element of a count as zero. Elimination of an
+// exactly singular matrix leaves a pivot of the order of M rounding errors rather than zero.
+template <typename ArithT, int M>
+constexpr auto PivotTolerance(const Mat<ArithT, M, M>& a) noexcept -> ArithT {
+  return MaxAbs(a) *
+         ArithT(8 * M * std::numeric_limits<typename scalar_type<ArithT>::type>::epsilon());
+}
+
+template <typename ArithT, int M, typename PivotingT>
+constexpr auto Solve(const Mat<ArithT, M, M>& a,
+                     const Vec<ArithT, M>& b,
+                     const PivotingT pivoting) noexcept -> LinearSolution<ArithT, M> {
+  using ScalarT = typename scalar_type<ArithT>::type;
+  return Solution(Eliminate(RowReduction<ArithT, M>{Transpose(a), b, Vec<ArithT, M>{},
+                                                    ArithT(std::numeric_limits<ScalarT>::max()),
+                                                    PivotTolerance(a)},
+                            pivoting, Iterations<M>{}));
+}
+
+} // namespace tph_linalg_internal
+
+// Solve a * x = b by LU factorization with partial pivoting, for 2x2, 3x3 and 4x4 matrices. The
+// elimination is unrolled and has no data-dependent branches, rows are exchanged by Select, so a
+// system of SIMD packets solves one system per lane, see SolveLUMany in tph_linalg_batch.hpp.
+// Prefer this to multiplying by Inverse, which is less accurate and does not report singular a.
+template <typename FloatT, int M>
+TPH_NODISCARD constexpr auto SolveLU(const Mat<FloatT, M, M>& a, const Vec<FloatT, M>& b) noexcept
+    -> LinearSolution<FloatT, M> {
+  return tph_linalg_internal::Solve(a, b, tph_linalg_internal::PartialPivoting{});
+}
+
+// Solve a * x = b for a symmetric positive definite a, e.g. normal equations or a quadric, by the
+// square root free Cholesky factorization a = L * D * Transpose(L). No rows are exchanged, so this
+// is cheaper than SolveLU, but solved is false unless a is (numerically) positive definite. See
+// also SolveCholeskyMany in tph_linalg_batch.hpp.
+template <typename FloatT, int M>
+TPH_NODISCARD constexpr auto SolveCholesky(const Mat<FloatT, M, M>& a,
+                                           const Vec<FloatT, M>& b) noexcept
+    -> LinearSolution<FloatT, M> {
+  return tph_linalg_internal::Solve(a, b, tph_linalg_internal::PositiveDefinite{});
+}
+
+// Quaternion v.x * i + v.y * j + v.z * k + w. Unit quaternions represent rotations, q and -q the
+// same one. A float rotation takes 16 bytes instead of the 36 of a Mat<float, 3, 3>, and composing
+// two costs 28 operations instead of 45. Rotating a vector costs 30 operations against 15 for Mul,
+// so to rotate many vectors by one rotation convert it with ToMat3x3 first (RotateMany in
+// tph_linalg_batch.hpp does).
+template <typename ArithT>
+struct Quat {
+  Vec<ArithT, 3> v; // Vector (imaginary) part.
+  ArithT w;         // Scalar (real) part.
+};
+
+namespace tph_linalg_internal {
+
+template <typename ArithT>
+constexpr auto ScaledQuat(const Quat<ArithT>& q, const ArithT s) noexcept -> Quat<ArithT> {
+  return {q.v * s, q.w * s};
+}
+
+// p + w * t + v x t, with t = 2 * (v x p).
+template <typename ArithT>
+constexpr auto RotateCross(const Quat<ArithT>& q,
+                           const Vec<ArithT, 3>& p,
+                           const Vec<ArithT, 3>& t) noexcept -> Vec<ArithT, 3> {
+  return p + t * q.w + Cross(q.v, t);
+}
+
+} // namespace tph_linalg_internal
+
+// The identity rotation.
+template <typename ArithT>
+TPH_NODISCARD constexpr auto IdentityQuat() noexcept -> Quat<ArithT> {
+  return {{ArithT{0}, ArithT{0}, ArithT{0}}, ArithT{1}};
+}
+
+// Quaternion product, the rotation b followed by a, i.e. Rotate(Mul(a, b), p) equals
+// Rotate(a, Rotate(b, p)) up to rounding.
+template <typename ArithT>
+TPH_NODISCARD constexpr auto Mul(const Quat<ArithT>& a, const Quat<ArithT>& b) noexcept
+    -> Quat<ArithT> {
+  return {b.v * a.w + a.v * b.w + Cross(a.v, b.v), a.w * b.w - Dot(a.v, b.v)};
+}
+
+// Conjugate, the inverse rotation of a unit quaternion.
+template <typename ArithT>
+TPH_NODISCARD constexpr auto Conjugate(const Quat<ArithT>& q) noexcept -> Quat<ArithT> {
+  return {-q.v, q.w};
+}
+
+// Dot product, for unit quaternions the cosine of half the angle between the rotations.
+template <typename ArithT>
+TPH_NODISCARD constexpr auto Dot(const Quat<ArithT>& a, const Quat<ArithT>& b) noexcept
+    -> ArithT {
+  return Dot(a.v, b.v) + a.w * b.w;
+}
+
+// Normalized. The zero quaternion is not supported.
+template <typename FloatT>
+TPH_NODISCARD constexpr auto Normalized(const Quat<FloatT>& q) noexcept -> Quat<FloatT> {
+  return tph_linalg_internal::ScaledQuat(q, FloatT(1) / tph_linalg_internal::sqrt(Dot(q, q)));
+}
+
+// Rotate p by the unit quaternion q, p + 2 * w * (v x p) + 2 * v x (v x p) computed with two cross
+// products.
+template <typename ArithT>
+TPH_NODISCARD constexpr auto Rotate(const Quat<ArithT>& q, const Vec<ArithT, 3>& p) noexcept
+    -> Vec<ArithT, 3> {
+  return tph_linalg_internal::RotateCross(q, p, Cross(q.v, p) * ArithT(2));
+}
+
+namespace tph_linalg_internal {
+
+// a * sa + b * sb.
+template <typename ArithT>
+constexpr auto Blend(const Quat<ArithT>& a,
+                     const ArithT sa,
+                     const Quat<ArithT>& b,
+                     const ArithT sb) noexcept -> Quat<ArithT> {
+  return {a.v * sa + b.v * sb, a.w * sa + b.w * sb};
+}
+
+// Per lane m ? a : b for quaternions.
+template <typename MaskT, typename ArithT>
+constexpr auto SelectQuat(const MaskT& m, const Quat<ArithT>& a, const Quat<ArithT>& b) noexcept
+    -> Quat<ArithT> {
+  return {SelectVec(m, a.v, b.v), Select(m, a.w, b.w)};
+}
+
+// The rotation matrix given d = 2 * q.v.
+template <typename ArithT>
+constexpr auto QuatToMat(const Quat<ArithT>& q, const Vec<ArithT, 3>& d) noexcept
+    -> Mat<ArithT, 3, 3> {
+  return {{ArithT(1) - q.v.y * d.y - q.v.z * d.z, q.v.x * d.y + q.w * d.z,
+           q.v.x * d.z - q.w * d.y},
+          {q.v.x * d.y - q.w * d.z, ArithT(1) - q.v.x * d.x - q.v.z * d.z,
+           q.v.y * d.z + q.w * d.x},
+          {q.v.x * d.z + q.w * d.y, q.v.y * d.z - q.w * d.x,
+           ArithT(1) - q.v.x * d.x - q.v.y * d.y}};
+}
+
+// Affine 4x4 matrix with the linear part a and no translation.
+template <typename ArithT>
+constexpr auto Expand(const Mat<ArithT, 3, 3>& a) noexcept -> Mat<ArithT, 4, 4> {
+  return Expand(Mat<ArithT, 3, 4>{a.x, a.y, a.z, {ArithT(0), ArithT(0), ArithT(0)}});
+}
+
+// Shepperd's method, "Quaternion from Rotation Matrix" (Shepperd 1978). Each of the four
+// components c has a candidate n = 4 * c * (x, y, z, w), where n[c] = t = 4 * c^2 is a sum of
+// diagonal elements and the other three are sums and differences of off-diagonal elements. The
+// candidate with the largest t is divided by 2 * sqrt(t), which avoids cancellation, and is chosen
+// by Select so that matrices of SIMD packets convert lane-wise.
+template <typename ArithT>
+struct QuatCandidate {
+  Vec<ArithT, 4> n;
+  ArithT t;
+};
+
+template <typename ArithT>
+constexpr auto Larger(const QuatCandidate<ArithT>& a, const QuatCandidate<ArithT>& b) noexcept
+    -> QuatCandidate<ArithT> {
+  return {SelectVec(a.t < b.t, b.n, a.n), SelectMax(a.t, b.t)};
+}
+
+template <typename ArithT>
+constexpr auto QuatFromCandidate(const Vec<ArithT, 4>& n, const ArithT s) noexcept
+    -> Quat<ArithT> {
+  return {{n.x * s, n.y * s, n.z * s}, n.w * s};
+}
+
+template <typename ArithT>
+constexpr auto QuatFromCandidate(const QuatCandidate<ArithT>& c) noexcept -> Quat<ArithT> {
+  return QuatFromCandidate(c.n, ArithT(0.5) / sqrt(c.t));
+}
+
+// s = 4 * (y * z, x * z, x * y) and d = 4 * w * (x, y, z).
+template <typename ArithT>
+constexpr auto QuatFromMat(const Mat<ArithT, 3, 3>& m,
+                           const Vec<ArithT, 3>& s,
+                           const Vec<ArithT, 3>& d) noexcept -> Quat<ArithT> {
+  return QuatFromCandidate(
+      Larger(Larger(QuatCandidate<ArithT>{{d.x, d.y, d.z, ArithT(1) + m.x.x + m.y.y + m.z.z},
+                                          ArithT(1) + m.x.x + m.y.y + m.z.z},
+                    QuatCandidate<ArithT>{{ArithT(1) + m.x.x - m.y.y - m.z.z, s.z, s.y, d.x},
+                                          ArithT(1) + m.x.x - m.y.y - m.z.z}),
+             Larger(QuatCandidate<ArithT>{{s.z, ArithT(1) - m.x.x + m.y.y - m.z.z, s.x, d.y},
+                                          ArithT(1) - m.x.x + m.y.y - m.z.z},
+                    QuatCandidate<ArithT>{{s.y, s.x, ArithT(1) - m.x.x - m.y.y + m.z.z, d.z},
+                                          ArithT(1) - m.x.x - m.y.y + m.z.z})));
+}
+
+// b or -b, whichever is closer to a given d = Dot(a, b), so that interpolation takes the shorter
+// arc.
+template <typename ArithT>
+constexpr auto Nearest(const Quat<ArithT>& b, const ArithT d) noexcept -> Quat<ArithT> {
+  return SelectQuat(d < ArithT(0), Quat<ArithT>{-b.v, -b.w}, b);
+}
+
+// Terms of the series for Slerp, for about full precision with cos(theta) >= cos(pi / 4), where
+// the ratio of consecutive terms is below 0.15.
+template <typename ArithT>
+struct SlerpTerms {
+  static constexpr int value = sizeof(typename scalar_type<ArithT>::type) > 4 ? 17 : 7;
+};
+
+// sin(s * theta) / sin(theta) = s * (1 + r1 * d * (1 + r2 * d * (1 + ...))), with
+// d = cos(theta) - 1 and ri = (s^2 - i^2) / (i * (2 * i + 1)), see "A Fast and Accurate Algorithm
+// for Computing SLERP" (Eberly 2011). Evaluated by Horner's rule from the innermost of I terms.
+template <typename ArithT>
+constexpr auto SlerpSeries(const ArithT /*s2*/,
+                           const ArithT /*d*/,
+                           const ArithT acc,
+                           Iterations<0> /*n*/) noexcept -> ArithT {
+  return acc;
+}
+
+template <typename ArithT, int I>
+constexpr auto SlerpSeries(const ArithT s2,
+                           const ArithT d,
+                           const ArithT acc,
+                           Iterations<I> /*n*/) noexcept -> ArithT {
+  return SlerpSeries(s2, d,
+                     ArithT(1) + (s2 - ArithT(I * I)) * (d * ArithT(1.0 / (I * (2 * I + 1)))) * acc,
+                     Iterations<I - 1>{});
+}
+
+template <typename ArithT>
+constexpr auto SlerpWeight(const ArithT s, const ArithT d) noexcept -> ArithT {
+  return s * SlerpSeries(s * s, d, ArithT(1), Iterations<SlerpTerms<ArithT>::value>{});
+}
+
+// Slerp from a to b with cos(theta) = c >= cos(pi / 4).
+template <typename ArithT>
+constexpr auto SlerpNear(const Quat<ArithT>& a,
+                         const Quat<ArithT>& b,
+                         const ArithT t,
+                         const ArithT c) noexcept -> Quat<ArithT> {
+  return Blend(a, SlerpWeight(ArithT(1) - t, c - ArithT(1)), b, SlerpWeight(t, c - ArithT(1)));
+}
+
+// The arc is split at its midpoint m = (a + b) / (2 * cos(theta / 2)), which halves the angle of
+// the series.
+template <typename ArithT>
+constexpr auto SlerpHalves(const Quat<ArithT>& a,
+                           const Quat<ArithT>& b,
+                           const Quat<ArithT>& m,
+                           const ArithT t,
+                           const ArithT c) noexcept -> Quat<ArithT> {
+  return SlerpNear(SelectQuat(t < ArithT(0.5), a, m), SelectQuat(t < ArithT(0.5), m, b),
+                   Select(t < ArithT(0.5), t * ArithT(2), t * ArithT(2) - ArithT(1)), c);
+}
+
+template <typename ArithT>
+constexpr auto SlerpHalves(const Quat<ArithT>& a,
+                           const Quat<ArithT>& b,
+                           const ArithT t,
+                           const ArithT c) noexcept -> Quat<ArithT> {
+  return SlerpHalves(a, b, Blend(a, ArithT(0.5) / c, b, ArithT(0.5) / c), t, c);
+}
+
+// Slerp given d = Dot(a, b).
+template <typename ArithT>
+constexpr auto Slerp(const Quat<ArithT>& a,
+                     const Quat<ArithT>& b,
+                     const ArithT t,
+                     const ArithT d) noexcept -> Quat<ArithT> {
+  return SlerpHalves(a, Nearest(b, d), t, sqrt(ArithT(0.5) + ArithT(0.5) * SelectAbs(d)));
+}
+
+} // namespace tph_linalg_internal
+
+// Rotation matrix of a unit quaternion, Mul(ToMat3x3(q), p) equals Rotate(q, p) up to rounding.
+// ToMat4x4 gives the affine transform without translation.
+template <typename ArithT>
+TPH_NODISCARD constexpr auto ToMat3x3(const Quat<ArithT>& q) noexcept -> Mat<ArithT, 3, 3> {
+  return tph_linalg_internal::QuatToMat(q, q.v * ArithT(2));
+}
+
+template <typename ArithT>
+TPH_NODISCARD constexpr auto ToMat4x4(const Quat<ArithT>& q) noexcept -> Mat<ArithT, 4, 4> {
+  return tph_linalg_internal::Expand(ToMat3x3(q));
+}
+
+// Unit quaternion of a rotation matrix (orthonormal, determinant one), for 4x4 matrices of the
+// upper-left 3x3 part. Either of q and -q may be returned. Branch-free, see
+// tph_linalg_internal::QuatFromMat.
+template <typename FloatT>
+TPH_NODISCARD constexpr auto ToQuat(const Mat<FloatT, 3, 3>& m) noexcept -> Quat<FloatT> {
+  return tph_linalg_internal::QuatFromMat(
+      m, Vec<FloatT, 3>{m.z.y + m.y.z, m.z.x + m.x.z, m.y.x + m.x.y},
+      Vec<FloatT, 3>{m.y.z - m.z.y, m.z.x - m.x.z, m.x.y - m.y.x});
+}
+
+template <typename FloatT>
+TPH_NODISCARD constexpr auto ToQuat(const Mat<FloatT, 4, 4>& m) noexcept -> Quat<FloatT> {
+  return ToQuat(tph_linalg_internal::Linear(tph_linalg_internal::UpperRows(m)));
+}
+
+// Normalized linear interpolation between unit quaternions along the shorter arc, for t in [0, 1].
+// Cheaper than Slerp, but the angular speed is not constant, e.g. a 90 degree rotation at t = 0.25
+// is interpolated by 21.6 degrees instead of 22.5.
+template <typename FloatT>
+TPH_NODISCARD constexpr auto Nlerp(const Quat<FloatT>& a,
+                                   const Quat<FloatT>& b,
+                                   const FloatT t) noexcept -> Quat<FloatT> {
+  return Normalized(
+      tph_linalg_internal::Blend(a, FloatT(1) - t, tph_linalg_internal::Nearest(b, Dot(a, b)), t));
+}
+
+// Spherical linear interpolation between unit quaternions along the shorter arc, for t in [0, 1],
+// at constant angular speed. Evaluated without trigonometric functions or branches, by a fixed
+// number of terms of a series in the cosine of the angle (see tph_linalg_internal::SlerpSeries),
+// so it works in constant expressions and lane-wise on SIMD packets. The error is within a few
+// ulps.
+template <typename FloatT>
+TPH_NODISCARD constexpr auto Slerp(const Quat<FloatT>& a,
+                                   const Quat<FloatT>& b,
+                                   const FloatT t) noexcept -> Quat<FloatT> {
+  return tph_linalg_internal::Slerp(a, b, t, Dot(a, b));
+}
+
+// Packed unit vectors, e.g. for storing normals. The octahedral formats map the unit sphere onto
+// the square [-1, 1]^2 by projecting onto the octahedron |x| + |y| + |z| = 1 and folding the lower
+// half over the diagonals, see "A Survey of Efficient Representations for Independent Unit
+// Vectors" (Cigolle et al. 2014). The two coordinates are stored as signed normalized integers,
+// round(c * (2^(bits - 1) - 1)). Maximum angular error of Decode(Encode(n)), measured for 2e7
+// random unit vectors, and size compared to 12 bytes for a float3:
+//   Oct16        2 x 8 bits   2 bytes   0.96 degrees
+//   Oct32        2 x 16 bits  4 bytes   0.0037 degrees
+//   Snorm1010102 3 x 10 bits  4 bytes   0.097 degrees
+struct Oct16 {
+  std::int8_t x;
+  std::int8_t y;
+};
+
+struct Oct32 {
+  std::int16_t x;
+  std::int16_t y;
+};
+
+// Three signed normalized 10-bit integers, round(c * 511), with x in the lowest bits, and two
+// unused bits that Encode sets to zero. The same layout as the GL_INT_2_10_10_10_REV vertex format.
+struct Snorm1010102 {
+  std::uint32_t bits;
+};
+
+namespace tph_linalg_internal {
+
+// Round to nearest, ties away from zero, after clamping to [-1, 1].
+template <typename IntT, typename FloatT>
+constexpr auto Quantize(const FloatT c, const FloatT max) noexcept -> IntT {
+  return c <= FloatT(-1)  ? static_cast<IntT>(-max)
+         : c >= FloatT(1) ? static_cast<IntT>(max)
+         : c < FloatT(0)  ? static_cast<IntT>(c * max - FloatT(0.5))
+                          : static_cast<IntT>(c * max + FloatT(0.5));
+}
+
+// (1 - |q|) with the sign of p, the fold of the lower half of the octahedron.
+template <typename FloatT>
+constexpr auto OctWrap(const FloatT p, const FloatT q) noexcept -> FloatT {
+  return p < FloatT(0) ? abs(q) - FloatT(1) : FloatT(1) - abs(q);
+}
+
+template <typename FloatT>
+constexpr auto OctFold(const FloatT px, const FloatT py, const bool lower) noexcept
+    -> Vec<FloatT, 2> {
+  return lower ? Vec<FloatT, 2>{OctWrap(px, py), OctWrap(py, px)} : Vec<FloatT, 2>{px, py};
+}
+
+template <typename FloatT>
+constexpr auto OctProject(const Vec<FloatT, 3>& n, const FloatT inv_l1) noexcept
+    -> Vec<FloatT, 2> {
+  return OctFold(n.x * inv_l1, n.y * inv_l1, n.z < FloatT(0));
+}
+
+template <typename FloatT>
+constexpr auto OctProject(const Vec<FloatT, 3>& n) noexcept -> Vec<FloatT, 2> {
+  return OctProject(n, FloatT(1) / (abs(n.x) + abs(n.y) + abs(n.z)));
+}
+
+template <typename IntT, typename FloatT>
+constexpr auto OctQuantize(const Vec<FloatT, 2>& p, const FloatT max) noexcept -> Vec<IntT, 2> {
+  return {Quantize<IntT>(p.x, max), Quantize<IntT>(p.y, max)};
+}
+
+// Inverse of OctFold for a point (x, y) of the square, t = max(-z, 0).
+constexpr auto OctUnfold(const float p, const float t) noexcept -> float {
+  return p >= 0.0F ? p - t : p + t;
+}
+
+constexpr auto OctDecode(const float x, const float y, const float z) noexcept -> Vec<float, 3> {
+  return Normalized(Vec<float, 3>{
+      OctUnfold(x, z < 0.0F ? -z : 0.0F), OctUnfold(y, z < 0.0F ? -z : 0.0F), z});
+}
+
+constexpr auto OctDecode(const float x, const float y) noexcept -> Vec<float, 3> {
+  return OctDecode(x, y, 1.0F - abs(x) - abs(y));
+}
+
+template <typename FloatT>
+constexpr auto EncodeAs(const Vec<FloatT, 3>& n, Oct16 /*tag*/) noexcept -> Oct16 {
+  return Oct16{OctQuantize<std::int8_t>(OctProject(n), FloatT(127)).x,
+               OctQuantize<std::int8_t>(OctProject(n), FloatT(127)).y};
+}
+
+template <typename FloatT>
+constexpr auto EncodeAs(const Vec<FloatT, 3>& n, Oct32 /*tag*/) noexcept -> Oct32 {
+  return Oct32{OctQuantize<std::int16_t>(OctProject(n), FloatT(32767)).x,
+               OctQuantize<std::int16_t>(OctProject(n), FloatT(32767)).y};
+}
+
+template <typename FloatT>
+constexpr auto EncodeAs(const Vec<FloatT, 3>& n, Snorm1010102 /*tag*/) noexcept -> Snorm1010102 {
+  return Snorm1010102{(static_cast<std::uint32_t>(Quantize<int>(n.x, FloatT(511))) & 0x3ffU) |
+                      (static_cast<std::uint32_t>(Quantize<int>(n.y, FloatT(511))) & 0x3ffU) << 10 |
+                      (static_cast<std::uint32_t>(Quantize<int>(n.z, FloatT(511))) & 0x3ffU) << 20};
+}
+
+// Signed 10-bit integer at bit offset shift.
+constexpr auto Snorm10(const std::uint32_t bits, const int shift) noexcept -> int {
+  return static_cast<int>((bits >> shift) & 0x3ffU) -
+         static_cast<int>((bits >> shift) & 0x200U) * 2;
+}
+
+} // namespace tph_linalg_internal
+
+// Pack a unit vector, e.g. Encode<Oct32>(n). The octahedral formats accept any non-zero vector,
+// since the projection onto the octahedron normalizes it, Snorm1010102 expects a unit vector and
+// clamps the components to [-1, 1].
+template <typename PackedT, typename FloatT>
+TPH_NODISCARD constexpr auto Encode(const Vec<FloatT, 3>& n) noexcept -> PackedT {
+  return tph_linalg_internal::EncodeAs(n, PackedT{});
+}
+
+// Unpack a unit vector, the result is normalized.
+TPH_NODISCARD constexpr auto Decode(const Oct16& p) noexcept -> Vec<float, 3> {
+  return tph_linalg_internal::OctDecode(p.x * (1.0F / 127.0F), p.y * (1.0F / 127.0F));
+}
+
+TPH_NODISCARD constexpr auto Decode(const Oct32& p) noexcept -> Vec<float, 3> {
+  return tph_linalg_internal::OctDecode(p.x * (1.0F / 32767.0F), p.y * (1.0F / 32767.0F));
+}
+
+TPH_NODISCARD constexpr auto Decode(const Snorm1010102& p) noexcept -> Vec<float, 3> {
+  return Normalized(Vec<float, 3>{
+      static_cast<float>(tph_linalg_internal::Snorm10(p.bits, 0)) * (1.0F / 511.0F),
+      static_cast<float>(tph_linalg_internal::Snorm10(p.bits, 10)) * (1.0F / 511.0F),
+      static_cast<float>(tph_linalg_internal::Snorm10(p.bits, 20)) * (1.0F / 511.0F)});
+}
+
+namespace tph_linalg_internal {
+
+// x, or one where x is zero. A divisor for quotients that are not selected when x is zero, so that
+// constant expressions never divide by zero.
+template <typename FloatT>
+constexpr auto NonZero(const FloatT x) noexcept -> FloatT {
+  return Select(x == FloatT(0), FloatT(1), x);
+}
+
+// d / len2 clamped to [0, 1], the parameter of the closest point on a segment.
+template <typename FloatT>
+constexpr auto SegmentParam(const FloatT d, const FloatT len2) noexcept -> FloatT {
+  return Select(d <= FloatT(0), FloatT(0), Select(len2 <= d, FloatT(1), d / NonZero(len2)));
+}
+
+// x clamped to [lo, hi] per component.
+template <typename ArithT>
+constexpr auto ClampSelect(const ArithT x, const ArithT lo, const ArithT hi) noexcept -> ArithT {
+  return Select(x < lo, lo, Select(hi < x, hi, x));
+}
+
+template <typename ArithT>
+constexpr auto ClampVec(const Vec<ArithT, 2>& p, const Aabb<ArithT, 2>& box) noexcept
+    -> Vec<ArithT, 2> {
+  return {ClampSelect(p.x, box.min.x, box.max.x), ClampSelect(p.y, box.min.y, box.max.y)};
+}
+
+template <typename ArithT>
+constexpr auto ClampVec(const Vec<ArithT, 3>& p, const Aabb<ArithT, 3>& box) noexcept
+    -> Vec<ArithT, 3> {
+  return {ClampSelect(p.x, box.min.x, box.max.x), ClampSelect(p.y, box.min.y, box.max.y),
+          ClampSelect(p.z, box.min.z, box.max.z)};
+}
+
+// Dot products of the edges ab and ac with p - a (d1, d2), p - b (d3, d4) and p - c (d5, d6).
+template <typename FloatT>
+struct TriangleDots {
+  FloatT d1, d2, d3, d4, d5, d6;
+};
+
+template <typename FloatT, int M>
+constexpr auto MakeTriangleDots(const Vec<FloatT, M>& ap,
+                                const Vec<FloatT, M>& bp,
+                                const Vec<FloatT, M>& cp,
+                                const Vec<FloatT, M>& ab,
+                                const Vec<FloatT, M>& ac) noexcept -> TriangleDots<FloatT> {
+  return {Dot(ab, ap), Dot(ac, ap), Dot(ab, bp), Dot(ac, bp), Dot(ab, cp), Dot(ac, cp)};
+}
+
+// x, or zero where x is negative.
+template <typename FloatT>
+constexpr auto NonNegative(const FloatT x) noexcept -> FloatT {
+  return Select(x < FloatT(0), FloatT(0), x);
+}
+
+// The point with barycentric coordinates vb * inv_sum and vc * inv_sum for b and c.
+template <typename FloatT, int M>
+constexpr auto TriangleInterior(const Vec<FloatT, M>& a,
+                                const Vec<FloatT, M>& ab,
+                                const Vec<FloatT, M>& ac,
+                                const FloatT vb,
+                                const FloatT vc,
+                                const FloatT inv_sum) noexcept -> Vec<FloatT, M> {
+  return a + ab * (vb * inv_sum) + ac * (vc * inv_sum);
+}
+
+// The Voronoi regions of "Real-Time Collision Detection" (Ericson 2005), 5.1.5, tested in the same
+// order, but every region is computed and the first one that contains p is selected, so there are
+// no branches. va, vb and vc are the barycentric areas opposite a, b and c, and e_ab, e_ac and e_bc
+// the closest points on the edges. Negative areas are taken as zero in the interior, which keeps
+// the point on the triangle when the region tests disagree after rounding.
+template <typename FloatT, int M>
+constexpr auto TriangleRegion(const Vec<FloatT, M>& a,
+                              const Vec<FloatT, M>& b,
+                              const Vec<FloatT, M>& c,
+                              const Vec<FloatT, M>& ab,
+                              const Vec<FloatT, M>& ac,
+                              const TriangleDots<FloatT>& t,
+                              const FloatT va,
+                              const FloatT vb,
+                              const FloatT vc,
+                              const Vec<FloatT, M>& e_ab,
+                              const Vec<FloatT, M>& e_ac,
+                              const Vec<FloatT, M>& e_bc) noexcept -> Vec<FloatT, M> {
+  return SelectVec(
+      (t.d1 <= FloatT(0)) & (t.d2 <= FloatT(0)), a,
+      SelectVec(
+          (t.d3 >= FloatT(0)) & (t.d4 <= t.d3), b,
+          SelectVec(
+              (vc <= FloatT(0)) & (t.d1 >= FloatT(0)) & (t.d3 <= FloatT(0)), e_ab,
+              SelectVec(
+                  (t.d6 >= FloatT(0)) & (t.d5 <= t.d6), c,
+                  SelectVec(
+                      (vb <= FloatT(0)) & (t.d2 >= FloatT(0)) & (t.d6 <= FloatT(0)), e_ac,
+                      SelectVec((va <= FloatT(0)) & (t.d4 >= t.d3) & (t.d5 >= t.d6), e_bc,
+                                TriangleInterior(a, ab, ac, NonNegative(vb), NonNegative(vc),
+                                                 FloatT(1) / NonZero(NonNegative(va) +
+                                                                     NonNegative(vb) +
+                                                                     NonNegative(vc)))))))));
+}
+
+// y where it is closer to p than x, otherwise x.
+template <typename FloatT, int M>
+constexpr auto Closer(const Vec<FloatT, M>& p,
+                      const Vec<FloatT, M>& x,
+                      const Vec<FloatT, M>& y) noexcept -> Vec<FloatT, M> {
+  return SelectVec(Length2(y - p) < Length2(x - p), y, x);
+}
+
+// The region's point, or the closest point on the longest edge where that is closer. For zero-area
+// and sliver triangles va + vb + vc, the squared area, may round to next to nothing and the
+// interior point be far from p, but the triangle is then within its height of the longest edge.
+template <typename FloatT, int M>
+constexpr auto ClosestOnTriangle(const Vec<FloatT, M>& p,
+                                 const Vec<FloatT, M>& a,
+                                 const Vec<FloatT, M>& b,
+                                 const Vec<FloatT, M>& c,
+                                 const Vec<FloatT, M>& ab,
+                                 const Vec<FloatT, M>& ac,
+                                 const TriangleDots<FloatT>& t,
+                                 const FloatT ab2,
+                                 const FloatT ac2,
+                                 const FloatT bc2,
+                                 const Vec<FloatT, M>& e_ab,
+                                 const Vec<FloatT, M>& e_ac,
+                                 const Vec<FloatT, M>& e_bc) noexcept -> Vec<FloatT, M> {
+  return Closer(p,
+                TriangleRegion(a, b, c, ab, ac, t, t.d3 * t.d6 - t.d5 * t.d4,
+                               t.d5 * t.d2 - t.d1 * t.d6, t.d1 * t.d4 - t.d3 * t.d2, e_ab, e_ac,
+                               e_bc),
+                SelectVec((bc2 > ab2) & (bc2 > ac2), e_bc, SelectVec(ac2 > ab2, e_ac, e_ab)));
+}
+
+// The edge parameters are those of SegmentParam, d1 - d3 = |ab|^2, d2 - d6 = |ac|^2 and
+// (d4 - d3) + (d5 - d6) = |bc|^2.
+template <typename FloatT, int M>
+constexpr auto ClosestOnTriangle(const Vec<FloatT, M>& p,
+                                 const Vec<FloatT, M>& a,
+                                 const Vec<FloatT, M>& b,
+                                 const Vec<FloatT, M>& c,
+                                 const Vec<FloatT, M>& ab,
+                                 const Vec<FloatT, M>& ac,
+                                 const TriangleDots<FloatT>& t) noexcept -> Vec<FloatT, M> {
+  return ClosestOnTriangle(p, a, b, c, ab, ac, t, t.d1 - t.d3, t.d2 - t.d6,
+                           (t.d4 - t.d3) + (t.d5 - t.d6),
+                           a + ab * SegmentParam(t.d1, t.d1 - t.d3),
+                           a + ac * SegmentParam(t.d2, t.d2 - t.d6),
+                           b + (c - b) * SegmentParam(t.d4 - t.d3, (t.d4 - t.d3) + (t.d5 - t.d6)));
+}
+
+} // namespace tph_linalg_internal
+
+// Closest point to p on the segment from a to b. A segment with a == b gives a.
+template <typename FloatT, int M>
+TPH_NODISCARD constexpr auto ClosestPointOnSegment(const Vec<FloatT, M>& p,
+                                                   const Vec<FloatT, M>& a,
+                                                   const Vec<FloatT, M>& b) noexcept
+    -> Vec<FloatT, M> {
+  return a + (b - a) * tph_linalg_internal::SegmentParam(Dot(p - a, b - a), Length2(b - a));
+}
+
+// Closest point to p on the triangle abc, including its interior. The point is on the triangle also
+// for zero-area triangles, e.g. with collinear or coincident vertices, and for those no farther
+// from p than the closest point on any edge.
+template <typename FloatT, int M>
+TPH_NODISCARD constexpr auto ClosestPointOnTriangle(const Vec<FloatT, M>& p,
+                                                    const Vec<FloatT, M>& a,
+                                                    const Vec<FloatT, M>& b,
+                                                    const Vec<FloatT, M>& c) noexcept
+    -> Vec<FloatT, M> {
+  return tph_linalg_internal::ClosestOnTriangle(
+      p, a, b, c, b - a, c - a,
+      tph_linalg_internal::MakeTriangleDots(p - a, p - b, p - c, b - a, c - a));
+}
+
+// Closest point to p in the box, p itself if it is inside. The box must not be empty.
+template <typename ArithT, int M>
+TPH_NODISCARD constexpr auto ClosestPointOnBox(const Vec<ArithT, M>& p,
+                                               const Aabb<ArithT, M>& box) noexcept
+    -> Vec<ArithT, M> {
+  return tph_linalg_internal::ClampVec(p, box);
+}
+
+// Distance from p to the box, zero if p is inside. The box must not be empty.
+template <typename FloatT, int M>
+TPH_NODISCARD constexpr auto DistanceToBox(const Vec<FloatT, M>& p,
+                                           const Aabb<FloatT, M>& box) noexcept
+    -> decltype(Distance(p, p)) {
+  return Distance(p, tph_linalg_internal::ClampVec(p, box));
 }
 
 } // namespace tph
 
 #undef TPH_NODISCARD
+#undef TPH_CONSTEXPR14
+#undef TPH_HAS_IS_CONSTANT_EVALUATED
+#undef TPH_HAS_SSE2
+#undef TPH_HAS_F16C
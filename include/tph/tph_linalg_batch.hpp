@@ -0,0 +1,4233 @@
+#pragma once
+
+#include <algorithm> // std::fill, std::max, std::min
+#include <cmath>     // std::abs
+#include <cstddef>   // std::ptrdiff_t, std::size_t
+#include <cstdint>   // std::uintptr_t
+#include <cstring>   // std::memcpy
+#include <limits>    // std::numeric_limits
+#include <type_traits>
+#include <vector>
+
+#include "tph_linalg.hpp"
+#include "tph_linalg_simd.hpp"
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define TPH_HAS_SSE2 1
+#else
+#define TPH_HAS_SSE2 0
+#endif
+// MSVC does not define __FMA__, but all AVX2 processors also support FMA.
+#if defined(__AVX2__) && (defined(__FMA__) || defined(_MSC_VER))
+#define TPH_HAS_AVX2 1
+#else
+#define TPH_HAS_AVX2 0
+#endif
+#if defined(__AVX512F__)
+#define TPH_HAS_AVX512F 1
+#else
+#define TPH_HAS_AVX512F 0
+#endif
+// F16C is separate from AVX2 in compiler flags, but every AVX2 processor has it.
+#if defined(__F16C__) || (defined(_MSC_VER) && defined(__AVX2__))
+#define TPH_HAS_F16C 1
+#else
+#define TPH_HAS_F16C 0
+#endif
+
+// Defining TPH_LINALG_ALL_KERNELS compiles the SIMD kernels for every x86 instruction set, whatever
+// the including translation unit targets. This is used by the tph_linalg_kernels library, which
+// selects a kernel at run-time (see tph_linalg_kernels.hpp).
+#if defined(TPH_LINALG_ALL_KERNELS) &&                                                            \
+    (defined(__x86_64__) || defined(__i386__) || defined(_M_X64) || defined(_M_IX86))
+#define TPH_ALL_KERNELS 1
+#else
+#define TPH_ALL_KERNELS 0
+#endif
+#if TPH_HAS_SSE2 || TPH_ALL_KERNELS
+#include <immintrin.h>
+#endif
+
+// Each SIMD kernel is tagged with the instruction set it is written for, so that it can be compiled
+// in translation units that do not target that instruction set. MSVC allows intrinsics for any
+// instruction set without flags.
+#if defined(__GNUC__) || defined(__clang__)
+#define TPH_TARGET(isa) __attribute__((target(isa)))
+#else
+#define TPH_TARGET(isa)
+#endif
+
+#if __cplusplus >= 201703L // C++17 or later.
+#define TPH_NODISCARD [[nodiscard]]
+#else
+#define TPH_NODISCARD
+#endif
+
+// Batch operations over arrays of vectors. The kernels are plain loops over unit-stride lanes that
+// the compiler vectorizes for whatever instruction set the including translation unit targets. Note
+// that GCC and clang only vectorize loops calling sqrt (Length, Normalized) with -fno-math-errno.
+
+// Tell the compiler that loop iterations are independent, so that batch loops are vectorized without
+// run-time alias checks. Output may alias input, but only at the same index (i.e. in-place).
+#if defined(__clang__)
+#define TPH_IVDEP _Pragma("clang loop vectorize(assume_safety)")
+#elif defined(__GNUC__)
+#define TPH_IVDEP _Pragma("GCC ivdep")
+#elif defined(_MSC_VER)
+#define TPH_IVDEP __pragma(loop(ivdep))
+#else
+#define TPH_IVDEP
+#endif
+
+namespace tph {
+
+// Structure-of-arrays (SoA) storage for a number of vectors with M elements of type T. Each
+// component is stored in its own contiguous array, so that batch operations read unit-stride lanes.
+// All component arrays always have the same size.
+template <typename ArithT, int M>
+struct VecArraySoA;
+
+template <typename ArithT>
+struct VecArraySoA<ArithT, 2> {
+  std::vector<ArithT> x;
+  std::vector<ArithT> y;
+};
+
+template <typename ArithT>
+struct VecArraySoA<ArithT, 3> {
+  std::vector<ArithT> x;
+  std::vector<ArithT> y;
+  std::vector<ArithT> z;
+};
+
+template <typename ArithT>
+struct VecArraySoA<ArithT, 4> {
+  std::vector<ArithT> x;
+  std::vector<ArithT> y;
+  std::vector<ArithT> z;
+  std::vector<ArithT> w;
+};
+
+// A tile of W vectors stored as structure-of-arrays, the building block of VecArrayAoSoA.
+template <typename ArithT, int M, int W>
+struct VecTile;
+
+template <typename ArithT, int W>
+struct VecTile<ArithT, 2, W> {
+  ArithT x[W];
+  ArithT y[W];
+};
+
+template <typename ArithT, int W>
+struct VecTile<ArithT, 3, W> {
+  ArithT x[W];
+  ArithT y[W];
+  ArithT z[W];
+};
+
+template <typename ArithT, int W>
+struct VecTile<ArithT, 4, W> {
+  ArithT x[W];
+  ArithT y[W];
+  ArithT z[W];
+  ArithT w[W];
+};
+
+// Tiled, array-of-structures-of-arrays (AoSoA) storage for a number of vectors with M elements of
+// type T. Vectors are grouped in tiles of W, which keeps all components of a vector within a few
+// cache lines while still giving unit-stride lanes. W should be a multiple of the SIMD width. Unused
+// lanes in the last tile are never read or written by batch operations.
+template <typename ArithT, int M, int W = 8>
+struct VecArrayAoSoA {
+  std::vector<VecTile<ArithT, M, W>> tiles;
+  std::size_t size = 0;
+};
+
+// Convenient type aliases.
+using float2SoA = VecArraySoA<float, 2>;
+using float3SoA = VecArraySoA<float, 3>;
+using float4SoA = VecArraySoA<float, 4>;
+using double2SoA = VecArraySoA<double, 2>;
+using double3SoA = VecArraySoA<double, 3>;
+using double4SoA = VecArraySoA<double, 4>;
+using half2SoA = VecArraySoA<half, 2>;
+using half3SoA = VecArraySoA<half, 3>;
+using half4SoA = VecArraySoA<half, 4>;
+
+// Parent of the roots of a TransformHierarchy.
+constexpr auto kNoParent = static_cast<std::size_t>(-1);
+
+// Transforms of a forest of nodes, e.g. a scene graph or a skeleton, with world = parent world *
+// local for every node and world = local for the roots. The nodes are stored in breadth-first
+// level order: the roots first, then their children, and so on, each level ordered by the
+// positions of the parents. So every level is one contiguous range whose parents are all in the
+// levels before it, and UpdateWorld computes each level with batched products (in parallel with a
+// Scheduler, see tph_linalg_parallel.hpp) instead of following the chain of each node.
+//
+// Make with MakeTransformHierarchy. Nodes keep their original indices in SetLocal and GetWorld.
+// The arrays below are in level order, and may also be used directly, e.g. to write all local
+// transforms at once, as long as dirty is set for the changed positions.
+template <typename ArithT>
+struct TransformHierarchy {
+  std::vector<std::size_t> node;     // Original index of the node at each position.
+  std::vector<std::size_t> position; // Position of each original index.
+  std::vector<std::size_t> parent;   // Position of the parent, kNoParent for the roots.
+  std::vector<std::size_t> levels;   // Position of the first node of each level, then the size.
+  std::vector<Mat<ArithT, 4, 4>> local;
+  std::vector<Mat<ArithT, 4, 4>> world;
+  std::vector<unsigned char> dirty; // Nonzero where local has changed since the last update.
+};
+
+// Vectors of M elements of type T at a fixed byte stride in an existing buffer, e.g. one attribute
+// of an interleaved vertex buffer, so that batch operations read and write them in place instead
+// of repacking them into arrays. The vectors need not be aligned. StridedVecView is read-only,
+// StridedVecSpan is writable. Make with MakeStridedView and MakeStridedSpan.
+template <typename ArithT, int M>
+struct StridedVecView {
+  const unsigned char* data; // First vector.
+  std::size_t stride;        // Bytes from one vector to the next.
+  std::size_t size;          // Number of vectors.
+};
+
+template <typename ArithT, int M>
+struct StridedVecSpan {
+  unsigned char* data;
+  std::size_t stride;
+  std::size_t size;
+};
+
+// Number of vectors.
+template <typename ArithT, int M>
+TPH_NODISCARD auto Size(const VecArraySoA<ArithT, M>& a) noexcept -> std::size_t {
+  return a.x.size();
+}
+
+template <typename ArithT, int M, int W>
+TPH_NODISCARD auto Size(const VecArrayAoSoA<ArithT, M, W>& a) noexcept -> std::size_t {
+  return a.size;
+}
+
+// Resize, new vectors are zero.
+template <typename ArithT>
+void Resize(VecArraySoA<ArithT, 2>& a, const std::size_t n) {
+  a.x.resize(n);
+  a.y.resize(n);
+}
+
+template <typename ArithT>
+void Resize(VecArraySoA<ArithT, 3>& a, const std::size_t n) {
+  a.x.resize(n);
+  a.y.resize(n);
+  a.z.resize(n);
+}
+
+template <typename ArithT>
+void Resize(VecArraySoA<ArithT, 4>& a, const std::size_t n) {
+  a.x.resize(n);
+  a.y.resize(n);
+  a.z.resize(n);
+  a.w.resize(n);
+}
+
+template <typename ArithT, int M, int W>
+void Resize(VecArrayAoSoA<ArithT, M, W>& a, const std::size_t n) {
+  a.tiles.resize((n + W - 1) / W, VecTile<ArithT, M, W>{});
+  a.size = n;
+}
+
+namespace tph_linalg_internal {
+
+// Component pointers, i.e. a Vec of pointers to the first lane of each component.
+template <typename ArithT>
+auto Lanes(VecArraySoA<ArithT, 2>& a) noexcept -> Vec<ArithT*, 2> {
+  return {a.x.data(), a.y.data()};
+}
+
+template <typename ArithT>
+auto Lanes(VecArraySoA<ArithT, 3>& a) noexcept -> Vec<ArithT*, 3> {
+  return {a.x.data(), a.y.data(), a.z.data()};
+}
+
+template <typename ArithT>
+auto Lanes(VecArraySoA<ArithT, 4>& a) noexcept -> Vec<ArithT*, 4> {
+  return {a.x.data(), a.y.data(), a.z.data(), a.w.data()};
+}
+
+template <typename ArithT>
+auto Lanes(const VecArraySoA<ArithT, 2>& a) noexcept -> Vec<const ArithT*, 2> {
+  return {a.x.data(), a.y.data()};
+}
+
+template <typename ArithT>
+auto Lanes(const VecArraySoA<ArithT, 3>& a) noexcept -> Vec<const ArithT*, 3> {
+  return {a.x.data(), a.y.data(), a.z.data()};
+}
+
+template <typename ArithT>
+auto Lanes(const VecArraySoA<ArithT, 4>& a) noexcept -> Vec<const ArithT*, 4> {
+  return {a.x.data(), a.y.data(), a.z.data(), a.w.data()};
+}
+
+template <typename ArithT, int W>
+auto Lanes(VecTile<ArithT, 2, W>& a) noexcept -> Vec<ArithT*, 2> {
+  return {a.x, a.y};
+}
+
+template <typename ArithT, int W>
+auto Lanes(VecTile<ArithT, 3, W>& a) noexcept -> Vec<ArithT*, 3> {
+  return {a.x, a.y, a.z};
+}
+
+template <typename ArithT, int W>
+auto Lanes(VecTile<ArithT, 4, W>& a) noexcept -> Vec<ArithT*, 4> {
+  return {a.x, a.y, a.z, a.w};
+}
+
+template <typename ArithT, int W>
+auto Lanes(const VecTile<ArithT, 2, W>& a) noexcept -> Vec<const ArithT*, 2> {
+  return {a.x, a.y};
+}
+
+template <typename ArithT, int W>
+auto Lanes(const VecTile<ArithT, 3, W>& a) noexcept -> Vec<const ArithT*, 3> {
+  return {a.x, a.y, a.z};
+}
+
+template <typename ArithT, int W>
+auto Lanes(const VecTile<ArithT, 4, W>& a) noexcept -> Vec<const ArithT*, 4> {
+  return {a.x, a.y, a.z, a.w};
+}
+
+// Gather lane i into a vector.
+template <typename ArithT>
+auto Load(const Vec<ArithT*, 2>& p, const std::size_t i) noexcept
+    -> Vec<typename std::remove_const<ArithT>::type, 2> {
+  return {p.x[i], p.y[i]};
+}
+
+template <typename ArithT>
+auto Load(const Vec<ArithT*, 3>& p, const std::size_t i) noexcept
+    -> Vec<typename std::remove_const<ArithT>::type, 3> {
+  return {p.x[i], p.y[i], p.z[i]};
+}
+
+template <typename ArithT>
+auto Load(const Vec<ArithT*, 4>& p, const std::size_t i) noexcept
+    -> Vec<typename std::remove_const<ArithT>::type, 4> {
+  return {p.x[i], p.y[i], p.z[i], p.w[i]};
+}
+
+// Scatter a vector into lane i.
+template <typename ArithT, typename ArithT2>
+void Store(const Vec<ArithT*, 2>& p, const std::size_t i, const Vec<ArithT2, 2>& v) noexcept {
+  p.x[i] = v.x;
+  p.y[i] = v.y;
+}
+
+template <typename ArithT, typename ArithT2>
+void Store(const Vec<ArithT*, 3>& p, const std::size_t i, const Vec<ArithT2, 3>& v) noexcept {
+  p.x[i] = v.x;
+  p.y[i] = v.y;
+  p.z[i] = v.z;
+}
+
+template <typename ArithT, typename ArithT2>
+void Store(const Vec<ArithT*, 4>& p, const std::size_t i, const Vec<ArithT2, 4>& v) noexcept {
+  p.x[i] = v.x;
+  p.y[i] = v.y;
+  p.z[i] = v.z;
+  p.w[i] = v.w;
+}
+
+// Batch kernels, out[i] = f(a[i]) and out[i] = f(a[i], b[i]), where the output is either a scalar
+// array or component pointers. These are written so that the compiler vectorizes across lanes.
+template <typename ArithT, typename OutT, int M, typename F>
+void MapScalar(const Vec<const ArithT*, M>& a, OutT* out, const std::size_t n, F f) noexcept {
+  TPH_IVDEP
+  for (std::size_t i = 0; i < n; ++i) {
+    out[i] = f(Load(a, i));
+  }
+}
+
+template <typename ArithT, typename OutT, int M, typename F>
+void MapScalar(const Vec<const ArithT*, M>& a,
+               const Vec<const ArithT*, M>& b,
+               OutT* out,
+               const std::size_t n,
+               F f) noexcept {
+  TPH_IVDEP
+  for (std::size_t i = 0; i < n; ++i) {
+    out[i] = f(Load(a, i), Load(b, i));
+  }
+}
+
+template <typename ArithT, typename OutT, int M, int N, typename F>
+void MapVec(const Vec<const ArithT*, M>& a,
+            const Vec<OutT*, N>& out,
+            const std::size_t n,
+            F f) noexcept {
+  TPH_IVDEP
+  for (std::size_t i = 0; i < n; ++i) {
+    Store(out, i, f(Load(a, i)));
+  }
+}
+
+template <typename ArithT, typename OutT, int M, int N, typename F>
+void MapVec(const Vec<const ArithT*, M>& a,
+            const Vec<const ArithT*, M>& b,
+            const Vec<OutT*, N>& out,
+            const std::size_t n,
+            F f) noexcept {
+  TPH_IVDEP
+  for (std::size_t i = 0; i < n; ++i) {
+    Store(out, i, f(Load(a, i), Load(b, i)));
+  }
+}
+
+// Number of lanes used in tile t of an AoSoA array with n vectors.
+template <int W>
+auto TileCount(const std::size_t n, const std::size_t t) noexcept -> std::size_t {
+  return n - t * W < static_cast<std::size_t>(W) ? n - t * W : static_cast<std::size_t>(W);
+}
+
+// Function objects wrapping the scalar free functions, used by the batch overloads below.
+struct DotOp {
+  template <typename A, typename B>
+  auto operator()(const A& a, const B& b) const noexcept -> decltype(Dot(a, b)) {
+    return Dot(a, b);
+  }
+};
+
+struct CrossOp {
+  template <typename A, typename B>
+  auto operator()(const A& a, const B& b) const noexcept -> decltype(Cross(a, b)) {
+    return Cross(a, b);
+  }
+};
+
+struct Length2Op {
+  template <typename A>
+  auto operator()(const A& a) const noexcept -> decltype(Length2(a)) {
+    return Length2(a);
+  }
+};
+
+struct LengthOp {
+  template <typename A>
+  auto operator()(const A& a) const noexcept -> decltype(Length(a)) {
+    return Length(a);
+  }
+};
+
+struct NormalizedOp {
+  template <typename A>
+  auto operator()(const A& a) const noexcept -> decltype(Normalized(a)) {
+    return Normalized(a);
+  }
+};
+
+struct Distance2Op {
+  template <typename A, typename B>
+  auto operator()(const A& a, const B& b) const noexcept -> decltype(Distance2(a, b)) {
+    return Distance2(a, b);
+  }
+};
+
+struct AddOp {
+  template <typename A, typename B>
+  auto operator()(const A& a, const B& b) const noexcept -> decltype(a + b) {
+    return a + b;
+  }
+};
+
+struct SubOp {
+  template <typename A, typename B>
+  auto operator()(const A& a, const B& b) const noexcept -> decltype(a - b) {
+    return a - b;
+  }
+};
+
+template <typename MatT>
+struct MulOp {
+  MatT m;
+  template <typename A>
+  auto operator()(const A& a) const noexcept -> decltype(Mul(m, a)) {
+    return Mul(m, a);
+  }
+};
+
+template <typename ArithT>
+struct ScaleOp {
+  ArithT s;
+  template <typename A>
+  auto operator()(const A& a) const noexcept -> decltype(a * s) {
+    return a * s;
+  }
+};
+
+// Apply a unary/binary scalar-valued op over SoA/AoSoA arrays.
+template <typename ArithT, int M, typename OutT, typename F>
+void BatchScalar(const VecArraySoA<ArithT, M>& a, OutT* out, F f) noexcept {
+  MapScalar(Lanes(a), out, a.x.size(), f);
+}
+
+template <typename ArithT, int M, typename OutT, typename F>
+void BatchScalar(const VecArraySoA<ArithT, M>& a,
+                 const VecArraySoA<ArithT, M>& b,
+                 OutT* out,
+                 F f) noexcept {
+  MapScalar(Lanes(a), Lanes(b), out, a.x.size(), f);
+}
+
+template <typename ArithT, int M, int W, typename OutT, typename F>
+void BatchScalar(const VecArrayAoSoA<ArithT, M, W>& a, OutT* out, F f) noexcept {
+  for (std::size_t t = 0; t < a.tiles.size(); ++t) {
+    MapScalar(Lanes(a.tiles[t]), out + t * W, TileCount<W>(a.size, t), f);
+  }
+}
+
+template <typename ArithT, int M, int W, typename OutT, typename F>
+void BatchScalar(const VecArrayAoSoA<ArithT, M, W>& a,
+                 const VecArrayAoSoA<ArithT, M, W>& b,
+                 OutT* out,
+                 F f) noexcept {
+  for (std::size_t t = 0; t < a.tiles.size(); ++t) {
+    MapScalar(Lanes(a.tiles[t]), Lanes(b.tiles[t]), out + t * W, TileCount<W>(a.size, t), f);
+  }
+}
+
+// Apply a unary/binary vector-valued op over SoA/AoSoA arrays. The output is resized to match the
+// input and may be the same object as one of the inputs.
+template <typename ArithT, int M, int N, typename F>
+void BatchVec(const VecArraySoA<ArithT, M>& a, VecArraySoA<ArithT, N>& out, F f) {
+  Resize(out, Size(a));
+  MapVec(Lanes(a), Lanes(out), Size(a), f);
+}
+
+template <typename ArithT, int M, int N, typename F>
+void BatchVec(const VecArraySoA<ArithT, M>& a,
+              const VecArraySoA<ArithT, M>& b,
+              VecArraySoA<ArithT, N>& out,
+              F f) {
+  Resize(out, Size(a));
+  MapVec(Lanes(a), Lanes(b), Lanes(out), Size(a), f);
+}
+
+template <typename ArithT, int M, int N, int W, typename F>
+void BatchVec(const VecArrayAoSoA<ArithT, M, W>& a, VecArrayAoSoA<ArithT, N, W>& out, F f) {
+  Resize(out, Size(a));
+  for (std::size_t t = 0; t < a.tiles.size(); ++t) {
+    MapVec(Lanes(a.tiles[t]), Lanes(out.tiles[t]), TileCount<W>(a.size, t), f);
+  }
+}
+
+template <typename ArithT, int M, int N, int W, typename F>
+void BatchVec(const VecArrayAoSoA<ArithT, M, W>& a,
+              const VecArrayAoSoA<ArithT, M, W>& b,
+              VecArrayAoSoA<ArithT, N, W>& out,
+              F f) {
+  Resize(out, Size(a));
+  for (std::size_t t = 0; t < a.tiles.size(); ++t) {
+    MapVec(Lanes(a.tiles[t]), Lanes(b.tiles[t]), Lanes(out.tiles[t]), TileCount<W>(a.size, t), f);
+  }
+}
+
+} // namespace tph_linalg_internal
+
+// Read/write a single vector.
+template <typename ArithT, int M>
+TPH_NODISCARD auto Get(const VecArraySoA<ArithT, M>& a, const std::size_t i) noexcept
+    -> Vec<ArithT, M> {
+  return tph_linalg_internal::Load(tph_linalg_internal::Lanes(a), i);
+}
+
+template <typename ArithT, int M, int W>
+TPH_NODISCARD auto Get(const VecArrayAoSoA<ArithT, M, W>& a, const std::size_t i) noexcept
+    -> Vec<ArithT, M> {
+  return tph_linalg_internal::Load(tph_linalg_internal::Lanes(a.tiles[i / W]), i % W);
+}
+
+template <typename ArithT, int M>
+void Set(VecArraySoA<ArithT, M>& a, const std::size_t i, const Vec<ArithT, M>& v) noexcept {
+  tph_linalg_internal::Store(tph_linalg_internal::Lanes(a), i, v);
+}
+
+template <typename ArithT, int M, int W>
+void Set(VecArrayAoSoA<ArithT, M, W>& a, const std::size_t i, const Vec<ArithT, M>& v) noexcept {
+  tph_linalg_internal::Store(tph_linalg_internal::Lanes(a.tiles[i / W]), i % W, v);
+}
+
+// Conversion from/to arrays of vectors (AoS). The AoS array holds Size(a) vectors.
+template <typename ArithT, int M>
+TPH_NODISCARD auto ToSoA(const Vec<ArithT, M>* src, const std::size_t n) -> VecArraySoA<ArithT, M> {
+  VecArraySoA<ArithT, M> a;
+  Resize(a, n);
+  const auto p = tph_linalg_internal::Lanes(a);
+  TPH_IVDEP
+  for (std::size_t i = 0; i < n; ++i) {
+    tph_linalg_internal::Store(p, i, src[i]);
+  }
+  return a;
+}
+
+template <int W, typename ArithT, int M>
+TPH_NODISCARD auto ToAoSoA(const Vec<ArithT, M>* src, const std::size_t n)
+    -> VecArrayAoSoA<ArithT, M, W> {
+  VecArrayAoSoA<ArithT, M, W> a{};
+  Resize(a, n);
+  for (std::size_t t = 0; t < a.tiles.size(); ++t) {
+    const auto p = tph_linalg_internal::Lanes(a.tiles[t]);
+    const auto count = tph_linalg_internal::TileCount<W>(n, t);
+    for (std::size_t i = 0; i < count; ++i) {
+      tph_linalg_internal::Store(p, i, src[t * W + i]);
+    }
+  }
+  return a;
+}
+
+template <typename ArithT, int M>
+void ToAoS(const VecArraySoA<ArithT, M>& a, Vec<ArithT, M>* dst) noexcept {
+  const auto p = tph_linalg_internal::Lanes(a);
+  const auto n = Size(a);
+  TPH_IVDEP
+  for (std::size_t i = 0; i < n; ++i) {
+    dst[i] = tph_linalg_internal::Load(p, i);
+  }
+}
+
+template <typename ArithT, int M, int W>
+void ToAoS(const VecArrayAoSoA<ArithT, M, W>& a, Vec<ArithT, M>* dst) noexcept {
+  for (std::size_t t = 0; t < a.tiles.size(); ++t) {
+    const auto p = tph_linalg_internal::Lanes(a.tiles[t]);
+    const auto count = tph_linalg_internal::TileCount<W>(a.size, t);
+    for (std::size_t i = 0; i < count; ++i) {
+      dst[t * W + i] = tph_linalg_internal::Load(p, i);
+    }
+  }
+}
+
+// Batch versions of the free functions. Arrays must have the same size, scalar results are written
+// to out[0..Size(a)), vector results resize out.
+//
+// Dot product, out[i] = Dot(a[i], b[i]).
+template <typename ArrayT>
+void Dot(const ArrayT& a, const ArrayT& b, decltype(Get(a, 0).x)* out) noexcept {
+  tph_linalg_internal::BatchScalar(a, b, out, tph_linalg_internal::DotOp{});
+}
+
+// Length squared, out[i] = Length2(a[i]).
+template <typename ArrayT>
+void Length2(const ArrayT& a, decltype(Get(a, 0).x)* out) noexcept {
+  tph_linalg_internal::BatchScalar(a, out, tph_linalg_internal::Length2Op{});
+}
+
+// Length, out[i] = Length(a[i]).
+template <typename ArrayT>
+void Length(const ArrayT& a, decltype(Get(a, 0).x)* out) noexcept {
+  tph_linalg_internal::BatchScalar(a, out, tph_linalg_internal::LengthOp{});
+}
+
+// Distance squared, out[i] = Distance2(a[i], b[i]).
+template <typename ArrayT>
+void Distance2(const ArrayT& a, const ArrayT& b, decltype(Get(a, 0).x)* out) noexcept {
+  tph_linalg_internal::BatchScalar(a, b, out, tph_linalg_internal::Distance2Op{});
+}
+
+// Cross product, out[i] = Cross(a[i], b[i]).
+template <typename ArithT>
+void Cross(const VecArraySoA<ArithT, 3>& a,
+           const VecArraySoA<ArithT, 3>& b,
+           VecArraySoA<ArithT, 3>& out) {
+  tph_linalg_internal::BatchVec(a, b, out, tph_linalg_internal::CrossOp{});
+}
+
+template <typename ArithT, int W>
+void Cross(const VecArrayAoSoA<ArithT, 3, W>& a,
+           const VecArrayAoSoA<ArithT, 3, W>& b,
+           VecArrayAoSoA<ArithT, 3, W>& out) {
+  tph_linalg_internal::BatchVec(a, b, out, tph_linalg_internal::CrossOp{});
+}
+
+// Normalized, out[i] = Normalized(a[i]).
+template <typename ArrayT>
+void Normalized(const ArrayT& a, ArrayT& out) {
+  tph_linalg_internal::BatchVec(a, out, tph_linalg_internal::NormalizedOp{});
+}
+
+// Matrix-vector product, out[i] = Mul(m, a[i]).
+template <typename ArithT, int M, int N>
+void Mul(const Mat<ArithT, M, N>& m, const VecArraySoA<ArithT, N>& a, VecArraySoA<ArithT, M>& out) {
+  tph_linalg_internal::BatchVec(a, out, tph_linalg_internal::MulOp<Mat<ArithT, M, N>>{m});
+}
+
+template <typename ArithT, int M, int N, int W>
+void Mul(const Mat<ArithT, M, N>& m,
+         const VecArrayAoSoA<ArithT, N, W>& a,
+         VecArrayAoSoA<ArithT, M, W>& out) {
+  tph_linalg_internal::BatchVec(a, out, tph_linalg_internal::MulOp<Mat<ArithT, M, N>>{m});
+}
+
+// operator+(a, b)
+template <typename ArithT, int M>
+TPH_NODISCARD auto operator+(const VecArraySoA<ArithT, M>& a, const VecArraySoA<ArithT, M>& b)
+    -> VecArraySoA<ArithT, M> {
+  VecArraySoA<ArithT, M> out;
+  tph_linalg_internal::BatchVec(a, b, out, tph_linalg_internal::AddOp{});
+  return out;
+}
+
+template <typename ArithT, int M, int W>
+TPH_NODISCARD auto operator+(const VecArrayAoSoA<ArithT, M, W>& a,
+                             const VecArrayAoSoA<ArithT, M, W>& b) -> VecArrayAoSoA<ArithT, M, W> {
+  VecArrayAoSoA<ArithT, M, W> out{};
+  tph_linalg_internal::BatchVec(a, b, out, tph_linalg_internal::AddOp{});
+  return out;
+}
+
+// operator-(a, b)
+template <typename ArithT, int M>
+TPH_NODISCARD auto operator-(const VecArraySoA<ArithT, M>& a, const VecArraySoA<ArithT, M>& b)
+    -> VecArraySoA<ArithT, M> {
+  VecArraySoA<ArithT, M> out;
+  tph_linalg_internal::BatchVec(a, b, out, tph_linalg_internal::SubOp{});
+  return out;
+}
+
+template <typename ArithT, int M, int W>
+TPH_NODISCARD auto operator-(const VecArrayAoSoA<ArithT, M, W>& a,
+                             const VecArrayAoSoA<ArithT, M, W>& b) -> VecArrayAoSoA<ArithT, M, W> {
+  VecArrayAoSoA<ArithT, M, W> out{};
+  tph_linalg_internal::BatchVec(a, b, out, tph_linalg_internal::SubOp{});
+  return out;
+}
+
+// operator*(array, scalar)
+template <typename ArithT, int M>
+TPH_NODISCARD auto operator*(const VecArraySoA<ArithT, M>& a, const ArithT b)
+    -> VecArraySoA<ArithT, M> {
+  VecArraySoA<ArithT, M> out;
+  tph_linalg_internal::BatchVec(a, out, tph_linalg_internal::ScaleOp<ArithT>{b});
+  return out;
+}
+
+template <typename ArithT, int M, int W>
+TPH_NODISCARD auto operator*(const VecArrayAoSoA<ArithT, M, W>& a, const ArithT b)
+    -> VecArrayAoSoA<ArithT, M, W> {
+  VecArrayAoSoA<ArithT, M, W> out{};
+  tph_linalg_internal::BatchVec(a, out, tph_linalg_internal::ScaleOp<ArithT>{b});
+  return out;
+}
+
+// operator+=(a, b), operator-=(a, b) and operator*=(array, scalar), in-place without allocation.
+template <typename ArithT, int M>
+auto operator+=(VecArraySoA<ArithT, M>& a, const VecArraySoA<ArithT, M>& b)
+    -> VecArraySoA<ArithT, M>& {
+  tph_linalg_internal::BatchVec(a, b, a, tph_linalg_internal::AddOp{});
+  return a;
+}
+
+template <typename ArithT, int M, int W>
+auto operator+=(VecArrayAoSoA<ArithT, M, W>& a, const VecArrayAoSoA<ArithT, M, W>& b)
+    -> VecArrayAoSoA<ArithT, M, W>& {
+  tph_linalg_internal::BatchVec(a, b, a, tph_linalg_internal::AddOp{});
+  return a;
+}
+
+template <typename ArithT, int M>
+auto operator-=(VecArraySoA<ArithT, M>& a, const VecArraySoA<ArithT, M>& b)
+    -> VecArraySoA<ArithT, M>& {
+  tph_linalg_internal::BatchVec(a, b, a, tph_linalg_internal::SubOp{});
+  return a;
+}
+
+template <typename ArithT, int M, int W>
+auto operator-=(VecArrayAoSoA<ArithT, M, W>& a, const VecArrayAoSoA<ArithT, M, W>& b)
+    -> VecArrayAoSoA<ArithT, M, W>& {
+  tph_linalg_internal::BatchVec(a, b, a, tph_linalg_internal::SubOp{});
+  return a;
+}
+
+template <typename ArithT, int M>
+auto operator*=(VecArraySoA<ArithT, M>& a, const ArithT b) -> VecArraySoA<ArithT, M>& {
+  tph_linalg_internal::BatchVec(a, a, tph_linalg_internal::ScaleOp<ArithT>{b});
+  return a;
+}
+
+template <typename ArithT, int M, int W>
+auto operator*=(VecArrayAoSoA<ArithT, M, W>& a, const ArithT b) -> VecArrayAoSoA<ArithT, M, W>& {
+  tph_linalg_internal::BatchVec(a, a, tph_linalg_internal::ScaleOp<ArithT>{b});
+  return a;
+}
+
+namespace tph_linalg_internal {
+
+// Scalar transform kernels, used for types without SIMD kernels and for the remaining few vectors
+// after the last full SIMD block. kPoint selects points (w = 1) or directions (w = 0).
+template <bool kPoint, typename ArithT>
+void AffineScalar(const Mat<ArithT, 3, 4>& m,
+                  const Vec<ArithT, 3>* src,
+                  Vec<ArithT, 3>* dst,
+                  const std::size_t n) noexcept {
+  for (std::size_t i = 0; i < n; ++i) {
+    const auto p = src[i];
+    const auto r = m.x * p.x + m.y * p.y + m.z * p.z;
+    dst[i] = kPoint ? r + m.w : r;
+  }
+}
+
+template <typename ArithT>
+void ProjectScalar(const Mat<ArithT, 4, 4>& m,
+                   const Vec<ArithT, 3>* src,
+                   Vec<ArithT, 3>* dst,
+                   const std::size_t n) noexcept {
+  for (std::size_t i = 0; i < n; ++i) {
+    const auto p = src[i];
+    const auto r = Mul(m, Vec<ArithT, 4>{p.x, p.y, p.z, ArithT(1)});
+    const auto inv_w = ArithT(1) / r.w;
+    dst[i] = {r.x * inv_w, r.y * inv_w, r.z * inv_w};
+  }
+}
+
+template <typename ArithT>
+void InverseScalar(const Mat<ArithT, 4, 4>* src,
+                   Mat<ArithT, 4, 4>* dst,
+                   const std::size_t n) noexcept {
+  for (std::size_t i = 0; i < n; ++i) {
+    dst[i] = Inverse(src[i]);
+  }
+}
+
+template <typename ArithT>
+void MulScalar(const Mat<ArithT, 4, 4>* a,
+               const std::size_t a_step,
+               const Mat<ArithT, 4, 4>* b,
+               Mat<ArithT, 4, 4>* dst,
+               const std::size_t n) noexcept {
+  for (std::size_t i = 0; i < n; ++i) {
+    dst[i] = Mul(a[i * a_step], b[i]);
+  }
+}
+
+// Scalar half kernels, one value at a time.
+inline void WidenScalar(const half* src, float* dst, const std::size_t n) noexcept {
+  for (std::size_t i = 0; i < n; ++i) {
+    dst[i] = src[i];
+  }
+}
+
+inline void NarrowScalar(const float* src, half* dst, const std::size_t n) noexcept {
+  for (std::size_t i = 0; i < n; ++i) {
+    dst[i] = src[i];
+  }
+}
+
+template <bool kPoint>
+void AffineScalar(const Mat<float, 3, 4>& m,
+                  const Vec<half, 3>* src,
+                  Vec<half, 3>* dst,
+                  const std::size_t n) noexcept {
+  for (std::size_t i = 0; i < n; ++i) {
+    const auto p = Widen(src[i]);
+    const auto r = m.x * p.x + m.y * p.y + m.z * p.z;
+    dst[i] = Narrow(kPoint ? r + m.w : r);
+  }
+}
+
+inline void ProjectScalar(const Mat<float, 4, 4>& m,
+                          const Vec<half, 3>* src,
+                          Vec<half, 3>* dst,
+                          const std::size_t n) noexcept {
+  for (std::size_t i = 0; i < n; ++i) {
+    const auto p = Widen(src[i]);
+    const auto r = Mul(m, Vec<float, 4>{p.x, p.y, p.z, 1.0F});
+    const auto inv_w = 1.0F / r.w;
+    dst[i] = Narrow(Vec<float, 3>{r.x * inv_w, r.y * inv_w, r.z * inv_w});
+  }
+}
+
+// Scalar kernels on strided vectors, see StridedVecView. The vectors are copied with memcpy, which
+// compiles to plain loads and stores of the components for any alignment. Views of packed, aligned
+// vectors are passed to the array kernels instead.
+template <typename ArithT, int M>
+auto IsArray(const StridedVecView<ArithT, M>& a) noexcept -> bool {
+  return a.stride == sizeof(Vec<ArithT, M>) &&
+         reinterpret_cast<std::uintptr_t>(a.data) % alignof(Vec<ArithT, M>) == 0;
+}
+
+template <typename ArithT, int M>
+auto IsArray(const StridedVecSpan<ArithT, M>& a) noexcept -> bool {
+  return IsArray(StridedVecView<ArithT, M>{a.data, a.stride, a.size});
+}
+
+template <typename ArithT, int M>
+auto AsArray(const StridedVecView<ArithT, M>& a) noexcept -> const Vec<ArithT, M>* {
+  return reinterpret_cast<const Vec<ArithT, M>*>(a.data);
+}
+
+template <typename ArithT, int M>
+auto AsArray(const StridedVecSpan<ArithT, M>& a) noexcept -> Vec<ArithT, M>* {
+  return reinterpret_cast<Vec<ArithT, M>*>(a.data);
+}
+
+// Vectors [begin, begin + n).
+template <typename ArithT, int M>
+auto Slice(const StridedVecView<ArithT, M>& a,
+           const std::size_t begin,
+           const std::size_t n) noexcept -> StridedVecView<ArithT, M> {
+  return {a.data + begin * a.stride, a.stride, n};
+}
+
+template <typename ArithT, int M>
+auto Slice(const StridedVecSpan<ArithT, M>& a,
+           const std::size_t begin,
+           const std::size_t n) noexcept -> StridedVecSpan<ArithT, M> {
+  return {a.data + begin * a.stride, a.stride, n};
+}
+
+template <typename ArithT, int M>
+auto Load(const StridedVecView<ArithT, M>& a, const std::size_t i) noexcept -> Vec<ArithT, M> {
+  Vec<ArithT, M> v;
+  std::memcpy(&v, a.data + i * a.stride, sizeof(v));
+  return v;
+}
+
+template <typename ArithT, int M>
+void Store(const StridedVecSpan<ArithT, M>& a,
+           const std::size_t i,
+           const Vec<ArithT, M>& v) noexcept {
+  std::memcpy(a.data + i * a.stride, &v, sizeof(v));
+}
+
+template <bool kPoint, typename ArithT>
+void AffineScalar(const Mat<ArithT, 3, 4>& m,
+                  const StridedVecView<ArithT, 3>& src,
+                  const StridedVecSpan<ArithT, 3>& dst) noexcept {
+  for (std::size_t i = 0; i < src.size; ++i) {
+    const auto p = Load(src, i);
+    const auto r = m.x * p.x + m.y * p.y + m.z * p.z;
+    Store(dst, i, kPoint ? r + m.w : r);
+  }
+}
+
+template <typename ArithT>
+void ProjectScalar(const Mat<ArithT, 4, 4>& m,
+                   const StridedVecView<ArithT, 3>& src,
+                   const StridedVecSpan<ArithT, 3>& dst) noexcept {
+  for (std::size_t i = 0; i < src.size; ++i) {
+    const auto p = Load(src, i);
+    const auto r = Mul(m, Vec<ArithT, 4>{p.x, p.y, p.z, ArithT(1)});
+    const auto inv_w = ArithT(1) / r.w;
+    Store(dst, i, Vec<ArithT, 3>{r.x * inv_w, r.y * inv_w, r.z * inv_w});
+  }
+}
+
+template <typename ArithT, int M>
+void NormalizeScalar(const StridedVecView<ArithT, M>& src,
+                     const StridedVecSpan<ArithT, M>& dst) noexcept {
+  for (std::size_t i = 0; i < src.size; ++i) {
+    Store(dst, i, Normalized(Load(src, i)));
+  }
+}
+
+// Packed unit vector formats, see Encode and Decode in tph_linalg.hpp. kMax is the largest
+// quantized value.
+template <typename PackedT>
+struct PackedTraits;
+
+template <>
+struct PackedTraits<Oct16> {
+  static constexpr bool kOctahedral = true;
+  static constexpr float kMax = 127.0F;
+};
+
+template <>
+struct PackedTraits<Oct32> {
+  static constexpr bool kOctahedral = true;
+  static constexpr float kMax = 32767.0F;
+};
+
+template <>
+struct PackedTraits<Snorm1010102> {
+  static constexpr bool kOctahedral = false;
+  static constexpr float kMax = 511.0F;
+};
+
+template <typename PackedT>
+void EncodeScalar(const Vec<float, 3>* src, PackedT* dst, const std::size_t n) noexcept {
+  for (std::size_t i = 0; i < n; ++i) {
+    dst[i] = Encode<PackedT>(src[i]);
+  }
+}
+
+template <typename PackedT>
+void DecodeScalar(const PackedT* src, Vec<float, 3>* dst, const std::size_t n) noexcept {
+  for (std::size_t i = 0; i < n; ++i) {
+    dst[i] = Decode(src[i]);
+  }
+}
+
+// Reductions over arrays of points. Moments are the sums of the products of the components
+// relative to a center, (xx, yy, zz) and (xy, xz, yz).
+template <typename AccT>
+struct Moments {
+  Vec<AccT, 3> diag;
+  Vec<AccT, 3> off;
+};
+
+template <typename AccT>
+auto operator+(const Moments<AccT>& a, const Moments<AccT>& b) noexcept -> Moments<AccT> {
+  return {a.diag + b.diag, a.off + b.off};
+}
+
+// The empty box, min = +inf and max = -inf.
+template <typename ArithT>
+auto EmptyBounds() noexcept -> Aabb<ArithT, 3> {
+  return {Vec<ArithT, 3>{numeric_limits<ArithT>::infinity(),
+                         numeric_limits<ArithT>::infinity(),
+                         numeric_limits<ArithT>::infinity()},
+          Vec<ArithT, 3>{-numeric_limits<ArithT>::infinity(),
+                         -numeric_limits<ArithT>::infinity(),
+                         -numeric_limits<ArithT>::infinity()}};
+}
+
+template <typename AccT, typename ArithT>
+auto ToAcc(const Vec<ArithT, 3>& a) noexcept -> Vec<AccT, 3> {
+  return {static_cast<AccT>(a.x), static_cast<AccT>(a.y), static_cast<AccT>(a.z)};
+}
+
+template <typename ArithT>
+auto BoundsScalar(const Vec<ArithT, 3>* src, const std::size_t n) noexcept -> Aabb<ArithT, 3> {
+  auto b = EmptyBounds<ArithT>();
+  for (std::size_t i = 0; i < n; ++i) {
+    b.min = Min(b.min, src[i]);
+    b.max = Max(b.max, src[i]);
+  }
+  return b;
+}
+
+// (min, max) of Dot(d, src[i]).
+template <typename ArithT>
+auto DotRangeScalar(const Vec<ArithT, 3>* src,
+                    const std::size_t n,
+                    const Vec<ArithT, 3>& d) noexcept -> Vec<ArithT, 2> {
+  Vec<ArithT, 2> r = {numeric_limits<ArithT>::infinity(), -numeric_limits<ArithT>::infinity()};
+  for (std::size_t i = 0; i < n; ++i) {
+    const auto t = Dot(d, src[i]);
+    r.x = t < r.x ? t : r.x;
+    r.y = r.y < t ? t : r.y;
+  }
+  return r;
+}
+
+template <typename ArithT>
+auto BoundsScalar(const StridedVecView<ArithT, 3>& src) noexcept -> Aabb<ArithT, 3> {
+  auto b = EmptyBounds<ArithT>();
+  for (std::size_t i = 0; i < src.size; ++i) {
+    const auto p = Load(src, i);
+    b.min = Min(b.min, p);
+    b.max = Max(b.max, p);
+  }
+  return b;
+}
+
+template <typename ArithT>
+auto DotRangeScalar(const StridedVecView<ArithT, 3>& src, const Vec<ArithT, 3>& d) noexcept
+    -> Vec<ArithT, 2> {
+  Vec<ArithT, 2> r = {numeric_limits<ArithT>::infinity(), -numeric_limits<ArithT>::infinity()};
+  for (std::size_t i = 0; i < src.size; ++i) {
+    const auto t = Dot(d, Load(src, i));
+    r.x = t < r.x ? t : r.x;
+    r.y = r.y < t ? t : r.y;
+  }
+  return r;
+}
+
+// Four accumulators, which hides the latency of the additions.
+template <typename AccT, typename ArithT>
+auto SumScalar(const Vec<ArithT, 3>* src, const std::size_t n) noexcept -> Vec<AccT, 3> {
+  Vec<AccT, 3> a[4] = {};
+  std::size_t i = 0;
+  for (; i + 4 <= n; i += 4) {
+    for (std::size_t k = 0; k < 4; ++k) {
+      a[k] = a[k] + ToAcc<AccT>(src[i + k]);
+    }
+  }
+  for (; i < n; ++i) {
+    a[0] = a[0] + ToAcc<AccT>(src[i]);
+  }
+  return (a[0] + a[1]) + (a[2] + a[3]);
+}
+
+template <typename AccT, typename ArithT>
+auto MomentsScalar(const Vec<ArithT, 3>* src, const std::size_t n, const Vec<AccT, 3>& c) noexcept
+    -> Moments<AccT> {
+  Moments<AccT> m = {};
+  for (std::size_t i = 0; i < n; ++i) {
+    const auto p = ToAcc<AccT>(src[i]) - c;
+    m.diag = m.diag + Vec<AccT, 3>{p.x * p.x, p.y * p.y, p.z * p.z};
+    m.off = m.off + Vec<AccT, 3>{p.x * p.y, p.x * p.z, p.y * p.z};
+  }
+  return m;
+}
+
+// SIMD kernels for float, and for double where noted. Blocks of 4 (SSE2), 8 (AVX2) or 16 (AVX-512)
+// vectors are loaded, transposed to x/y/z registers with in-lane shuffles, transformed by broadcast
+// matrix elements kept in registers for the whole loop, and transposed back. Each block is loaded
+// before it is stored, so src == dst is fine. The kernels must not depend on the flags of the
+// translation unit (e.g. __FMA__), since the same kernel may be compiled by several translation
+// units.
+#if TPH_HAS_SSE2 || TPH_ALL_KERNELS
+namespace sse2 {
+
+struct Regs {
+  __m128 x;
+  __m128 y;
+  __m128 z;
+};
+
+// [x0 y0 z0 x1] [y1 z1 x2 y2] [z2 x3 y3 z3] -> [x0 x1 x2 x3] [y0 y1 y2 y3] [z0 z1 z2 z3].
+TPH_TARGET("sse2") inline auto Load4(const Vec<float, 3>* src) noexcept -> Regs {
+  const auto* p = &src->x;
+  const auto a = _mm_loadu_ps(p);
+  const auto b = _mm_loadu_ps(p + 4);
+  const auto c = _mm_loadu_ps(p + 8);
+  const auto xy = _mm_shuffle_ps(b, c, _MM_SHUFFLE(2, 1, 3, 2));
+  const auto yz = _mm_shuffle_ps(a, b, _MM_SHUFFLE(1, 0, 2, 1));
+  return {_mm_shuffle_ps(a, xy, _MM_SHUFFLE(2, 0, 3, 0)),
+          _mm_shuffle_ps(yz, xy, _MM_SHUFFLE(3, 1, 2, 0)),
+          _mm_shuffle_ps(yz, c, _MM_SHUFFLE(3, 0, 3, 1))};
+}
+
+// Inverse of Load4.
+TPH_TARGET("sse2") inline void Store4(const Regs& r, Vec<float, 3>* dst) noexcept {
+  auto* p = &dst->x;
+  const auto xy = _mm_shuffle_ps(r.x, r.y, _MM_SHUFFLE(2, 0, 2, 0));
+  const auto yz = _mm_shuffle_ps(r.y, r.z, _MM_SHUFFLE(3, 1, 3, 1));
+  const auto zx = _mm_shuffle_ps(r.z, r.x, _MM_SHUFFLE(3, 1, 2, 0));
+  _mm_storeu_ps(p, _mm_shuffle_ps(xy, zx, _MM_SHUFFLE(2, 0, 2, 0)));
+  _mm_storeu_ps(p + 4, _mm_shuffle_ps(yz, xy, _MM_SHUFFLE(3, 1, 2, 0)));
+  _mm_storeu_ps(p + 8, _mm_shuffle_ps(zx, yz, _MM_SHUFFLE(3, 1, 3, 1)));
+}
+
+// A vector at p as [x y z 0], loaded as 8 + 4 bytes.
+TPH_TARGET("sse2") inline auto LoadXyz(const unsigned char* p) noexcept -> __m128 {
+  float z;
+  std::memcpy(&z, p + 8, sizeof(z));
+  return _mm_movelh_ps(_mm_castsi128_ps(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(p))),
+                       _mm_set_ss(z));
+}
+
+// [x0 y0 z0 .] [x1 y1 z1 .] [x2 y2 z2 .] [x3 y3 z3 .] -> [x0 x1 x2 x3] [y0 y1 y2 y3] [z0 z1 z2 z3].
+TPH_TARGET("sse2") inline auto Transpose4(const __m128 a,
+                                          const __m128 b,
+                                          const __m128 c,
+                                          const __m128 d) noexcept -> Regs {
+  const auto xy_ab = _mm_unpacklo_ps(a, b); // x0 x1 y0 y1
+  const auto xy_cd = _mm_unpacklo_ps(c, d); // x2 x3 y2 y3
+  return {_mm_movelh_ps(xy_ab, xy_cd),
+          _mm_movehl_ps(xy_cd, xy_ab),
+          _mm_movelh_ps(_mm_unpackhi_ps(a, b), _mm_unpackhi_ps(c, d))};
+}
+
+// Load4 and Store4 for four vectors at a byte stride, e.g. in an interleaved vertex buffer. Load4
+// reads 16 bytes per vector, i.e. 4 bytes past each vector, which are within the view for all but
+// its last vector, see Load4Last. Store4 writes only the 12 bytes of each vector.
+TPH_TARGET("sse2") inline auto Load4(const unsigned char* p, const std::size_t stride) noexcept
+    -> Regs {
+  return Transpose4(_mm_loadu_ps(reinterpret_cast<const float*>(p)),
+                    _mm_loadu_ps(reinterpret_cast<const float*>(p + stride)),
+                    _mm_loadu_ps(reinterpret_cast<const float*>(p + 2 * stride)),
+                    _mm_loadu_ps(reinterpret_cast<const float*>(p + 3 * stride)));
+}
+
+TPH_TARGET("sse2") inline auto Load4Last(const unsigned char* p, const std::size_t stride) noexcept
+    -> Regs {
+  return Transpose4(LoadXyz(p), LoadXyz(p + stride), LoadXyz(p + 2 * stride),
+                    LoadXyz(p + 3 * stride));
+}
+
+TPH_TARGET("sse2") inline void Store4(const Regs& r,
+                                      unsigned char* p,
+                                      const std::size_t stride) noexcept {
+  const auto lo = _mm_unpacklo_ps(r.x, r.y); // x0 y0 x1 y1
+  const auto hi = _mm_unpackhi_ps(r.x, r.y); // x2 y2 x3 y3
+  _mm_storel_pi(reinterpret_cast<__m64*>(p), lo);
+  _mm_storeh_pi(reinterpret_cast<__m64*>(p + stride), lo);
+  _mm_storel_pi(reinterpret_cast<__m64*>(p + 2 * stride), hi);
+  _mm_storeh_pi(reinterpret_cast<__m64*>(p + 3 * stride), hi);
+  float z[4];
+  _mm_storeu_ps(z, r.z);
+  for (std::size_t k = 0; k < 4; ++k) {
+    std::memcpy(p + k * stride + 8, &z[k], sizeof(z[k]));
+  }
+}
+
+// Four vectors at src[i], loaded with Load4Last for the last block of n.
+TPH_TARGET("sse2") inline auto Load4(const StridedVecView<float, 3>& src,
+                                     const std::size_t i) noexcept -> Regs {
+  return i + 4 < src.size ? Load4(src.data + i * src.stride, src.stride)
+                          : Load4Last(src.data + i * src.stride, src.stride);
+}
+
+TPH_TARGET("sse2") inline auto Madd(const __m128 a, const __m128 b, const __m128 c) noexcept
+    -> __m128 {
+  return _mm_add_ps(_mm_mul_ps(a, b), c);
+}
+
+// Row i of m, times (x, y, z) plus t.
+TPH_TARGET("sse2") inline auto Dot3(const __m128 m0,
+                                    const __m128 m1,
+                                    const __m128 m2,
+                                    const Regs& p,
+                                    const __m128 t) noexcept -> __m128 {
+  return Madd(m0, p.x, Madd(m1, p.y, Madd(m2, p.z, t)));
+}
+
+// Matrix elements broadcast to all lanes, e[row][col], loaded once so that they stay in registers
+// across the loop.
+struct Elems {
+  __m128 e[4][3];
+};
+
+template <int M>
+TPH_TARGET("sse2") auto Broadcast(const Mat<float, M, 4>& m) noexcept -> Elems {
+  Elems c{};
+  for (int i = 0; i < M; ++i) {
+    c.e[i][0] = _mm_set1_ps(Comp(m.x, i));
+    c.e[i][1] = _mm_set1_ps(Comp(m.y, i));
+    c.e[i][2] = _mm_set1_ps(Comp(m.z, i));
+  }
+  return c;
+}
+
+template <bool kPoint>
+TPH_TARGET("sse2") void Affine(const Mat<float, 3, 4>& m,
+                               const Vec<float, 3>* src,
+                               Vec<float, 3>* dst,
+                               const std::size_t n) noexcept {
+  const auto c = Broadcast(m);
+  const auto tx = _mm_set1_ps(kPoint ? m.w.x : 0.0F);
+  const auto ty = _mm_set1_ps(kPoint ? m.w.y : 0.0F);
+  const auto tz = _mm_set1_ps(kPoint ? m.w.z : 0.0F);
+  std::size_t i = 0;
+  for (; i + 4 <= n; i += 4) {
+    const auto p = Load4(src + i);
+    Store4({Dot3(c.e[0][0], c.e[0][1], c.e[0][2], p, tx),
+            Dot3(c.e[1][0], c.e[1][1], c.e[1][2], p, ty),
+            Dot3(c.e[2][0], c.e[2][1], c.e[2][2], p, tz)},
+           dst + i);
+  }
+  AffineScalar<kPoint>(m, src + i, dst + i, n - i);
+}
+
+// Affine and Normalized on strided vectors, in-place is fine as above. SSE2 only, the AVX2 and
+// AVX-512 versions would need twice and four times the scalar loads per block, and are no faster.
+template <bool kPoint>
+TPH_TARGET("sse2") void Affine(const Mat<float, 3, 4>& m,
+                               const StridedVecView<float, 3>& src,
+                               const StridedVecSpan<float, 3>& dst) noexcept {
+  const auto c = Broadcast(m);
+  const auto tx = _mm_set1_ps(kPoint ? m.w.x : 0.0F);
+  const auto ty = _mm_set1_ps(kPoint ? m.w.y : 0.0F);
+  const auto tz = _mm_set1_ps(kPoint ? m.w.z : 0.0F);
+  std::size_t i = 0;
+  for (; i + 4 <= src.size; i += 4) {
+    const auto p = Load4(src, i);
+    Store4({Dot3(c.e[0][0], c.e[0][1], c.e[0][2], p, tx),
+            Dot3(c.e[1][0], c.e[1][1], c.e[1][2], p, ty),
+            Dot3(c.e[2][0], c.e[2][1], c.e[2][2], p, tz)},
+           dst.data + i * dst.stride, dst.stride);
+  }
+  AffineScalar<kPoint>(m, Slice(src, i, src.size - i), Slice(dst, i, src.size - i));
+}
+
+// Same operations as Normalized, so the results are the same.
+TPH_TARGET("sse2") inline void Normalize(const StridedVecView<float, 3>& src,
+                                         const StridedVecSpan<float, 3>& dst) noexcept {
+  const auto one = _mm_set1_ps(1.0F);
+  std::size_t i = 0;
+  for (; i + 4 <= src.size; i += 4) {
+    const auto p = Load4(src, i);
+    const auto len2 =
+        _mm_add_ps(_mm_add_ps(_mm_mul_ps(p.x, p.x), _mm_mul_ps(p.y, p.y)), _mm_mul_ps(p.z, p.z));
+    const auto s = _mm_div_ps(one, _mm_sqrt_ps(len2));
+    Store4({_mm_mul_ps(p.x, s), _mm_mul_ps(p.y, s), _mm_mul_ps(p.z, s)},
+           dst.data + i * dst.stride, dst.stride);
+  }
+  NormalizeScalar(Slice(src, i, src.size - i), Slice(dst, i, src.size - i));
+}
+
+TPH_TARGET("sse2") inline void Project(const Mat<float, 4, 4>& m,
+                                       const Vec<float, 3>* src,
+                                       Vec<float, 3>* dst,
+                                       const std::size_t n) noexcept {
+  const auto c = Broadcast(m);
+  const auto tx = _mm_set1_ps(m.w.x);
+  const auto ty = _mm_set1_ps(m.w.y);
+  const auto tz = _mm_set1_ps(m.w.z);
+  const auto tw = _mm_set1_ps(m.w.w);
+  std::size_t i = 0;
+  for (; i + 4 <= n; i += 4) {
+    const auto p = Load4(src + i);
+    const auto w = _mm_div_ps(_mm_set1_ps(1.0F), Dot3(c.e[3][0], c.e[3][1], c.e[3][2], p, tw));
+    Store4({_mm_mul_ps(Dot3(c.e[0][0], c.e[0][1], c.e[0][2], p, tx), w),
+            _mm_mul_ps(Dot3(c.e[1][0], c.e[1][1], c.e[1][2], p, ty), w),
+            _mm_mul_ps(Dot3(c.e[2][0], c.e[2][1], c.e[2][2], p, tz), w)},
+           dst + i);
+  }
+  ProjectScalar(m, src + i, dst + i, n - i);
+}
+
+// 4x4 inverse by 2x2 blocks, one matrix. The columns are loaded as rows, which gives the rows of the
+// inverse of the transpose, i.e. the columns of the inverse. In the comments X# is the adjugate and
+// |X| the determinant of X.
+template <int I, int J, int K, int L>
+TPH_TARGET("sse2") inline auto Shuffle(const __m128 a, const __m128 b) noexcept -> __m128 {
+  return _mm_shuffle_ps(a, b, _MM_SHUFFLE(L, K, J, I));
+}
+
+template <int I, int J, int K, int L>
+TPH_TARGET("sse2") inline auto Swizzle(const __m128 a) noexcept -> __m128 {
+  return _mm_shuffle_ps(a, a, _MM_SHUFFLE(L, K, J, I));
+}
+
+// 2x2 matrices with lanes (m00, m01, m10, m11), A B.
+TPH_TARGET("sse2") inline auto Mul2x2(const __m128 a, const __m128 b) noexcept -> __m128 {
+  return _mm_add_ps(_mm_mul_ps(a, Swizzle<0, 3, 0, 3>(b)),
+                    _mm_mul_ps(Swizzle<1, 0, 3, 2>(a), Swizzle<2, 1, 2, 1>(b)));
+}
+
+// A# B.
+TPH_TARGET("sse2") inline auto AdjMul2x2(const __m128 a, const __m128 b) noexcept -> __m128 {
+  return _mm_sub_ps(_mm_mul_ps(Swizzle<3, 3, 0, 0>(a), b),
+                    _mm_mul_ps(Swizzle<1, 1, 2, 2>(a), Swizzle<2, 3, 0, 1>(b)));
+}
+
+// A B#.
+TPH_TARGET("sse2") inline auto MulAdj2x2(const __m128 a, const __m128 b) noexcept -> __m128 {
+  return _mm_sub_ps(_mm_mul_ps(a, Swizzle<3, 0, 3, 0>(b)),
+                    _mm_mul_ps(Swizzle<1, 0, 3, 2>(a), Swizzle<2, 1, 2, 1>(b)));
+}
+
+struct Cols {
+  __m128 c[4];
+};
+
+TPH_TARGET("sse2") inline auto Inverse4x4(const Cols& m) noexcept -> Cols {
+  // Blocks | A B |
+  //        | C D |.
+  const auto a = Shuffle<0, 1, 0, 1>(m.c[0], m.c[1]);
+  const auto b = Shuffle<2, 3, 2, 3>(m.c[0], m.c[1]);
+  const auto c = Shuffle<0, 1, 0, 1>(m.c[2], m.c[3]);
+  const auto d = Shuffle<2, 3, 2, 3>(m.c[2], m.c[3]);
+
+  // (|A|, |B|, |C|, |D|).
+  const auto even02 = Shuffle<0, 2, 0, 2>(m.c[0], m.c[2]);
+  const auto odd02 = Shuffle<1, 3, 1, 3>(m.c[0], m.c[2]);
+  const auto even13 = Shuffle<0, 2, 0, 2>(m.c[1], m.c[3]);
+  const auto odd13 = Shuffle<1, 3, 1, 3>(m.c[1], m.c[3]);
+  const auto det_sub = _mm_sub_ps(_mm_mul_ps(even02, odd13), _mm_mul_ps(odd02, even13));
+  const auto det_a = Swizzle<0, 0, 0, 0>(det_sub);
+  const auto det_b = Swizzle<1, 1, 1, 1>(det_sub);
+  const auto det_c = Swizzle<2, 2, 2, 2>(det_sub);
+  const auto det_d = Swizzle<3, 3, 3, 3>(det_sub);
+
+  // The inverse is | X Y | / |M|, with
+  //                | Z W |
+  // X# = |D| A - B (D# C), Y# = |B| C - D (A# B)#, Z# = |C| B - A (D# C)#, W# = |A| D - C (A# B).
+  const auto d_c = AdjMul2x2(d, c);
+  const auto a_b = AdjMul2x2(a, b);
+  const auto x = _mm_sub_ps(_mm_mul_ps(det_d, a), Mul2x2(b, d_c));
+  const auto w = _mm_sub_ps(_mm_mul_ps(det_a, d), Mul2x2(c, a_b));
+  const auto y = _mm_sub_ps(_mm_mul_ps(det_b, c), MulAdj2x2(d, a_b));
+  const auto z = _mm_sub_ps(_mm_mul_ps(det_c, b), MulAdj2x2(a, d_c));
+
+  // |M| = |A| |D| + |B| |C| - tr((A# B) (D# C)).
+  auto tr = _mm_mul_ps(a_b, Swizzle<0, 2, 1, 3>(d_c));
+  tr = _mm_add_ps(tr, Swizzle<1, 0, 3, 2>(tr));
+  tr = _mm_add_ps(tr, Swizzle<2, 3, 0, 1>(tr));
+  const auto det_m =
+      _mm_sub_ps(_mm_add_ps(_mm_mul_ps(det_a, det_d), _mm_mul_ps(det_b, det_c)), tr);
+
+  // The adjugate of each block is applied by the signs and the final shuffles.
+  const auto signs = _mm_setr_ps(1.0F, -1.0F, -1.0F, 1.0F);
+  const auto r = _mm_div_ps(signs, det_m);
+  const auto xr = _mm_mul_ps(x, r);
+  const auto yr = _mm_mul_ps(y, r);
+  const auto zr = _mm_mul_ps(z, r);
+  const auto wr = _mm_mul_ps(w, r);
+  return {{Shuffle<3, 1, 3, 1>(xr, yr),
+           Shuffle<2, 0, 2, 0>(xr, yr),
+           Shuffle<3, 1, 3, 1>(zr, wr),
+           Shuffle<2, 0, 2, 0>(zr, wr)}};
+}
+
+TPH_TARGET("sse2") inline void InverseMany(const Mat<float, 4, 4>* src,
+                                           Mat<float, 4, 4>* dst,
+                                           const std::size_t n) noexcept {
+  for (std::size_t i = 0; i < n; ++i) {
+    const auto* p = &src[i].x.x;
+    const auto r = Inverse4x4(
+        {{_mm_loadu_ps(p), _mm_loadu_ps(p + 4), _mm_loadu_ps(p + 8), _mm_loadu_ps(p + 12)}});
+    auto* q = &dst[i].x.x;
+    for (int k = 0; k < 4; ++k) {
+      _mm_storeu_ps(q + 4 * k, r.c[k]);
+    }
+  }
+}
+
+// 4x4 products (float and double) with the columns of the left operand kept in registers. Column k
+// of the product is the sum of the columns of a, each times the broadcast element of column k of b.
+// Column k of b is loaded before column k of dst is stored, so dst may be b.
+TPH_TARGET("sse2") inline auto LoadCols(const Mat<float, 4, 4>& m) noexcept -> Cols {
+  const auto* p = &m.x.x;
+  return {{_mm_loadu_ps(p), _mm_loadu_ps(p + 4), _mm_loadu_ps(p + 8), _mm_loadu_ps(p + 12)}};
+}
+
+TPH_TARGET("sse2") inline void Mul4x4(const Cols& a,
+                                      const Mat<float, 4, 4>& b,
+                                      Mat<float, 4, 4>& dst) noexcept {
+  const auto* p = &b.x.x;
+  __m128 r[4];
+  for (int k = 0; k < 4; ++k) {
+    const auto c = _mm_loadu_ps(p + 4 * k);
+    r[k] = _mm_add_ps(_mm_add_ps(_mm_mul_ps(a.c[0], Swizzle<0, 0, 0, 0>(c)),
+                                 _mm_mul_ps(a.c[1], Swizzle<1, 1, 1, 1>(c))),
+                      _mm_add_ps(_mm_mul_ps(a.c[2], Swizzle<2, 2, 2, 2>(c)),
+                                 _mm_mul_ps(a.c[3], Swizzle<3, 3, 3, 3>(c))));
+  }
+  auto* q = &dst.x.x;
+  for (int k = 0; k < 4; ++k) {
+    _mm_storeu_ps(q + 4 * k, r[k]);
+  }
+}
+
+// Columns of a double matrix as rows 0-1 (lo) and rows 2-3 (hi).
+struct ColsD {
+  __m128d lo[4];
+  __m128d hi[4];
+};
+
+TPH_TARGET("sse2") inline auto LoadCols(const Mat<double, 4, 4>& m) noexcept -> ColsD {
+  const auto* p = &m.x.x;
+  ColsD r;
+  for (int k = 0; k < 4; ++k) {
+    r.lo[k] = _mm_loadu_pd(p + 4 * k);
+    r.hi[k] = _mm_loadu_pd(p + 4 * k + 2);
+  }
+  return r;
+}
+
+TPH_TARGET("sse2") inline void Mul4x4(const ColsD& a,
+                                      const Mat<double, 4, 4>& b,
+                                      Mat<double, 4, 4>& dst) noexcept {
+  const auto* p = &b.x.x;
+  auto* q = &dst.x.x;
+  for (int k = 0; k < 4; ++k) {
+    const auto b01 = _mm_loadu_pd(p + 4 * k);
+    const auto b23 = _mm_loadu_pd(p + 4 * k + 2);
+    const auto b0 = _mm_unpacklo_pd(b01, b01);
+    const auto b1 = _mm_unpackhi_pd(b01, b01);
+    const auto b2 = _mm_unpacklo_pd(b23, b23);
+    const auto b3 = _mm_unpackhi_pd(b23, b23);
+    _mm_storeu_pd(q + 4 * k,
+                  _mm_add_pd(_mm_add_pd(_mm_mul_pd(a.lo[0], b0), _mm_mul_pd(a.lo[1], b1)),
+                             _mm_add_pd(_mm_mul_pd(a.lo[2], b2), _mm_mul_pd(a.lo[3], b3))));
+    _mm_storeu_pd(q + 4 * k + 2,
+                  _mm_add_pd(_mm_add_pd(_mm_mul_pd(a.hi[0], b0), _mm_mul_pd(a.hi[1], b1)),
+                             _mm_add_pd(_mm_mul_pd(a.hi[2], b2), _mm_mul_pd(a.hi[3], b3))));
+  }
+}
+
+// dst[i] = a[i * a_step] * b[i], a_step is 0 (one left operand) or 1.
+template <typename ArithT>
+TPH_TARGET("sse2") inline void MulMany(const Mat<ArithT, 4, 4>* a,
+                                       const std::size_t a_step,
+                                       const Mat<ArithT, 4, 4>* b,
+                                       Mat<ArithT, 4, 4>* dst,
+                                       const std::size_t n) noexcept {
+  if (n == 0) {
+    return;
+  }
+  auto cols = LoadCols(a[0]);
+  for (std::size_t i = 0; i < n; ++i) {
+    if (a_step != 0) {
+      cols = LoadCols(a[i]);
+    }
+    Mul4x4(cols, b[i], dst[i]);
+  }
+}
+
+// Packed unit vectors, the same operations as the scalar Encode and Decode. Ints holds the
+// quantized components of four vectors, z is not used by the octahedral formats.
+struct Ints {
+  __m128i x;
+  __m128i y;
+  __m128i z;
+};
+
+// [x0 y0 x1 y1 ...] as 8-bit integers, sign-extended to pairs of 16-bit integers.
+TPH_TARGET("sse2") inline auto LoadInts(const Oct16* p) noexcept -> Ints {
+  const auto b = _mm_loadl_epi64(reinterpret_cast<const __m128i*>(p));
+  const auto w = _mm_srai_epi16(_mm_unpacklo_epi8(b, b), 8);
+  return {_mm_srai_epi32(_mm_slli_epi32(w, 16), 16), _mm_srai_epi32(w, 16), _mm_setzero_si128()};
+}
+
+TPH_TARGET("sse2") inline auto LoadInts(const Oct32* p) noexcept -> Ints {
+  const auto w = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+  return {_mm_srai_epi32(_mm_slli_epi32(w, 16), 16), _mm_srai_epi32(w, 16), _mm_setzero_si128()};
+}
+
+TPH_TARGET("sse2") inline auto LoadInts(const Snorm1010102* p) noexcept -> Ints {
+  const auto w = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+  return {_mm_srai_epi32(_mm_slli_epi32(w, 22), 22),
+          _mm_srai_epi32(_mm_slli_epi32(w, 12), 22),
+          _mm_srai_epi32(_mm_slli_epi32(w, 2), 22)};
+}
+
+// Each pair as a sign-extended 16-bit integer (y << 8 | x), packed to 16 bits.
+TPH_TARGET("sse2") inline void StoreInts(const Ints& q, Oct16* p) noexcept {
+  const auto yx = _mm_or_si128(_mm_slli_epi32(q.y, 24), _mm_srli_epi32(_mm_slli_epi32(q.x, 24), 8));
+  const auto w = _mm_srai_epi32(yx, 16);
+  _mm_storel_epi64(reinterpret_cast<__m128i*>(p), _mm_packs_epi32(w, w));
+}
+
+TPH_TARGET("sse2") inline void StoreInts(const Ints& q, Oct32* p) noexcept {
+  const auto w = _mm_or_si128(_mm_slli_epi32(q.y, 16), _mm_and_si128(q.x, _mm_set1_epi32(0xffff)));
+  _mm_storeu_si128(reinterpret_cast<__m128i*>(p), w);
+}
+
+TPH_TARGET("sse2") inline void StoreInts(const Ints& q, Snorm1010102* p) noexcept {
+  const auto mask = _mm_set1_epi32(0x3ff);
+  const auto w = _mm_or_si128(_mm_and_si128(q.x, mask),
+                              _mm_or_si128(_mm_slli_epi32(_mm_and_si128(q.y, mask), 10),
+                                           _mm_slli_epi32(_mm_and_si128(q.z, mask), 20)));
+  _mm_storeu_si128(reinterpret_cast<__m128i*>(p), w);
+}
+
+TPH_TARGET("sse2") inline auto Abs(const __m128 a) noexcept -> __m128 {
+  return _mm_andnot_ps(_mm_set1_ps(-0.0F), a);
+}
+
+// a with the sign flipped where p < 0.
+TPH_TARGET("sse2") inline auto FlipIfNegative(const __m128 a, const __m128 p) noexcept -> __m128 {
+  return _mm_xor_ps(a, _mm_and_ps(_mm_cmplt_ps(p, _mm_setzero_ps()), _mm_set1_ps(-0.0F)));
+}
+
+TPH_TARGET("sse2") inline auto Normalize(const Regs& v) noexcept -> Regs {
+  const auto l2 = _mm_add_ps(_mm_add_ps(_mm_mul_ps(v.x, v.x), _mm_mul_ps(v.y, v.y)),
+                             _mm_mul_ps(v.z, v.z));
+  const auto inv = _mm_div_ps(_mm_set1_ps(1.0F), _mm_sqrt_ps(l2));
+  return {_mm_mul_ps(v.x, inv), _mm_mul_ps(v.y, inv), _mm_mul_ps(v.z, inv)};
+}
+
+TPH_TARGET("sse2") inline auto Quantize(const __m128 c, const __m128 max) noexcept -> __m128i {
+  const auto one = _mm_set1_ps(1.0F);
+  const auto clamped = _mm_min_ps(_mm_max_ps(c, _mm_sub_ps(_mm_setzero_ps(), one)), one);
+  const auto half = FlipIfNegative(_mm_set1_ps(0.5F), clamped);
+  return _mm_cvttps_epi32(_mm_add_ps(_mm_mul_ps(clamped, max), half));
+}
+
+template <typename PackedT>
+TPH_TARGET("sse2") auto ToInts(const Regs& v) noexcept -> Ints {
+  const auto max = _mm_set1_ps(PackedTraits<PackedT>::kMax);
+  if (!PackedTraits<PackedT>::kOctahedral) {
+    return {Quantize(v.x, max), Quantize(v.y, max), Quantize(v.z, max)};
+  }
+  const auto inv_l1 =
+      _mm_div_ps(_mm_set1_ps(1.0F), _mm_add_ps(_mm_add_ps(Abs(v.x), Abs(v.y)), Abs(v.z)));
+  const auto px = _mm_mul_ps(v.x, inv_l1);
+  const auto py = _mm_mul_ps(v.y, inv_l1);
+  const auto one = _mm_set1_ps(1.0F);
+  const auto lower = _mm_cmplt_ps(v.z, _mm_setzero_ps());
+  const auto wx = FlipIfNegative(_mm_sub_ps(one, Abs(py)), px);
+  const auto wy = FlipIfNegative(_mm_sub_ps(one, Abs(px)), py);
+  return {Quantize(_mm_or_ps(_mm_and_ps(lower, wx), _mm_andnot_ps(lower, px)), max),
+          Quantize(_mm_or_ps(_mm_and_ps(lower, wy), _mm_andnot_ps(lower, py)), max),
+          _mm_setzero_si128()};
+}
+
+template <typename PackedT>
+TPH_TARGET("sse2") auto ToRegs(const Ints& q) noexcept -> Regs {
+  const auto scale = _mm_set1_ps(1.0F / PackedTraits<PackedT>::kMax);
+  const auto x = _mm_mul_ps(_mm_cvtepi32_ps(q.x), scale);
+  const auto y = _mm_mul_ps(_mm_cvtepi32_ps(q.y), scale);
+  if (!PackedTraits<PackedT>::kOctahedral) {
+    return Normalize({x, y, _mm_mul_ps(_mm_cvtepi32_ps(q.z), scale)});
+  }
+  const auto z = _mm_sub_ps(_mm_sub_ps(_mm_set1_ps(1.0F), Abs(x)), Abs(y));
+  const auto t = _mm_max_ps(_mm_sub_ps(_mm_setzero_ps(), z), _mm_setzero_ps());
+  return Normalize({_mm_sub_ps(x, FlipIfNegative(t, x)), _mm_sub_ps(y, FlipIfNegative(t, y)), z});
+}
+
+template <typename PackedT>
+TPH_TARGET("sse2") void Encode(const Vec<float, 3>* src,
+                               PackedT* dst,
+                               const std::size_t n) noexcept {
+  std::size_t i = 0;
+  for (; i + 4 <= n; i += 4) {
+    StoreInts(ToInts<PackedT>(Load4(src + i)), dst + i);
+  }
+  EncodeScalar(src + i, dst + i, n - i);
+}
+
+template <typename PackedT>
+TPH_TARGET("sse2") void Decode(const PackedT* src,
+                               Vec<float, 3>* dst,
+                               const std::size_t n) noexcept {
+  std::size_t i = 0;
+  for (; i + 4 <= n; i += 4) {
+    Store4(ToRegs<PackedT>(LoadInts(src + i)), dst + i);
+  }
+  DecodeScalar(src + i, dst + i, n - i);
+}
+
+// Reductions, see BoundsScalar, SumScalar, MomentsScalar and DotRangeScalar. The lanes are
+// combined at the end, and the remaining vectors added by the scalar kernels.
+TPH_TARGET("sse2") inline auto HSum(const __m128 a) noexcept -> float {
+  const auto b = _mm_add_ps(a, _mm_movehl_ps(a, a));
+  return _mm_cvtss_f32(_mm_add_ss(b, _mm_shuffle_ps(b, b, _MM_SHUFFLE(1, 1, 1, 1))));
+}
+
+TPH_TARGET("sse2") inline auto HMin(const __m128 a) noexcept -> float {
+  const auto b = _mm_min_ps(a, _mm_movehl_ps(a, a));
+  return _mm_cvtss_f32(_mm_min_ss(b, _mm_shuffle_ps(b, b, _MM_SHUFFLE(1, 1, 1, 1))));
+}
+
+TPH_TARGET("sse2") inline auto HMax(const __m128 a) noexcept -> float {
+  const auto b = _mm_max_ps(a, _mm_movehl_ps(a, a));
+  return _mm_cvtss_f32(_mm_max_ss(b, _mm_shuffle_ps(b, b, _MM_SHUFFLE(1, 1, 1, 1))));
+}
+
+TPH_TARGET("sse2") inline auto Bounds(const Vec<float, 3>* src, const std::size_t n) noexcept
+    -> Aabb<float, 3> {
+  auto lo = Regs{_mm_set1_ps(numeric_limits<float>::infinity()),
+                 _mm_set1_ps(numeric_limits<float>::infinity()),
+                 _mm_set1_ps(numeric_limits<float>::infinity())};
+  auto hi = Regs{_mm_sub_ps(_mm_setzero_ps(), lo.x), _mm_sub_ps(_mm_setzero_ps(), lo.x),
+                 _mm_sub_ps(_mm_setzero_ps(), lo.x)};
+  std::size_t i = 0;
+  for (; i + 4 <= n; i += 4) {
+    const auto p = Load4(src + i);
+    lo = {_mm_min_ps(lo.x, p.x), _mm_min_ps(lo.y, p.y), _mm_min_ps(lo.z, p.z)};
+    hi = {_mm_max_ps(hi.x, p.x), _mm_max_ps(hi.y, p.y), _mm_max_ps(hi.z, p.z)};
+  }
+  const Aabb<float, 3> b = {{HMin(lo.x), HMin(lo.y), HMin(lo.z)},
+                            {HMax(hi.x), HMax(hi.y), HMax(hi.z)}};
+  return Union(b, BoundsScalar(src + i, n - i));
+}
+
+TPH_TARGET("sse2") inline auto Bounds(const StridedVecView<float, 3>& src) noexcept
+    -> Aabb<float, 3> {
+  auto lo = Regs{_mm_set1_ps(numeric_limits<float>::infinity()),
+                 _mm_set1_ps(numeric_limits<float>::infinity()),
+                 _mm_set1_ps(numeric_limits<float>::infinity())};
+  auto hi = Regs{_mm_sub_ps(_mm_setzero_ps(), lo.x), _mm_sub_ps(_mm_setzero_ps(), lo.x),
+                 _mm_sub_ps(_mm_setzero_ps(), lo.x)};
+  std::size_t i = 0;
+  for (; i + 4 <= src.size; i += 4) {
+    const auto p = Load4(src, i);
+    lo = {_mm_min_ps(lo.x, p.x), _mm_min_ps(lo.y, p.y), _mm_min_ps(lo.z, p.z)};
+    hi = {_mm_max_ps(hi.x, p.x), _mm_max_ps(hi.y, p.y), _mm_max_ps(hi.z, p.z)};
+  }
+  const Aabb<float, 3> b = {{HMin(lo.x), HMin(lo.y), HMin(lo.z)},
+                            {HMax(hi.x), HMax(hi.y), HMax(hi.z)}};
+  return Union(b, BoundsScalar(Slice(src, i, src.size - i)));
+}
+
+// Two sets of accumulators, which hides the latency of the additions.
+TPH_TARGET("sse2") inline auto Sum(const Vec<float, 3>* src, const std::size_t n) noexcept
+    -> Vec<float, 3> {
+  auto a = Regs{_mm_setzero_ps(), _mm_setzero_ps(), _mm_setzero_ps()};
+  auto b = a;
+  std::size_t i = 0;
+  for (; i + 8 <= n; i += 8) {
+    const auto p = Load4(src + i);
+    const auto q = Load4(src + i + 4);
+    a = {_mm_add_ps(a.x, p.x), _mm_add_ps(a.y, p.y), _mm_add_ps(a.z, p.z)};
+    b = {_mm_add_ps(b.x, q.x), _mm_add_ps(b.y, q.y), _mm_add_ps(b.z, q.z)};
+  }
+  if (i + 4 <= n) {
+    const auto p = Load4(src + i);
+    a = {_mm_add_ps(a.x, p.x), _mm_add_ps(a.y, p.y), _mm_add_ps(a.z, p.z)};
+    i += 4;
+  }
+  const auto r = SumScalar<float>(src + i, n - i);
+  return {HSum(_mm_add_ps(a.x, b.x)) + r.x,
+          HSum(_mm_add_ps(a.y, b.y)) + r.y,
+          HSum(_mm_add_ps(a.z, b.z)) + r.z};
+}
+
+TPH_TARGET("sse2") inline auto CenteredMoments(const Vec<float, 3>* src,
+                                               const std::size_t n,
+                                               const Vec<float, 3>& c) noexcept
+    -> Moments<float> {
+  const auto cx = _mm_set1_ps(c.x);
+  const auto cy = _mm_set1_ps(c.y);
+  const auto cz = _mm_set1_ps(c.z);
+  auto d = Regs{_mm_setzero_ps(), _mm_setzero_ps(), _mm_setzero_ps()};
+  auto o = d;
+  std::size_t i = 0;
+  for (; i + 4 <= n; i += 4) {
+    const auto p = Load4(src + i);
+    const auto x = _mm_sub_ps(p.x, cx);
+    const auto y = _mm_sub_ps(p.y, cy);
+    const auto z = _mm_sub_ps(p.z, cz);
+    d = {Madd(x, x, d.x), Madd(y, y, d.y), Madd(z, z, d.z)};
+    o = {Madd(x, y, o.x), Madd(x, z, o.y), Madd(y, z, o.z)};
+  }
+  const auto r = MomentsScalar(src + i, n - i, c);
+  return {{HSum(d.x) + r.diag.x, HSum(d.y) + r.diag.y, HSum(d.z) + r.diag.z},
+          {HSum(o.x) + r.off.x, HSum(o.y) + r.off.y, HSum(o.z) + r.off.z}};
+}
+
+TPH_TARGET("sse2") inline auto DotRange(const Vec<float, 3>* src,
+                                        const std::size_t n,
+                                        const Vec<float, 3>& d) noexcept -> Vec<float, 2> {
+  const auto dx = _mm_set1_ps(d.x);
+  const auto dy = _mm_set1_ps(d.y);
+  const auto dz = _mm_set1_ps(d.z);
+  auto lo = _mm_set1_ps(numeric_limits<float>::infinity());
+  auto hi = _mm_sub_ps(_mm_setzero_ps(), lo);
+  std::size_t i = 0;
+  for (; i + 4 <= n; i += 4) {
+    const auto p = Load4(src + i);
+    const auto t = Madd(p.z, dz, Madd(p.y, dy, _mm_mul_ps(p.x, dx)));
+    lo = _mm_min_ps(lo, t);
+    hi = _mm_max_ps(hi, t);
+  }
+  const auto r = DotRangeScalar(src + i, n - i, d);
+  const auto a = HMin(lo);
+  const auto b = HMax(hi);
+  return {r.x < a ? r.x : a, b < r.y ? r.y : b};
+}
+
+} // namespace sse2
+#endif // TPH_HAS_SSE2 || TPH_ALL_KERNELS
+
+#if TPH_HAS_AVX2 || TPH_ALL_KERNELS
+namespace avx2 {
+
+struct Regs {
+  __m256 x;
+  __m256 y;
+  __m256 z;
+};
+
+// Same shuffles as sse2::Load4, vectors 0-3 in the lower and 4-7 in the upper 128-bit lane.
+TPH_TARGET("avx2,fma") inline auto Deinterleave(const __m256 a,
+                                                const __m256 b,
+                                                const __m256 c) noexcept -> Regs {
+  const auto xy = _mm256_shuffle_ps(b, c, _MM_SHUFFLE(2, 1, 3, 2));
+  const auto yz = _mm256_shuffle_ps(a, b, _MM_SHUFFLE(1, 0, 2, 1));
+  return {_mm256_shuffle_ps(a, xy, _MM_SHUFFLE(2, 0, 3, 0)),
+          _mm256_shuffle_ps(yz, xy, _MM_SHUFFLE(3, 1, 2, 0)),
+          _mm256_shuffle_ps(yz, c, _MM_SHUFFLE(3, 0, 3, 1))};
+}
+
+// Inverse of Deinterleave.
+TPH_TARGET("avx2,fma") inline void Interleave(const Regs& r,
+                                              __m256* a,
+                                              __m256* b,
+                                              __m256* c) noexcept {
+  const auto xy = _mm256_shuffle_ps(r.x, r.y, _MM_SHUFFLE(2, 0, 2, 0));
+  const auto yz = _mm256_shuffle_ps(r.y, r.z, _MM_SHUFFLE(3, 1, 3, 1));
+  const auto zx = _mm256_shuffle_ps(r.z, r.x, _MM_SHUFFLE(3, 1, 2, 0));
+  *a = _mm256_shuffle_ps(xy, zx, _MM_SHUFFLE(2, 0, 2, 0));
+  *b = _mm256_shuffle_ps(yz, xy, _MM_SHUFFLE(3, 1, 2, 0));
+  *c = _mm256_shuffle_ps(zx, yz, _MM_SHUFFLE(3, 1, 3, 1));
+}
+
+TPH_TARGET("avx2,fma") inline auto Load8(const Vec<float, 3>* src) noexcept -> Regs {
+  const auto* p = &src->x;
+  const auto a = _mm256_insertf128_ps(_mm256_castps128_ps256(_mm_loadu_ps(p)), _mm_loadu_ps(p + 12), 1);
+  const auto b =
+      _mm256_insertf128_ps(_mm256_castps128_ps256(_mm_loadu_ps(p + 4)), _mm_loadu_ps(p + 16), 1);
+  const auto c =
+      _mm256_insertf128_ps(_mm256_castps128_ps256(_mm_loadu_ps(p + 8)), _mm_loadu_ps(p + 20), 1);
+  return Deinterleave(a, b, c);
+}
+
+TPH_TARGET("avx2,fma") inline void Store8(const Regs& r, Vec<float, 3>* dst) noexcept {
+  auto* p = &dst->x;
+  __m256 a;
+  __m256 b;
+  __m256 c;
+  Interleave(r, &a, &b, &c);
+  _mm_storeu_ps(p, _mm256_castps256_ps128(a));
+  _mm_storeu_ps(p + 4, _mm256_castps256_ps128(b));
+  _mm_storeu_ps(p + 8, _mm256_castps256_ps128(c));
+  _mm_storeu_ps(p + 12, _mm256_extractf128_ps(a, 1));
+  _mm_storeu_ps(p + 16, _mm256_extractf128_ps(b, 1));
+  _mm_storeu_ps(p + 20, _mm256_extractf128_ps(c, 1));
+}
+
+// Half versions of Load8 and Store8, the same layout with 64-bit loads and stores of four halves
+// converted to and from float in registers. These and the half kernels below also need F16C, and
+// are separate from the float kernels so that those do not.
+TPH_TARGET("avx2,fma,f16c") inline auto Load2x4(const half* p) noexcept -> __m256 {
+  const auto lo = _mm_loadl_epi64(reinterpret_cast<const __m128i*>(p));
+  const auto hi = _mm_loadl_epi64(reinterpret_cast<const __m128i*>(p + 12));
+  return _mm256_cvtph_ps(_mm_unpacklo_epi64(lo, hi));
+}
+
+TPH_TARGET("avx2,fma,f16c") inline void Store2x4(const __m256 r, half* p) noexcept {
+  const auto h = _mm256_cvtps_ph(r, _MM_FROUND_TO_NEAREST_INT);
+  _mm_storel_epi64(reinterpret_cast<__m128i*>(p), h);
+  _mm_storel_epi64(reinterpret_cast<__m128i*>(p + 12), _mm_unpackhi_epi64(h, h));
+}
+
+TPH_TARGET("avx2,fma,f16c") inline auto Load8(const Vec<half, 3>* src) noexcept -> Regs {
+  const auto* p = &src->x;
+  return Deinterleave(Load2x4(p), Load2x4(p + 4), Load2x4(p + 8));
+}
+
+TPH_TARGET("avx2,fma,f16c") inline void Store8(const Regs& r, Vec<half, 3>* dst) noexcept {
+  auto* p = &dst->x;
+  __m256 a;
+  __m256 b;
+  __m256 c;
+  Interleave(r, &a, &b, &c);
+  Store2x4(a, p);
+  Store2x4(b, p + 4);
+  Store2x4(c, p + 8);
+}
+
+TPH_TARGET("avx2,fma") inline auto Dot3(const __m256 m0,
+                                        const __m256 m1,
+                                        const __m256 m2,
+                                        const Regs& p,
+                                        const __m256 t) noexcept -> __m256 {
+  return _mm256_fmadd_ps(m0, p.x, _mm256_fmadd_ps(m1, p.y, _mm256_fmadd_ps(m2, p.z, t)));
+}
+
+// Matrix elements broadcast to all lanes, e[row][col], loaded once so that they stay in registers
+// across the loop.
+struct Elems {
+  __m256 e[4][3];
+};
+
+template <int M>
+TPH_TARGET("avx2,fma") auto Broadcast(const Mat<float, M, 4>& m) noexcept -> Elems {
+  Elems c{};
+  for (int i = 0; i < M; ++i) {
+    c.e[i][0] = _mm256_set1_ps(Comp(m.x, i));
+    c.e[i][1] = _mm256_set1_ps(Comp(m.y, i));
+    c.e[i][2] = _mm256_set1_ps(Comp(m.z, i));
+  }
+  return c;
+}
+
+template <bool kPoint>
+TPH_TARGET("avx2,fma") void Affine(const Mat<float, 3, 4>& m,
+                                   const Vec<float, 3>* src,
+                                   Vec<float, 3>* dst,
+                                   const std::size_t n) noexcept {
+  const auto c = Broadcast(m);
+  const auto tx = _mm256_set1_ps(kPoint ? m.w.x : 0.0F);
+  const auto ty = _mm256_set1_ps(kPoint ? m.w.y : 0.0F);
+  const auto tz = _mm256_set1_ps(kPoint ? m.w.z : 0.0F);
+  std::size_t i = 0;
+  for (; i + 8 <= n; i += 8) {
+    const auto p = Load8(src + i);
+    Store8({Dot3(c.e[0][0], c.e[0][1], c.e[0][2], p, tx),
+            Dot3(c.e[1][0], c.e[1][1], c.e[1][2], p, ty),
+            Dot3(c.e[2][0], c.e[2][1], c.e[2][2], p, tz)},
+           dst + i);
+  }
+  AffineScalar<kPoint>(m, src + i, dst + i, n - i);
+}
+
+TPH_TARGET("avx2,fma") inline void Project(const Mat<float, 4, 4>& m,
+                                           const Vec<float, 3>* src,
+                                           Vec<float, 3>* dst,
+                                           const std::size_t n) noexcept {
+  const auto c = Broadcast(m);
+  const auto tx = _mm256_set1_ps(m.w.x);
+  const auto ty = _mm256_set1_ps(m.w.y);
+  const auto tz = _mm256_set1_ps(m.w.z);
+  const auto tw = _mm256_set1_ps(m.w.w);
+  std::size_t i = 0;
+  for (; i + 8 <= n; i += 8) {
+    const auto p = Load8(src + i);
+    const auto w = _mm256_div_ps(_mm256_set1_ps(1.0F), Dot3(c.e[3][0], c.e[3][1], c.e[3][2], p, tw));
+    Store8({_mm256_mul_ps(Dot3(c.e[0][0], c.e[0][1], c.e[0][2], p, tx), w),
+            _mm256_mul_ps(Dot3(c.e[1][0], c.e[1][1], c.e[1][2], p, ty), w),
+            _mm256_mul_ps(Dot3(c.e[2][0], c.e[2][1], c.e[2][2], p, tz), w)},
+           dst + i);
+  }
+  ProjectScalar(m, src + i, dst + i, n - i);
+}
+
+template <bool kPoint>
+TPH_TARGET("avx2,fma,f16c") void Affine(const Mat<float, 3, 4>& m,
+                                        const Vec<half, 3>* src,
+                                        Vec<half, 3>* dst,
+                                        const std::size_t n) noexcept {
+  const auto c = Broadcast(m);
+  const auto tx = _mm256_set1_ps(kPoint ? m.w.x : 0.0F);
+  const auto ty = _mm256_set1_ps(kPoint ? m.w.y : 0.0F);
+  const auto tz = _mm256_set1_ps(kPoint ? m.w.z : 0.0F);
+  std::size_t i = 0;
+  for (; i + 8 <= n; i += 8) {
+    const auto p = Load8(src + i);
+    Store8({Dot3(c.e[0][0], c.e[0][1], c.e[0][2], p, tx),
+            Dot3(c.e[1][0], c.e[1][1], c.e[1][2], p, ty),
+            Dot3(c.e[2][0], c.e[2][1], c.e[2][2], p, tz)},
+           dst + i);
+  }
+  AffineScalar<kPoint>(m, src + i, dst + i, n - i);
+}
+
+TPH_TARGET("avx2,fma,f16c") inline void Project(const Mat<float, 4, 4>& m,
+                                                const Vec<half, 3>* src,
+                                                Vec<half, 3>* dst,
+                                                const std::size_t n) noexcept {
+  const auto c = Broadcast(m);
+  const auto tx = _mm256_set1_ps(m.w.x);
+  const auto ty = _mm256_set1_ps(m.w.y);
+  const auto tz = _mm256_set1_ps(m.w.z);
+  const auto tw = _mm256_set1_ps(m.w.w);
+  std::size_t i = 0;
+  for (; i + 8 <= n; i += 8) {
+    const auto p = Load8(src + i);
+    const auto w = _mm256_div_ps(_mm256_set1_ps(1.0F), Dot3(c.e[3][0], c.e[3][1], c.e[3][2], p, tw));
+    Store8({_mm256_mul_ps(Dot3(c.e[0][0], c.e[0][1], c.e[0][2], p, tx), w),
+            _mm256_mul_ps(Dot3(c.e[1][0], c.e[1][1], c.e[1][2], p, ty), w),
+            _mm256_mul_ps(Dot3(c.e[2][0], c.e[2][1], c.e[2][2], p, tz), w)},
+           dst + i);
+  }
+  ProjectScalar(m, src + i, dst + i, n - i);
+}
+
+TPH_TARGET("avx2,fma,f16c") inline void Widen(const half* src,
+                                              float* dst,
+                                              const std::size_t n) noexcept {
+  std::size_t i = 0;
+  for (; i + 8 <= n; i += 8) {
+    const auto h = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i));
+    _mm256_storeu_ps(dst + i, _mm256_cvtph_ps(h));
+  }
+  WidenScalar(src + i, dst + i, n - i);
+}
+
+TPH_TARGET("avx2,fma,f16c") inline void Narrow(const float* src,
+                                               half* dst,
+                                               const std::size_t n) noexcept {
+  std::size_t i = 0;
+  for (; i + 8 <= n; i += 8) {
+    const auto h = _mm256_cvtps_ph(_mm256_loadu_ps(src + i), _MM_FROUND_TO_NEAREST_INT);
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i), h);
+  }
+  NarrowScalar(src + i, dst + i, n - i);
+}
+
+// 4x4 inverse by 2x2 blocks, two matrices at once, one per 128-bit lane. The columns are loaded
+// as rows, which gives the rows of the inverse of the transpose, i.e. the columns of the inverse. In
+// the comments X# is the adjugate and |X| the determinant of X.
+template <int I, int J, int K, int L>
+TPH_TARGET("avx2,fma") inline auto Shuffle(const __m256 a, const __m256 b) noexcept -> __m256 {
+  return _mm256_shuffle_ps(a, b, _MM_SHUFFLE(L, K, J, I));
+}
+
+template <int I, int J, int K, int L>
+TPH_TARGET("avx2,fma") inline auto Swizzle(const __m256 a) noexcept -> __m256 {
+  return _mm256_permute_ps(a, _MM_SHUFFLE(L, K, J, I));
+}
+
+// 2x2 matrices with lanes (m00, m01, m10, m11), A B.
+TPH_TARGET("avx2,fma") inline auto Mul2x2(const __m256 a, const __m256 b) noexcept -> __m256 {
+  return _mm256_add_ps(_mm256_mul_ps(a, Swizzle<0, 3, 0, 3>(b)),
+                    _mm256_mul_ps(Swizzle<1, 0, 3, 2>(a), Swizzle<2, 1, 2, 1>(b)));
+}
+
+// A# B.
+TPH_TARGET("avx2,fma") inline auto AdjMul2x2(const __m256 a, const __m256 b) noexcept -> __m256 {
+  return _mm256_sub_ps(_mm256_mul_ps(Swizzle<3, 3, 0, 0>(a), b),
+                    _mm256_mul_ps(Swizzle<1, 1, 2, 2>(a), Swizzle<2, 3, 0, 1>(b)));
+}
+
+// A B#.
+TPH_TARGET("avx2,fma") inline auto MulAdj2x2(const __m256 a, const __m256 b) noexcept -> __m256 {
+  return _mm256_sub_ps(_mm256_mul_ps(a, Swizzle<3, 0, 3, 0>(b)),
+                    _mm256_mul_ps(Swizzle<1, 0, 3, 2>(a), Swizzle<2, 1, 2, 1>(b)));
+}
+
+struct Cols {
+  __m256 c[4];
+};
+
+TPH_TARGET("avx2,fma") inline auto Inverse4x4(const Cols& m) noexcept -> Cols {
+  // Blocks | A B |
+  //        | C D |.
+  const auto a = Shuffle<0, 1, 0, 1>(m.c[0], m.c[1]);
+  const auto b = Shuffle<2, 3, 2, 3>(m.c[0], m.c[1]);
+  const auto c = Shuffle<0, 1, 0, 1>(m.c[2], m.c[3]);
+  const auto d = Shuffle<2, 3, 2, 3>(m.c[2], m.c[3]);
+
+  // (|A|, |B|, |C|, |D|).
+  const auto even02 = Shuffle<0, 2, 0, 2>(m.c[0], m.c[2]);
+  const auto odd02 = Shuffle<1, 3, 1, 3>(m.c[0], m.c[2]);
+  const auto even13 = Shuffle<0, 2, 0, 2>(m.c[1], m.c[3]);
+  const auto odd13 = Shuffle<1, 3, 1, 3>(m.c[1], m.c[3]);
+  const auto det_sub = _mm256_sub_ps(_mm256_mul_ps(even02, odd13), _mm256_mul_ps(odd02, even13));
+  const auto det_a = Swizzle<0, 0, 0, 0>(det_sub);
+  const auto det_b = Swizzle<1, 1, 1, 1>(det_sub);
+  const auto det_c = Swizzle<2, 2, 2, 2>(det_sub);
+  const auto det_d = Swizzle<3, 3, 3, 3>(det_sub);
+
+  // The inverse is | X Y | / |M|, with
+  //                | Z W |
+  // X# = |D| A - B (D# C), Y# = |B| C - D (A# B)#, Z# = |C| B - A (D# C)#, W# = |A| D - C (A# B).
+  const auto d_c = AdjMul2x2(d, c);
+  const auto a_b = AdjMul2x2(a, b);
+  const auto x = _mm256_sub_ps(_mm256_mul_ps(det_d, a), Mul2x2(b, d_c));
+  const auto w = _mm256_sub_ps(_mm256_mul_ps(det_a, d), Mul2x2(c, a_b));
+  const auto y = _mm256_sub_ps(_mm256_mul_ps(det_b, c), MulAdj2x2(d, a_b));
+  const auto z = _mm256_sub_ps(_mm256_mul_ps(det_c, b), MulAdj2x2(a, d_c));
+
+  // |M| = |A| |D| + |B| |C| - tr((A# B) (D# C)).
+  auto tr = _mm256_mul_ps(a_b, Swizzle<0, 2, 1, 3>(d_c));
+  tr = _mm256_add_ps(tr, Swizzle<1, 0, 3, 2>(tr));
+  tr = _mm256_add_ps(tr, Swizzle<2, 3, 0, 1>(tr));
+  const auto det_m =
+      _mm256_sub_ps(_mm256_add_ps(_mm256_mul_ps(det_a, det_d), _mm256_mul_ps(det_b, det_c)), tr);
+
+  // The adjugate of each block is applied by the signs and the final shuffles.
+  const auto signs = _mm256_setr_ps(1.0F, -1.0F, -1.0F, 1.0F, 1.0F, -1.0F, -1.0F, 1.0F);
+  const auto r = _mm256_div_ps(signs, det_m);
+  const auto xr = _mm256_mul_ps(x, r);
+  const auto yr = _mm256_mul_ps(y, r);
+  const auto zr = _mm256_mul_ps(z, r);
+  const auto wr = _mm256_mul_ps(w, r);
+  return {{Shuffle<3, 1, 3, 1>(xr, yr),
+           Shuffle<2, 0, 2, 0>(xr, yr),
+           Shuffle<3, 1, 3, 1>(zr, wr),
+           Shuffle<2, 0, 2, 0>(zr, wr)}};
+}
+
+// Two matrices per iteration, the last odd one by the SSE2 kernel.
+TPH_TARGET("avx2,fma") inline void InverseMany(const Mat<float, 4, 4>* src,
+                                               Mat<float, 4, 4>* dst,
+                                               const std::size_t n) noexcept {
+  std::size_t i = 0;
+  for (; i + 2 <= n; i += 2) {
+    const auto* p = &src[i].x.x;
+    Cols m;
+    for (int k = 0; k < 4; ++k) {
+      m.c[k] = _mm256_insertf128_ps(
+          _mm256_castps128_ps256(_mm_loadu_ps(p + 4 * k)), _mm_loadu_ps(p + 16 + 4 * k), 1);
+    }
+    const auto r = Inverse4x4(m);
+    auto* q = &dst[i].x.x;
+    for (int k = 0; k < 4; ++k) {
+      _mm_storeu_ps(q + 4 * k, _mm256_castps256_ps128(r.c[k]));
+      _mm_storeu_ps(q + 16 + 4 * k, _mm256_extractf128_ps(r.c[k], 1));
+    }
+  }
+  sse2::InverseMany(src + i, dst + i, n - i);
+}
+
+// 4x4 products as in sse2, two columns of the product per register. The columns of a are
+// broadcast to both 128-bit lanes.
+TPH_TARGET("avx2,fma") inline auto LoadCols(const Mat<float, 4, 4>& m) noexcept -> Cols {
+  const auto* p = &m.x.x;
+  Cols r;
+  for (int k = 0; k < 4; ++k) {
+    r.c[k] = _mm256_broadcast_ps(reinterpret_cast<const __m128*>(p + 4 * k));
+  }
+  return r;
+}
+
+TPH_TARGET("avx2,fma") inline void Mul4x4(const Cols& a,
+                                          const Mat<float, 4, 4>& b,
+                                          Mat<float, 4, 4>& dst) noexcept {
+  const auto* p = &b.x.x;
+  __m256 r[2];
+  for (int k = 0; k < 2; ++k) {
+    const auto c = _mm256_loadu_ps(p + 8 * k);
+    auto t = _mm256_mul_ps(a.c[0], Swizzle<0, 0, 0, 0>(c));
+    t = _mm256_fmadd_ps(a.c[1], Swizzle<1, 1, 1, 1>(c), t);
+    t = _mm256_fmadd_ps(a.c[2], Swizzle<2, 2, 2, 2>(c), t);
+    r[k] = _mm256_fmadd_ps(a.c[3], Swizzle<3, 3, 3, 3>(c), t);
+  }
+  auto* q = &dst.x.x;
+  _mm256_storeu_ps(q, r[0]);
+  _mm256_storeu_ps(q + 8, r[1]);
+}
+
+struct ColsD {
+  __m256d c[4];
+};
+
+TPH_TARGET("avx2,fma") inline auto LoadCols(const Mat<double, 4, 4>& m) noexcept -> ColsD {
+  const auto* p = &m.x.x;
+  return {{_mm256_loadu_pd(p), _mm256_loadu_pd(p + 4), _mm256_loadu_pd(p + 8),
+           _mm256_loadu_pd(p + 12)}};
+}
+
+TPH_TARGET("avx2,fma") inline void Mul4x4(const ColsD& a,
+                                          const Mat<double, 4, 4>& b,
+                                          Mat<double, 4, 4>& dst) noexcept {
+  const auto* p = &b.x.x;
+  __m256d r[4];
+  for (int k = 0; k < 4; ++k) {
+    auto t = _mm256_mul_pd(a.c[0], _mm256_broadcast_sd(p + 4 * k));
+    t = _mm256_fmadd_pd(a.c[1], _mm256_broadcast_sd(p + 4 * k + 1), t);
+    t = _mm256_fmadd_pd(a.c[2], _mm256_broadcast_sd(p + 4 * k + 2), t);
+    r[k] = _mm256_fmadd_pd(a.c[3], _mm256_broadcast_sd(p + 4 * k + 3), t);
+  }
+  auto* q = &dst.x.x;
+  for (int k = 0; k < 4; ++k) {
+    _mm256_storeu_pd(q + 4 * k, r[k]);
+  }
+}
+
+// dst[i] = a[i * a_step] * b[i], a_step is 0 (one left operand) or 1.
+template <typename ArithT>
+TPH_TARGET("avx2,fma") inline void MulMany(const Mat<ArithT, 4, 4>* a,
+                                           const std::size_t a_step,
+                                           const Mat<ArithT, 4, 4>* b,
+                                           Mat<ArithT, 4, 4>* dst,
+                                           const std::size_t n) noexcept {
+  if (n == 0) {
+    return;
+  }
+  auto cols = LoadCols(a[0]);
+  for (std::size_t i = 0; i < n; ++i) {
+    if (a_step != 0) {
+      cols = LoadCols(a[i]);
+    }
+    Mul4x4(cols, b[i], dst[i]);
+  }
+}
+
+// Packed unit vectors, see sse2::ToInts. Vectors 0-3 are in the lower and 4-7 in the upper 128-bit
+// lane, as for Load8.
+struct Ints {
+  __m256i x;
+  __m256i y;
+  __m256i z;
+};
+
+TPH_TARGET("avx2,fma") inline auto LoadInts(const Oct16* p) noexcept -> Ints {
+  const auto w = _mm256_cvtepi8_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i*>(p)));
+  return {_mm256_srai_epi32(_mm256_slli_epi32(w, 16), 16),
+          _mm256_srai_epi32(w, 16),
+          _mm256_setzero_si256()};
+}
+
+TPH_TARGET("avx2,fma") inline auto LoadInts(const Oct32* p) noexcept -> Ints {
+  const auto w = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p));
+  return {_mm256_srai_epi32(_mm256_slli_epi32(w, 16), 16),
+          _mm256_srai_epi32(w, 16),
+          _mm256_setzero_si256()};
+}
+
+TPH_TARGET("avx2,fma") inline auto LoadInts(const Snorm1010102* p) noexcept -> Ints {
+  const auto w = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p));
+  return {_mm256_srai_epi32(_mm256_slli_epi32(w, 22), 22),
+          _mm256_srai_epi32(_mm256_slli_epi32(w, 12), 22),
+          _mm256_srai_epi32(_mm256_slli_epi32(w, 2), 22)};
+}
+
+TPH_TARGET("avx2,fma") inline void StoreInts(const Ints& q, Oct16* p) noexcept {
+  const auto yx = _mm256_or_si256(_mm256_slli_epi32(q.y, 24),
+                                  _mm256_srli_epi32(_mm256_slli_epi32(q.x, 24), 8));
+  const auto w = _mm256_srai_epi32(yx, 16);
+  _mm_storeu_si128(reinterpret_cast<__m128i*>(p),
+                   _mm_packs_epi32(_mm256_castsi256_si128(w), _mm256_extracti128_si256(w, 1)));
+}
+
+TPH_TARGET("avx2,fma") inline void StoreInts(const Ints& q, Oct32* p) noexcept {
+  const auto w = _mm256_or_si256(_mm256_slli_epi32(q.y, 16),
+                                 _mm256_and_si256(q.x, _mm256_set1_epi32(0xffff)));
+  _mm256_storeu_si256(reinterpret_cast<__m256i*>(p), w);
+}
+
+TPH_TARGET("avx2,fma") inline void StoreInts(const Ints& q, Snorm1010102* p) noexcept {
+  const auto mask = _mm256_set1_epi32(0x3ff);
+  const auto y = _mm256_slli_epi32(_mm256_and_si256(q.y, mask), 10);
+  const auto z = _mm256_slli_epi32(_mm256_and_si256(q.z, mask), 20);
+  const auto w = _mm256_or_si256(_mm256_and_si256(q.x, mask), _mm256_or_si256(y, z));
+  _mm256_storeu_si256(reinterpret_cast<__m256i*>(p), w);
+}
+
+TPH_TARGET("avx2,fma") inline auto Abs(const __m256 a) noexcept -> __m256 {
+  return _mm256_andnot_ps(_mm256_set1_ps(-0.0F), a);
+}
+
+TPH_TARGET("avx2,fma") inline auto FlipIfNegative(const __m256 a, const __m256 p) noexcept
+    -> __m256 {
+  const auto negative = _mm256_cmp_ps(p, _mm256_setzero_ps(), _CMP_LT_OQ);
+  return _mm256_xor_ps(a, _mm256_and_ps(negative, _mm256_set1_ps(-0.0F)));
+}
+
+TPH_TARGET("avx2,fma") inline auto Normalize(const Regs& v) noexcept -> Regs {
+  const auto l2 = _mm256_fmadd_ps(v.z, v.z, _mm256_fmadd_ps(v.y, v.y, _mm256_mul_ps(v.x, v.x)));
+  const auto inv = _mm256_div_ps(_mm256_set1_ps(1.0F), _mm256_sqrt_ps(l2));
+  return {_mm256_mul_ps(v.x, inv), _mm256_mul_ps(v.y, inv), _mm256_mul_ps(v.z, inv)};
+}
+
+TPH_TARGET("avx2,fma") inline auto Quantize(const __m256 c, const __m256 max) noexcept -> __m256i {
+  const auto one = _mm256_set1_ps(1.0F);
+  const auto clamped =
+      _mm256_min_ps(_mm256_max_ps(c, _mm256_sub_ps(_mm256_setzero_ps(), one)), one);
+  const auto half = FlipIfNegative(_mm256_set1_ps(0.5F), clamped);
+  return _mm256_cvttps_epi32(_mm256_fmadd_ps(clamped, max, half));
+}
+
+template <typename PackedT>
+TPH_TARGET("avx2,fma") auto ToInts(const Regs& v) noexcept -> Ints {
+  const auto max = _mm256_set1_ps(PackedTraits<PackedT>::kMax);
+  if (!PackedTraits<PackedT>::kOctahedral) {
+    return {Quantize(v.x, max), Quantize(v.y, max), Quantize(v.z, max)};
+  }
+  const auto inv_l1 = _mm256_div_ps(_mm256_set1_ps(1.0F),
+                                    _mm256_add_ps(_mm256_add_ps(Abs(v.x), Abs(v.y)), Abs(v.z)));
+  const auto px = _mm256_mul_ps(v.x, inv_l1);
+  const auto py = _mm256_mul_ps(v.y, inv_l1);
+  const auto one = _mm256_set1_ps(1.0F);
+  const auto lower = _mm256_cmp_ps(v.z, _mm256_setzero_ps(), _CMP_LT_OQ);
+  const auto wx = FlipIfNegative(_mm256_sub_ps(one, Abs(py)), px);
+  const auto wy = FlipIfNegative(_mm256_sub_ps(one, Abs(px)), py);
+  return {Quantize(_mm256_blendv_ps(px, wx, lower), max),
+          Quantize(_mm256_blendv_ps(py, wy, lower), max),
+          _mm256_setzero_si256()};
+}
+
+template <typename PackedT>
+TPH_TARGET("avx2,fma") auto ToRegs(const Ints& q) noexcept -> Regs {
+  const auto scale = _mm256_set1_ps(1.0F / PackedTraits<PackedT>::kMax);
+  const auto x = _mm256_mul_ps(_mm256_cvtepi32_ps(q.x), scale);
+  const auto y = _mm256_mul_ps(_mm256_cvtepi32_ps(q.y), scale);
+  if (!PackedTraits<PackedT>::kOctahedral) {
+    return Normalize({x, y, _mm256_mul_ps(_mm256_cvtepi32_ps(q.z), scale)});
+  }
+  const auto z = _mm256_sub_ps(_mm256_sub_ps(_mm256_set1_ps(1.0F), Abs(x)), Abs(y));
+  const auto t = _mm256_max_ps(_mm256_sub_ps(_mm256_setzero_ps(), z), _mm256_setzero_ps());
+  return Normalize(
+      {_mm256_sub_ps(x, FlipIfNegative(t, x)), _mm256_sub_ps(y, FlipIfNegative(t, y)), z});
+}
+
+template <typename PackedT>
+TPH_TARGET("avx2,fma") void Encode(const Vec<float, 3>* src,
+                                   PackedT* dst,
+                                   const std::size_t n) noexcept {
+  std::size_t i = 0;
+  for (; i + 8 <= n; i += 8) {
+    StoreInts(ToInts<PackedT>(Load8(src + i)), dst + i);
+  }
+  EncodeScalar(src + i, dst + i, n - i);
+}
+
+template <typename PackedT>
+TPH_TARGET("avx2,fma") void Decode(const PackedT* src,
+                                   Vec<float, 3>* dst,
+                                   const std::size_t n) noexcept {
+  std::size_t i = 0;
+  for (; i + 8 <= n; i += 8) {
+    Store8(ToRegs<PackedT>(LoadInts(src + i)), dst + i);
+  }
+  DecodeScalar(src + i, dst + i, n - i);
+}
+
+// Reductions as in sse2, eight vectors per block.
+TPH_TARGET("avx2,fma") inline auto HSum(const __m256 a) noexcept -> float {
+  return sse2::HSum(_mm_add_ps(_mm256_castps256_ps128(a), _mm256_extractf128_ps(a, 1)));
+}
+
+TPH_TARGET("avx2,fma") inline auto HMin(const __m256 a) noexcept -> float {
+  return sse2::HMin(_mm_min_ps(_mm256_castps256_ps128(a), _mm256_extractf128_ps(a, 1)));
+}
+
+TPH_TARGET("avx2,fma") inline auto HMax(const __m256 a) noexcept -> float {
+  return sse2::HMax(_mm_max_ps(_mm256_castps256_ps128(a), _mm256_extractf128_ps(a, 1)));
+}
+
+TPH_TARGET("avx2,fma") inline auto Bounds(const Vec<float, 3>* src, const std::size_t n) noexcept
+    -> Aabb<float, 3> {
+  const auto inf = _mm256_set1_ps(numeric_limits<float>::infinity());
+  const auto neg_inf = _mm256_sub_ps(_mm256_setzero_ps(), inf);
+  auto lo = Regs{inf, inf, inf};
+  auto hi = Regs{neg_inf, neg_inf, neg_inf};
+  std::size_t i = 0;
+  for (; i + 8 <= n; i += 8) {
+    const auto p = Load8(src + i);
+    lo = {_mm256_min_ps(lo.x, p.x), _mm256_min_ps(lo.y, p.y), _mm256_min_ps(lo.z, p.z)};
+    hi = {_mm256_max_ps(hi.x, p.x), _mm256_max_ps(hi.y, p.y), _mm256_max_ps(hi.z, p.z)};
+  }
+  const Aabb<float, 3> b = {{HMin(lo.x), HMin(lo.y), HMin(lo.z)},
+                            {HMax(hi.x), HMax(hi.y), HMax(hi.z)}};
+  return Union(b, BoundsScalar(src + i, n - i));
+}
+
+TPH_TARGET("avx2,fma") inline auto Sum(const Vec<float, 3>* src, const std::size_t n) noexcept
+    -> Vec<float, 3> {
+  auto a = Regs{_mm256_setzero_ps(), _mm256_setzero_ps(), _mm256_setzero_ps()};
+  auto b = a;
+  std::size_t i = 0;
+  for (; i + 16 <= n; i += 16) {
+    const auto p = Load8(src + i);
+    const auto q = Load8(src + i + 8);
+    a = {_mm256_add_ps(a.x, p.x), _mm256_add_ps(a.y, p.y), _mm256_add_ps(a.z, p.z)};
+    b = {_mm256_add_ps(b.x, q.x), _mm256_add_ps(b.y, q.y), _mm256_add_ps(b.z, q.z)};
+  }
+  if (i + 8 <= n) {
+    const auto p = Load8(src + i);
+    a = {_mm256_add_ps(a.x, p.x), _mm256_add_ps(a.y, p.y), _mm256_add_ps(a.z, p.z)};
+    i += 8;
+  }
+  const auto r = SumScalar<float>(src + i, n - i);
+  return {HSum(_mm256_add_ps(a.x, b.x)) + r.x,
+          HSum(_mm256_add_ps(a.y, b.y)) + r.y,
+          HSum(_mm256_add_ps(a.z, b.z)) + r.z};
+}
+
+TPH_TARGET("avx2,fma") inline auto CenteredMoments(const Vec<float, 3>* src,
+                                                   const std::size_t n,
+                                                   const Vec<float, 3>& c) noexcept
+    -> Moments<float> {
+  const auto cx = _mm256_set1_ps(c.x);
+  const auto cy = _mm256_set1_ps(c.y);
+  const auto cz = _mm256_set1_ps(c.z);
+  auto d = Regs{_mm256_setzero_ps(), _mm256_setzero_ps(), _mm256_setzero_ps()};
+  auto o = d;
+  std::size_t i = 0;
+  for (; i + 8 <= n; i += 8) {
+    const auto p = Load8(src + i);
+    const auto x = _mm256_sub_ps(p.x, cx);
+    const auto y = _mm256_sub_ps(p.y, cy);
+    const auto z = _mm256_sub_ps(p.z, cz);
+    d = {_mm256_fmadd_ps(x, x, d.x), _mm256_fmadd_ps(y, y, d.y), _mm256_fmadd_ps(z, z, d.z)};
+    o = {_mm256_fmadd_ps(x, y, o.x), _mm256_fmadd_ps(x, z, o.y), _mm256_fmadd_ps(y, z, o.z)};
+  }
+  const auto r = MomentsScalar(src + i, n - i, c);
+  return {{HSum(d.x) + r.diag.x, HSum(d.y) + r.diag.y, HSum(d.z) + r.diag.z},
+          {HSum(o.x) + r.off.x, HSum(o.y) + r.off.y, HSum(o.z) + r.off.z}};
+}
+
+TPH_TARGET("avx2,fma") inline auto DotRange(const Vec<float, 3>* src,
+                                            const std::size_t n,
+                                            const Vec<float, 3>& d) noexcept -> Vec<float, 2> {
+  const auto dx = _mm256_set1_ps(d.x);
+  const auto dy = _mm256_set1_ps(d.y);
+  const auto dz = _mm256_set1_ps(d.z);
+  auto lo = _mm256_set1_ps(numeric_limits<float>::infinity());
+  auto hi = _mm256_sub_ps(_mm256_setzero_ps(), lo);
+  std::size_t i = 0;
+  for (; i + 8 <= n; i += 8) {
+    const auto p = Load8(src + i);
+    const auto t = _mm256_fmadd_ps(p.z, dz, _mm256_fmadd_ps(p.y, dy, _mm256_mul_ps(p.x, dx)));
+    lo = _mm256_min_ps(lo, t);
+    hi = _mm256_max_ps(hi, t);
+  }
+  const auto r = DotRangeScalar(src + i, n - i, d);
+  const auto a = HMin(lo);
+  const auto b = HMax(hi);
+  return {r.x < a ? r.x : a, b < r.y ? r.y : b};
+}
+
+} // namespace avx2
+#endif // TPH_HAS_AVX2 || TPH_ALL_KERNELS
+
+#if TPH_HAS_AVX512F || TPH_ALL_KERNELS
+#if defined(__GNUC__) && !defined(__clang__)
+// GCC 12 warns about the undefined pass-through operand inside the AVX-512 intrinsics.
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wuninitialized"
+#pragma GCC diagnostic ignored "-Wmaybe-uninitialized"
+#endif
+namespace avx512 {
+
+struct Regs {
+  __m512 x;
+  __m512 y;
+  __m512 z;
+};
+
+// Same shuffles as sse2::Load4, with four vectors in each 128-bit lane.
+TPH_TARGET("avx512f") inline auto Load3x4(const float* p) noexcept -> __m512 {
+  auto r = _mm512_castps128_ps512(_mm_loadu_ps(p));
+  r = _mm512_insertf32x4(r, _mm_loadu_ps(p + 12), 1);
+  r = _mm512_insertf32x4(r, _mm_loadu_ps(p + 24), 2);
+  return _mm512_insertf32x4(r, _mm_loadu_ps(p + 36), 3);
+}
+
+TPH_TARGET("avx512f") inline void Store3x4(const __m512 r, float* p) noexcept {
+  _mm_storeu_ps(p, _mm512_castps512_ps128(r));
+  _mm_storeu_ps(p + 12, _mm512_extractf32x4_ps(r, 1));
+  _mm_storeu_ps(p + 24, _mm512_extractf32x4_ps(r, 2));
+  _mm_storeu_ps(p + 36, _mm512_extractf32x4_ps(r, 3));
+}
+
+// Half versions of Load3x4 and Store3x4, 64-bit loads and stores of four halves converted to and
+// from float in registers.
+TPH_TARGET("avx512f") inline auto Load4Halves(const half* p) noexcept -> __m128i {
+  return _mm_loadl_epi64(reinterpret_cast<const __m128i*>(p));
+}
+
+TPH_TARGET("avx512f") inline void Store4Halves(const __m128i h, half* p) noexcept {
+  _mm_storel_epi64(reinterpret_cast<__m128i*>(p), h);
+}
+
+TPH_TARGET("avx512f") inline auto Load3x4(const half* p) noexcept -> __m512 {
+  const auto lo = _mm_unpacklo_epi64(Load4Halves(p), Load4Halves(p + 12));
+  const auto hi = _mm_unpacklo_epi64(Load4Halves(p + 24), Load4Halves(p + 36));
+  return _mm512_cvtph_ps(_mm256_insertf128_si256(_mm256_castsi128_si256(lo), hi, 1));
+}
+
+TPH_TARGET("avx512f") inline void Store3x4(const __m512 r, half* p) noexcept {
+  const auto h = _mm512_cvtps_ph(r, _MM_FROUND_TO_NEAREST_INT);
+  const auto lo = _mm256_castsi256_si128(h);
+  const auto hi = _mm256_extractf128_si256(h, 1);
+  Store4Halves(lo, p);
+  Store4Halves(_mm_unpackhi_epi64(lo, lo), p + 12);
+  Store4Halves(hi, p + 24);
+  Store4Halves(_mm_unpackhi_epi64(hi, hi), p + 36);
+}
+
+// StorageT is float or half.
+template <typename StorageT>
+TPH_TARGET("avx512f") auto Load16(const Vec<StorageT, 3>* src) noexcept -> Regs {
+  const auto* p = &src->x;
+  const auto a = Load3x4(p);
+  const auto b = Load3x4(p + 4);
+  const auto c = Load3x4(p + 8);
+  const auto xy = _mm512_shuffle_ps(b, c, _MM_SHUFFLE(2, 1, 3, 2));
+  const auto yz = _mm512_shuffle_ps(a, b, _MM_SHUFFLE(1, 0, 2, 1));
+  return {_mm512_shuffle_ps(a, xy, _MM_SHUFFLE(2, 0, 3, 0)),
+          _mm512_shuffle_ps(yz, xy, _MM_SHUFFLE(3, 1, 2, 0)),
+          _mm512_shuffle_ps(yz, c, _MM_SHUFFLE(3, 0, 3, 1))};
+}
+
+template <typename StorageT>
+TPH_TARGET("avx512f") void Store16(const Regs& r, Vec<StorageT, 3>* dst) noexcept {
+  auto* p = &dst->x;
+  const auto xy = _mm512_shuffle_ps(r.x, r.y, _MM_SHUFFLE(2, 0, 2, 0));
+  const auto yz = _mm512_shuffle_ps(r.y, r.z, _MM_SHUFFLE(3, 1, 3, 1));
+  const auto zx = _mm512_shuffle_ps(r.z, r.x, _MM_SHUFFLE(3, 1, 2, 0));
+  Store3x4(_mm512_shuffle_ps(xy, zx, _MM_SHUFFLE(2, 0, 2, 0)), p);
+  Store3x4(_mm512_shuffle_ps(yz, xy, _MM_SHUFFLE(3, 1, 2, 0)), p + 4);
+  Store3x4(_mm512_shuffle_ps(zx, yz, _MM_SHUFFLE(3, 1, 3, 1)), p + 8);
+}
+
+TPH_TARGET("avx512f") inline auto Dot3(const __m512 m0,
+                                       const __m512 m1,
+                                       const __m512 m2,
+                                       const Regs& p,
+                                       const __m512 t) noexcept -> __m512 {
+  return _mm512_fmadd_ps(
+      m0,
+      p.x,
+      _mm512_fmadd_ps(m1, p.y, _mm512_fmadd_ps(m2, p.z, t)));
+}
+
+// Matrix elements broadcast to all lanes, e[row][col], loaded once so that they stay in registers
+// across the loop.
+struct Elems {
+  __m512 e[4][3];
+};
+
+template <int M>
+TPH_TARGET("avx512f") auto Broadcast(const Mat<float, M, 4>& m) noexcept -> Elems {
+  Elems c{};
+  for (int i = 0; i < M; ++i) {
+    c.e[i][0] = _mm512_set1_ps(Comp(m.x, i));
+    c.e[i][1] = _mm512_set1_ps(Comp(m.y, i));
+    c.e[i][2] = _mm512_set1_ps(Comp(m.z, i));
+  }
+  return c;
+}
+
+// StorageT is float or half, half vectors are converted to and from float in registers.
+template <bool kPoint, typename StorageT>
+TPH_TARGET("avx512f") void Affine(const Mat<float, 3, 4>& m,
+                                  const Vec<StorageT, 3>* src,
+                                  Vec<StorageT, 3>* dst,
+                                  const std::size_t n) noexcept {
+  const auto c = Broadcast(m);
+  const auto tx = _mm512_set1_ps(kPoint ? m.w.x : 0.0F);
+  const auto ty = _mm512_set1_ps(kPoint ? m.w.y : 0.0F);
+  const auto tz = _mm512_set1_ps(kPoint ? m.w.z : 0.0F);
+  std::size_t i = 0;
+  for (; i + 16 <= n; i += 16) {
+    const auto p = Load16(src + i);
+    Store16({Dot3(c.e[0][0], c.e[0][1], c.e[0][2], p, tx),
+             Dot3(c.e[1][0], c.e[1][1], c.e[1][2], p, ty),
+             Dot3(c.e[2][0], c.e[2][1], c.e[2][2], p, tz)},
+            dst + i);
+  }
+  AffineScalar<kPoint>(m, src + i, dst + i, n - i);
+}
+
+template <typename StorageT>
+TPH_TARGET("avx512f") void Project(const Mat<float, 4, 4>& m,
+                                   const Vec<StorageT, 3>* src,
+                                   Vec<StorageT, 3>* dst,
+                                   const std::size_t n) noexcept {
+  const auto c = Broadcast(m);
+  const auto tx = _mm512_set1_ps(m.w.x);
+  const auto ty = _mm512_set1_ps(m.w.y);
+  const auto tz = _mm512_set1_ps(m.w.z);
+  const auto tw = _mm512_set1_ps(m.w.w);
+  std::size_t i = 0;
+  for (; i + 16 <= n; i += 16) {
+    const auto p = Load16(src + i);
+    const auto w = _mm512_div_ps(_mm512_set1_ps(1.0F), Dot3(c.e[3][0], c.e[3][1], c.e[3][2], p, tw));
+    Store16({_mm512_mul_ps(Dot3(c.e[0][0], c.e[0][1], c.e[0][2], p, tx), w),
+             _mm512_mul_ps(Dot3(c.e[1][0], c.e[1][1], c.e[1][2], p, ty), w),
+             _mm512_mul_ps(Dot3(c.e[2][0], c.e[2][1], c.e[2][2], p, tz), w)},
+            dst + i);
+  }
+  ProjectScalar(m, src + i, dst + i, n - i);
+}
+
+TPH_TARGET("avx512f") inline void Widen(const half* src, float* dst, const std::size_t n) noexcept {
+  std::size_t i = 0;
+  for (; i + 16 <= n; i += 16) {
+    const auto h = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + i));
+    _mm512_storeu_ps(dst + i, _mm512_cvtph_ps(h));
+  }
+  WidenScalar(src + i, dst + i, n - i);
+}
+
+TPH_TARGET("avx512f") inline void Narrow(const float* src, half* dst, const std::size_t n) noexcept {
+  std::size_t i = 0;
+  for (; i + 16 <= n; i += 16) {
+    const auto h = _mm512_cvtps_ph(_mm512_loadu_ps(src + i), _MM_FROUND_TO_NEAREST_INT);
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + i), h);
+  }
+  NarrowScalar(src + i, dst + i, n - i);
+}
+
+// 4x4 inverse by 2x2 blocks, four matrices at once, one per 128-bit lane. The columns are loaded
+// as rows, which gives the rows of the inverse of the transpose, i.e. the columns of the inverse. In
+// the comments X# is the adjugate and |X| the determinant of X.
+template <int I, int J, int K, int L>
+TPH_TARGET("avx512f") inline auto Shuffle(const __m512 a, const __m512 b) noexcept -> __m512 {
+  return _mm512_shuffle_ps(a, b, _MM_SHUFFLE(L, K, J, I));
+}
+
+template <int I, int J, int K, int L>
+TPH_TARGET("avx512f") inline auto Swizzle(const __m512 a) noexcept -> __m512 {
+  return _mm512_permute_ps(a, _MM_SHUFFLE(L, K, J, I));
+}
+
+// 2x2 matrices with lanes (m00, m01, m10, m11), A B.
+TPH_TARGET("avx512f") inline auto Mul2x2(const __m512 a, const __m512 b) noexcept -> __m512 {
+  return _mm512_add_ps(_mm512_mul_ps(a, Swizzle<0, 3, 0, 3>(b)),
+                    _mm512_mul_ps(Swizzle<1, 0, 3, 2>(a), Swizzle<2, 1, 2, 1>(b)));
+}
+
+// A# B.
+TPH_TARGET("avx512f") inline auto AdjMul2x2(const __m512 a, const __m512 b) noexcept -> __m512 {
+  return _mm512_sub_ps(_mm512_mul_ps(Swizzle<3, 3, 0, 0>(a), b),
+                    _mm512_mul_ps(Swizzle<1, 1, 2, 2>(a), Swizzle<2, 3, 0, 1>(b)));
+}
+
+// A B#.
+TPH_TARGET("avx512f") inline auto MulAdj2x2(const __m512 a, const __m512 b) noexcept -> __m512 {
+  return _mm512_sub_ps(_mm512_mul_ps(a, Swizzle<3, 0, 3, 0>(b)),
+                    _mm512_mul_ps(Swizzle<1, 0, 3, 2>(a), Swizzle<2, 1, 2, 1>(b)));
+}
+
+struct Cols {
+  __m512 c[4];
+};
+
+TPH_TARGET("avx512f") inline auto Inverse4x4(const Cols& m) noexcept -> Cols {
+  // Blocks | A B |
+  //        | C D |.
+  const auto a = Shuffle<0, 1, 0, 1>(m.c[0], m.c[1]);
+  const auto b = Shuffle<2, 3, 2, 3>(m.c[0], m.c[1]);
+  const auto c = Shuffle<0, 1, 0, 1>(m.c[2], m.c[3]);
+  const auto d = Shuffle<2, 3, 2, 3>(m.c[2], m.c[3]);
+
+  // (|A|, |B|, |C|, |D|).
+  const auto even02 = Shuffle<0, 2, 0, 2>(m.c[0], m.c[2]);
+  const auto odd02 = Shuffle<1, 3, 1, 3>(m.c[0], m.c[2]);
+  const auto even13 = Shuffle<0, 2, 0, 2>(m.c[1], m.c[3]);
+  const auto odd13 = Shuffle<1, 3, 1, 3>(m.c[1], m.c[3]);
+  const auto det_sub = _mm512_sub_ps(_mm512_mul_ps(even02, odd13), _mm512_mul_ps(odd02, even13));
+  const auto det_a = Swizzle<0, 0, 0, 0>(det_sub);
+  const auto det_b = Swizzle<1, 1, 1, 1>(det_sub);
+  const auto det_c = Swizzle<2, 2, 2, 2>(det_sub);
+  const auto det_d = Swizzle<3, 3, 3, 3>(det_sub);
+
+  // The inverse is | X Y | / |M|, with
+  //                | Z W |
+  // X# = |D| A - B (D# C), Y# = |B| C - D (A# B)#, Z# = |C| B - A (D# C)#, W# = |A| D - C (A# B).
+  const auto d_c = AdjMul2x2(d, c);
+  const auto a_b = AdjMul2x2(a, b);
+  const auto x = _mm512_sub_ps(_mm512_mul_ps(det_d, a), Mul2x2(b, d_c));
+  const auto w = _mm512_sub_ps(_mm512_mul_ps(det_a, d), Mul2x2(c, a_b));
+  const auto y = _mm512_sub_ps(_mm512_mul_ps(det_b, c), MulAdj2x2(d, a_b));
+  const auto z = _mm512_sub_ps(_mm512_mul_ps(det_c, b), MulAdj2x2(a, d_c));
+
+  // |M| = |A| |D| + |B| |C| - tr((A# B) (D# C)).
+  auto tr = _mm512_mul_ps(a_b, Swizzle<0, 2, 1, 3>(d_c));
+  tr = _mm512_add_ps(tr, Swizzle<1, 0, 3, 2>(tr));
+  tr = _mm512_add_ps(tr, Swizzle<2, 3, 0, 1>(tr));
+  const auto det_m =
+      _mm512_sub_ps(_mm512_add_ps(_mm512_mul_ps(det_a, det_d), _mm512_mul_ps(det_b, det_c)), tr);
+
+  // The adjugate of each block is applied by the signs and the final shuffles.
+  const auto signs = _mm512_setr_ps(1.0F, -1.0F, -1.0F, 1.0F, 1.0F, -1.0F, -1.0F, 1.0F,
+                                    1.0F, -1.0F, -1.0F, 1.0F, 1.0F, -1.0F, -1.0F, 1.0F);
+  const auto r = _mm512_div_ps(signs, det_m);
+  const auto xr = _mm512_mul_ps(x, r);
+  const auto yr = _mm512_mul_ps(y, r);
+  const auto zr = _mm512_mul_ps(z, r);
+  const auto wr = _mm512_mul_ps(w, r);
+  return {{Shuffle<3, 1, 3, 1>(xr, yr),
+           Shuffle<2, 0, 2, 0>(xr, yr),
+           Shuffle<3, 1, 3, 1>(zr, wr),
+           Shuffle<2, 0, 2, 0>(zr, wr)}};
+}
+
+// Four matrices per iteration, the remaining ones by the SSE2 kernel.
+TPH_TARGET("avx512f") inline void InverseMany(const Mat<float, 4, 4>* src,
+                                              Mat<float, 4, 4>* dst,
+                                              const std::size_t n) noexcept {
+  std::size_t i = 0;
+  for (; i + 4 <= n; i += 4) {
+    const auto* p = &src[i].x.x;
+    Cols m;
+    for (int k = 0; k < 4; ++k) {
+      auto c = _mm512_castps128_ps512(_mm_loadu_ps(p + 4 * k));
+      c = _mm512_insertf32x4(c, _mm_loadu_ps(p + 16 + 4 * k), 1);
+      c = _mm512_insertf32x4(c, _mm_loadu_ps(p + 32 + 4 * k), 2);
+      m.c[k] = _mm512_insertf32x4(c, _mm_loadu_ps(p + 48 + 4 * k), 3);
+    }
+    const auto r = Inverse4x4(m);
+    auto* q = &dst[i].x.x;
+    for (int k = 0; k < 4; ++k) {
+      _mm_storeu_ps(q + 4 * k, _mm512_castps512_ps128(r.c[k]));
+      _mm_storeu_ps(q + 16 + 4 * k, _mm512_extractf32x4_ps(r.c[k], 1));
+      _mm_storeu_ps(q + 32 + 4 * k, _mm512_extractf32x4_ps(r.c[k], 2));
+      _mm_storeu_ps(q + 48 + 4 * k, _mm512_extractf32x4_ps(r.c[k], 3));
+    }
+  }
+  sse2::InverseMany(src + i, dst + i, n - i);
+}
+
+// 4x4 products as in sse2, a whole float product (or two columns of a double product) per
+// register. The columns of a are broadcast to all 128-bit (256-bit for double) lanes.
+TPH_TARGET("avx512f") inline auto LoadCols(const Mat<float, 4, 4>& m) noexcept -> Cols {
+  const auto* p = &m.x.x;
+  Cols r;
+  for (int k = 0; k < 4; ++k) {
+    r.c[k] = _mm512_broadcast_f32x4(_mm_loadu_ps(p + 4 * k));
+  }
+  return r;
+}
+
+TPH_TARGET("avx512f") inline void Mul4x4(const Cols& a,
+                                         const Mat<float, 4, 4>& b,
+                                         Mat<float, 4, 4>& dst) noexcept {
+  const auto c = _mm512_loadu_ps(&b.x.x);
+  auto t = _mm512_mul_ps(a.c[0], Swizzle<0, 0, 0, 0>(c));
+  t = _mm512_fmadd_ps(a.c[1], Swizzle<1, 1, 1, 1>(c), t);
+  t = _mm512_fmadd_ps(a.c[2], Swizzle<2, 2, 2, 2>(c), t);
+  _mm512_storeu_ps(&dst.x.x, _mm512_fmadd_ps(a.c[3], Swizzle<3, 3, 3, 3>(c), t));
+}
+
+struct ColsD {
+  __m512d c[4];
+};
+
+TPH_TARGET("avx512f") inline auto LoadCols(const Mat<double, 4, 4>& m) noexcept -> ColsD {
+  const auto* p = &m.x.x;
+  ColsD r;
+  for (int k = 0; k < 4; ++k) {
+    r.c[k] = _mm512_broadcast_f64x4(_mm256_loadu_pd(p + 4 * k));
+  }
+  return r;
+}
+
+// Element I of each 256-bit lane broadcast to the lane.
+template <int I>
+TPH_TARGET("avx512f") inline auto Broadcast4(const __m512d a) noexcept -> __m512d {
+  return _mm512_permutex_pd(a, _MM_SHUFFLE(I, I, I, I));
+}
+
+TPH_TARGET("avx512f") inline void Mul4x4(const ColsD& a,
+                                         const Mat<double, 4, 4>& b,
+                                         Mat<double, 4, 4>& dst) noexcept {
+  const auto* p = &b.x.x;
+  __m512d r[2];
+  for (int k = 0; k < 2; ++k) {
+    const auto c = _mm512_loadu_pd(p + 8 * k);
+    auto t = _mm512_mul_pd(a.c[0], Broadcast4<0>(c));
+    t = _mm512_fmadd_pd(a.c[1], Broadcast4<1>(c), t);
+    t = _mm512_fmadd_pd(a.c[2], Broadcast4<2>(c), t);
+    r[k] = _mm512_fmadd_pd(a.c[3], Broadcast4<3>(c), t);
+  }
+  auto* q = &dst.x.x;
+  _mm512_storeu_pd(q, r[0]);
+  _mm512_storeu_pd(q + 8, r[1]);
+}
+
+// dst[i] = a[i * a_step] * b[i], a_step is 0 (one left operand) or 1.
+template <typename ArithT>
+TPH_TARGET("avx512f") inline void MulMany(const Mat<ArithT, 4, 4>* a,
+                                          const std::size_t a_step,
+                                          const Mat<ArithT, 4, 4>* b,
+                                          Mat<ArithT, 4, 4>* dst,
+                                          const std::size_t n) noexcept {
+  if (n == 0) {
+    return;
+  }
+  auto cols = LoadCols(a[0]);
+  for (std::size_t i = 0; i < n; ++i) {
+    if (a_step != 0) {
+      cols = LoadCols(a[i]);
+    }
+    Mul4x4(cols, b[i], dst[i]);
+  }
+}
+
+// Reductions as in sse2, sixteen vectors per block.
+TPH_TARGET("avx512f") inline auto Bounds(const Vec<float, 3>* src, const std::size_t n) noexcept
+    -> Aabb<float, 3> {
+  const auto inf = _mm512_set1_ps(numeric_limits<float>::infinity());
+  const auto neg_inf = _mm512_sub_ps(_mm512_setzero_ps(), inf);
+  auto lo = Regs{inf, inf, inf};
+  auto hi = Regs{neg_inf, neg_inf, neg_inf};
+  std::size_t i = 0;
+  for (; i + 16 <= n; i += 16) {
+    const auto p = Load16(src + i);
+    lo = {_mm512_min_ps(lo.x, p.x), _mm512_min_ps(lo.y, p.y), _mm512_min_ps(lo.z, p.z)};
+    hi = {_mm512_max_ps(hi.x, p.x), _mm512_max_ps(hi.y, p.y), _mm512_max_ps(hi.z, p.z)};
+  }
+  const Aabb<float, 3> b = {
+      {_mm512_reduce_min_ps(lo.x), _mm512_reduce_min_ps(lo.y), _mm512_reduce_min_ps(lo.z)},
+      {_mm512_reduce_max_ps(hi.x), _mm512_reduce_max_ps(hi.y), _mm512_reduce_max_ps(hi.z)}};
+  return Union(b, BoundsScalar(src + i, n - i));
+}
+
+TPH_TARGET("avx512f") inline auto Sum(const Vec<float, 3>* src, const std::size_t n) noexcept
+    -> Vec<float, 3> {
+  auto a = Regs{_mm512_setzero_ps(), _mm512_setzero_ps(), _mm512_setzero_ps()};
+  auto b = a;
+  std::size_t i = 0;
+  for (; i + 32 <= n; i += 32) {
+    const auto p = Load16(src + i);
+    const auto q = Load16(src + i + 16);
+    a = {_mm512_add_ps(a.x, p.x), _mm512_add_ps(a.y, p.y), _mm512_add_ps(a.z, p.z)};
+    b = {_mm512_add_ps(b.x, q.x), _mm512_add_ps(b.y, q.y), _mm512_add_ps(b.z, q.z)};
+  }
+  if (i + 16 <= n) {
+    const auto p = Load16(src + i);
+    a = {_mm512_add_ps(a.x, p.x), _mm512_add_ps(a.y, p.y), _mm512_add_ps(a.z, p.z)};
+    i += 16;
+  }
+  const auto r = SumScalar<float>(src + i, n - i);
+  return {_mm512_reduce_add_ps(_mm512_add_ps(a.x, b.x)) + r.x,
+          _mm512_reduce_add_ps(_mm512_add_ps(a.y, b.y)) + r.y,
+          _mm512_reduce_add_ps(_mm512_add_ps(a.z, b.z)) + r.z};
+}
+
+TPH_TARGET("avx512f") inline auto CenteredMoments(const Vec<float, 3>* src,
+                                                  const std::size_t n,
+                                                  const Vec<float, 3>& c) noexcept
+    -> Moments<float> {
+  const auto cx = _mm512_set1_ps(c.x);
+  const auto cy = _mm512_set1_ps(c.y);
+  const auto cz = _mm512_set1_ps(c.z);
+  auto d = Regs{_mm512_setzero_ps(), _mm512_setzero_ps(), _mm512_setzero_ps()};
+  auto o = d;
+  std::size_t i = 0;
+  for (; i + 16 <= n; i += 16) {
+    const auto p = Load16(src + i);
+    const auto x = _mm512_sub_ps(p.x, cx);
+    const auto y = _mm512_sub_ps(p.y, cy);
+    const auto z = _mm512_sub_ps(p.z, cz);
+    d = {_mm512_fmadd_ps(x, x, d.x), _mm512_fmadd_ps(y, y, d.y), _mm512_fmadd_ps(z, z, d.z)};
+    o = {_mm512_fmadd_ps(x, y, o.x), _mm512_fmadd_ps(x, z, o.y), _mm512_fmadd_ps(y, z, o.z)};
+  }
+  const auto r = MomentsScalar(src + i, n - i, c);
+  return {{_mm512_reduce_add_ps(d.x) + r.diag.x,
+           _mm512_reduce_add_ps(d.y) + r.diag.y,
+           _mm512_reduce_add_ps(d.z) + r.diag.z},
+          {_mm512_reduce_add_ps(o.x) + r.off.x,
+           _mm512_reduce_add_ps(o.y) + r.off.y,
+           _mm512_reduce_add_ps(o.z) + r.off.z}};
+}
+
+TPH_TARGET("avx512f") inline auto DotRange(const Vec<float, 3>* src,
+                                           const std::size_t n,
+                                           const Vec<float, 3>& d) noexcept -> Vec<float, 2> {
+  const auto dx = _mm512_set1_ps(d.x);
+  const auto dy = _mm512_set1_ps(d.y);
+  const auto dz = _mm512_set1_ps(d.z);
+  auto lo = _mm512_set1_ps(numeric_limits<float>::infinity());
+  auto hi = _mm512_sub_ps(_mm512_setzero_ps(), lo);
+  std::size_t i = 0;
+  for (; i + 16 <= n; i += 16) {
+    const auto p = Load16(src + i);
+    const auto t = _mm512_fmadd_ps(p.z, dz, _mm512_fmadd_ps(p.y, dy, _mm512_mul_ps(p.x, dx)));
+    lo = _mm512_min_ps(lo, t);
+    hi = _mm512_max_ps(hi, t);
+  }
+  const auto r = DotRangeScalar(src + i, n - i, d);
+  const auto a = _mm512_reduce_min_ps(lo);
+  const auto b = _mm512_reduce_max_ps(hi);
+  return {r.x < a ? r.x : a, b < r.y ? r.y : b};
+}
+
+} // namespace avx512
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic pop
+#endif
+#endif // TPH_HAS_AVX512F || TPH_ALL_KERNELS
+
+// Kernel selection, the widest instruction set enabled for the including translation unit.
+template <bool kPoint, typename ArithT>
+void Affine(const Mat<ArithT, 3, 4>& m,
+            const Vec<ArithT, 3>* src,
+            Vec<ArithT, 3>* dst,
+            const std::size_t n) noexcept {
+  AffineScalar<kPoint>(m, src, dst, n);
+}
+
+template <bool kPoint>
+void Affine(const Mat<float, 3, 4>& m,
+            const Vec<float, 3>* src,
+            Vec<float, 3>* dst,
+            const std::size_t n) noexcept {
+#if TPH_HAS_AVX512F
+  avx512::Affine<kPoint>(m, src, dst, n);
+#elif TPH_HAS_AVX2
+  avx2::Affine<kPoint>(m, src, dst, n);
+#elif TPH_HAS_SSE2
+  sse2::Affine<kPoint>(m, src, dst, n);
+#else
+  AffineScalar<kPoint>(m, src, dst, n);
+#endif
+}
+
+template <typename ArithT>
+void Project(const Mat<ArithT, 4, 4>& m,
+             const Vec<ArithT, 3>* src,
+             Vec<ArithT, 3>* dst,
+             const std::size_t n) noexcept {
+  ProjectScalar(m, src, dst, n);
+}
+
+inline void Project(const Mat<float, 4, 4>& m,
+                    const Vec<float, 3>* src,
+                    Vec<float, 3>* dst,
+                    const std::size_t n) noexcept {
+#if TPH_HAS_AVX512F
+  avx512::Project(m, src, dst, n);
+#elif TPH_HAS_AVX2
+  avx2::Project(m, src, dst, n);
+#elif TPH_HAS_SSE2
+  sse2::Project(m, src, dst, n);
+#else
+  ProjectScalar(m, src, dst, n);
+#endif
+}
+
+// Half kernels need F16C with AVX2, AVX-512F has its own conversions.
+template <bool kPoint>
+void Affine(const Mat<float, 3, 4>& m,
+            const Vec<half, 3>* src,
+            Vec<half, 3>* dst,
+            const std::size_t n) noexcept {
+#if TPH_HAS_AVX512F
+  avx512::Affine<kPoint>(m, src, dst, n);
+#elif TPH_HAS_AVX2 && TPH_HAS_F16C
+  avx2::Affine<kPoint>(m, src, dst, n);
+#else
+  AffineScalar<kPoint>(m, src, dst, n);
+#endif
+}
+
+inline void Project(const Mat<float, 4, 4>& m,
+                    const Vec<half, 3>* src,
+                    Vec<half, 3>* dst,
+                    const std::size_t n) noexcept {
+#if TPH_HAS_AVX512F
+  avx512::Project(m, src, dst, n);
+#elif TPH_HAS_AVX2 && TPH_HAS_F16C
+  avx2::Project(m, src, dst, n);
+#else
+  ProjectScalar(m, src, dst, n);
+#endif
+}
+
+inline void WidenArray(const half* src, float* dst, const std::size_t n) noexcept {
+#if TPH_HAS_AVX512F
+  avx512::Widen(src, dst, n);
+#elif TPH_HAS_AVX2 && TPH_HAS_F16C
+  avx2::Widen(src, dst, n);
+#else
+  WidenScalar(src, dst, n);
+#endif
+}
+
+inline void NarrowArray(const float* src, half* dst, const std::size_t n) noexcept {
+#if TPH_HAS_AVX512F
+  avx512::Narrow(src, dst, n);
+#elif TPH_HAS_AVX2 && TPH_HAS_F16C
+  avx2::Narrow(src, dst, n);
+#else
+  NarrowScalar(src, dst, n);
+#endif
+}
+
+// AVX-512 uses the AVX2 kernels, which are bound by the packing and unpacking.
+template <typename PackedT>
+void EncodeArray(const Vec<float, 3>* src, PackedT* dst, const std::size_t n) noexcept {
+#if TPH_HAS_AVX2
+  avx2::Encode(src, dst, n);
+#elif TPH_HAS_SSE2
+  sse2::Encode(src, dst, n);
+#else
+  EncodeScalar(src, dst, n);
+#endif
+}
+
+template <typename PackedT>
+void DecodeArray(const PackedT* src, Vec<float, 3>* dst, const std::size_t n) noexcept {
+#if TPH_HAS_AVX2
+  avx2::Decode(src, dst, n);
+#elif TPH_HAS_SSE2
+  sse2::Decode(src, dst, n);
+#else
+  DecodeScalar(src, dst, n);
+#endif
+}
+
+// Reductions, SIMD kernels for float points, the scalar kernels for other types. The sums are
+// returned through a pointer, so that the float overload is chosen for float accumulation only.
+template <typename ArithT>
+auto BoundsArray(const Vec<ArithT, 3>* src, const std::size_t n) noexcept -> Aabb<ArithT, 3> {
+  return BoundsScalar(src, n);
+}
+
+inline auto BoundsArray(const Vec<float, 3>* src, const std::size_t n) noexcept -> Aabb<float, 3> {
+#if TPH_HAS_AVX512F
+  return avx512::Bounds(src, n);
+#elif TPH_HAS_AVX2
+  return avx2::Bounds(src, n);
+#elif TPH_HAS_SSE2
+  return sse2::Bounds(src, n);
+#else
+  return BoundsScalar(src, n);
+#endif
+}
+
+template <typename ArithT>
+auto DotRangeArray(const Vec<ArithT, 3>* src, const std::size_t n, const Vec<ArithT, 3>& d) noexcept
+    -> Vec<ArithT, 2> {
+  return DotRangeScalar(src, n, d);
+}
+
+inline auto DotRangeArray(const Vec<float, 3>* src,
+                          const std::size_t n,
+                          const Vec<float, 3>& d) noexcept -> Vec<float, 2> {
+#if TPH_HAS_AVX512F
+  return avx512::DotRange(src, n, d);
+#elif TPH_HAS_AVX2
+  return avx2::DotRange(src, n, d);
+#elif TPH_HAS_SSE2
+  return sse2::DotRange(src, n, d);
+#else
+  return DotRangeScalar(src, n, d);
+#endif
+}
+
+template <typename AccT, typename ArithT>
+void SumArray(const Vec<ArithT, 3>* src, const std::size_t n, Vec<AccT, 3>* sum) noexcept {
+  *sum = SumScalar<AccT>(src, n);
+}
+
+inline void SumArray(const Vec<float, 3>* src, const std::size_t n, Vec<float, 3>* sum) noexcept {
+#if TPH_HAS_AVX512F
+  *sum = avx512::Sum(src, n);
+#elif TPH_HAS_AVX2
+  *sum = avx2::Sum(src, n);
+#elif TPH_HAS_SSE2
+  *sum = sse2::Sum(src, n);
+#else
+  *sum = SumScalar<float>(src, n);
+#endif
+}
+
+template <typename AccT, typename ArithT>
+void MomentsArray(const Vec<ArithT, 3>* src,
+                  const std::size_t n,
+                  const Vec<AccT, 3>& c,
+                  Moments<AccT>* m) noexcept {
+  *m = MomentsScalar(src, n, c);
+}
+
+inline void MomentsArray(const Vec<float, 3>* src,
+                         const std::size_t n,
+                         const Vec<float, 3>& c,
+                         Moments<float>* m) noexcept {
+#if TPH_HAS_AVX512F
+  *m = avx512::CenteredMoments(src, n, c);
+#elif TPH_HAS_AVX2
+  *m = avx2::CenteredMoments(src, n, c);
+#elif TPH_HAS_SSE2
+  *m = sse2::CenteredMoments(src, n, c);
+#else
+  *m = MomentsScalar(src, n, c);
+#endif
+}
+
+// Vectors per block of the sums, the blocks are added pairwise.
+constexpr std::size_t kReduceBlock = 1024;
+
+// f(begin, end) for blocks of at most block elements of [begin, end), added pairwise. The rounding
+// error then grows with log2(n / block) rather than with n. The blocks do not depend on how the
+// sum is computed, only on begin, end and block.
+template <typename T, typename F>
+auto PairwiseSum(const std::size_t begin,
+                 const std::size_t end,
+                 const std::size_t block,
+                 const F& f) -> T {
+  if (end - begin <= block) {
+    return f(begin, end);
+  }
+  const auto mid = begin + ((end - begin) / 2 + block - 1) / block * block;
+  return PairwiseSum<T>(begin, mid, block, f) + PairwiseSum<T>(mid, end, block, f);
+}
+
+template <typename AccT, typename ArithT>
+auto PointSum(const Vec<ArithT, 3>* src, const std::size_t n) noexcept -> Vec<AccT, 3> {
+  return PairwiseSum<Vec<AccT, 3>>(
+      0, n, kReduceBlock, [src](const std::size_t begin, const std::size_t end) {
+        Vec<AccT, 3> sum;
+        SumArray(src + begin, end - begin, &sum);
+        return sum;
+      });
+}
+
+template <typename AccT, typename ArithT>
+auto PointMoments(const Vec<ArithT, 3>* src, const std::size_t n, const Vec<AccT, 3>& c) noexcept
+    -> Moments<AccT> {
+  return PairwiseSum<Moments<AccT>>(
+      0, n, kReduceBlock, [src, &c](const std::size_t begin, const std::size_t end) {
+        Moments<AccT> m;
+        MomentsArray(src + begin, end - begin, c, &m);
+        return m;
+      });
+}
+
+// The mean of n values with the given sum, zero for n = 0.
+template <typename AccT>
+auto Mean(const Vec<AccT, 3>& sum, const std::size_t n) noexcept -> Vec<AccT, 3> {
+  return sum * (n > 0 ? AccT(1) / static_cast<AccT>(n) : AccT(0));
+}
+
+template <typename AccT>
+auto CovarianceMatrix(const Moments<AccT>& m, const std::size_t n) noexcept -> Mat<AccT, 3, 3> {
+  const auto d = Mean(m.diag, n);
+  const auto o = Mean(m.off, n);
+  return MakeMat3x3(d.x, o.x, o.y, //
+                    o.x, d.y, o.z, //
+                    o.y, o.z, d.z);
+}
+
+// Accumulation type of Centroid and Covariance, AccT or ArithT if AccT is void.
+template <typename AccT, typename ArithT>
+using AccumType = typename std::conditional<std::is_void<AccT>::value, ArithT, AccT>::type;
+
+template <typename ArithT>
+void InverseMatrices(const Mat<ArithT, 4, 4>* src,
+                     Mat<ArithT, 4, 4>* dst,
+                     const std::size_t n) noexcept {
+  InverseScalar(src, dst, n);
+}
+
+inline void InverseMatrices(const Mat<float, 4, 4>* src,
+                            Mat<float, 4, 4>* dst,
+                            const std::size_t n) noexcept {
+#if TPH_HAS_AVX512F
+  avx512::InverseMany(src, dst, n);
+#elif TPH_HAS_AVX2
+  avx2::InverseMany(src, dst, n);
+#elif TPH_HAS_SSE2
+  sse2::InverseMany(src, dst, n);
+#else
+  InverseScalar(src, dst, n);
+#endif
+}
+
+template <typename ArithT>
+void MulMatrices(const Mat<ArithT, 4, 4>* a,
+                 const std::size_t a_step,
+                 const Mat<ArithT, 4, 4>* b,
+                 Mat<ArithT, 4, 4>* dst,
+                 const std::size_t n) noexcept {
+  MulScalar(a, a_step, b, dst, n);
+}
+
+inline void MulMatrices(const Mat<float, 4, 4>* a,
+                        const std::size_t a_step,
+                        const Mat<float, 4, 4>* b,
+                        Mat<float, 4, 4>* dst,
+                        const std::size_t n) noexcept {
+#if TPH_HAS_AVX512F
+  avx512::MulMany(a, a_step, b, dst, n);
+#elif TPH_HAS_AVX2
+  avx2::MulMany(a, a_step, b, dst, n);
+#elif TPH_HAS_SSE2
+  sse2::MulMany(a, a_step, b, dst, n);
+#else
+  MulScalar(a, a_step, b, dst, n);
+#endif
+}
+
+inline void MulMatrices(const Mat<double, 4, 4>* a,
+                        const std::size_t a_step,
+                        const Mat<double, 4, 4>* b,
+                        Mat<double, 4, 4>* dst,
+                        const std::size_t n) noexcept {
+#if TPH_HAS_AVX512F
+  avx512::MulMany(a, a_step, b, dst, n);
+#elif TPH_HAS_AVX2
+  avx2::MulMany(a, a_step, b, dst, n);
+#elif TPH_HAS_SSE2
+  sse2::MulMany(a, a_step, b, dst, n);
+#else
+  MulScalar(a, a_step, b, dst, n);
+#endif
+}
+
+// The widest packet of T the target supports natively, for the batch versions of the branch-free
+// decompositions. Without AVX the 32-byte packets are pairs of SSE2 registers, which still helps
+// to hide latency.
+#if TPH_HAS_AVX512F
+template <typename T>
+using WidePacket = simd::Packet<T, 64 / sizeof(T)>;
+#else
+template <typename T>
+using WidePacket = simd::Packet<T, 32 / sizeof(T)>;
+#endif
+
+// Lane i of a vector or matrix of packets.
+template <typename T, int N>
+auto Lane(const Vec<simd::Packet<T, N>, 3>& a, const std::size_t i) noexcept -> Vec<T, 3> {
+  return {a.x.v[i], a.y.v[i], a.z.v[i]};
+}
+
+template <typename T, int N>
+auto Lane(const Mat<simd::Packet<T, N>, 3, 3>& a, const std::size_t i) noexcept -> Mat<T, 3, 3> {
+  return {Lane(a.x, i), Lane(a.y, i), Lane(a.z, i)};
+}
+
+template <typename T, int N>
+auto Lane(const EigenDecomposition<simd::Packet<T, N>, 3>& a, const std::size_t i) noexcept
+    -> EigenDecomposition<T, 3> {
+  return {Lane(a.values, i), Lane(a.vectors, i)};
+}
+
+template <typename T, int N>
+auto Lane(const SingularValueDecomposition<simd::Packet<T, N>, 3>& a, const std::size_t i) noexcept
+    -> SingularValueDecomposition<T, 3> {
+  return {Lane(a.u, i), Lane(a.values, i), Lane(a.v, i)};
+}
+
+template <typename T, int N>
+auto Lane(const PolarDecomposition<simd::Packet<T, N>, 3>& a, const std::size_t i) noexcept
+    -> PolarDecomposition<T, 3> {
+  return {Lane(a.rotation, i), Lane(a.stretch, i)};
+}
+
+struct EigenSymmetricOp {
+  template <typename A>
+  auto operator()(const A& a) const noexcept -> decltype(EigenSymmetric(a)) {
+    return EigenSymmetric(a);
+  }
+};
+
+struct SvdOp {
+  template <typename A>
+  auto operator()(const A& a) const noexcept -> decltype(Svd(a)) {
+    return Svd(a);
+  }
+};
+
+struct PolarDecomposeOp {
+  template <typename A>
+  auto operator()(const A& a) const noexcept -> decltype(PolarDecompose(a)) {
+    return PolarDecompose(a);
+  }
+};
+
+// dst[i] = op(src[i]) for one of the branch-free decompositions, one packet of matrices per
+// iteration with the last one padded with zero matrices.
+template <typename T, typename ResultT, typename Op>
+void DecomposePackets(const Mat<T, 3, 3>* src,
+                      ResultT* dst,
+                      const std::size_t n,
+                      const Op op) noexcept {
+  using PacketT = WidePacket<T>;
+  constexpr auto kN = static_cast<std::size_t>(PacketT::kSize);
+  for (std::size_t i = 0; i < n; i += kN) {
+    const auto count = n - i < kN ? n - i : kN;
+    const auto r = op(simd::LoadMat<PacketT>(src + i, count));
+    for (std::size_t k = 0; k < count; ++k) {
+      dst[i + k] = Lane(r, k);
+    }
+  }
+}
+
+// Transpose count points into packets and back, padding with zeros. The components are named,
+// rather than indexed as in simd::LoadVec, which keeps the transposes cheap next to the small
+// amount of work per query below.
+template <typename PacketT, typename T>
+auto LoadPoints(const Vec<T, 3>* src, const std::size_t count) noexcept -> Vec<PacketT, 3> {
+  Vec<PacketT, 3> r{};
+  for (std::size_t i = 0; i < count; ++i) {
+    r.x.v[i] = src[i].x;
+    r.y.v[i] = src[i].y;
+    r.z.v[i] = src[i].z;
+  }
+  return r;
+}
+
+template <typename T, int N>
+void StorePoints(const Vec<simd::Packet<T, N>, 3>& a,
+                 Vec<T, 3>* dst,
+                 const std::size_t count) noexcept {
+  for (std::size_t i = 0; i < count; ++i) {
+    dst[i] = Vec<T, 3>{a.x.v[i], a.y.v[i], a.z.v[i]};
+  }
+}
+
+// Transpose count boxes into packets, padding with empty boxes at the origin.
+template <typename PacketT, typename T>
+auto LoadBoxes(const Aabb<T, 3>* src, const std::size_t count) noexcept -> Aabb<PacketT, 3> {
+  Aabb<PacketT, 3> r{};
+  for (std::size_t i = 0; i < count; ++i) {
+    r.min.x.v[i] = src[i].min.x;
+    r.min.y.v[i] = src[i].min.y;
+    r.min.z.v[i] = src[i].min.z;
+    r.max.x.v[i] = src[i].max.x;
+    r.max.y.v[i] = src[i].max.y;
+    r.max.z.v[i] = src[i].max.z;
+  }
+  return r;
+}
+
+// Closest-point and distance queries on one packet of WidePacket<T> lanes, queries i to
+// i + count, or on query i alone. Run by RunQueries.
+template <typename T>
+struct SegmentQueries {
+  const Vec<T, 3>* p;
+  const Vec<T, 3>* a;
+  const Vec<T, 3>* b;
+  Vec<T, 3>* dst;
+
+  void operator()(const std::size_t i, const std::size_t count) const noexcept {
+    using PacketT = WidePacket<T>;
+    StorePoints(ClosestPointOnSegment(LoadPoints<PacketT>(p + i, count),
+                                      LoadPoints<PacketT>(a + i, count),
+                                      LoadPoints<PacketT>(b + i, count)),
+                dst + i, count);
+  }
+
+  void One(const std::size_t i) const noexcept { dst[i] = ClosestPointOnSegment(p[i], a[i], b[i]); }
+};
+
+template <typename T>
+struct TriangleQueries {
+  const Vec<T, 3>* p;
+  const Vec<T, 3>* a;
+  const Vec<T, 3>* b;
+  const Vec<T, 3>* c;
+  Vec<T, 3>* dst;
+
+  void operator()(const std::size_t i, const std::size_t count) const noexcept {
+    using PacketT = WidePacket<T>;
+    StorePoints(ClosestPointOnTriangle(LoadPoints<PacketT>(p + i, count),
+                                       LoadPoints<PacketT>(a + i, count),
+                                       LoadPoints<PacketT>(b + i, count),
+                                       LoadPoints<PacketT>(c + i, count)),
+                dst + i, count);
+  }
+
+  void One(const std::size_t i) const noexcept {
+    dst[i] = ClosestPointOnTriangle(p[i], a[i], b[i], c[i]);
+  }
+};
+
+template <typename T>
+struct BoxQueries {
+  const Vec<T, 3>* p;
+  const Aabb<T, 3>* boxes;
+  T* dst;
+
+  void operator()(const std::size_t i, const std::size_t count) const noexcept {
+    using PacketT = WidePacket<T>;
+    const auto d = DistanceToBox(LoadPoints<PacketT>(p + i, count),
+                                 LoadBoxes<PacketT>(boxes + i, count));
+    for (std::size_t k = 0; k < count; ++k) {
+      dst[i + k] = d.v[k];
+    }
+  }
+
+  void One(const std::size_t i) const noexcept { dst[i] = DistanceToBox(p[i], boxes[i]); }
+};
+
+// Runs the n queries one packet at a time. The full packets are passed a constant count, so that
+// their transposes are unrolled, and the last one is padded with zeros. Without AVX2 the 64-bit
+// lane masks of double packets are not vectorized, and the selects cost more than the branches of
+// the scalar functions, so doubles are run one at a time instead.
+template <typename T, typename Queries>
+void RunQueries(const Queries& queries, const std::size_t n) noexcept {
+  constexpr auto kN = static_cast<std::size_t>(WidePacket<T>::kSize);
+  if (sizeof(T) > 4 && !TPH_HAS_AVX2) {
+    for (std::size_t i = 0; i < n; ++i) {
+      queries.One(i);
+    }
+    return;
+  }
+  std::size_t i = 0;
+  for (; n - i >= kN; i += kN) {
+    queries(i, kN);
+  }
+  if (i < n) {
+    queries(i, n - i);
+  }
+}
+
+// A tile of W small linear systems a x = b in structure-of-arrays layout, a[i][j][w] is element
+// (i, j) of system w. The solvers below run every step on all W lanes at once with loops that the
+// compiler vectorizes for the target, the same way as the TPH_IVDEP kernels above.
+template <typename T, int M, int W>
+struct SystemTile {
+  T a[M][M][W];
+  T b[M][W];
+  T inv_pivots[M][W];
+  T min_pivot[W];
+  T tol[W];
+};
+
+// Transpose count <= W systems into t, padding the remaining lanes with identity systems.
+template <typename T, int M, int W>
+void LoadSystems(const Mat<T, M, M>* a,
+                 const Vec<T, M>* b,
+                 const std::size_t count,
+                 SystemTile<T, M, W>& t) noexcept {
+  const auto* pa = &a[0].x.x;
+  const auto* pb = &b[0].x;
+  for (std::size_t w = 0; w < count; ++w) {
+    for (int j = 0; j < M; ++j) {
+      for (int i = 0; i < M; ++i) {
+        t.a[i][j][w] = pa[w * M * M + j * M + i];
+      }
+    }
+    for (int i = 0; i < M; ++i) {
+      t.b[i][w] = pb[w * M + i];
+    }
+  }
+  for (std::size_t w = count; w < W; ++w) {
+    for (int j = 0; j < M; ++j) {
+      for (int i = 0; i < M; ++i) {
+        t.a[i][j][w] = T(i == j);
+      }
+      t.b[j][w] = T(0);
+    }
+  }
+}
+
+// Gaussian elimination of all lanes of t, with partial pivoting (SolveLU) or without (the LDLᵀ
+// of SolveCholesky, which only needs the sign of the pivots). Leaves the solutions in t.b, with
+// the same pivot tolerance and the same order of operations as the scalar solvers.
+template <bool kPivoting, typename T, int M, int W>
+void SolveSystems(SystemTile<T, M, W>& t) noexcept {
+  for (int w = 0; w < W; ++w) {
+    t.tol[w] = T(0);
+    t.min_pivot[w] = std::numeric_limits<T>::max();
+  }
+  for (int i = 0; i < M; ++i) {
+    for (int j = 0; j < M; ++j) {
+      TPH_IVDEP
+      for (int w = 0; w < W; ++w) {
+        t.tol[w] = std::max(t.tol[w], std::abs(t.a[i][j][w]));
+      }
+    }
+  }
+  for (int w = 0; w < W; ++w) {
+    t.tol[w] *= T(8 * M) * std::numeric_limits<T>::epsilon();
+  }
+  for (int k = 0; k < M; ++k) {
+    if (kPivoting) {
+      for (int i = k + 1; i < M; ++i) {
+        TPH_IVDEP
+        for (int w = 0; w < W; ++w) {
+          const auto swap = std::abs(t.a[k][k][w]) < std::abs(t.a[i][k][w]);
+          for (int j = 0; j < M; ++j) {
+            const auto ak = t.a[k][j][w];
+            const auto ai = t.a[i][j][w];
+            t.a[k][j][w] = swap ? ai : ak;
+            t.a[i][j][w] = swap ? ak : ai;
+          }
+          const auto bk = t.b[k][w];
+          const auto bi = t.b[i][w];
+          t.b[k][w] = swap ? bi : bk;
+          t.b[i][w] = swap ? bk : bi;
+        }
+      }
+    }
+    TPH_IVDEP
+    for (int w = 0; w < W; ++w) {
+      const auto p = t.a[k][k][w];
+      t.inv_pivots[k][w] = T(1) / (std::abs(p) <= t.tol[w] ? T(1) : p);
+      t.min_pivot[w] = std::min(t.min_pivot[w], kPivoting ? std::abs(p) : p);
+    }
+    for (int i = k + 1; i < M; ++i) {
+      T l[W];
+      TPH_IVDEP
+      for (int w = 0; w < W; ++w) {
+        l[w] = t.a[i][k][w] * t.inv_pivots[k][w];
+        t.b[i][w] -= t.b[k][w] * l[w];
+      }
+      for (int j = k + 1; j < M; ++j) {
+        TPH_IVDEP
+        for (int w = 0; w < W; ++w) {
+          t.a[i][j][w] -= t.a[k][j][w] * l[w];
+        }
+      }
+    }
+  }
+  for (int i = M - 1; i >= 0; --i) {
+    for (int j = i + 1; j < M; ++j) {
+      TPH_IVDEP
+      for (int w = 0; w < W; ++w) {
+        t.b[i][w] -= t.a[i][j][w] * t.b[j][w];
+      }
+    }
+    TPH_IVDEP
+    for (int w = 0; w < W; ++w) {
+      t.b[i][w] *= t.inv_pivots[i][w];
+    }
+  }
+}
+
+template <typename T, int M, int W>
+void StoreSolutions(const SystemTile<T, M, W>& t,
+                    const std::size_t count,
+                    LinearSolution<T, M>* dst) noexcept {
+  for (std::size_t w = 0; w < count; ++w) {
+    const auto solved = t.tol[w] < t.min_pivot[w];
+    auto* x = &dst[w].x.x;
+    for (int i = 0; i < M; ++i) {
+      x[i] = solved ? t.b[i][w] : T(0);
+    }
+    dst[w].solved = solved;
+  }
+}
+
+// dst[i] = SolveLU(a[i], b[i]) or SolveCholesky(a[i], b[i]), in tiles of 64 systems. The tiles
+// are wider than any SIMD register so that the lane loops stay loops and vectorize.
+template <bool kPivoting, typename T, int M>
+void SolveSystemsMany(const Mat<T, M, M>* a,
+                      const Vec<T, M>* b,
+                      LinearSolution<T, M>* dst,
+                      const std::size_t n) noexcept {
+  constexpr auto kW = std::size_t{64};
+  SystemTile<T, M, static_cast<int>(kW)> t;
+  for (std::size_t i = 0; i < n; i += kW) {
+    const auto count = n - i < kW ? n - i : kW;
+    LoadSystems(a + i, b + i, count, t);
+    SolveSystems<kPivoting>(t);
+    StoreSolutions(t, count, dst + i);
+  }
+}
+
+// Rotations and interpolations of arrays of quaternions.
+template <typename ArithT>
+void RotateQuats(const Quat<ArithT>* q,
+                 const Vec<ArithT, 3>* src,
+                 Vec<ArithT, 3>* dst,
+                 const std::size_t n) noexcept {
+  TPH_IVDEP
+  for (std::size_t i = 0; i < n; ++i) {
+    dst[i] = Rotate(q[i], src[i]);
+  }
+}
+
+// The interpolations run in chunks of 64, with the dot products, and for Slerp the cosines of the
+// half angles, in lane loops of their own. The shorter-arc choice of Nearest is then a select
+// between b and -b that the compiler vectorizes. In one loop GCC duplicates the arithmetic after
+// the choice into both branches, and does not vectorize at all.
+template <typename ArithT>
+void NlerpQuats(const Quat<ArithT>* a,
+                const Quat<ArithT>* b,
+                const ArithT t,
+                Quat<ArithT>* dst,
+                const std::size_t n) noexcept {
+  constexpr auto kW = std::size_t{64};
+  ArithT d[kW];
+  for (std::size_t i = 0; i < n; i += kW) {
+    const auto count = n - i < kW ? n - i : kW;
+    TPH_IVDEP
+    for (std::size_t k = 0; k < count; ++k) {
+      d[k] = Dot(a[i + k], b[i + k]);
+    }
+    TPH_IVDEP
+    for (std::size_t k = 0; k < count; ++k) {
+      dst[i + k] = Normalized(Blend(a[i + k], ArithT(1) - t, Nearest(b[i + k], d[k]), t));
+    }
+  }
+}
+
+template <typename ArithT>
+void SlerpQuats(const Quat<ArithT>* a,
+                const Quat<ArithT>* b,
+                const ArithT t,
+                Quat<ArithT>* dst,
+                const std::size_t n) noexcept {
+  constexpr auto kW = std::size_t{64};
+  ArithT d[kW];
+  ArithT c[kW];
+  for (std::size_t i = 0; i < n; i += kW) {
+    const auto count = n - i < kW ? n - i : kW;
+    TPH_IVDEP
+    for (std::size_t k = 0; k < count; ++k) {
+      d[k] = Dot(a[i + k], b[i + k]);
+    }
+    TPH_IVDEP
+    for (std::size_t k = 0; k < count; ++k) {
+      c[k] = sqrt(ArithT(0.5) + ArithT(0.5) * SelectAbs(d[k]));
+    }
+    TPH_IVDEP
+    for (std::size_t k = 0; k < count; ++k) {
+      dst[i + k] = SlerpHalves(a[i + k], Nearest(b[i + k], d[k]), t, c[k]);
+    }
+  }
+}
+
+// Parents with the cycles cut, so that the nodes form a forest. Each walk up from a node stops at a
+// root or at a node already visited, and a node met twice in the same walk is on a cycle and is
+// made a root.
+inline auto CutCycles(const std::size_t* parents, const std::size_t n) -> std::vector<std::size_t> {
+  std::vector<std::size_t> p(parents, parents + n);
+  std::vector<unsigned char> state(n, 0); // 0 not visited, 1 on the current walk, 2 done.
+  std::vector<std::size_t> walk;
+  for (std::size_t i = 0; i < n; ++i) {
+    auto j = i;
+    while (j < n && state[j] == 0) {
+      state[j] = 1;
+      walk.push_back(j);
+      j = p[j];
+    }
+    if (j < n && state[j] == 1) {
+      p[j] = kNoParent;
+    }
+    for (const auto k : walk) {
+      state[k] = 2;
+    }
+    walk.clear();
+  }
+  return p;
+}
+
+// Update the world transforms of the positions [begin, end) of one level below the roots, in
+// chunks. The dirty flags of the parents are propagated first. A chunk that has changed entirely,
+// the usual case after all local transforms are set, is multiplied in place. Otherwise the parents
+// and local transforms of the changed nodes are gathered, multiplied, and scattered back.
+template <typename ArithT>
+void UpdateLevel(TransformHierarchy<ArithT>& h,
+                 const std::size_t begin,
+                 const std::size_t end) noexcept {
+  constexpr auto kW = std::size_t{32};
+  Mat<ArithT, 4, 4> parents[kW];
+  Mat<ArithT, 4, 4> products[kW];
+  std::size_t changed[kW];
+  for (std::size_t i = begin; i < end; i += kW) {
+    const auto count = end - i < kW ? end - i : kW;
+    std::size_t m = 0;
+    for (std::size_t k = 0; k < count; ++k) {
+      h.dirty[i + k] = static_cast<unsigned char>(h.dirty[i + k] | h.dirty[h.parent[i + k]]);
+      changed[m] = i + k;
+      m += h.dirty[i + k] != 0 ? 1 : 0;
+    }
+    if (m == count) {
+      for (std::size_t k = 0; k < count; ++k) {
+        parents[k] = h.world[h.parent[i + k]];
+      }
+      MulMatrices(parents, 1, &h.local[i], &h.world[i], count);
+    } else if (m > 0) {
+      for (std::size_t k = 0; k < m; ++k) {
+        parents[k] = h.world[h.parent[changed[k]]];
+        products[k] = h.local[changed[k]];
+      }
+      MulMatrices(parents, 1, products, products, m);
+      for (std::size_t k = 0; k < m; ++k) {
+        h.world[changed[k]] = products[k];
+      }
+    }
+  }
+}
+
+template <typename ArithT>
+void UpdateRoots(TransformHierarchy<ArithT>& h,
+                 const std::size_t begin,
+                 const std::size_t end) noexcept {
+  for (std::size_t i = begin; i < end; ++i) {
+    if (h.dirty[i] != 0) {
+      h.world[i] = h.local[i];
+    }
+  }
+}
+
+// Kernel selection for strided vectors. Packed, aligned vectors go to the array kernels, float
+// vectors at other strides to the SSE2 strided kernels, and the rest to the scalar loops.
+template <bool kPoint, typename ArithT>
+void AffineView(const Mat<ArithT, 3, 4>& m,
+                const StridedVecView<ArithT, 3>& src,
+                const StridedVecSpan<ArithT, 3>& dst) noexcept {
+  if (IsArray(src) && IsArray(dst)) {
+    Affine<kPoint>(m, AsArray(src), AsArray(dst), src.size);
+  } else {
+    AffineScalar<kPoint>(m, src, dst);
+  }
+}
+
+template <bool kPoint>
+void AffineView(const Mat<float, 3, 4>& m,
+                const StridedVecView<float, 3>& src,
+                const StridedVecSpan<float, 3>& dst) noexcept {
+  if (IsArray(src) && IsArray(dst)) {
+    Affine<kPoint>(m, AsArray(src), AsArray(dst), src.size);
+  } else {
+#if TPH_HAS_SSE2
+    sse2::Affine<kPoint>(m, src, dst);
+#else
+    AffineScalar<kPoint>(m, src, dst);
+#endif
+  }
+}
+
+template <typename ArithT>
+void ProjectView(const Mat<ArithT, 4, 4>& m,
+                 const StridedVecView<ArithT, 3>& src,
+                 const StridedVecSpan<ArithT, 3>& dst) noexcept {
+  if (IsArray(src) && IsArray(dst)) {
+    Project(m, AsArray(src), AsArray(dst), src.size);
+  } else {
+    ProjectScalar(m, src, dst);
+  }
+}
+
+template <typename ArithT, int M>
+void NormalizeView(const StridedVecView<ArithT, M>& src,
+                   const StridedVecSpan<ArithT, M>& dst) noexcept {
+  NormalizeScalar(src, dst);
+}
+
+inline void NormalizeView(const StridedVecView<float, 3>& src,
+                          const StridedVecSpan<float, 3>& dst) noexcept {
+#if TPH_HAS_SSE2
+  sse2::Normalize(src, dst);
+#else
+  NormalizeScalar(src, dst);
+#endif
+}
+
+template <typename ArithT>
+auto BoundsView(const StridedVecView<ArithT, 3>& src) noexcept -> Aabb<ArithT, 3> {
+  return IsArray(src) ? BoundsArray(AsArray(src), src.size) : BoundsScalar(src);
+}
+
+inline auto BoundsView(const StridedVecView<float, 3>& src) noexcept -> Aabb<float, 3> {
+#if TPH_HAS_SSE2
+  return IsArray(src) ? BoundsArray(AsArray(src), src.size) : sse2::Bounds(src);
+#else
+  return IsArray(src) ? BoundsArray(AsArray(src), src.size) : BoundsScalar(src);
+#endif
+}
+
+template <typename ArithT>
+auto DotRangeView(const StridedVecView<ArithT, 3>& src, const Vec<ArithT, 3>& d) noexcept
+    -> Vec<ArithT, 2> {
+  return IsArray(src) ? DotRangeArray(AsArray(src), src.size, d) : DotRangeScalar(src, d);
+}
+
+} // namespace tph_linalg_internal
+
+// Transform points, dst[i] = m * (src[i], 1). 4x4 matrices are assumed to be affine, i.e. the fourth
+// row is ignored, use ProjectPoints for projective transforms. dst may be the same array as src
+// (in-place), but the arrays must not otherwise overlap.
+template <typename ArithT>
+void TransformPoints(const Mat<ArithT, 3, 4>& m,
+                     const Vec<ArithT, 3>* src,
+                     Vec<ArithT, 3>* dst,
+                     const std::size_t n) noexcept {
+  tph_linalg_internal::Affine<true>(m, src, dst, n);
+}
+
+template <typename ArithT>
+void TransformPoints(const Mat<ArithT, 4, 4>& m,
+                     const Vec<ArithT, 3>* src,
+                     Vec<ArithT, 3>* dst,
+                     const std::size_t n) noexcept {
+  tph_linalg_internal::Affine<true>(tph_linalg_internal::UpperRows(m), src, dst, n);
+}
+
+// Transform directions, dst[i] = m * (src[i], 0), i.e. the translation is ignored. Same
+// requirements as TransformPoints.
+template <typename ArithT>
+void TransformDirections(const Mat<ArithT, 3, 4>& m,
+                         const Vec<ArithT, 3>* src,
+                         Vec<ArithT, 3>* dst,
+                         const std::size_t n) noexcept {
+  tph_linalg_internal::Affine<false>(m, src, dst, n);
+}
+
+template <typename ArithT>
+void TransformDirections(const Mat<ArithT, 4, 4>& m,
+                         const Vec<ArithT, 3>* src,
+                         Vec<ArithT, 3>* dst,
+                         const std::size_t n) noexcept {
+  tph_linalg_internal::Affine<false>(tph_linalg_internal::UpperRows(m), src, dst, n);
+}
+
+// Project points, dst[i] = (x, y, z) / w where (x, y, z, w) = m * (src[i], 1). Same requirements as
+// TransformPoints.
+template <typename ArithT>
+void ProjectPoints(const Mat<ArithT, 4, 4>& m,
+                   const Vec<ArithT, 3>* src,
+                   Vec<ArithT, 3>* dst,
+                   const std::size_t n) noexcept {
+  tph_linalg_internal::Project(m, src, dst, n);
+}
+
+// Transform arrays of half vectors by a float matrix, as the functions above. Blocks of vectors are
+// widened to float in registers, transformed and narrowed back, so the arrays are read and written
+// as half and no float copy is made. The results are the float results rounded to half.
+inline void TransformPoints(const Mat<float, 3, 4>& m,
+                            const Vec<half, 3>* src,
+                            Vec<half, 3>* dst,
+                            const std::size_t n) noexcept {
+  tph_linalg_internal::Affine<true>(m, src, dst, n);
+}
+
+inline void TransformPoints(const Mat<float, 4, 4>& m,
+                            const Vec<half, 3>* src,
+                            Vec<half, 3>* dst,
+                            const std::size_t n) noexcept {
+  tph_linalg_internal::Affine<true>(tph_linalg_internal::UpperRows(m), src, dst, n);
+}
+
+inline void TransformDirections(const Mat<float, 3, 4>& m,
+                                const Vec<half, 3>* src,
+                                Vec<half, 3>* dst,
+                                const std::size_t n) noexcept {
+  tph_linalg_internal::Affine<false>(m, src, dst, n);
+}
+
+inline void TransformDirections(const Mat<float, 4, 4>& m,
+                                const Vec<half, 3>* src,
+                                Vec<half, 3>* dst,
+                                const std::size_t n) noexcept {
+  tph_linalg_internal::Affine<false>(tph_linalg_internal::UpperRows(m), src, dst, n);
+}
+
+inline void ProjectPoints(const Mat<float, 4, 4>& m,
+                          const Vec<half, 3>* src,
+                          Vec<half, 3>* dst,
+                          const std::size_t n) noexcept {
+  tph_linalg_internal::Project(m, src, dst, n);
+}
+
+// Convert n values from half to float, exact. The arrays must not overlap.
+inline void Widen(const half* src, float* dst, const std::size_t n) noexcept {
+  tph_linalg_internal::WidenArray(src, dst, n);
+}
+
+// Convert n values from float to half, rounded to nearest even. The arrays must not overlap.
+inline void Narrow(const float* src, half* dst, const std::size_t n) noexcept {
+  tph_linalg_internal::NarrowArray(src, dst, n);
+}
+
+// Convert arrays of n vectors, see above.
+template <int M>
+void Widen(const Vec<half, M>* src, Vec<float, M>* dst, const std::size_t n) noexcept {
+  Widen(reinterpret_cast<const half*>(src), reinterpret_cast<float*>(dst), n * M);
+}
+
+template <int M>
+void Narrow(const Vec<float, M>* src, Vec<half, M>* dst, const std::size_t n) noexcept {
+  Narrow(reinterpret_cast<const float*>(src), reinterpret_cast<half*>(dst), n * M);
+}
+
+// Convert SoA arrays, out is resized to the size of a.
+template <int M>
+void Widen(const VecArraySoA<half, M>& a, VecArraySoA<float, M>& out) {
+  Resize(out, Size(a));
+  const auto pa = tph_linalg_internal::Lanes(a);
+  const auto po = tph_linalg_internal::Lanes(out);
+  for (int k = 0; k < M; ++k) {
+    Widen(Comp(pa, k), Comp(po, k), Size(a));
+  }
+}
+
+template <int M>
+void Narrow(const VecArraySoA<float, M>& a, VecArraySoA<half, M>& out) {
+  Resize(out, Size(a));
+  const auto pa = tph_linalg_internal::Lanes(a);
+  const auto po = tph_linalg_internal::Lanes(out);
+  for (int k = 0; k < M; ++k) {
+    Narrow(Comp(pa, k), Comp(po, k), Size(a));
+  }
+}
+
+// Pack arrays of unit vectors, dst[i] = Encode<PackedT>(src[i]) for PackedT Oct16, Oct32 or
+// Snorm1010102. The arrays must not overlap. The SIMD kernels may differ from the scalar functions
+// by one in the last quantized bit where fused multiply-add changes the rounding.
+template <typename PackedT>
+void Encode(const Vec<float, 3>* src, PackedT* dst, const std::size_t n) noexcept {
+  tph_linalg_internal::EncodeArray(src, dst, n);
+}
+
+// Unpack arrays of unit vectors, dst[i] = Decode(src[i]), up to rounding. The arrays must not
+// overlap.
+template <typename PackedT>
+void Decode(const PackedT* src, Vec<float, 3>* dst, const std::size_t n) noexcept {
+  tph_linalg_internal::DecodeArray(src, dst, n);
+}
+
+// Bounds of n points, the smallest box containing them. For n = 0 the box is empty, with
+// min = +inf and max = -inf, which is the identity of Union.
+template <typename ArithT>
+auto ComputeBounds(const Vec<ArithT, 3>* src, const std::size_t n) noexcept -> Aabb<ArithT, 3> {
+  return tph_linalg_internal::BoundsArray(src, n);
+}
+
+// Extent of n points along the direction d, (min, max) of Dot(d, src[i]). For n = 0 the range is
+// empty, (+inf, -inf). d need not be normalized, the extent is then scaled by Length(d).
+template <typename ArithT>
+auto MinMaxDot(const Vec<ArithT, 3>* src, const std::size_t n, const Vec<ArithT, 3>& d) noexcept
+    -> Vec<ArithT, 2> {
+  return tph_linalg_internal::DotRangeArray(src, n, d);
+}
+
+// Centroid (mean) of n points, zero for n = 0. The sums are accumulated in AccT, by default the
+// type of the points, e.g. Centroid<double>(src, n) for float points accumulated in double.
+// Blocks of about a thousand points are summed with several SIMD accumulators, and the block sums
+// are added pairwise, so the rounding error grows with log(n) rather than n.
+template <typename AccT = void, typename ArithT>
+auto Centroid(const Vec<ArithT, 3>* src, const std::size_t n) noexcept
+    -> Vec<tph_linalg_internal::AccumType<AccT, ArithT>, 3> {
+  using T = tph_linalg_internal::AccumType<AccT, ArithT>;
+  return tph_linalg_internal::Mean(tph_linalg_internal::PointSum<T>(src, n), n);
+}
+
+// Covariance matrix of n points, (1 / n) * sum((p - c) * (p - c)^T) where c is the centroid, zero
+// for n = 0. Computed in two passes, the centroid and then the products relative to it, which
+// avoids the cancellation of the one-pass formula for points far from the origin. Accumulated as in
+// Centroid.
+template <typename AccT = void, typename ArithT>
+auto Covariance(const Vec<ArithT, 3>* src, const std::size_t n) noexcept
+    -> Mat<tph_linalg_internal::AccumType<AccT, ArithT>, 3, 3> {
+  using T = tph_linalg_internal::AccumType<AccT, ArithT>;
+  const auto c = Centroid<T>(src, n);
+  return tph_linalg_internal::CovarianceMatrix(tph_linalg_internal::PointMoments(src, n, c), n);
+}
+
+// Invert matrices, dst[i] = Inverse(src[i]). The matrices must be invertible. For float the inverses
+// are computed by 2x2 blocks in SIMD registers, and may differ from Inverse in the last bits. Same
+// requirements on the arrays as TransformPoints.
+template <typename ArithT>
+void InverseMany(const Mat<ArithT, 4, 4>* src,
+                 Mat<ArithT, 4, 4>* dst,
+                 const std::size_t n) noexcept {
+  tph_linalg_internal::InverseMatrices(src, dst, n);
+}
+
+// Multiply matrices, dst[i] = a[i] * b[i], e.g. to compose arrays of transforms. dst may be the
+// same array as a or b, but the arrays must not otherwise overlap.
+template <typename ArithT>
+void MulMany(const Mat<ArithT, 4, 4>* a,
+             const Mat<ArithT, 4, 4>* b,
+             Mat<ArithT, 4, 4>* dst,
+             const std::size_t n) noexcept {
+  tph_linalg_internal::MulMatrices(a, 1, b, dst, n);
+}
+
+// Multiply matrices, dst[i] = a * b[i], e.g. to apply a parent transform to child transforms. a is
+// kept in registers for the whole array. dst may be the same array as b, but must not contain a.
+template <typename ArithT>
+void MulMany(const Mat<ArithT, 4, 4>& a,
+             const Mat<ArithT, 4, 4>* b,
+             Mat<ArithT, 4, 4>* dst,
+             const std::size_t n) noexcept {
+  tph_linalg_internal::MulMatrices(&a, 0, b, dst, n);
+}
+
+// Eigendecompositions of symmetric matrices, dst[i] = EigenSymmetric(src[i]). The matrices are
+// transposed into SIMD packets, 8 floats or 4 doubles at a time (16 and 8 with AVX-512), and solved
+// in lock-step by the same branch-free Jacobi sweeps as EigenSymmetric, so the results match
+// EigenSymmetric up to rounding. dst must not overlap src.
+template <typename FloatT>
+void EigenSymmetricMany(const Mat<FloatT, 3, 3>* src,
+                        EigenDecomposition<FloatT, 3>* dst,
+                        const std::size_t n) noexcept {
+  tph_linalg_internal::DecomposePackets(src, dst, n, tph_linalg_internal::EigenSymmetricOp{});
+}
+
+// Singular value and polar decompositions, dst[i] = Svd(src[i]) and
+// dst[i] = PolarDecompose(src[i]), solved in SIMD packets in the same way as EigenSymmetricMany.
+template <typename FloatT>
+void SvdMany(const Mat<FloatT, 3, 3>* src,
+             SingularValueDecomposition<FloatT, 3>* dst,
+             const std::size_t n) noexcept {
+  tph_linalg_internal::DecomposePackets(src, dst, n, tph_linalg_internal::SvdOp{});
+}
+
+template <typename FloatT>
+void PolarDecomposeMany(const Mat<FloatT, 3, 3>* src,
+                        PolarDecomposition<FloatT, 3>* dst,
+                        const std::size_t n) noexcept {
+  tph_linalg_internal::DecomposePackets(src, dst, n, tph_linalg_internal::PolarDecomposeOp{});
+}
+
+// Closest points and distances for arrays of queries, dst[i] = ClosestPointOnSegment(p[i], a[i],
+// b[i]), dst[i] = ClosestPointOnTriangle(p[i], a[i], b[i], c[i]) and
+// dst[i] = DistanceToBox(p[i], boxes[i]), e.g. for the candidates of a broad phase. The queries are
+// transposed into SIMD packets as in EigenSymmetricMany and run through the same branch-free
+// functions, where every lane computes all the regions and selects its own, so the results match
+// the scalar functions up to rounding. Without AVX2 doubles are run through the scalar functions
+// instead, see RunQueries. The closest points may be written over p, but the arrays must not
+// otherwise overlap.
+template <typename FloatT>
+void ClosestPointsOnSegments(const Vec<FloatT, 3>* p,
+                             const Vec<FloatT, 3>* a,
+                             const Vec<FloatT, 3>* b,
+                             Vec<FloatT, 3>* dst,
+                             const std::size_t n) noexcept {
+  tph_linalg_internal::RunQueries<FloatT>(
+      tph_linalg_internal::SegmentQueries<FloatT>{p, a, b, dst}, n);
+}
+
+template <typename FloatT>
+void ClosestPointsOnTriangles(const Vec<FloatT, 3>* p,
+                              const Vec<FloatT, 3>* a,
+                              const Vec<FloatT, 3>* b,
+                              const Vec<FloatT, 3>* c,
+                              Vec<FloatT, 3>* dst,
+                              const std::size_t n) noexcept {
+  tph_linalg_internal::RunQueries<FloatT>(
+      tph_linalg_internal::TriangleQueries<FloatT>{p, a, b, c, dst}, n);
+}
+
+template <typename FloatT>
+void DistancesToBoxes(const Vec<FloatT, 3>* p,
+                      const Aabb<FloatT, 3>* boxes,
+                      FloatT* dst,
+                      const std::size_t n) noexcept {
+  tph_linalg_internal::RunQueries<FloatT>(tph_linalg_internal::BoxQueries<FloatT>{p, boxes, dst},
+                                          n);
+}
+
+// Solve many small linear systems, dst[i] = SolveLU(a[i], b[i]) and
+// dst[i] = SolveCholesky(a[i], b[i]), for 2x2, 3x3 and 4x4 matrices. The systems are transposed
+// into tiles of 64 and factored and solved in lock-step, one SIMD register of systems per
+// instruction, so the results match SolveLU and SolveCholesky up to rounding. Systems with a
+// singular (not positive definite) matrix do not slow down the others, they get solved == false.
+// dst must not overlap a or b.
+template <typename FloatT, int M>
+void SolveLUMany(const Mat<FloatT, M, M>* a,
+                 const Vec<FloatT, M>* b,
+                 LinearSolution<FloatT, M>* dst,
+                 const std::size_t n) noexcept {
+  tph_linalg_internal::SolveSystemsMany<true>(a, b, dst, n);
+}
+
+template <typename FloatT, int M>
+void SolveCholeskyMany(const Mat<FloatT, M, M>* a,
+                       const Vec<FloatT, M>* b,
+                       LinearSolution<FloatT, M>* dst,
+                       const std::size_t n) noexcept {
+  tph_linalg_internal::SolveSystemsMany<false>(a, b, dst, n);
+}
+
+// Rotate vectors by one rotation, dst[i] = Rotate(q, src[i]). q is converted to a matrix once and
+// the vectors are transformed by TransformDirections, which costs half the operations of Rotate.
+// Same requirements on the arrays as TransformPoints.
+template <typename ArithT>
+void RotateMany(const Quat<ArithT>& q,
+                const Vec<ArithT, 3>* src,
+                Vec<ArithT, 3>* dst,
+                const std::size_t n) noexcept {
+  const auto r = ToMat3x3(q);
+  TransformDirections(Mat<ArithT, 3, 4>{r.x, r.y, r.z, Vec<ArithT, 3>{}}, src, dst, n);
+}
+
+// Rotate vectors by their own rotations, dst[i] = Rotate(q[i], src[i]). dst may be the same array
+// as src, but the arrays must not otherwise overlap.
+template <typename ArithT>
+void RotateMany(const Quat<ArithT>* q,
+                const Vec<ArithT, 3>* src,
+                Vec<ArithT, 3>* dst,
+                const std::size_t n) noexcept {
+  tph_linalg_internal::RotateQuats(q, src, dst, n);
+}
+
+// Interpolate arrays of rotations with one weight, dst[i] = Nlerp(a[i], b[i], t) and
+// dst[i] = Slerp(a[i], b[i], t), e.g. to blend two animation poses joint by joint. The results
+// match the scalar functions up to rounding. dst may be the same array as a or b, but the arrays
+// must not otherwise overlap.
+template <typename FloatT>
+void NlerpMany(const Quat<FloatT>* a,
+               const Quat<FloatT>* b,
+               const FloatT t,
+               Quat<FloatT>* dst,
+               const std::size_t n) noexcept {
+  tph_linalg_internal::NlerpQuats(a, b, t, dst, n);
+}
+
+template <typename FloatT>
+void SlerpMany(const Quat<FloatT>* a,
+               const Quat<FloatT>* b,
+               const FloatT t,
+               Quat<FloatT>* dst,
+               const std::size_t n) noexcept {
+  tph_linalg_internal::SlerpQuats(a, b, t, dst, n);
+}
+
+// Hierarchy of n nodes where node i has the local transform local[i] and the parent parents[i], or
+// no parent if parents[i] >= n, e.g. kNoParent. The parents should form a forest. Any cycle is
+// cut by making one of its nodes a root. All nodes start dirty, so the first UpdateWorld computes
+// every world transform.
+template <typename ArithT>
+TPH_NODISCARD auto MakeTransformHierarchy(const std::size_t* parents,
+                                          const Mat<ArithT, 4, 4>* local,
+                                          const std::size_t n) -> TransformHierarchy<ArithT> {
+  const auto p = tph_linalg_internal::CutCycles(parents, n);
+  // Children of each node in compressed rows, in the order of their indices.
+  std::vector<std::size_t> first(n + 1, 0);
+  for (std::size_t i = 0; i < n; ++i) {
+    if (p[i] < n) {
+      ++first[p[i] + 1];
+    }
+  }
+  for (std::size_t i = 0; i < n; ++i) {
+    first[i + 1] += first[i];
+  }
+  std::vector<std::size_t> children(first[n]);
+  auto next = first;
+  for (std::size_t i = 0; i < n; ++i) {
+    if (p[i] < n) {
+      children[next[p[i]]++] = i;
+    }
+  }
+
+  TransformHierarchy<ArithT> h;
+  h.node.reserve(n);
+  for (std::size_t i = 0; i < n; ++i) {
+    if (p[i] >= n) {
+      h.node.push_back(i);
+    }
+  }
+  // Breadth-first, the children of each level appended in the order of their parents.
+  h.levels.push_back(0);
+  while (h.levels.back() < h.node.size()) {
+    const auto level_end = h.node.size();
+    for (auto i = h.levels.back(); i < level_end; ++i) {
+      const auto v = h.node[i];
+      h.node.insert(h.node.end(), children.begin() + static_cast<std::ptrdiff_t>(first[v]),
+                    children.begin() + static_cast<std::ptrdiff_t>(first[v + 1]));
+    }
+    h.levels.push_back(level_end);
+  }
+
+  h.position.resize(n);
+  for (std::size_t i = 0; i < n; ++i) {
+    h.position[h.node[i]] = i;
+  }
+  h.parent.resize(n);
+  h.local.resize(n);
+  for (std::size_t i = 0; i < n; ++i) {
+    const auto v = h.node[i];
+    h.parent[i] = p[v] < n ? h.position[p[v]] : kNoParent;
+    h.local[i] = local[v];
+  }
+  h.world = h.local;
+  h.dirty.assign(n, 1);
+  return h;
+}
+
+// Set the local transform of node i, by its original index, and mark it dirty.
+template <typename ArithT>
+void SetLocal(TransformHierarchy<ArithT>& h, const std::size_t i, const Mat<ArithT, 4, 4>& m) {
+  const auto k = h.position[i];
+  h.local[k] = m;
+  h.dirty[k] = 1;
+}
+
+// World transform of node i, by its original index, as of the last UpdateWorld.
+template <typename ArithT>
+TPH_NODISCARD auto GetWorld(const TransformHierarchy<ArithT>& h, const std::size_t i) noexcept
+    -> const Mat<ArithT, 4, 4>& {
+  return h.world[h.position[i]];
+}
+
+// Recompute the world transforms of the dirty nodes and their descendants, level by level with
+// the batched products of MulMany, and clear the dirty flags. The other nodes are not multiplied,
+// but every dirty flag is still read once.
+template <typename ArithT>
+void UpdateWorld(TransformHierarchy<ArithT>& h) noexcept {
+  if (h.node.empty()) {
+    return;
+  }
+  tph_linalg_internal::UpdateRoots(h, h.levels[0], h.levels[1]);
+  for (std::size_t l = 1; l + 1 < h.levels.size(); ++l) {
+    tph_linalg_internal::UpdateLevel(h, h.levels[l], h.levels[l + 1]);
+  }
+  std::fill(h.dirty.begin(), h.dirty.end(), static_cast<unsigned char>(0));
+}
+
+// View of the n vectors at base + offset, base + offset + stride, ... in bytes, e.g. the
+// positions of an interleaved vertex buffer.
+template <typename ArithT, int M>
+TPH_NODISCARD auto MakeStridedView(const void* base,
+                                   const std::size_t offset,
+                                   const std::size_t stride,
+                                   const std::size_t n) noexcept -> StridedVecView<ArithT, M> {
+  return {static_cast<const unsigned char*>(base) + offset, stride, n};
+}
+
+template <typename ArithT, int M>
+TPH_NODISCARD auto MakeStridedSpan(void* base,
+                                   const std::size_t offset,
+                                   const std::size_t stride,
+                                   const std::size_t n) noexcept -> StridedVecSpan<ArithT, M> {
+  return {static_cast<unsigned char*>(base) + offset, stride, n};
+}
+
+// View of a member of n structures, e.g. MakeStridedView(vertices, n, &Vertex::normal).
+template <typename StructT, typename ArithT, int M>
+TPH_NODISCARD auto MakeStridedView(const StructT* a,
+                                   const std::size_t n,
+                                   Vec<ArithT, M> StructT::*member) noexcept
+    -> StridedVecView<ArithT, M> {
+  return {n > 0 ? reinterpret_cast<const unsigned char*>(&(a->*member)) : nullptr,
+          sizeof(StructT), n};
+}
+
+template <typename StructT, typename ArithT, int M>
+TPH_NODISCARD auto MakeStridedSpan(StructT* a,
+                                   const std::size_t n,
+                                   Vec<ArithT, M> StructT::*member) noexcept
+    -> StridedVecSpan<ArithT, M> {
+  return {n > 0 ? reinterpret_cast<unsigned char*>(&(a->*member)) : nullptr, sizeof(StructT), n};
+}
+
+// Read-only view of a span, e.g. to transform vectors in place.
+template <typename ArithT, int M>
+TPH_NODISCARD auto ToView(const StridedVecSpan<ArithT, M>& a) noexcept
+    -> StridedVecView<ArithT, M> {
+  return {a.data, a.stride, a.size};
+}
+
+template <typename ArithT, int M>
+TPH_NODISCARD auto Size(const StridedVecView<ArithT, M>& a) noexcept -> std::size_t {
+  return a.size;
+}
+
+template <typename ArithT, int M>
+TPH_NODISCARD auto Size(const StridedVecSpan<ArithT, M>& a) noexcept -> std::size_t {
+  return a.size;
+}
+
+template <typename ArithT, int M>
+TPH_NODISCARD auto Get(const StridedVecView<ArithT, M>& a, const std::size_t i) noexcept
+    -> Vec<ArithT, M> {
+  return tph_linalg_internal::Load(a, i);
+}
+
+template <typename ArithT, int M>
+TPH_NODISCARD auto Get(const StridedVecSpan<ArithT, M>& a, const std::size_t i) noexcept
+    -> Vec<ArithT, M> {
+  return tph_linalg_internal::Load(ToView(a), i);
+}
+
+template <typename ArithT, int M>
+void Set(const StridedVecSpan<ArithT, M>& a,
+         const std::size_t i,
+         const Vec<ArithT, M>& v) noexcept {
+  tph_linalg_internal::Store(a, i, v);
+}
+
+// Batch operations on strided vectors, as the array versions above, without copying. Float vectors
+// are loaded and stored four at a time straight from and to the strides, and transposed in
+// registers, with SSE2. Packed, aligned vectors, stride == sizeof(Vec), go to the array kernels.
+// dst must have the size of src. It may be the same vectors as src, but must not otherwise overlap
+// them. The results are the same as for arrays, except that the float transforms use the SSE2
+// kernel at other strides, which may differ in the last bits from the AVX2 and AVX-512 kernels.
+template <typename ArithT>
+void TransformPoints(const Mat<ArithT, 3, 4>& m,
+                     const StridedVecView<ArithT, 3>& src,
+                     const StridedVecSpan<ArithT, 3>& dst) noexcept {
+  tph_linalg_internal::AffineView<true>(m, src, dst);
+}
+
+template <typename ArithT>
+void TransformPoints(const Mat<ArithT, 4, 4>& m,
+                     const StridedVecView<ArithT, 3>& src,
+                     const StridedVecSpan<ArithT, 3>& dst) noexcept {
+  tph_linalg_internal::AffineView<true>(tph_linalg_internal::UpperRows(m), src, dst);
+}
+
+template <typename ArithT>
+void TransformDirections(const Mat<ArithT, 3, 4>& m,
+                         const StridedVecView<ArithT, 3>& src,
+                         const StridedVecSpan<ArithT, 3>& dst) noexcept {
+  tph_linalg_internal::AffineView<false>(m, src, dst);
+}
+
+template <typename ArithT>
+void TransformDirections(const Mat<ArithT, 4, 4>& m,
+                         const StridedVecView<ArithT, 3>& src,
+                         const StridedVecSpan<ArithT, 3>& dst) noexcept {
+  tph_linalg_internal::AffineView<false>(tph_linalg_internal::UpperRows(m), src, dst);
+}
+
+template <typename ArithT>
+void ProjectPoints(const Mat<ArithT, 4, 4>& m,
+                   const StridedVecView<ArithT, 3>& src,
+                   const StridedVecSpan<ArithT, 3>& dst) noexcept {
+  tph_linalg_internal::ProjectView(m, src, dst);
+}
+
+// dst[i] = Normalized(src[i]).
+template <typename ArithT, int M>
+void Normalized(const StridedVecView<ArithT, M>& src,
+                const StridedVecSpan<ArithT, M>& dst) noexcept {
+  tph_linalg_internal::NormalizeView(src, dst);
+}
+
+template <typename ArithT>
+auto ComputeBounds(const StridedVecView<ArithT, 3>& src) noexcept -> Aabb<ArithT, 3> {
+  return tph_linalg_internal::BoundsView(src);
+}
+
+template <typename ArithT>
+auto MinMaxDot(const StridedVecView<ArithT, 3>& src, const Vec<ArithT, 3>& d) noexcept
+    -> Vec<ArithT, 2> {
+  return tph_linalg_internal::DotRangeView(src, d);
+}
+
+} // namespace tph
+
+#undef TPH_NODISCARD
+#undef TPH_IVDEP
+#undef TPH_HAS_SSE2
+#undef TPH_HAS_AVX2
+#undef TPH_ALL_KERNELS
+#undef TPH_TARGET
+#undef TPH_HAS_AVX512F
+#undef TPH_HAS_F16C
@@ -0,0 +1,456 @@
+#pragma once
+
+#include <cstddef> // std::size_t
+#include <cstdint> // std::uint16_t, std::uint32_t, std::uint64_t, std::uint8_t, SIZE_MAX
+#include <cstdio>  // std::FILE, std::fopen, std::fwrite, std::fseek, std::fclose
+#include <cstring> // std::memcmp, std::memcpy
+#include <type_traits>
+
+#include "tph_linalg.hpp"
+
+#if defined(_WIN32)
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#include <windows.h> // CreateFileA, CreateFileMappingA, MapViewOfFile, UnmapViewOfFile
+#else
+#include <fcntl.h>    // open
+#include <sys/mman.h> // mmap, munmap, posix_madvise
+#include <sys/stat.h> // fstat
+#include <unistd.h>   // close
+#endif
+
+#if __cplusplus >= 201703L // C++17 or later.
+#define TPH_NODISCARD [[nodiscard]]
+#else
+#define TPH_NODISCARD
+#endif
+
+// Memory-mapped input of vector arrays, e.g. point clouds, so that the batch operations in
+// tph_linalg_batch.hpp run directly on the page cache instead of on a copy read into memory. Files
+// are either raw arrays of vectors in native byte order, or point cloud files with a header
+// written by PointCloudWriter. Errors are returned as IoError, nothing throws.
+//
+// A point cloud file is a 32-byte header followed, at byte data_offset (64 when written here), by
+// count vectors of dimension scalars each:
+//
+//   char magic[4]            "TPHV"
+//   uint32_t byte_order      0x01020304 in the byte order of the file.
+//   uint32_t version         1
+//   uint8_t scalar_kind      'f' floating-point, 'i' signed or 'u' unsigned integer.
+//   uint8_t scalar_size      Bytes per scalar.
+//   uint16_t dimension       Scalars per vector.
+//   uint64_t count           Number of vectors.
+//   uint64_t data_offset     Bytes from the start of the file to the first vector.
+
+namespace tph {
+
+enum class IoError {
+  kNone,
+  kOpen,      // The file could not be opened, or is not a regular file.
+  kMap,       // The file could not be memory-mapped.
+  kFormat,    // Not a point cloud file, or an unsupported version.
+  kType,      // The scalar type or dimension of the file differ from the requested ones.
+  kEndian,    // The file was written with the other byte order.
+  kSize,      // The file size does not match the number of vectors.
+  kAlignment, // The vectors are not aligned for their type.
+  kWrite,     // The file could not be written.
+};
+
+// Lower-case name of error, e.g. for messages.
+TPH_NODISCARD inline auto IoErrorName(const IoError error) noexcept -> const char* {
+  switch (error) {
+  case IoError::kNone:
+    return "none";
+  case IoError::kOpen:
+    return "open";
+  case IoError::kMap:
+    return "map";
+  case IoError::kFormat:
+    return "format";
+  case IoError::kType:
+    return "type";
+  case IoError::kEndian:
+    return "endian";
+  case IoError::kSize:
+    return "size";
+  case IoError::kAlignment:
+    return "alignment";
+  case IoError::kWrite:
+    return "write";
+  }
+  return "unknown";
+}
+
+// kReadOnly maps the file read-only and shared, writing to it is not allowed. kCopyOnWrite maps
+// it writable and private, written pages are copied on first write and the file is not changed.
+enum class MapMode { kReadOnly, kCopyOnWrite };
+
+// A whole file mapped into memory, unmapped on destruction. The mapping starts on a page boundary.
+class MappedFile {
+ public:
+  MappedFile() noexcept = default;
+  ~MappedFile() { Close(); }
+
+  MappedFile(const MappedFile&) = delete;
+  auto operator=(const MappedFile&) -> MappedFile& = delete;
+
+  MappedFile(MappedFile&& other) noexcept
+      : data_(other.data_), size_(other.size_), mode_(other.mode_) {
+    other.data_ = nullptr;
+    other.size_ = 0;
+  }
+
+  auto operator=(MappedFile&& other) noexcept -> MappedFile& {
+    if (this != &other) {
+      Close();
+      data_ = other.data_;
+      size_ = other.size_;
+      mode_ = other.mode_;
+      other.data_ = nullptr;
+      other.size_ = 0;
+    }
+    return *this;
+  }
+
+  // Maps the file at path, replacing any current mapping. An empty file maps to no data.
+  auto Open(const char* path, MapMode mode) noexcept -> IoError;
+
+  void Close() noexcept;
+
+  TPH_NODISCARD auto Data() const noexcept -> const unsigned char* { return data_; }
+
+  // Writable data with kCopyOnWrite, otherwise nullptr.
+  TPH_NODISCARD auto MutableData() const noexcept -> unsigned char* {
+    return mode_ == MapMode::kCopyOnWrite ? data_ : nullptr;
+  }
+
+  TPH_NODISCARD auto Size() const noexcept -> std::size_t { return size_; }
+  TPH_NODISCARD auto Mode() const noexcept -> MapMode { return mode_; }
+
+ private:
+  unsigned char* data_ = nullptr;
+  std::size_t size_ = 0;
+  MapMode mode_ = MapMode::kReadOnly;
+};
+
+#if defined(_WIN32)
+
+inline auto MappedFile::Open(const char* path, const MapMode mode) noexcept -> IoError {
+  Close();
+  mode_ = mode;
+  const auto file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING,
+                                FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+  if (file == INVALID_HANDLE_VALUE) {
+    return IoError::kOpen;
+  }
+  LARGE_INTEGER size;
+  if (GetFileSizeEx(file, &size) == 0 ||
+      static_cast<unsigned long long>(size.QuadPart) > SIZE_MAX) {
+    CloseHandle(file);
+    return IoError::kOpen;
+  }
+  if (size.QuadPart == 0) {
+    CloseHandle(file);
+    return IoError::kNone;
+  }
+  const auto copy = mode == MapMode::kCopyOnWrite;
+  const auto mapping =
+      CreateFileMappingA(file, nullptr, copy ? PAGE_WRITECOPY : PAGE_READONLY, 0, 0, nullptr);
+  CloseHandle(file);
+  if (mapping == nullptr) {
+    return IoError::kMap;
+  }
+  // The view keeps the mapping alive.
+  const auto view = MapViewOfFile(mapping, copy ? FILE_MAP_COPY : FILE_MAP_READ, 0, 0, 0);
+  CloseHandle(mapping);
+  if (view == nullptr) {
+    return IoError::kMap;
+  }
+  data_ = static_cast<unsigned char*>(view);
+  size_ = static_cast<std::size_t>(size.QuadPart);
+  return IoError::kNone;
+}
+
+inline void MappedFile::Close() noexcept {
+  if (data_ != nullptr) {
+    UnmapViewOfFile(data_);
+  }
+  data_ = nullptr;
+  size_ = 0;
+}
+
+#else
+
+inline auto MappedFile::Open(const char* path, const MapMode mode) noexcept -> IoError {
+  Close();
+  mode_ = mode;
+  const auto fd = ::open(path, O_RDONLY);
+  if (fd < 0) {
+    return IoError::kOpen;
+  }
+  struct stat st;
+  if (::fstat(fd, &st) != 0 || !S_ISREG(st.st_mode) ||
+      static_cast<unsigned long long>(st.st_size) > SIZE_MAX) {
+    ::close(fd);
+    return IoError::kOpen;
+  }
+  const auto size = static_cast<std::size_t>(st.st_size);
+  if (size == 0) {
+    ::close(fd);
+    return IoError::kNone;
+  }
+  const auto copy = mode == MapMode::kCopyOnWrite;
+  // The mapping keeps the file alive.
+  const auto p = ::mmap(nullptr, size, copy ? PROT_READ | PROT_WRITE : PROT_READ,
+                        copy ? MAP_PRIVATE : MAP_SHARED, fd, 0);
+  ::close(fd);
+  if (p == MAP_FAILED) {
+    return IoError::kMap;
+  }
+  // The batch operations read front to back, so read ahead aggressively. Only a hint.
+  ::posix_madvise(p, size, POSIX_MADV_SEQUENTIAL);
+  data_ = static_cast<unsigned char*>(p);
+  size_ = size;
+  return IoError::kNone;
+}
+
+inline void MappedFile::Close() noexcept {
+  if (data_ != nullptr) {
+    ::munmap(data_, size_);
+  }
+  data_ = nullptr;
+  size_ = 0;
+}
+
+#endif
+
+// Vectors in a mapped file. data (and MutableData) point into file, and are nullptr when error is
+// set or there are no vectors.
+template <typename ArithT, int M>
+struct MappedVecArray {
+  MappedFile file;
+  const Vec<ArithT, M>* data;
+  std::size_t size;
+  IoError error;
+};
+
+// Writable vectors with MapMode::kCopyOnWrite, otherwise nullptr.
+template <typename ArithT, int M>
+TPH_NODISCARD auto MutableData(const MappedVecArray<ArithT, M>& a) noexcept -> Vec<ArithT, M>* {
+  return a.file.Mode() == MapMode::kCopyOnWrite ? const_cast<Vec<ArithT, M>*>(a.data) : nullptr;
+}
+
+namespace tph_linalg_internal {
+
+constexpr char kPointCloudMagic[4] = {'T', 'P', 'H', 'V'};
+constexpr std::uint32_t kByteOrderMark = 0x01020304U;
+constexpr std::uint32_t kPointCloudVersion = 1;
+
+// Offset of the vectors in written files, a cache line so that vectors of up to 64 bytes never
+// straddle one.
+constexpr std::uint64_t kPointCloudDataOffset = 64;
+
+struct PointCloudHeader {
+  char magic[4];
+  std::uint32_t byte_order;
+  std::uint32_t version;
+  std::uint8_t scalar_kind;
+  std::uint8_t scalar_size;
+  std::uint16_t dimension;
+  std::uint64_t count;
+  std::uint64_t data_offset;
+};
+static_assert(sizeof(PointCloudHeader) == 32, "unexpected point cloud header padding");
+
+template <typename ArithT>
+constexpr auto ScalarKind() noexcept -> std::uint8_t {
+  return static_cast<std::uint8_t>(!std::is_integral<ArithT>::value ? 'f'
+                                   : std::is_signed<ArithT>::value  ? 'i'
+                                                                    : 'u');
+}
+
+template <typename ArithT, int M>
+auto MakePointCloudHeader(const std::uint64_t count) noexcept -> PointCloudHeader {
+  PointCloudHeader h = {};
+  std::memcpy(h.magic, kPointCloudMagic, sizeof(h.magic));
+  h.byte_order = kByteOrderMark;
+  h.version = kPointCloudVersion;
+  h.scalar_kind = ScalarKind<ArithT>();
+  h.scalar_size = static_cast<std::uint8_t>(sizeof(ArithT));
+  h.dimension = static_cast<std::uint16_t>(M);
+  h.count = count;
+  h.data_offset = kPointCloudDataOffset;
+  return h;
+}
+
+inline auto ByteSwap(const std::uint32_t x) noexcept -> std::uint32_t {
+  return (x >> 24U) | ((x >> 8U) & 0xFF00U) | ((x << 8U) & 0xFF0000U) | (x << 24U);
+}
+
+// Points a at the count vectors at byte offset of its file, or sets its error. The size of the
+// file must be exactly that of the vectors.
+template <typename ArithT, int M>
+void SetVectors(MappedVecArray<ArithT, M>* a,
+                const std::uint64_t offset,
+                const std::uint64_t count) noexcept {
+  const auto bytes = static_cast<std::uint64_t>(a->file.Size());
+  if (offset > bytes || count != (bytes - offset) / sizeof(Vec<ArithT, M>) ||
+      (bytes - offset) % sizeof(Vec<ArithT, M>) != 0) {
+    a->error = IoError::kSize;
+  } else if (offset % alignof(Vec<ArithT, M>) != 0) {
+    // The mapping is page-aligned, so only the offset matters.
+    a->error = IoError::kAlignment;
+  } else if (count != 0) {
+    a->data = reinterpret_cast<const Vec<ArithT, M>*>(a->file.Data() + offset);
+    a->size = static_cast<std::size_t>(count);
+  }
+  if (a->error != IoError::kNone) {
+    a->file.Close();
+  }
+}
+
+} // namespace tph_linalg_internal
+
+// Maps a raw array of vectors in native byte order, starting offset bytes into the file at path.
+// Raw files carry no type or byte order, only the size and alignment are checked.
+template <typename ArithT, int M>
+TPH_NODISCARD auto MapRawPoints(const char* path,
+                                const MapMode mode,
+                                const std::size_t offset = 0) noexcept
+    -> MappedVecArray<ArithT, M> {
+  MappedVecArray<ArithT, M> a = {MappedFile{}, nullptr, 0, IoError::kNone};
+  a.error = a.file.Open(path, mode);
+  if (a.error == IoError::kNone) {
+    const auto bytes = a.file.Size();
+    tph_linalg_internal::SetVectors(
+        &a, offset, offset <= bytes ? (bytes - offset) / sizeof(Vec<ArithT, M>) : 0);
+  }
+  return a;
+}
+
+// Maps a point cloud file, e.g. written by PointCloudWriter, checking that its header matches
+// ArithT and M, the native byte order and the file size.
+template <typename ArithT, int M>
+TPH_NODISCARD auto MapPointCloud(const char* path, const MapMode mode) noexcept
+    -> MappedVecArray<ArithT, M> {
+  namespace internal = tph_linalg_internal;
+  MappedVecArray<ArithT, M> a = {MappedFile{}, nullptr, 0, IoError::kNone};
+  a.error = a.file.Open(path, mode);
+  if (a.error != IoError::kNone) {
+    return a;
+  }
+  internal::PointCloudHeader h;
+  if (a.file.Size() < sizeof(h)) {
+    a.error = IoError::kFormat;
+  } else {
+    std::memcpy(&h, a.file.Data(), sizeof(h));
+    if (std::memcmp(h.magic, internal::kPointCloudMagic, sizeof(h.magic)) != 0) {
+      a.error = IoError::kFormat;
+    } else if (h.byte_order != internal::kByteOrderMark) {
+      a.error = h.byte_order == internal::ByteSwap(internal::kByteOrderMark) ? IoError::kEndian
+                                                                             : IoError::kFormat;
+    } else if (h.version != internal::kPointCloudVersion) {
+      a.error = IoError::kFormat;
+    } else if (h.scalar_kind != internal::ScalarKind<ArithT>() ||
+               h.scalar_size != sizeof(ArithT) || h.dimension != M) {
+      a.error = IoError::kType;
+    } else if (h.data_offset < sizeof(h)) {
+      a.error = IoError::kFormat;
+    }
+  }
+  if (a.error != IoError::kNone) {
+    a.file.Close();
+    return a;
+  }
+  internal::SetVectors(&a, h.data_offset, h.count);
+  return a;
+}
+
+// Writes a point cloud file in chunks, e.g. results as they are computed. The count in the header
+// is written by Close, so a file that was not closed fails to map with IoError::kSize. Errors are
+// sticky: after the first one, Write and Close return it and write nothing more.
+template <typename ArithT, int M>
+class PointCloudWriter {
+ public:
+  PointCloudWriter() noexcept = default;
+  ~PointCloudWriter() { Close(); }
+
+  PointCloudWriter(const PointCloudWriter&) = delete;
+  auto operator=(const PointCloudWriter&) -> PointCloudWriter& = delete;
+
+  // Creates or truncates the file at path and writes the header, closing any current file.
+  auto Open(const char* path) noexcept -> IoError {
+    Close();
+    error_ = IoError::kNone;
+    count_ = 0;
+    file_ = std::fopen(path, "wb");
+    if (file_ == nullptr) {
+      return error_ = IoError::kOpen;
+    }
+    return WriteHeader();
+  }
+
+  auto Write(const Vec<ArithT, M>* src, const std::size_t n) noexcept -> IoError {
+    if (error_ == IoError::kNone && n != 0) {
+      if (file_ == nullptr || std::fwrite(src, sizeof(*src), n, file_) != n) {
+        error_ = IoError::kWrite;
+      } else {
+        count_ += n;
+      }
+    }
+    return error_;
+  }
+
+  // Writes the final count and closes the file.
+  auto Close() noexcept -> IoError {
+    if (file_ != nullptr) {
+      if (error_ == IoError::kNone &&
+          (std::fseek(file_, 0, SEEK_SET) != 0 || WriteHeader() != IoError::kNone)) {
+        error_ = IoError::kWrite;
+      }
+      if (std::fclose(file_) != 0 && error_ == IoError::kNone) {
+        error_ = IoError::kWrite;
+      }
+      file_ = nullptr;
+    }
+    return error_;
+  }
+
+  // Number of vectors written since Open.
+  TPH_NODISCARD auto Count() const noexcept -> std::uint64_t { return count_; }
+
+ private:
+  auto WriteHeader() noexcept -> IoError {
+    namespace internal = tph_linalg_internal;
+    const auto h = internal::MakePointCloudHeader<ArithT, M>(count_);
+    const unsigned char padding[internal::kPointCloudDataOffset - sizeof(h)] = {};
+    if (std::fwrite(&h, sizeof(h), 1, file_) != 1 ||
+        std::fwrite(padding, sizeof(padding), 1, file_) != 1) {
+      error_ = IoError::kWrite;
+    }
+    return error_;
+  }
+
+  std::FILE* file_ = nullptr;
+  std::uint64_t count_ = 0;
+  IoError error_ = IoError::kNone;
+};
+
+// Writes the n vectors at src as a point cloud file.
+template <typename ArithT, int M>
+auto WritePointCloud(const char* path, const Vec<ArithT, M>* src, const std::size_t n) noexcept
+    -> IoError {
+  PointCloudWriter<ArithT, M> w;
+  if (w.Open(path) == IoError::kNone) {
+    w.Write(src, n);
+  }
+  return w.Close();
+}
+
+} // namespace tph
+
+#undef TPH_NODISCARD
@@ -0,0 +1,115 @@
+#pragma once
+
+#include <cstddef> // std::size_t
+
+#include "tph_linalg.hpp"
+
+#if __cplusplus >= 201703L // C++17 or later.
+#define TPH_NODISCARD [[nodiscard]]
+#else
+#define TPH_NODISCARD
+#endif
+
+// Batch kernels compiled for several instruction sets, with the best one supported by the processor
+// selected at run-time on first use. Declared here, defined in the tph_linalg_kernels library
+// (TPH_BuildKernels). The header-only versions in tph_linalg_batch.hpp are instead compiled for the
+// instruction set targeted by the including translation unit, which is typically the baseline.
+//
+// The selection can be forced with the TPH_LINALG_ISA environment variable, set to one of "scalar",
+// "sse2", "avx2" or "avx512" in any case, e.g. to compare kernels. A level that the processor does
+// not support falls back to the best supported level below it. Any other value is ignored and the
+// best supported level is used, IsaOverridden tells whether the variable was applied.
+
+namespace tph {
+namespace kernels {
+
+// Instruction set levels, each one implies the ones before it. kAvx2 includes FMA and F16C.
+enum class Isa { kScalar, kSse2, kAvx2, kAvx512 };
+
+// The best instruction set supported by the processor and operating system.
+TPH_NODISCARD auto SupportedIsa() noexcept -> Isa;
+
+// The instruction set of the kernels currently in use.
+TPH_NODISCARD auto ActiveIsa() noexcept -> Isa;
+
+// Use the kernels for isa, or for the best supported level below it. Returns the level used.
+auto SetIsa(Isa isa) noexcept -> Isa;
+
+// True if the level was initially selected by TPH_LINALG_ISA. False if the variable is unset or not
+// a level name, or if SetIsa was called before the kernels were first used.
+TPH_NODISCARD auto IsaOverridden() noexcept -> bool;
+
+// Lower-case name of isa, as accepted by TPH_LINALG_ISA.
+TPH_NODISCARD auto IsaName(Isa isa) noexcept -> const char*;
+
+// Same as the header-only functions with the same names in tph_linalg_batch.hpp.
+void TransformPoints(const Mat<float, 3, 4>& m,
+                     const Vec<float, 3>* src,
+                     Vec<float, 3>* dst,
+                     std::size_t n) noexcept;
+void TransformPoints(const Mat<float, 4, 4>& m,
+                     const Vec<float, 3>* src,
+                     Vec<float, 3>* dst,
+                     std::size_t n) noexcept;
+void TransformDirections(const Mat<float, 3, 4>& m,
+                         const Vec<float, 3>* src,
+                         Vec<float, 3>* dst,
+                         std::size_t n) noexcept;
+void TransformDirections(const Mat<float, 4, 4>& m,
+                         const Vec<float, 3>* src,
+                         Vec<float, 3>* dst,
+                         std::size_t n) noexcept;
+void ProjectPoints(const Mat<float, 4, 4>& m,
+                   const Vec<float, 3>* src,
+                   Vec<float, 3>* dst,
+                   std::size_t n) noexcept;
+void TransformPoints(const Mat<float, 3, 4>& m,
+                     const Vec<half, 3>* src,
+                     Vec<half, 3>* dst,
+                     std::size_t n) noexcept;
+void TransformPoints(const Mat<float, 4, 4>& m,
+                     const Vec<half, 3>* src,
+                     Vec<half, 3>* dst,
+                     std::size_t n) noexcept;
+void TransformDirections(const Mat<float, 3, 4>& m,
+                         const Vec<half, 3>* src,
+                         Vec<half, 3>* dst,
+                         std::size_t n) noexcept;
+void TransformDirections(const Mat<float, 4, 4>& m,
+                         const Vec<half, 3>* src,
+                         Vec<half, 3>* dst,
+                         std::size_t n) noexcept;
+void ProjectPoints(const Mat<float, 4, 4>& m,
+                   const Vec<half, 3>* src,
+                   Vec<half, 3>* dst,
+                   std::size_t n) noexcept;
+void Widen(const half* src, float* dst, std::size_t n) noexcept;
+void Narrow(const float* src, half* dst, std::size_t n) noexcept;
+void Encode(const Vec<float, 3>* src, Oct16* dst, std::size_t n) noexcept;
+void Encode(const Vec<float, 3>* src, Oct32* dst, std::size_t n) noexcept;
+void Encode(const Vec<float, 3>* src, Snorm1010102* dst, std::size_t n) noexcept;
+void Decode(const Oct16* src, Vec<float, 3>* dst, std::size_t n) noexcept;
+void Decode(const Oct32* src, Vec<float, 3>* dst, std::size_t n) noexcept;
+void Decode(const Snorm1010102* src, Vec<float, 3>* dst, std::size_t n) noexcept;
+TPH_NODISCARD auto ComputeBounds(const Vec<float, 3>* src, std::size_t n) noexcept
+    -> Aabb<float, 3>;
+TPH_NODISCARD auto MinMaxDot(const Vec<float, 3>* src,
+                             std::size_t n,
+                             const Vec<float, 3>& d) noexcept -> Vec<float, 2>;
+TPH_NODISCARD auto Centroid(const Vec<float, 3>* src, std::size_t n) noexcept -> Vec<float, 3>;
+TPH_NODISCARD auto Covariance(const Vec<float, 3>* src, std::size_t n) noexcept
+    -> Mat<float, 3, 3>;
+void InverseMany(const Mat<float, 4, 4>* src, Mat<float, 4, 4>* dst, std::size_t n) noexcept;
+void MulMany(const Mat<float, 4, 4>* a,
+             const Mat<float, 4, 4>* b,
+             Mat<float, 4, 4>* dst,
+             std::size_t n) noexcept;
+void MulMany(const Mat<float, 4, 4>& a,
+             const Mat<float, 4, 4>* b,
+             Mat<float, 4, 4>* dst,
+             std::size_t n) noexcept;
+
+} // namespace kernels
+} // namespace tph
+
+#undef TPH_NODISCARD
@@ -0,0 +1,847 @@
+#pragma once
+
+#include <algorithm> // std::fill
+#include <atomic>
+#include <condition_variable>
+#include <cstddef> // std::ptrdiff_t, std::size_t
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <utility> // std::swap
+#include <vector>
+
+#include "tph_linalg_batch.hpp"
+
+#if __cplusplus >= 201703L // C++17 or later.
+#define TPH_NODISCARD [[nodiscard]]
+#else
+#define TPH_NODISCARD
+#endif
+
+// Parallel versions of the batch operations in tph_linalg_batch.hpp, taking a Scheduler as first
+// argument. Arrays are split into chunks of a fixed number of elements, small enough for the data
+// of a chunk to stay in the L2 cache, and the chunks are run by the scheduler. The chunks depend
+// only on the number of elements, and reductions combine the chunk results in chunk order, so the
+// results are the same for any number of threads and any scheduling.
+//
+// ThreadPool is a work-stealing scheduler built on std::thread (link with Threads::Threads). An
+// existing thread pool can be used instead by implementing Scheduler.
+
+namespace tph {
+
+// Runs tasks, possibly concurrently.
+class Scheduler {
+ public:
+  using Task = std::function<void(std::size_t)>;
+
+  virtual ~Scheduler() = default;
+
+  // Call task(i) once for each i in [0, task_count), in any order and possibly concurrently, and
+  // return when all calls have returned. If a task throws, the tasks not yet started may be skipped
+  // and Run rethrows the exception once the running tasks have returned.
+  virtual void Run(std::size_t task_count, const Task& task) = 0;
+};
+
+// Runs the tasks in order on the calling thread.
+class SerialScheduler final : public Scheduler {
+ public:
+  void Run(const std::size_t task_count, const Task& task) override {
+    for (std::size_t i = 0; i < task_count; ++i) {
+      task(i);
+    }
+  }
+};
+
+// Work-stealing thread pool. Run splits the tasks into contiguous ranges, one per thread including
+// the calling thread. Each thread takes tasks from the front of its own range and, when that is
+// empty, steals from the back of the other ranges. Concurrent Run calls are serialized, and Run
+// called from inside a task runs the tasks on the calling thread. The first exception thrown by a
+// task, on any thread, empties all ranges and is rethrown by Run on the calling thread.
+class ThreadPool final : public Scheduler {
+ public:
+  // thread_count threads in total including the thread calling Run, 0 for one per hardware thread.
+  explicit ThreadPool(unsigned thread_count = 0);
+  ~ThreadPool() override;
+
+  ThreadPool(const ThreadPool&) = delete;
+  auto operator=(const ThreadPool&) -> ThreadPool& = delete;
+
+  TPH_NODISCARD auto ThreadCount() const noexcept -> std::size_t { return ranges_.size(); }
+
+  void Run(std::size_t task_count, const Task& task) override;
+
+ private:
+  struct Range {
+    std::mutex mutex;
+    std::size_t begin = 0;
+    std::size_t end = 0;
+  };
+
+  // The pool whose tasks the current thread is running, if any.
+  static auto Current() noexcept -> const ThreadPool*& {
+    static thread_local const ThreadPool* pool = nullptr;
+    return pool;
+  }
+
+  static auto HardwareThreads() noexcept -> unsigned {
+    const auto n = std::thread::hardware_concurrency();
+    return n > 0 ? n : 1; // 0 if unknown.
+  }
+
+  auto Take(std::size_t self, std::size_t* i) -> bool;
+  auto Cancel(const std::exception_ptr& e) -> std::size_t;
+  void Work(std::size_t self);
+  void WorkerLoop(std::size_t self);
+
+  std::vector<Range> ranges_; // ranges_[0] belongs to the thread calling Run.
+  std::mutex run_mutex_;
+  std::mutex mutex_;
+  std::condition_variable wake_;
+  std::condition_variable done_;
+  unsigned long long generation_ = 0;
+  bool stop_ = false;
+  const Task* task_ = nullptr;
+  std::exception_ptr error_; // Guarded by mutex_.
+  std::atomic<std::size_t> remaining_{0};
+  std::vector<std::thread> workers_;
+};
+
+inline ThreadPool::ThreadPool(const unsigned thread_count)
+    : ranges_(thread_count != 0 ? thread_count : HardwareThreads()) {
+  workers_.reserve(ranges_.size() - 1);
+  for (std::size_t i = 1; i < ranges_.size(); ++i) {
+    workers_.emplace_back([this, i] { WorkerLoop(i); });
+  }
+}
+
+inline ThreadPool::~ThreadPool() {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stop_ = true;
+  }
+  wake_.notify_all();
+  for (auto& t : workers_) {
+    t.join();
+  }
+}
+
+inline void ThreadPool::Run(const std::size_t task_count, const Task& task) {
+  if (workers_.empty() || task_count <= 1 || Current() == this) {
+    for (std::size_t i = 0; i < task_count; ++i) {
+      task(i);
+    }
+    return;
+  }
+
+  std::lock_guard<std::mutex> run_lock(run_mutex_);
+  // Workers read task_ only after taking a task, which synchronizes with the range mutex below.
+  task_ = &task;
+  remaining_.store(task_count, std::memory_order_relaxed);
+  const auto n = ranges_.size();
+  for (std::size_t r = 0; r < n; ++r) {
+    std::lock_guard<std::mutex> lock(ranges_[r].mutex);
+    ranges_[r].begin = task_count * r / n;
+    ranges_[r].end = task_count * (r + 1) / n;
+  }
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    ++generation_;
+  }
+  wake_.notify_all();
+
+  const auto* const previous = Current();
+  Current() = this;
+  Work(0);
+  Current() = previous;
+
+  std::exception_ptr error;
+  {
+    std::unique_lock<std::mutex> lock(mutex_);
+    done_.wait(lock, [this] { return remaining_.load(std::memory_order_acquire) == 0; });
+    std::swap(error, error_);
+  }
+  if (error) {
+    std::rethrow_exception(error);
+  }
+}
+
+inline auto ThreadPool::Take(const std::size_t self, std::size_t* i) -> bool {
+  {
+    auto& r = ranges_[self];
+    std::lock_guard<std::mutex> lock(r.mutex);
+    if (r.begin < r.end) {
+      *i = r.begin++;
+      return true;
+    }
+  }
+  for (std::size_t k = 1; k < ranges_.size(); ++k) {
+    auto& r = ranges_[(self + k) % ranges_.size()];
+    std::lock_guard<std::mutex> lock(r.mutex);
+    if (r.begin < r.end) {
+      *i = --r.end;
+      return true;
+    }
+  }
+  return false;
+}
+
+// Keep the first exception and empty all ranges, returns the number of tasks dropped.
+inline auto ThreadPool::Cancel(const std::exception_ptr& e) -> std::size_t {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (!error_) {
+      error_ = e;
+    }
+  }
+  std::size_t dropped = 0;
+  for (auto& r : ranges_) {
+    std::lock_guard<std::mutex> lock(r.mutex);
+    dropped += r.end - r.begin;
+    r.begin = r.end;
+  }
+  return dropped;
+}
+
+inline void ThreadPool::Work(const std::size_t self) {
+  std::size_t i = 0;
+  while (Take(self, &i)) {
+    std::size_t finished = 1;
+    try {
+      (*task_)(i);
+    } catch (...) {
+      finished += Cancel(std::current_exception());
+    }
+    if (remaining_.fetch_sub(finished, std::memory_order_acq_rel) == finished) {
+      std::lock_guard<std::mutex> lock(mutex_);
+      done_.notify_all();
+    }
+  }
+}
+
+inline void ThreadPool::WorkerLoop(const std::size_t self) {
+  Current() = this;
+  unsigned long long seen = 0;
+  for (;;) {
+    {
+      std::unique_lock<std::mutex> lock(mutex_);
+      wake_.wait(lock, [this, seen] { return stop_ || generation_ != seen; });
+      if (stop_) {
+        return;
+      }
+      seen = generation_;
+    }
+    Work(self);
+  }
+}
+
+// Call f(begin, end) for the consecutive chunks [0, chunk), [chunk, 2 * chunk), ... of [0, n), the
+// last chunk may be smaller.
+template <typename F>
+void ParallelFor(Scheduler& s, const std::size_t n, const std::size_t chunk, F f) {
+  const auto c = chunk > 0 ? chunk : 1;
+  s.Run((n + c - 1) / c, [n, c, &f](const std::size_t i) {
+    const auto begin = i * c;
+    f(begin, n - begin < c ? n : begin + c);
+  });
+}
+
+// Reduce the chunks of [0, n) as in ParallelFor, returns
+// combine(...combine(combine(init, map(chunk 0)), map(chunk 1))..., map(last chunk)).
+template <typename T, typename Map, typename Combine>
+TPH_NODISCARD auto ParallelReduce(Scheduler& s,
+                                  const std::size_t n,
+                                  const std::size_t chunk,
+                                  T init,
+                                  Map map,
+                                  Combine combine) -> T {
+  const auto c = chunk > 0 ? chunk : 1;
+  std::vector<T> partial((n + c - 1) / c, init);
+  s.Run(partial.size(), [n, c, &map, &partial](const std::size_t i) {
+    const auto begin = i * c;
+    partial[i] = map(begin, n - begin < c ? n : begin + c);
+  });
+  for (const auto& p : partial) {
+    init = combine(init, p);
+  }
+  return init;
+}
+
+namespace tph_linalg_internal {
+
+// Bytes of input and output per chunk, well within the L2 cache.
+constexpr std::size_t kChunkBytes = std::size_t{1} << 17;
+
+// Elements per chunk, a multiple of 64 so that SIMD blocks are not split.
+constexpr auto ChunkSize(const std::size_t bytes_per_element) noexcept -> std::size_t {
+  return kChunkBytes / bytes_per_element / 64 < 1 ? 64
+                                                  : kChunkBytes / bytes_per_element / 64 * 64;
+}
+
+// Component pointers advanced to lane i.
+template <typename ArithT>
+auto Advance(const Vec<ArithT*, 2>& p, const std::size_t i) noexcept -> Vec<ArithT*, 2> {
+  return {p.x + i, p.y + i};
+}
+
+template <typename ArithT>
+auto Advance(const Vec<ArithT*, 3>& p, const std::size_t i) noexcept -> Vec<ArithT*, 3> {
+  return {p.x + i, p.y + i, p.z + i};
+}
+
+template <typename ArithT>
+auto Advance(const Vec<ArithT*, 4>& p, const std::size_t i) noexcept -> Vec<ArithT*, 4> {
+  return {p.x + i, p.y + i, p.z + i, p.w + i};
+}
+
+template <typename ArithT, int M, typename OutT, typename F>
+void ParallelScalar(Scheduler& s, const VecArraySoA<ArithT, M>& a, OutT* out, F f) {
+  const auto pa = Lanes(a);
+  ParallelFor(s, Size(a), ChunkSize(sizeof(ArithT) * M + sizeof(OutT)),
+              [pa, out, f](const std::size_t begin, const std::size_t end) {
+                MapScalar(Advance(pa, begin), out + begin, end - begin, f);
+              });
+}
+
+template <typename ArithT, int M, typename OutT, typename F>
+void ParallelScalar(Scheduler& s,
+                    const VecArraySoA<ArithT, M>& a,
+                    const VecArraySoA<ArithT, M>& b,
+                    OutT* out,
+                    F f) {
+  const auto pa = Lanes(a);
+  const auto pb = Lanes(b);
+  ParallelFor(s, Size(a), ChunkSize(2 * sizeof(ArithT) * M + sizeof(OutT)),
+              [pa, pb, out, f](const std::size_t begin, const std::size_t end) {
+                MapScalar(Advance(pa, begin), Advance(pb, begin), out + begin, end - begin, f);
+              });
+}
+
+template <typename ArithT, int M, int N, typename F>
+void ParallelVec(Scheduler& s, const VecArraySoA<ArithT, M>& a, VecArraySoA<ArithT, N>& out, F f) {
+  Resize(out, Size(a));
+  const auto pa = Lanes(a);
+  const auto po = Lanes(out);
+  ParallelFor(s, Size(a), ChunkSize(sizeof(ArithT) * (M + N)),
+              [pa, po, f](const std::size_t begin, const std::size_t end) {
+                MapVec(Advance(pa, begin), Advance(po, begin), end - begin, f);
+              });
+}
+
+template <typename ArithT, int M, int N, typename F>
+void ParallelVec(Scheduler& s,
+                 const VecArraySoA<ArithT, M>& a,
+                 const VecArraySoA<ArithT, M>& b,
+                 VecArraySoA<ArithT, N>& out,
+                 F f) {
+  Resize(out, Size(a));
+  const auto pa = Lanes(a);
+  const auto pb = Lanes(b);
+  const auto po = Lanes(out);
+  ParallelFor(s, Size(a), ChunkSize(sizeof(ArithT) * (2 * M + N)),
+              [pa, pb, po, f](const std::size_t begin, const std::size_t end) {
+                MapVec(Advance(pa, begin), Advance(pb, begin), Advance(po, begin), end - begin, f);
+              });
+}
+
+// f(src + begin, dst + begin, end - begin) for the chunks of arrays of T.
+template <typename T, typename U, typename F>
+void ParallelArrays(Scheduler& s, const T* src, U* dst, const std::size_t n, F f) {
+  ParallelFor(s, n, ChunkSize(sizeof(T) + sizeof(U)),
+              [src, dst, &f](const std::size_t begin, const std::size_t end) {
+                f(src + begin, dst + begin, end - begin);
+              });
+}
+
+// Sum of map(begin, end) over the chunks of [0, n), added pairwise as in PairwiseSum. The result
+// depends only on n and chunk, not on the scheduler.
+template <typename T, typename Map>
+auto ParallelSum(Scheduler& s, const std::size_t n, const std::size_t chunk, Map map) -> T {
+  std::vector<T> partial((n + chunk - 1) / chunk);
+  s.Run(partial.size(), [n, chunk, &map, &partial](const std::size_t i) {
+    const auto begin = i * chunk;
+    partial[i] = map(begin, n - begin < chunk ? n : begin + chunk);
+  });
+  return partial.empty() ? T{}
+                         : PairwiseSum<T>(0, partial.size(), 1,
+                                          [&partial](const std::size_t i, std::size_t /*end*/) {
+                                            return partial[i];
+                                          });
+}
+
+} // namespace tph_linalg_internal
+
+// Parallel versions of the SoA batch functions, same requirements.
+template <typename ArithT, int M>
+void Dot(Scheduler& s,
+         const VecArraySoA<ArithT, M>& a,
+         const VecArraySoA<ArithT, M>& b,
+         ArithT* out) {
+  tph_linalg_internal::ParallelScalar(s, a, b, out, tph_linalg_internal::DotOp{});
+}
+
+template <typename ArithT, int M>
+void Length2(Scheduler& s, const VecArraySoA<ArithT, M>& a, ArithT* out) {
+  tph_linalg_internal::ParallelScalar(s, a, out, tph_linalg_internal::Length2Op{});
+}
+
+template <typename ArithT, int M>
+void Length(Scheduler& s, const VecArraySoA<ArithT, M>& a, ArithT* out) {
+  tph_linalg_internal::ParallelScalar(s, a, out, tph_linalg_internal::LengthOp{});
+}
+
+template <typename ArithT, int M>
+void Distance2(Scheduler& s,
+               const VecArraySoA<ArithT, M>& a,
+               const VecArraySoA<ArithT, M>& b,
+               ArithT* out) {
+  tph_linalg_internal::ParallelScalar(s, a, b, out, tph_linalg_internal::Distance2Op{});
+}
+
+template <typename ArithT>
+void Cross(Scheduler& s,
+           const VecArraySoA<ArithT, 3>& a,
+           const VecArraySoA<ArithT, 3>& b,
+           VecArraySoA<ArithT, 3>& out) {
+  tph_linalg_internal::ParallelVec(s, a, b, out, tph_linalg_internal::CrossOp{});
+}
+
+template <typename ArithT, int M>
+void Normalized(Scheduler& s, const VecArraySoA<ArithT, M>& a, VecArraySoA<ArithT, M>& out) {
+  tph_linalg_internal::ParallelVec(s, a, out, tph_linalg_internal::NormalizedOp{});
+}
+
+template <typename ArithT, int M, int N>
+void Mul(Scheduler& s,
+         const Mat<ArithT, M, N>& m,
+         const VecArraySoA<ArithT, N>& a,
+         VecArraySoA<ArithT, M>& out) {
+  tph_linalg_internal::ParallelVec(s, a, out, tph_linalg_internal::MulOp<Mat<ArithT, M, N>>{m});
+}
+
+// Parallel versions of the array transforms, same requirements.
+template <typename ArithT>
+void TransformPoints(Scheduler& s,
+                     const Mat<ArithT, 3, 4>& m,
+                     const Vec<ArithT, 3>* src,
+                     Vec<ArithT, 3>* dst,
+                     const std::size_t n) {
+  tph_linalg_internal::ParallelArrays(
+      s, src, dst, n, [&m](const Vec<ArithT, 3>* a, Vec<ArithT, 3>* b, const std::size_t k) {
+        TransformPoints(m, a, b, k);
+      });
+}
+
+template <typename ArithT>
+void TransformPoints(Scheduler& s,
+                     const Mat<ArithT, 4, 4>& m,
+                     const Vec<ArithT, 3>* src,
+                     Vec<ArithT, 3>* dst,
+                     const std::size_t n) {
+  TransformPoints(s, tph_linalg_internal::UpperRows(m), src, dst, n);
+}
+
+template <typename ArithT>
+void TransformDirections(Scheduler& s,
+                         const Mat<ArithT, 3, 4>& m,
+                         const Vec<ArithT, 3>* src,
+                         Vec<ArithT, 3>* dst,
+                         const std::size_t n) {
+  tph_linalg_internal::ParallelArrays(
+      s, src, dst, n, [&m](const Vec<ArithT, 3>* a, Vec<ArithT, 3>* b, const std::size_t k) {
+        TransformDirections(m, a, b, k);
+      });
+}
+
+template <typename ArithT>
+void TransformDirections(Scheduler& s,
+                         const Mat<ArithT, 4, 4>& m,
+                         const Vec<ArithT, 3>* src,
+                         Vec<ArithT, 3>* dst,
+                         const std::size_t n) {
+  TransformDirections(s, tph_linalg_internal::UpperRows(m), src, dst, n);
+}
+
+template <typename ArithT>
+void ProjectPoints(Scheduler& s,
+                   const Mat<ArithT, 4, 4>& m,
+                   const Vec<ArithT, 3>* src,
+                   Vec<ArithT, 3>* dst,
+                   const std::size_t n) {
+  tph_linalg_internal::ParallelArrays(
+      s, src, dst, n, [&m](const Vec<ArithT, 3>* a, Vec<ArithT, 3>* b, const std::size_t k) {
+        ProjectPoints(m, a, b, k);
+      });
+}
+
+inline void TransformPoints(Scheduler& s,
+                            const Mat<float, 3, 4>& m,
+                            const Vec<half, 3>* src,
+                            Vec<half, 3>* dst,
+                            const std::size_t n) {
+  tph_linalg_internal::ParallelArrays(
+      s, src, dst, n, [&m](const Vec<half, 3>* a, Vec<half, 3>* b, const std::size_t k) {
+        TransformPoints(m, a, b, k);
+      });
+}
+
+inline void TransformPoints(Scheduler& s,
+                            const Mat<float, 4, 4>& m,
+                            const Vec<half, 3>* src,
+                            Vec<half, 3>* dst,
+                            const std::size_t n) {
+  TransformPoints(s, tph_linalg_internal::UpperRows(m), src, dst, n);
+}
+
+inline void TransformDirections(Scheduler& s,
+                                const Mat<float, 3, 4>& m,
+                                const Vec<half, 3>* src,
+                                Vec<half, 3>* dst,
+                                const std::size_t n) {
+  tph_linalg_internal::ParallelArrays(
+      s, src, dst, n, [&m](const Vec<half, 3>* a, Vec<half, 3>* b, const std::size_t k) {
+        TransformDirections(m, a, b, k);
+      });
+}
+
+inline void TransformDirections(Scheduler& s,
+                                const Mat<float, 4, 4>& m,
+                                const Vec<half, 3>* src,
+                                Vec<half, 3>* dst,
+                                const std::size_t n) {
+  TransformDirections(s, tph_linalg_internal::UpperRows(m), src, dst, n);
+}
+
+inline void ProjectPoints(Scheduler& s,
+                          const Mat<float, 4, 4>& m,
+                          const Vec<half, 3>* src,
+                          Vec<half, 3>* dst,
+                          const std::size_t n) {
+  tph_linalg_internal::ParallelArrays(
+      s, src, dst, n, [&m](const Vec<half, 3>* a, Vec<half, 3>* b, const std::size_t k) {
+        ProjectPoints(m, a, b, k);
+      });
+}
+
+template <typename PackedT>
+void Encode(Scheduler& s, const Vec<float, 3>* src, PackedT* dst, const std::size_t n) {
+  tph_linalg_internal::ParallelArrays(
+      s, src, dst, n, [](const Vec<float, 3>* a, PackedT* b, const std::size_t k) {
+        Encode(a, b, k);
+      });
+}
+
+template <typename PackedT>
+void Decode(Scheduler& s, const PackedT* src, Vec<float, 3>* dst, const std::size_t n) {
+  tph_linalg_internal::ParallelArrays(
+      s, src, dst, n, [](const PackedT* a, Vec<float, 3>* b, const std::size_t k) {
+        Decode(a, b, k);
+      });
+}
+
+template <typename ArithT>
+void InverseMany(Scheduler& s,
+                 const Mat<ArithT, 4, 4>* src,
+                 Mat<ArithT, 4, 4>* dst,
+                 const std::size_t n) {
+  tph_linalg_internal::ParallelArrays(
+      s, src, dst, n, [](const Mat<ArithT, 4, 4>* a, Mat<ArithT, 4, 4>* b, const std::size_t k) {
+        InverseMany(a, b, k);
+      });
+}
+
+template <typename ArithT>
+void MulMany(Scheduler& s,
+             const Mat<ArithT, 4, 4>* a,
+             const Mat<ArithT, 4, 4>* b,
+             Mat<ArithT, 4, 4>* dst,
+             const std::size_t n) {
+  ParallelFor(s, n, tph_linalg_internal::ChunkSize(3 * sizeof(Mat<ArithT, 4, 4>)),
+              [a, b, dst](const std::size_t begin, const std::size_t end) {
+                MulMany(a + begin, b + begin, dst + begin, end - begin);
+              });
+}
+
+template <typename ArithT>
+void MulMany(Scheduler& s,
+             const Mat<ArithT, 4, 4>& a,
+             const Mat<ArithT, 4, 4>* b,
+             Mat<ArithT, 4, 4>* dst,
+             const std::size_t n) {
+  tph_linalg_internal::ParallelArrays(
+      s, b, dst, n, [&a](const Mat<ArithT, 4, 4>* bb, Mat<ArithT, 4, 4>* d, const std::size_t k) {
+        MulMany(a, bb, d, k);
+      });
+}
+
+template <typename FloatT>
+void EigenSymmetricMany(Scheduler& s,
+                        const Mat<FloatT, 3, 3>* src,
+                        EigenDecomposition<FloatT, 3>* dst,
+                        const std::size_t n) {
+  tph_linalg_internal::ParallelArrays(
+      s, src, dst, n,
+      [](const Mat<FloatT, 3, 3>* a, EigenDecomposition<FloatT, 3>* b, const std::size_t k) {
+        EigenSymmetricMany(a, b, k);
+      });
+}
+
+template <typename FloatT>
+void SvdMany(Scheduler& s,
+             const Mat<FloatT, 3, 3>* src,
+             SingularValueDecomposition<FloatT, 3>* dst,
+             const std::size_t n) {
+  ParallelFor(s, n, tph_linalg_internal::ChunkSize(sizeof(*src) + sizeof(*dst)),
+              [src, dst](const std::size_t begin, const std::size_t end) {
+                SvdMany(src + begin, dst + begin, end - begin);
+              });
+}
+
+template <typename FloatT>
+void PolarDecomposeMany(Scheduler& s,
+                        const Mat<FloatT, 3, 3>* src,
+                        PolarDecomposition<FloatT, 3>* dst,
+                        const std::size_t n) {
+  ParallelFor(s, n, tph_linalg_internal::ChunkSize(sizeof(*src) + sizeof(*dst)),
+              [src, dst](const std::size_t begin, const std::size_t end) {
+                PolarDecomposeMany(src + begin, dst + begin, end - begin);
+              });
+}
+
+template <typename FloatT, int M>
+void SolveLUMany(Scheduler& s,
+                 const Mat<FloatT, M, M>* a,
+                 const Vec<FloatT, M>* b,
+                 LinearSolution<FloatT, M>* dst,
+                 const std::size_t n) {
+  ParallelFor(s, n, tph_linalg_internal::ChunkSize(sizeof(*a) + sizeof(*b) + sizeof(*dst)),
+              [a, b, dst](const std::size_t begin, const std::size_t end) {
+                SolveLUMany(a + begin, b + begin, dst + begin, end - begin);
+              });
+}
+
+template <typename FloatT, int M>
+void SolveCholeskyMany(Scheduler& s,
+                       const Mat<FloatT, M, M>* a,
+                       const Vec<FloatT, M>* b,
+                       LinearSolution<FloatT, M>* dst,
+                       const std::size_t n) {
+  ParallelFor(s, n, tph_linalg_internal::ChunkSize(sizeof(*a) + sizeof(*b) + sizeof(*dst)),
+              [a, b, dst](const std::size_t begin, const std::size_t end) {
+                SolveCholeskyMany(a + begin, b + begin, dst + begin, end - begin);
+              });
+}
+
+template <typename ArithT>
+void RotateMany(Scheduler& s,
+                const Quat<ArithT>& q,
+                const Vec<ArithT, 3>* src,
+                Vec<ArithT, 3>* dst,
+                const std::size_t n) {
+  const auto r = ToMat3x3(q);
+  TransformDirections(s, Mat<ArithT, 3, 4>{r.x, r.y, r.z, Vec<ArithT, 3>{}}, src, dst, n);
+}
+
+template <typename ArithT>
+void RotateMany(Scheduler& s,
+                const Quat<ArithT>* q,
+                const Vec<ArithT, 3>* src,
+                Vec<ArithT, 3>* dst,
+                const std::size_t n) {
+  ParallelFor(s, n, tph_linalg_internal::ChunkSize(sizeof(*q) + sizeof(*src) + sizeof(*dst)),
+              [q, src, dst](const std::size_t begin, const std::size_t end) {
+                RotateMany(q + begin, src + begin, dst + begin, end - begin);
+              });
+}
+
+template <typename FloatT>
+void NlerpMany(Scheduler& s,
+               const Quat<FloatT>* a,
+               const Quat<FloatT>* b,
+               const FloatT t,
+               Quat<FloatT>* dst,
+               const std::size_t n) {
+  ParallelFor(s, n, tph_linalg_internal::ChunkSize(sizeof(*a) + sizeof(*b) + sizeof(*dst)),
+              [a, b, t, dst](const std::size_t begin, const std::size_t end) {
+                NlerpMany(a + begin, b + begin, t, dst + begin, end - begin);
+              });
+}
+
+template <typename FloatT>
+void SlerpMany(Scheduler& s,
+               const Quat<FloatT>* a,
+               const Quat<FloatT>* b,
+               const FloatT t,
+               Quat<FloatT>* dst,
+               const std::size_t n) {
+  ParallelFor(s, n, tph_linalg_internal::ChunkSize(sizeof(*a) + sizeof(*b) + sizeof(*dst)),
+              [a, b, t, dst](const std::size_t begin, const std::size_t end) {
+                SlerpMany(a + begin, b + begin, t, dst + begin, end - begin);
+              });
+}
+
+template <typename ArithT>
+void TransformPoints(Scheduler& s,
+                     const Mat<ArithT, 3, 4>& m,
+                     const StridedVecView<ArithT, 3>& src,
+                     const StridedVecSpan<ArithT, 3>& dst) {
+  ParallelFor(s, src.size, tph_linalg_internal::ChunkSize(2 * sizeof(Vec<ArithT, 3>)),
+              [&m, &src, &dst](const std::size_t begin, const std::size_t end) {
+                TransformPoints(m, tph_linalg_internal::Slice(src, begin, end - begin),
+                                tph_linalg_internal::Slice(dst, begin, end - begin));
+              });
+}
+
+template <typename ArithT>
+void TransformPoints(Scheduler& s,
+                     const Mat<ArithT, 4, 4>& m,
+                     const StridedVecView<ArithT, 3>& src,
+                     const StridedVecSpan<ArithT, 3>& dst) {
+  TransformPoints(s, tph_linalg_internal::UpperRows(m), src, dst);
+}
+
+template <typename ArithT>
+void TransformDirections(Scheduler& s,
+                         const Mat<ArithT, 3, 4>& m,
+                         const StridedVecView<ArithT, 3>& src,
+                         const StridedVecSpan<ArithT, 3>& dst) {
+  ParallelFor(s, src.size, tph_linalg_internal::ChunkSize(2 * sizeof(Vec<ArithT, 3>)),
+              [&m, &src, &dst](const std::size_t begin, const std::size_t end) {
+                TransformDirections(m, tph_linalg_internal::Slice(src, begin, end - begin),
+                                    tph_linalg_internal::Slice(dst, begin, end - begin));
+              });
+}
+
+template <typename ArithT>
+void TransformDirections(Scheduler& s,
+                         const Mat<ArithT, 4, 4>& m,
+                         const StridedVecView<ArithT, 3>& src,
+                         const StridedVecSpan<ArithT, 3>& dst) {
+  TransformDirections(s, tph_linalg_internal::UpperRows(m), src, dst);
+}
+
+template <typename ArithT, int M>
+void Normalized(Scheduler& s,
+                const StridedVecView<ArithT, M>& src,
+                const StridedVecSpan<ArithT, M>& dst) {
+  ParallelFor(s, src.size, tph_linalg_internal::ChunkSize(2 * sizeof(Vec<ArithT, M>)),
+              [&src, &dst](const std::size_t begin, const std::size_t end) {
+                Normalized(tph_linalg_internal::Slice(src, begin, end - begin),
+                           tph_linalg_internal::Slice(dst, begin, end - begin));
+              });
+}
+
+// The levels are updated one after the other, each split into chunks that run in parallel. Levels
+// smaller than a chunk, e.g. near the roots, run as a single task.
+template <typename ArithT>
+void UpdateWorld(Scheduler& s, TransformHierarchy<ArithT>& h) {
+  if (h.node.empty()) {
+    return;
+  }
+  const auto chunk = tph_linalg_internal::ChunkSize(3 * sizeof(Mat<ArithT, 4, 4>) +
+                                                    sizeof(std::size_t) + sizeof(h.dirty[0]));
+  const auto roots = h.levels[1];
+  ParallelFor(s, roots, chunk, [&h](const std::size_t begin, const std::size_t end) {
+    tph_linalg_internal::UpdateRoots(h, begin, end);
+  });
+  for (std::size_t l = 1; l + 1 < h.levels.size(); ++l) {
+    const auto first = h.levels[l];
+    ParallelFor(s, h.levels[l + 1] - first, chunk,
+                [&h, first](const std::size_t begin, const std::size_t end) {
+                  tph_linalg_internal::UpdateLevel(h, first + begin, first + end);
+                });
+  }
+  ParallelFor(s, h.dirty.size(), tph_linalg_internal::ChunkSize(sizeof(h.dirty[0])),
+              [&h](const std::size_t begin, const std::size_t end) {
+                std::fill(h.dirty.begin() + static_cast<std::ptrdiff_t>(begin),
+                          h.dirty.begin() + static_cast<std::ptrdiff_t>(end),
+                          static_cast<unsigned char>(0));
+              });
+}
+
+// Parallel versions of the reductions. ComputeBounds and MinMaxDot give the same results as the
+// sequential functions. The sums of Centroid and Covariance are added pairwise over the chunks, so
+// they do not depend on the scheduler, but may differ from the sequential functions in the last
+// bits.
+template <typename ArithT>
+auto ComputeBounds(Scheduler& s, const Vec<ArithT, 3>* src, const std::size_t n)
+    -> Aabb<ArithT, 3> {
+  return ParallelReduce(
+      s, n, tph_linalg_internal::ChunkSize(sizeof(Vec<ArithT, 3>)),
+      tph_linalg_internal::EmptyBounds<ArithT>(),
+      [src](const std::size_t begin, const std::size_t end) {
+        return ComputeBounds(src + begin, end - begin);
+      },
+      [](const Aabb<ArithT, 3>& a, const Aabb<ArithT, 3>& b) { return Union(a, b); });
+}
+
+template <typename ArithT>
+auto MinMaxDot(Scheduler& s,
+               const Vec<ArithT, 3>* src,
+               const std::size_t n,
+               const Vec<ArithT, 3>& d) -> Vec<ArithT, 2> {
+  return ParallelReduce(
+      s, n, tph_linalg_internal::ChunkSize(sizeof(Vec<ArithT, 3>)), MinMaxDot(src, 0, d),
+      [src, &d](const std::size_t begin, const std::size_t end) {
+        return MinMaxDot(src + begin, end - begin, d);
+      },
+      [](const Vec<ArithT, 2>& a, const Vec<ArithT, 2>& b) {
+        return Vec<ArithT, 2>{b.x < a.x ? b.x : a.x, a.y < b.y ? b.y : a.y};
+      });
+}
+
+template <typename ArithT>
+auto ComputeBounds(Scheduler& s, const StridedVecView<ArithT, 3>& src) -> Aabb<ArithT, 3> {
+  return ParallelReduce(
+      s, src.size, tph_linalg_internal::ChunkSize(sizeof(Vec<ArithT, 3>)),
+      tph_linalg_internal::EmptyBounds<ArithT>(),
+      [&src](const std::size_t begin, const std::size_t end) {
+        return ComputeBounds(tph_linalg_internal::Slice(src, begin, end - begin));
+      },
+      [](const Aabb<ArithT, 3>& a, const Aabb<ArithT, 3>& b) { return Union(a, b); });
+}
+
+template <typename ArithT>
+auto MinMaxDot(Scheduler& s, const StridedVecView<ArithT, 3>& src, const Vec<ArithT, 3>& d)
+    -> Vec<ArithT, 2> {
+  return ParallelReduce(
+      s, src.size, tph_linalg_internal::ChunkSize(sizeof(Vec<ArithT, 3>)),
+      MinMaxDot(tph_linalg_internal::Slice(src, 0, 0), d),
+      [&src, &d](const std::size_t begin, const std::size_t end) {
+        return MinMaxDot(tph_linalg_internal::Slice(src, begin, end - begin), d);
+      },
+      [](const Vec<ArithT, 2>& a, const Vec<ArithT, 2>& b) {
+        return Vec<ArithT, 2>{b.x < a.x ? b.x : a.x, a.y < b.y ? b.y : a.y};
+      });
+}
+
+template <typename AccT = void, typename ArithT>
+auto Centroid(Scheduler& s, const Vec<ArithT, 3>* src, const std::size_t n)
+    -> Vec<tph_linalg_internal::AccumType<AccT, ArithT>, 3> {
+  using T = tph_linalg_internal::AccumType<AccT, ArithT>;
+  return tph_linalg_internal::Mean(
+      tph_linalg_internal::ParallelSum<Vec<T, 3>>(
+          s, n, tph_linalg_internal::ChunkSize(sizeof(Vec<ArithT, 3>)),
+          [src](const std::size_t begin, const std::size_t end) {
+            return tph_linalg_internal::PointSum<T>(src + begin, end - begin);
+          }),
+      n);
+}
+
+template <typename AccT = void, typename ArithT>
+auto Covariance(Scheduler& s, const Vec<ArithT, 3>* src, const std::size_t n)
+    -> Mat<tph_linalg_internal::AccumType<AccT, ArithT>, 3, 3> {
+  using T = tph_linalg_internal::AccumType<AccT, ArithT>;
+  const auto c = Centroid<T>(s, src, n);
+  return tph_linalg_internal::CovarianceMatrix(
+      tph_linalg_internal::ParallelSum<tph_linalg_internal::Moments<T>>(
+          s, n, tph_linalg_internal::ChunkSize(sizeof(Vec<ArithT, 3>)),
+          [src, &c](const std::size_t begin, const std::size_t end) {
+            return tph_linalg_internal::PointMoments(src + begin, end - begin, c);
+          }),
+      n);
+}
+
+} // namespace tph
+
+#undef TPH_NODISCARD
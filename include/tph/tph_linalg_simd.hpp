@@ -0,0 +1,879 @@
+#pragma once
+
+#include <cmath>   // std::abs, std::fma
+#include <cstddef> // std::size_t
+#include <cstdint> // std::int32_t, std::int64_t
+#include <limits>  // std::numeric_limits
+#include <type_traits>
+
+#include "tph_linalg.hpp"
+
+#if __cplusplus >= 201703L // C++17 or later.
+#define TPH_NODISCARD [[nodiscard]]
+#else
+#define TPH_NODISCARD
+#endif
+
+// Loops are not allowed in constexpr functions before C++14.
+#if __cplusplus >= 201402L || (defined(_MSVC_LANG) && _MSVC_LANG >= 201402L)
+#define TPH_CONSTEXPR14 constexpr
+#else
+#define TPH_CONSTEXPR14 inline
+#endif
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define TPH_HAS_SSE2 1
+#include <immintrin.h>
+#else
+#define TPH_HAS_SSE2 0
+#endif
+#if defined(__AVX__)
+#define TPH_HAS_AVX 1
+#else
+#define TPH_HAS_AVX 0
+#endif
+#if defined(__AVX512F__)
+#define TPH_HAS_AVX512F 1
+#else
+#define TPH_HAS_AVX512F 0
+#endif
+// Whether the compiler may fuse a multiply and an add (FMA contraction). MSVC does not define
+// __FMA__, but all AVX2 processors also support FMA.
+#if defined(__FMA__) || defined(__AVX2__) || defined(__FP_FAST_FMAF) || defined(__aarch64__) || \
+    defined(_M_ARM64)
+#define TPH_HAS_FMA 1
+#else
+#define TPH_HAS_FMA 0
+#endif
+
+namespace tph {
+namespace simd {
+
+template <typename T, int N>
+struct Packet;
+
+// Convenient type aliases.
+using f32x4 = Packet<float, 4>;
+using f32x8 = Packet<float, 8>;
+using f32x16 = Packet<float, 16>;
+using f64x2 = Packet<double, 2>;
+using f64x4 = Packet<double, 4>;
+using f64x8 = Packet<double, 8>;
+
+} // namespace simd
+
+namespace tph_linalg_internal {
+
+// Lane-wise run-time sqrt and reciprocal sqrt, with intrinsics overloads for the packet sizes the
+// target supports. Defined below.
+template <typename T, int N>
+auto HardwareSqrtLanes(const simd::Packet<T, N>& x) noexcept -> simd::Packet<T, N>;
+template <typename T, int N>
+auto HardwareRsqrtLanes(const simd::Packet<T, N>& x) noexcept -> simd::Packet<T, N>;
+#if TPH_HAS_SSE2
+inline auto HardwareSqrtLanes(const simd::f32x4& x) noexcept -> simd::f32x4;
+inline auto HardwareSqrtLanes(const simd::f64x2& x) noexcept -> simd::f64x2;
+inline auto HardwareRsqrtLanes(const simd::f32x4& x) noexcept -> simd::f32x4;
+#endif
+#if TPH_HAS_SSE2 && !TPH_HAS_AVX
+inline auto HardwareSqrtLanes(const simd::f32x8& x) noexcept -> simd::f32x8;
+inline auto HardwareSqrtLanes(const simd::f64x4& x) noexcept -> simd::f64x4;
+inline auto HardwareRsqrtLanes(const simd::f32x8& x) noexcept -> simd::f32x8;
+#endif
+#if TPH_HAS_AVX
+inline auto HardwareSqrtLanes(const simd::f32x8& x) noexcept -> simd::f32x8;
+inline auto HardwareSqrtLanes(const simd::f64x4& x) noexcept -> simd::f64x4;
+inline auto HardwareRsqrtLanes(const simd::f32x8& x) noexcept -> simd::f32x8;
+#endif
+#if TPH_HAS_AVX512F
+inline auto HardwareSqrtLanes(const simd::f32x16& x) noexcept -> simd::f32x16;
+inline auto HardwareSqrtLanes(const simd::f64x8& x) noexcept -> simd::f64x8;
+inline auto HardwareRsqrtLanes(const simd::f32x16& x) noexcept -> simd::f32x16;
+#endif
+
+} // namespace tph_linalg_internal
+
+namespace simd {
+
+// A packet of N lanes of type T, used as the arithmetic type of Vec and Mat to evaluate N
+// independent problems at once, e.g. Cross(Vec<f32x8, 3>, Vec<f32x8, 3>) computes eight cross
+// products. Lane-wise operations are plain loops that the compiler maps to SIMD instructions, sqrt
+// uses intrinsics where available. Comparisons return a Mask rather than bool, so compare vectors of
+// packets using Equal (and All/Any) instead of operator==.
+//
+// Packets are aligned to their size, which for 32 and 64 byte packets is more than operator new
+// guarantees before C++17. Packets on the heap, e.g. in std::vector<f32x8>, need C++17 or an
+// aligned allocator to keep that alignment, but nothing here depends on it: intrinsics use
+// unaligned loads and stores.
+template <typename T, int N>
+struct alignas(sizeof(T) * N) Packet {
+  using value_type = T;
+  static constexpr int kSize = N;
+
+  T v[N];
+
+  constexpr Packet() noexcept : v{} {}
+
+  // Broadcast, all lanes set to s.
+  TPH_CONSTEXPR14 Packet(const T s) noexcept : v{} {
+    for (int i = 0; i < N; ++i) {
+      v[i] = s;
+    }
+  }
+
+  // Lane values, exactly N must be given.
+  template <typename... Ts>
+  constexpr Packet(const T a, const T b, const Ts... rest) noexcept
+      : v{a, b, static_cast<T>(rest)...} {
+    static_assert(sizeof...(Ts) + 2 == N, "wrong number of lanes");
+  }
+
+  TPH_NODISCARD constexpr auto operator[](const int i) const noexcept -> T { return v[i]; }
+
+  // Hooks for tph_linalg_internal::sqrt and rsqrt, found by argument-dependent lookup.
+  friend TPH_CONSTEXPR14 auto SqrtCheck(const Packet& x, const Packet& m) noexcept -> Packet {
+    Packet r;
+    for (int i = 0; i < N; ++i) {
+      r.v[i] = tph_linalg_internal::SqrtCheck(x.v[i], m.v[i]);
+    }
+    return r;
+  }
+
+  friend auto HardwareSqrt(const Packet& x) noexcept -> Packet {
+    return tph_linalg_internal::HardwareSqrtLanes(x);
+  }
+
+  friend auto HardwareRsqrt(const Packet& x) noexcept -> Packet {
+    return tph_linalg_internal::HardwareRsqrtLanes(x);
+  }
+};
+
+// Lane-wise comparison result, each lane is either all ones (true) or all zeros (false).
+template <typename T, int N>
+struct alignas(sizeof(T) * N) Mask {
+  using LaneT = typename std::conditional<sizeof(T) == 8, std::int64_t, std::int32_t>::type;
+
+  LaneT v[N];
+
+  TPH_NODISCARD constexpr auto operator[](const int i) const noexcept -> bool { return v[i] != 0; }
+};
+
+} // namespace simd
+
+namespace tph_linalg_internal {
+
+template <typename T>
+struct type_identity {
+  using type = T;
+};
+
+template <typename T, int N>
+struct scalar_type<simd::Packet<T, N>> {
+  using type = T;
+};
+
+template <typename T, int N>
+struct mask_type<simd::Packet<T, N>> {
+  using type = simd::Mask<T, N>;
+};
+
+template <typename T, int N>
+auto HardwareSqrtLanes(const simd::Packet<T, N>& x) noexcept -> simd::Packet<T, N> {
+  simd::Packet<T, N> r;
+  for (int i = 0; i < N; ++i) {
+    r.v[i] = HardwareSqrt(x.v[i]);
+  }
+  return r;
+}
+
+template <typename T, int N>
+auto HardwareRsqrtLanes(const simd::Packet<T, N>& x) noexcept -> simd::Packet<T, N> {
+  simd::Packet<T, N> r;
+  for (int i = 0; i < N; ++i) {
+    r.v[i] = HardwareRsqrt(x.v[i]);
+  }
+  return r;
+}
+
+// Reciprocal sqrt estimates are refined with one Newton-Raphson step, see HardwareRsqrt(float).
+// Loads and stores are unaligned, see Packet.
+#if TPH_HAS_SSE2
+inline auto HardwareSqrtLanes(const simd::f32x4& x) noexcept -> simd::f32x4 {
+  simd::f32x4 r;
+  _mm_storeu_ps(r.v, _mm_sqrt_ps(_mm_loadu_ps(x.v)));
+  return r;
+}
+
+inline auto HardwareSqrtLanes(const simd::f64x2& x) noexcept -> simd::f64x2 {
+  simd::f64x2 r;
+  _mm_storeu_pd(r.v, _mm_sqrt_pd(_mm_loadu_pd(x.v)));
+  return r;
+}
+
+inline auto HardwareRsqrtLanes(const simd::f32x4& x) noexcept -> simd::f32x4 {
+  const auto xv = _mm_loadu_ps(x.v);
+  const auto y = _mm_rsqrt_ps(xv);
+  const auto yyx = _mm_mul_ps(_mm_mul_ps(y, y), xv);
+  simd::f32x4 r;
+  _mm_storeu_ps(r.v,
+                _mm_mul_ps(y, _mm_sub_ps(_mm_set1_ps(1.5F), _mm_mul_ps(_mm_set1_ps(0.5F), yyx))));
+  return r;
+}
+#endif // TPH_HAS_SSE2
+
+// Without AVX the 8-lane float (4-lane double) packets are two SSE2 registers.
+#if TPH_HAS_SSE2 && !TPH_HAS_AVX
+inline auto HardwareSqrtLanes(const simd::f32x8& x) noexcept -> simd::f32x8 {
+  simd::f32x8 r;
+  _mm_storeu_ps(r.v, _mm_sqrt_ps(_mm_loadu_ps(x.v)));
+  _mm_storeu_ps(r.v + 4, _mm_sqrt_ps(_mm_loadu_ps(x.v + 4)));
+  return r;
+}
+
+inline auto HardwareSqrtLanes(const simd::f64x4& x) noexcept -> simd::f64x4 {
+  simd::f64x4 r;
+  _mm_storeu_pd(r.v, _mm_sqrt_pd(_mm_loadu_pd(x.v)));
+  _mm_storeu_pd(r.v + 2, _mm_sqrt_pd(_mm_loadu_pd(x.v + 2)));
+  return r;
+}
+
+inline auto HardwareRsqrtLanes(const simd::f32x8& x) noexcept -> simd::f32x8 {
+  const auto lo = HardwareRsqrtLanes(simd::f32x4{x.v[0], x.v[1], x.v[2], x.v[3]});
+  const auto hi = HardwareRsqrtLanes(simd::f32x4{x.v[4], x.v[5], x.v[6], x.v[7]});
+  return simd::f32x8{lo.v[0], lo.v[1], lo.v[2], lo.v[3], hi.v[0], hi.v[1], hi.v[2], hi.v[3]};
+}
+#endif // TPH_HAS_SSE2 && !TPH_HAS_AVX
+
+#if TPH_HAS_AVX
+inline auto HardwareSqrtLanes(const simd::f32x8& x) noexcept -> simd::f32x8 {
+  simd::f32x8 r;
+  _mm256_storeu_ps(r.v, _mm256_sqrt_ps(_mm256_loadu_ps(x.v)));
+  return r;
+}
+
+inline auto HardwareSqrtLanes(const simd::f64x4& x) noexcept -> simd::f64x4 {
+  simd::f64x4 r;
+  _mm256_storeu_pd(r.v, _mm256_sqrt_pd(_mm256_loadu_pd(x.v)));
+  return r;
+}
+
+inline auto HardwareRsqrtLanes(const simd::f32x8& x) noexcept -> simd::f32x8 {
+  const auto xv = _mm256_loadu_ps(x.v);
+  const auto y = _mm256_rsqrt_ps(xv);
+  const auto yyx = _mm256_mul_ps(_mm256_mul_ps(y, y), xv);
+  simd::f32x8 r;
+  _mm256_storeu_ps(
+      r.v,
+      _mm256_mul_ps(y, _mm256_sub_ps(_mm256_set1_ps(1.5F), _mm256_mul_ps(_mm256_set1_ps(0.5F), yyx))));
+  return r;
+}
+#endif // TPH_HAS_AVX
+
+#if TPH_HAS_AVX512F
+#if defined(__GNUC__) && !defined(__clang__)
+// GCC 12 warns about the undefined pass-through operand inside the AVX-512 intrinsics.
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wuninitialized"
+#pragma GCC diagnostic ignored "-Wmaybe-uninitialized"
+#endif
+inline auto HardwareSqrtLanes(const simd::f32x16& x) noexcept -> simd::f32x16 {
+  simd::f32x16 r;
+  _mm512_storeu_ps(r.v, _mm512_sqrt_ps(_mm512_loadu_ps(x.v)));
+  return r;
+}
+
+inline auto HardwareSqrtLanes(const simd::f64x8& x) noexcept -> simd::f64x8 {
+  simd::f64x8 r;
+  _mm512_storeu_pd(r.v, _mm512_sqrt_pd(_mm512_loadu_pd(x.v)));
+  return r;
+}
+
+inline auto HardwareRsqrtLanes(const simd::f32x16& x) noexcept -> simd::f32x16 {
+  const auto xv = _mm512_loadu_ps(x.v);
+  const auto y = _mm512_rsqrt14_ps(xv);
+  const auto yyx = _mm512_mul_ps(_mm512_mul_ps(y, y), xv);
+  simd::f32x16 r;
+  _mm512_storeu_ps(
+      r.v,
+      _mm512_mul_ps(y, _mm512_sub_ps(_mm512_set1_ps(1.5F), _mm512_mul_ps(_mm512_set1_ps(0.5F), yyx))));
+  return r;
+}
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic pop
+#endif
+#endif // TPH_HAS_AVX512F
+
+} // namespace tph_linalg_internal
+
+namespace simd {
+
+// operator+(a, b), operator-(a, b), operator*(a, b), operator/(a, b), lane-wise. Either operand may
+// be a scalar, which is broadcast to all lanes.
+#define TPH_SIMD_BINARY_OP(OP)                                                                     \
+  template <typename T, int N>                                                                     \
+  TPH_NODISCARD TPH_CONSTEXPR14 auto operator OP(const Packet<T, N>& a,                            \
+                                                 const Packet<T, N>& b) noexcept->Packet<T, N> {   \
+    Packet<T, N> r;                                                                                \
+    for (int i = 0; i < N; ++i) {                                                                  \
+      r.v[i] = a.v[i] OP b.v[i];                                                                   \
+    }                                                                                              \
+    return r;                                                                                      \
+  }                                                                                                \
+                                                                                                   \
+  template <typename T, int N>                                                                     \
+  TPH_NODISCARD TPH_CONSTEXPR14 auto operator OP(                                                  \
+      const Packet<T, N>& a,                                                                       \
+      const typename tph_linalg_internal::type_identity<T>::type b) noexcept->Packet<T, N> {       \
+    return a OP Packet<T, N>(b);                                                                   \
+  }                                                                                                \
+                                                                                                   \
+  template <typename T, int N>                                                                     \
+  TPH_NODISCARD TPH_CONSTEXPR14 auto operator OP(                                                  \
+      const typename tph_linalg_internal::type_identity<T>::type a,                                \
+      const Packet<T, N>& b) noexcept->Packet<T, N> {                                              \
+    return Packet<T, N>(a) OP b;                                                                   \
+  }
+
+TPH_SIMD_BINARY_OP(+)
+TPH_SIMD_BINARY_OP(-)
+TPH_SIMD_BINARY_OP(*)
+TPH_SIMD_BINARY_OP(/)
+
+#undef TPH_SIMD_BINARY_OP
+
+// operator-(a), unary negation.
+template <typename T, int N>
+TPH_NODISCARD TPH_CONSTEXPR14 auto operator-(const Packet<T, N>& a) noexcept -> Packet<T, N> {
+  Packet<T, N> r;
+  for (int i = 0; i < N; ++i) {
+    r.v[i] = -a.v[i];
+  }
+  return r;
+}
+
+// operator+=(a, b), operator-=(a, b), operator*=(a, b), operator/=(a, b)
+template <typename T, int N, typename U>
+TPH_CONSTEXPR14 auto operator+=(Packet<T, N>& a, const U& b) noexcept -> Packet<T, N>& {
+  return a = a + b;
+}
+
+template <typename T, int N, typename U>
+TPH_CONSTEXPR14 auto operator-=(Packet<T, N>& a, const U& b) noexcept -> Packet<T, N>& {
+  return a = a - b;
+}
+
+template <typename T, int N, typename U>
+TPH_CONSTEXPR14 auto operator*=(Packet<T, N>& a, const U& b) noexcept -> Packet<T, N>& {
+  return a = a * b;
+}
+
+template <typename T, int N, typename U>
+TPH_CONSTEXPR14 auto operator/=(Packet<T, N>& a, const U& b) noexcept -> Packet<T, N>& {
+  return a = a / b;
+}
+
+// Lane-wise comparisons.
+#define TPH_SIMD_COMPARE_OP(OP)                                                                    \
+  template <typename T, int N>                                                                     \
+  TPH_NODISCARD TPH_CONSTEXPR14 auto operator OP(const Packet<T, N>& a,                            \
+                                                 const Packet<T, N>& b) noexcept->Mask<T, N> {     \
+    Mask<T, N> r{};                                                                                \
+    for (int i = 0; i < N; ++i) {                                                                  \
+      r.v[i] = a.v[i] OP b.v[i] ? -1 : 0;                                                          \
+    }                                                                                              \
+    return r;                                                                                      \
+  }
+
+TPH_SIMD_COMPARE_OP(==)
+TPH_SIMD_COMPARE_OP(!=)
+TPH_SIMD_COMPARE_OP(<)
+TPH_SIMD_COMPARE_OP(<=)
+TPH_SIMD_COMPARE_OP(>)
+TPH_SIMD_COMPARE_OP(>=)
+
+#undef TPH_SIMD_COMPARE_OP
+
+// Mask logic.
+template <typename T, int N>
+TPH_NODISCARD TPH_CONSTEXPR14 auto operator&(const Mask<T, N>& a, const Mask<T, N>& b) noexcept
+    -> Mask<T, N> {
+  Mask<T, N> r{};
+  for (int i = 0; i < N; ++i) {
+    r.v[i] = a.v[i] & b.v[i];
+  }
+  return r;
+}
+
+template <typename T, int N>
+TPH_NODISCARD TPH_CONSTEXPR14 auto operator|(const Mask<T, N>& a, const Mask<T, N>& b) noexcept
+    -> Mask<T, N> {
+  Mask<T, N> r{};
+  for (int i = 0; i < N; ++i) {
+    r.v[i] = a.v[i] | b.v[i];
+  }
+  return r;
+}
+
+template <typename T, int N>
+TPH_NODISCARD TPH_CONSTEXPR14 auto operator!(const Mask<T, N>& a) noexcept -> Mask<T, N> {
+  Mask<T, N> r{};
+  for (int i = 0; i < N; ++i) {
+    r.v[i] = ~a.v[i];
+  }
+  return r;
+}
+
+// True if all/any lanes are set.
+template <typename T, int N>
+TPH_NODISCARD TPH_CONSTEXPR14 auto All(const Mask<T, N>& m) noexcept -> bool {
+  auto r = true;
+  for (int i = 0; i < N; ++i) {
+    r = r && m.v[i] != 0;
+  }
+  return r;
+}
+
+template <typename T, int N>
+TPH_NODISCARD TPH_CONSTEXPR14 auto Any(const Mask<T, N>& m) noexcept -> bool {
+  auto r = false;
+  for (int i = 0; i < N; ++i) {
+    r = r || m.v[i] != 0;
+  }
+  return r;
+}
+
+// Per lane, m ? a : b.
+template <typename T, int N>
+TPH_NODISCARD TPH_CONSTEXPR14 auto Select(const Mask<T, N>& m,
+                                          const Packet<T, N>& a,
+                                          const Packet<T, N>& b) noexcept -> Packet<T, N> {
+  Packet<T, N> r;
+  for (int i = 0; i < N; ++i) {
+    // Both lanes are read before the choice, so that the compiler emits a blend, not a branch.
+    const T x = a.v[i];
+    const T y = b.v[i];
+    r.v[i] = m.v[i] != 0 ? x : y;
+  }
+  return r;
+}
+
+template <typename T, int N, int M>
+TPH_NODISCARD TPH_CONSTEXPR14 auto Select(const Mask<T, N>& m,
+                                          const Vec<Packet<T, N>, M>& a,
+                                          const Vec<Packet<T, N>, M>& b) noexcept
+    -> Vec<Packet<T, N>, M> {
+  Vec<Packet<T, N>, M> r{};
+  for (int j = 0; j < M; ++j) {
+    tph_linalg_internal::CompRef(r, j) = Select(m, Comp(a, j), Comp(b, j));
+  }
+  return r;
+}
+
+// Lane-wise equality of vectors of packets, use instead of operator==.
+template <typename T, int N, int M>
+TPH_NODISCARD TPH_CONSTEXPR14 auto Equal(const Vec<Packet<T, N>, M>& a,
+                                         const Vec<Packet<T, N>, M>& b) noexcept -> Mask<T, N> {
+  auto r = a.x == b.x;
+  for (int j = 1; j < M; ++j) {
+    r = r & (Comp(a, j) == Comp(b, j));
+  }
+  return r;
+}
+
+// Lane-wise min/max/abs.
+template <typename T, int N>
+TPH_NODISCARD TPH_CONSTEXPR14 auto Min(const Packet<T, N>& a, const Packet<T, N>& b) noexcept
+    -> Packet<T, N> {
+  return Select(b < a, b, a);
+}
+
+template <typename T, int N>
+TPH_NODISCARD TPH_CONSTEXPR14 auto Max(const Packet<T, N>& a, const Packet<T, N>& b) noexcept
+    -> Packet<T, N> {
+  return Select(a < b, b, a);
+}
+
+template <typename T, int N>
+TPH_NODISCARD TPH_CONSTEXPR14 auto Abs(const Packet<T, N>& a) noexcept -> Packet<T, N> {
+  return Select(a < Packet<T, N>(T(0)), -a, a);
+}
+
+// Lane-wise sqrt and reciprocal sqrt, see tph_linalg_internal::sqrt and rsqrt.
+template <typename T, int N>
+TPH_NODISCARD TPH_CONSTEXPR14 auto Sqrt(const Packet<T, N>& a) noexcept -> Packet<T, N> {
+  return tph_linalg_internal::sqrt(a);
+}
+
+template <typename T, int N>
+TPH_NODISCARD TPH_CONSTEXPR14 auto Rsqrt(const Packet<T, N>& a) noexcept -> Packet<T, N> {
+  return tph_linalg_internal::rsqrt(a);
+}
+
+// Load/store N consecutive scalars, p need not be aligned. The lane loops compile to unaligned
+// vector loads and stores.
+template <typename PacketT>
+TPH_NODISCARD TPH_CONSTEXPR14 auto Load(const typename PacketT::value_type* p) noexcept -> PacketT {
+  PacketT r;
+  for (int i = 0; i < PacketT::kSize; ++i) {
+    r.v[i] = p[i];
+  }
+  return r;
+}
+
+template <typename T, int N>
+TPH_CONSTEXPR14 void Store(const Packet<T, N>& a, T* p) noexcept {
+  for (int i = 0; i < N; ++i) {
+    p[i] = a.v[i];
+  }
+}
+
+// Load count (at most N) consecutive vectors into the lanes of a vector of packets, i.e. transpose
+// from AoS. Lanes beyond count are zero.
+template <typename PacketT, typename T, int M>
+TPH_NODISCARD TPH_CONSTEXPR14 auto LoadVec(const Vec<T, M>* src,
+                                           const std::size_t count = PacketT::kSize) noexcept
+    -> Vec<PacketT, M> {
+  Vec<PacketT, M> r{};
+  for (std::size_t i = 0; i < count; ++i) {
+    for (int j = 0; j < M; ++j) {
+      tph_linalg_internal::CompRef(r, j).v[i] = Comp(src[i], j);
+    }
+  }
+  return r;
+}
+
+// Store the first count (at most N) lanes of a vector of packets as consecutive vectors.
+template <typename T, int N, int M>
+TPH_CONSTEXPR14 void StoreVec(const Vec<Packet<T, N>, M>& a,
+                              Vec<T, M>* dst,
+                              const std::size_t count = N) noexcept {
+  for (std::size_t i = 0; i < count; ++i) {
+    for (int j = 0; j < M; ++j) {
+      tph_linalg_internal::CompRef(dst[i], j) = Comp(a, j).v[i];
+    }
+  }
+}
+
+// Load count (at most N) matrices into the lanes of a matrix of packets, lanes beyond count are
+// zero.
+template <typename PacketT, typename T, int M>
+TPH_NODISCARD TPH_CONSTEXPR14 auto LoadMat(const Mat<T, M, 2>* src,
+                                           const std::size_t count = PacketT::kSize) noexcept
+    -> Mat<PacketT, M, 2> {
+  Mat<PacketT, M, 2> r{};
+  for (std::size_t i = 0; i < count; ++i) {
+    for (int j = 0; j < M; ++j) {
+      tph_linalg_internal::CompRef(r.x, j).v[i] = Comp(src[i].x, j);
+      tph_linalg_internal::CompRef(r.y, j).v[i] = Comp(src[i].y, j);
+    }
+  }
+  return r;
+}
+
+template <typename PacketT, typename T, int M>
+TPH_NODISCARD TPH_CONSTEXPR14 auto LoadMat(const Mat<T, M, 3>* src,
+                                           const std::size_t count = PacketT::kSize) noexcept
+    -> Mat<PacketT, M, 3> {
+  Mat<PacketT, M, 3> r{};
+  for (std::size_t i = 0; i < count; ++i) {
+    for (int j = 0; j < M; ++j) {
+      tph_linalg_internal::CompRef(r.x, j).v[i] = Comp(src[i].x, j);
+      tph_linalg_internal::CompRef(r.y, j).v[i] = Comp(src[i].y, j);
+      tph_linalg_internal::CompRef(r.z, j).v[i] = Comp(src[i].z, j);
+    }
+  }
+  return r;
+}
+
+template <typename PacketT, typename T, int M>
+TPH_NODISCARD TPH_CONSTEXPR14 auto LoadMat(const Mat<T, M, 4>* src,
+                                           const std::size_t count = PacketT::kSize) noexcept
+    -> Mat<PacketT, M, 4> {
+  Mat<PacketT, M, 4> r{};
+  for (std::size_t i = 0; i < count; ++i) {
+    for (int j = 0; j < M; ++j) {
+      tph_linalg_internal::CompRef(r.x, j).v[i] = Comp(src[i].x, j);
+      tph_linalg_internal::CompRef(r.y, j).v[i] = Comp(src[i].y, j);
+      tph_linalg_internal::CompRef(r.z, j).v[i] = Comp(src[i].z, j);
+      tph_linalg_internal::CompRef(r.w, j).v[i] = Comp(src[i].w, j);
+    }
+  }
+  return r;
+}
+
+// Store the first count (at most N) lanes of a matrix of packets as consecutive matrices.
+template <typename T, int N, int M>
+TPH_CONSTEXPR14 void StoreMat(const Mat<Packet<T, N>, M, 2>& a,
+                              Mat<T, M, 2>* dst,
+                              const std::size_t count = N) noexcept {
+  for (std::size_t i = 0; i < count; ++i) {
+    for (int j = 0; j < M; ++j) {
+      tph_linalg_internal::CompRef(dst[i].x, j) = Comp(a.x, j).v[i];
+      tph_linalg_internal::CompRef(dst[i].y, j) = Comp(a.y, j).v[i];
+    }
+  }
+}
+
+template <typename T, int N, int M>
+TPH_CONSTEXPR14 void StoreMat(const Mat<Packet<T, N>, M, 3>& a,
+                              Mat<T, M, 3>* dst,
+                              const std::size_t count = N) noexcept {
+  for (std::size_t i = 0; i < count; ++i) {
+    for (int j = 0; j < M; ++j) {
+      tph_linalg_internal::CompRef(dst[i].x, j) = Comp(a.x, j).v[i];
+      tph_linalg_internal::CompRef(dst[i].y, j) = Comp(a.y, j).v[i];
+      tph_linalg_internal::CompRef(dst[i].z, j) = Comp(a.z, j).v[i];
+    }
+  }
+}
+
+template <typename T, int N, int M>
+TPH_CONSTEXPR14 void StoreMat(const Mat<Packet<T, N>, M, 4>& a,
+                              Mat<T, M, 4>* dst,
+                              const std::size_t count = N) noexcept {
+  for (std::size_t i = 0; i < count; ++i) {
+    for (int j = 0; j < M; ++j) {
+      tph_linalg_internal::CompRef(dst[i].x, j) = Comp(a.x, j).v[i];
+      tph_linalg_internal::CompRef(dst[i].y, j) = Comp(a.y, j).v[i];
+      tph_linalg_internal::CompRef(dst[i].z, j) = Comp(a.z, j).v[i];
+      tph_linalg_internal::CompRef(dst[i].w, j) = Comp(a.w, j).v[i];
+    }
+  }
+}
+
+// All lanes of a vector of packets set to v, e.g. to test a packet of rays against one triangle.
+template <typename PacketT, typename T, int M>
+TPH_NODISCARD TPH_CONSTEXPR14 auto BroadcastVec(const Vec<T, M>& v) noexcept -> Vec<PacketT, M> {
+  Vec<PacketT, M> r{};
+  for (int j = 0; j < M; ++j) {
+    tph_linalg_internal::CompRef(r, j) = PacketT(Comp(v, j));
+  }
+  return r;
+}
+
+// Lane-wise results of IntersectRayTriangle.
+template <typename T, int N>
+struct TriangleHits {
+  Mask<T, N> hit;
+  Packet<T, N> t; // Ray parameter of the hit point, o + t * d.
+  Packet<T, N> u; // Barycentric coordinates of the hit point, the weights of b and c.
+  Packet<T, N> v;
+};
+
+// Lane-wise results of IntersectRayBox.
+template <typename T, int N>
+struct BoxHits {
+  Mask<T, N> hit;
+  Packet<T, N> t_near; // Ray parameters where the ray enters and leaves the box, within [0, t_max].
+  Packet<T, N> t_far;
+};
+
+} // namespace simd
+
+namespace tph_linalg_internal {
+
+// x * y - z * w with the exact sign, zero only if the exact value is. The products of floats are
+// exact in double.
+inline auto EdgeFunction(const float x, const float y, const float z, const float w) noexcept
+    -> float {
+  return static_cast<float>(static_cast<double>(x) * y - static_cast<double>(z) * w);
+}
+
+// Kahan's algorithm, where std::fma gives the rounding error of z * w exactly. The relative error
+// is below 2 ulp (Jeannerod, Louvet and Muller, Math. Comp. 82, 2013), so the sign is exact.
+inline auto EdgeFunction(const double x, const double y, const double z, const double w) noexcept
+    -> double {
+  const auto zw = z * w;
+  return std::fma(x, y, -zw) + std::fma(-z, w, zw);
+}
+
+// Watertight ray/triangle test of Woop, Benthin and Wald, "Watertight Ray/Triangle Intersection",
+// JCGT 2(1), 2013. The vertices are relative to the ray origin with their axes permuted so that
+// the ray direction is largest along z, and shear maps the ray direction to the z-axis. Rays
+// through an edge or vertex shared by triangles hit at least one of them.
+template <typename T, int N>
+auto WatertightTriangle(const Vec<simd::Packet<T, N>, 3>& a,
+                        const Vec<simd::Packet<T, N>, 3>& b,
+                        const Vec<simd::Packet<T, N>, 3>& c,
+                        const Vec<simd::Packet<T, N>, 3>& shear,
+                        const simd::Packet<T, N>& t_max) noexcept -> simd::TriangleHits<T, N> {
+  using PacketT = simd::Packet<T, N>;
+  const auto ax = a.x - shear.x * a.z;
+  const auto ay = a.y - shear.y * a.z;
+  const auto bx = b.x - shear.x * b.z;
+  const auto by = b.y - shear.y * b.z;
+  const auto cx = c.x - shear.x * c.z;
+  const auto cy = c.y - shear.y * c.z;
+  auto u = cx * by - cy * bx;
+  auto v = ax * cy - ay * cx;
+  auto w = bx * ay - by * ax;
+  // Rays (nearly) through an edge are decided by EdgeFunction, with the exact sign. Triangles
+  // sharing the edge then get edge functions of opposite sign also when the compiler fuses one of
+  // the products into the subtraction (FMA contraction), which can leave a small edge function of
+  // either sign rather than zero. bound is above the rounding error of all three, with or without
+  // fusing. Without FMA the edge functions of a shared edge are exact negatives, and only zero
+  // needs deciding.
+#if TPH_HAS_FMA
+  const auto sum_x = simd::Abs(ax) + simd::Abs(bx) + simd::Abs(cx);
+  const auto sum_y = simd::Abs(ay) + simd::Abs(by) + simd::Abs(cy);
+  const auto bound = PacketT(T(2) * std::numeric_limits<T>::epsilon()) * (sum_x * sum_y);
+#else
+  const PacketT bound(T(0));
+#endif
+  const auto near_edge = (simd::Abs(u) <= bound) | (simd::Abs(v) <= bound) |
+                         (simd::Abs(w) <= bound);
+  for (int i = 0; i < N; ++i) {
+    if (near_edge[i]) {
+      u.v[i] = EdgeFunction(cx.v[i], by.v[i], cy.v[i], bx.v[i]);
+      v.v[i] = EdgeFunction(ax.v[i], cy.v[i], ay.v[i], cx.v[i]);
+      w.v[i] = EdgeFunction(bx.v[i], ay.v[i], by.v[i], ax.v[i]);
+    }
+  }
+  const PacketT zero(T(0));
+  const auto det = u + v + w;
+  const auto t = u * (shear.z * a.z) + v * (shear.z * b.z) + w * (shear.z * c.z);
+  const auto negative = det < zero;
+  const auto t_scaled = simd::Select(negative, -t, t);
+  const auto det_abs = simd::Select(negative, -det, det);
+  const auto inside = ((u >= zero) & (v >= zero) & (w >= zero)) |
+                      ((u <= zero) & (v <= zero) & (w <= zero));
+  const auto nonzero = det != zero;
+  const auto inv_det = PacketT(T(1)) / simd::Select(nonzero, det, PacketT(T(1)));
+  simd::TriangleHits<T, N> r;
+  r.hit = inside & nonzero & (t_scaled >= zero) & (t_scaled <= t_max * det_abs);
+  r.t = t * inv_det;
+  r.u = v * inv_det;
+  r.v = w * inv_det;
+  return r;
+}
+
+} // namespace tph_linalg_internal
+
+namespace simd {
+
+// Lane-wise intersection of ray i, o + t * d, with triangle i, (a, b, c), for t in [0, t_max].
+// Both sides of the triangles are hit. Broadcast a triangle with BroadcastVec to test a packet of
+// rays against it.
+template <typename T, int N>
+TPH_NODISCARD auto IntersectRayTriangle(
+    const Vec<Packet<T, N>, 3>& o,
+    const Vec<Packet<T, N>, 3>& d,
+    const Vec<Packet<T, N>, 3>& a,
+    const Vec<Packet<T, N>, 3>& b,
+    const Vec<Packet<T, N>, 3>& c,
+    const Packet<T, N>& t_max = Packet<T, N>(std::numeric_limits<T>::infinity())) noexcept
+    -> TriangleHits<T, N> {
+  // Per lane, z is the axis where the ray direction is largest, x and y the next two, swapped if
+  // the direction is negative along z so that the winding of the triangles is kept.
+  const auto abs_x = Abs(d.x);
+  const auto abs_y = Abs(d.y);
+  const auto abs_z = Abs(d.z);
+  const auto z_is_x = (abs_x >= abs_y) & (abs_x >= abs_z);
+  const auto z_is_y = (!z_is_x) & (abs_y >= abs_z);
+  const auto rotate = [&z_is_x, &z_is_y](const Vec<Packet<T, N>, 3>& p) -> Vec<Packet<T, N>, 3> {
+    return {Select(z_is_x, p.y, Select(z_is_y, p.z, p.x)),
+            Select(z_is_x, p.z, Select(z_is_y, p.x, p.y)),
+            Select(z_is_x, p.x, Select(z_is_y, p.y, p.z))};
+  };
+  const auto rd = rotate(d);
+  const auto flip = rd.z < Packet<T, N>(T(0));
+  const auto permute = [&flip](const Vec<Packet<T, N>, 3>& p) -> Vec<Packet<T, N>, 3> {
+    return {Select(flip, p.y, p.x), Select(flip, p.x, p.y), p.z};
+  };
+  const auto pd = permute(rd);
+  const Vec<Packet<T, N>, 3> shear = {pd.x / pd.z, pd.y / pd.z, Packet<T, N>(T(1)) / pd.z};
+  return tph_linalg_internal::WatertightTriangle(permute(rotate(a - o)), permute(rotate(b - o)),
+                                                 permute(rotate(c - o)), shear, t_max);
+}
+
+// One ray against N triangles, held in packets of vertices e.g. loaded from SoA arrays.
+template <typename T, int N>
+TPH_NODISCARD auto IntersectRayTriangle(
+    const Vec<T, 3>& o,
+    const Vec<T, 3>& d,
+    const Vec<Packet<T, N>, 3>& a,
+    const Vec<Packet<T, N>, 3>& b,
+    const Vec<Packet<T, N>, 3>& c,
+    const T t_max = std::numeric_limits<T>::infinity()) noexcept -> TriangleHits<T, N> {
+  // The same axes as above, chosen once for all the lanes.
+  const auto abs_d = Vec<T, 3>{std::abs(d.x), std::abs(d.y), std::abs(d.z)};
+  const auto kz = abs_d.x >= abs_d.y && abs_d.x >= abs_d.z ? 0 : (abs_d.y >= abs_d.z ? 1 : 2);
+  auto kx = kz == 2 ? 0 : kz + 1;
+  auto ky = kx == 2 ? 0 : kx + 1;
+  if (Comp(d, kz) < T(0)) {
+    const auto k = kx;
+    kx = ky;
+    ky = k;
+  }
+  const auto po = BroadcastVec<Packet<T, N>>(o);
+  const auto permute = [&po, kx, ky, kz](const Vec<Packet<T, N>, 3>& p) -> Vec<Packet<T, N>, 3> {
+    const auto r = p - po;
+    return {Comp(r, kx), Comp(r, ky), Comp(r, kz)};
+  };
+  const auto dz = Comp(d, kz);
+  const Vec<Packet<T, N>, 3> shear = {Packet<T, N>(Comp(d, kx) / dz),
+                                      Packet<T, N>(Comp(d, ky) / dz), Packet<T, N>(T(1) / dz)};
+  return tph_linalg_internal::WatertightTriangle(permute(a), permute(b), permute(c), shear,
+                                                 Packet<T, N>(t_max));
+}
+
+// Lane-wise slab test of ray i, o + t * d, against the box [lo, hi] of lane i, for t in
+// [0, t_max]. inv_d is 1 / d, infinite along the axes the ray is parallel to. t_far is widened by
+// 1 + 2 * gamma(3) so that rounding never misses a box the ray touches, as in Ize, "Robust BVH Ray
+// Traversal", JCGT 2(2), 2013, and parallel rays in the plane of a face hit the box.
+template <typename T, int N>
+TPH_NODISCARD auto IntersectRayBox(
+    const Vec<Packet<T, N>, 3>& o,
+    const Vec<Packet<T, N>, 3>& inv_d,
+    const Vec<Packet<T, N>, 3>& lo,
+    const Vec<Packet<T, N>, 3>& hi,
+    const Packet<T, N>& t_max = Packet<T, N>(std::numeric_limits<T>::infinity())) noexcept
+    -> BoxHits<T, N> {
+  constexpr auto kEps = std::numeric_limits<T>::epsilon() / T(2);
+  BoxHits<T, N> r;
+  r.t_near = Packet<T, N>(T(0));
+  r.t_far = t_max;
+  for (int j = 0; j < 3; ++j) {
+    const auto t0 = (Comp(lo, j) - Comp(o, j)) * Comp(inv_d, j);
+    const auto t1 = (Comp(hi, j) - Comp(o, j)) * Comp(inv_d, j);
+    // 0 * inf is NaN for a parallel ray in the plane of a face, which does not limit the ray.
+    const auto valid = (t0 == t0) & (t1 == t1);
+    r.t_near = Select(valid, Max(r.t_near, Min(t0, t1)), r.t_near);
+    r.t_far = Select(valid, Min(r.t_far, Max(t0, t1)), r.t_far);
+  }
+  r.hit = r.t_near <= r.t_far * (T(1) + T(2) * (T(3) * kEps / (T(1) - T(3) * kEps)));
+  return r;
+}
+
+// One ray against N boxes, held in packets of corners e.g. loaded from SoA arrays.
+template <typename T, int N>
+TPH_NODISCARD auto IntersectRayBox(const Vec<T, 3>& o,
+                                   const Vec<T, 3>& inv_d,
+                                   const Vec<Packet<T, N>, 3>& lo,
+                                   const Vec<Packet<T, N>, 3>& hi,
+                                   const T t_max = std::numeric_limits<T>::infinity()) noexcept
+    -> BoxHits<T, N> {
+  return IntersectRayBox(BroadcastVec<Packet<T, N>>(o), BroadcastVec<Packet<T, N>>(inv_d), lo, hi,
+                         Packet<T, N>(t_max));
+}
+
+// Lane of the hit with the smallest t, -1 if no lane hit, e.g. the triangle of N a ray hits first.
+template <typename T, int N>
+TPH_NODISCARD TPH_CONSTEXPR14 auto NearestHit(const Mask<T, N>& hit, const Packet<T, N>& t) noexcept
+    -> int {
+  auto nearest = -1;
+  for (int i = 0; i < N; ++i) {
+    nearest = hit.v[i] != 0 && (nearest < 0 || t.v[i] < t.v[nearest]) ? i : nearest;
+  }
+  return nearest;
+}
+
+} // namespace simd
+} // namespace tph
+
+#undef TPH_NODISCARD
+#undef TPH_CONSTEXPR14
+#undef TPH_HAS_SSE2
+#undef TPH_HAS_AVX
+#undef TPH_HAS_AVX512F
+#undef TPH_HAS_FMA
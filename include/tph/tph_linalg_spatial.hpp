@@ -0,0 +1,1024 @@
+#pragma once
+
+#include <algorithm> // std::max, std::min, std::nth_element, std::set_difference, std::sort, ...
+#include <cmath>     // std::floor
+#include <cstddef>   // std::size_t
+#include <cstdint>   // std::int64_t, std::uint64_t
+#include <iterator>  // std::back_inserter
+#include <type_traits>
+#include <vector>
+
+#include "tph_linalg_parallel.hpp"
+
+#if __cplusplus >= 201703L // C++17 or later.
+#define TPH_NODISCARD [[nodiscard]]
+#else
+#define TPH_NODISCARD
+#endif
+
+// See tph_linalg_batch.hpp.
+#if defined(__clang__)
+#define TPH_IVDEP _Pragma("clang loop vectorize(assume_safety)")
+#elif defined(__GNUC__)
+#define TPH_IVDEP _Pragma("GCC ivdep")
+#elif defined(_MSC_VER)
+#define TPH_IVDEP __pragma(loop(ivdep))
+#else
+#define TPH_IVDEP
+#endif
+
+// Spatial indices over arrays of 2D or 3D points, for k-nearest-neighbour and radius queries that
+// are otherwise brute-force loops over all points for every query.
+//
+// KdTree is an implicit, balanced k-d tree: the inner nodes are stored as arrays in heap order
+// (the children of node i are 2i + 1 and 2i + 2) and the leaves hold at most 32 points each. It
+// suits any distribution of points. HashedGrid hashes uniform cells into a table of buckets, and
+// suits fairly uniform points with queries at a known scale, e.g. a radius close to the cell size.
+//
+// Both store the points reordered by leaf or bucket in SoA form, so that the distance tests of a
+// leaf or bucket are Distance2 loops over contiguous lanes that the compiler vectorizes. Building
+// and batches of queries take an optional Scheduler to run in parallel, with the same results.
+// Neighbors refer to the points by their index in the array the index was made from.
+//
+// SpatialSort orders 3D points along a Morton (Z-order) or Hilbert curve, so that points close in
+// the array are close in space. Points from scanners arrive in scan order, and applying the order
+// to the points and their attributes first makes later batch operations and queries, with queries
+// in the same order, visit memory coherently.
+
+namespace tph {
+
+template <typename ArithT>
+struct Neighbor {
+  std::size_t index; // Index of the point in the array the spatial index was made from.
+  ArithT distance2;  // Squared distance from the query point.
+};
+
+template <typename ArithT, int M>
+struct KdTree {
+  VecArraySoA<ArithT, M> points;       // Points in leaf order.
+  std::vector<std::size_t> index;      // Original index of each point in leaf order.
+  std::vector<ArithT> split;           // Split value of each inner node.
+  std::vector<unsigned char> axis;     // Split axis of each inner node.
+  std::vector<std::size_t> leaf_begin; // First point of each leaf, then the number of points.
+};
+
+template <typename ArithT, int M>
+struct HashedGrid {
+  VecArraySoA<ArithT, M> points;         // Points in bucket order.
+  std::vector<std::size_t> index;        // Original index of each point in bucket order.
+  std::vector<std::size_t> bucket_begin; // First point of each bucket, then the number of points.
+  ArithT cell_size;
+  Vec<std::int64_t, M> cell_min; // Range of the cells that hold points, empty for no points.
+  Vec<std::int64_t, M> cell_max;
+};
+
+enum class SpatialCurve {
+  kMorton, // Interleaved coordinate bits, cheapest.
+  kHilbert // No jumps between distant cells, best locality.
+};
+
+namespace tph_linalg_internal {
+
+// Points per k-d tree leaf at most, and per distance block.
+constexpr std::size_t kSpatialBlock = 32;
+
+// Queries per parallel task.
+constexpr std::size_t kQueryChunk = 64;
+
+// Inner node levels above the leaves, so that no leaf has more than kSpatialBlock points.
+inline auto KdDepth(const std::size_t n) noexcept -> int {
+  int d = 0;
+  while (((n + (std::size_t{1} << d) - 1) >> d) > kSpatialBlock) {
+    ++d;
+  }
+  return d;
+}
+
+// Builds the subtree of node, at level, over the points index[begin, end). Splits at the median of
+// the widest axis, so that the leaves are all at the same depth. With tasks, nodes at task_level
+// are not built but added to tasks, to be built later.
+struct KdTask {
+  std::size_t node;
+  std::size_t begin;
+  std::size_t end;
+  int level;
+};
+
+template <typename ArithT, int M>
+void BuildKdNode(KdTree<ArithT, M>* tree,
+                 const Vec<ArithT, M>* src,
+                 const KdTask& t,
+                 const int depth,
+                 const int task_level,
+                 std::vector<KdTask>* tasks) {
+  const auto inner = tree->split.size();
+  if (t.level == depth) {
+    tree->leaf_begin[t.node - inner] = t.begin;
+    return;
+  }
+  if (t.level == task_level) {
+    tasks->push_back(t);
+    return;
+  }
+  auto* index = tree->index.data();
+  auto lo = src[index[t.begin]];
+  auto hi = lo;
+  for (auto i = t.begin + 1; i < t.end; ++i) {
+    lo = Min(lo, src[index[i]]);
+    hi = Max(hi, src[index[i]]);
+  }
+  int a = 0;
+  for (int j = 1; j < M; ++j) {
+    a = Comp(hi, j) - Comp(lo, j) > Comp(hi, a) - Comp(lo, a) ? j : a;
+  }
+  const auto mid = t.begin + (t.end - t.begin) / 2;
+  std::nth_element(index + t.begin, index + mid, index + t.end,
+                   [src, a](const std::size_t i, const std::size_t j) {
+                     return Comp(src[i], a) < Comp(src[j], a);
+                   });
+  tree->split[t.node] = Comp(src[index[mid]], a);
+  tree->axis[t.node] = static_cast<unsigned char>(a);
+  BuildKdNode(tree, src, {2 * t.node + 1, t.begin, mid, t.level + 1}, depth, task_level, tasks);
+  BuildKdNode(tree, src, {2 * t.node + 2, mid, t.end, t.level + 1}, depth, task_level, tasks);
+}
+
+template <typename ArithT, int M>
+auto MakeKdTree(const Vec<ArithT, M>* src,
+                const std::size_t n,
+                const int task_level,
+                std::vector<KdTask>* tasks) -> KdTree<ArithT, M> {
+  KdTree<ArithT, M> tree;
+  const auto depth = KdDepth(n);
+  const auto leaves = std::size_t{1} << depth;
+  tree.split.resize(leaves - 1);
+  tree.axis.resize(leaves - 1);
+  tree.leaf_begin.resize(leaves + 1);
+  tree.leaf_begin[leaves] = n;
+  tree.index.resize(n);
+  for (std::size_t i = 0; i < n; ++i) {
+    tree.index[i] = i;
+  }
+  Resize(tree.points, n);
+  if (n != 0) {
+    BuildKdNode(&tree, src, {0, 0, n, 0}, depth, task_level, tasks);
+  }
+  return tree;
+}
+
+// Squared distances from q to the n points from begin, d2[i] for point begin + i.
+template <typename ArithT, int M>
+void Distances2(const Vec<const ArithT*, M>& p,
+                const std::size_t begin,
+                const std::size_t n,
+                const Vec<ArithT, M>& q,
+                ArithT* d2) noexcept {
+  TPH_IVDEP
+  for (std::size_t i = 0; i < n; ++i) {
+    d2[i] = Distance2(Load(p, begin + i), q);
+  }
+}
+
+// Adds c to the count best neighbors so far, best[0, count) sorted by distance, keeping at most k.
+// c must be closer than best[k - 1] if there are k already.
+template <typename ArithT>
+void InsertNeighbor(const Neighbor<ArithT>& c,
+                    const std::size_t k,
+                    Neighbor<ArithT>* best,
+                    std::size_t* count) noexcept {
+  auto i = *count < k ? (*count)++ : k - 1;
+  for (; i > 0 && best[i - 1].distance2 > c.distance2; --i) {
+    best[i] = best[i - 1];
+  }
+  best[i] = c;
+}
+
+// Points [begin, end) into the k nearest so far.
+template <typename ArithT, int M>
+void ScanNearest(const VecArraySoA<ArithT, M>& points,
+                 const std::vector<std::size_t>& index,
+                 const std::size_t begin,
+                 const std::size_t end,
+                 const Vec<ArithT, M>& q,
+                 const std::size_t k,
+                 Neighbor<ArithT>* best,
+                 std::size_t* count) noexcept {
+  const auto p = Lanes(points);
+  ArithT d2[kSpatialBlock];
+  for (auto b = begin; b < end; b += kSpatialBlock) {
+    const auto n = std::min(end - b, kSpatialBlock);
+    Distances2(p, b, n, q, d2);
+    for (std::size_t i = 0; i < n; ++i) {
+      if (*count < k || d2[i] < best[k - 1].distance2) {
+        InsertNeighbor({index[b + i], d2[i]}, k, best, count);
+      }
+    }
+  }
+}
+
+// Points [begin, end) within squared distance r2, appended to out.
+template <typename ArithT, int M>
+void ScanRadius(const VecArraySoA<ArithT, M>& points,
+                const std::vector<std::size_t>& index,
+                const std::size_t begin,
+                const std::size_t end,
+                const Vec<ArithT, M>& q,
+                const ArithT r2,
+                std::vector<Neighbor<ArithT>>* out) {
+  const auto p = Lanes(points);
+  ArithT d2[kSpatialBlock];
+  for (auto b = begin; b < end; b += kSpatialBlock) {
+    const auto n = std::min(end - b, kSpatialBlock);
+    Distances2(p, b, n, q, d2);
+    for (std::size_t i = 0; i < n; ++i) {
+      if (d2[i] <= r2) {
+        out->push_back({index[b + i], d2[i]});
+      }
+    }
+  }
+}
+
+// Scratch memory of the grid queries, reused across the queries of a batch.
+struct QueryScratch {
+  std::vector<std::size_t> buckets;
+  std::vector<std::size_t> visited;
+  std::vector<std::size_t> merged;
+};
+
+// Depth-first traversal of the nodes whose region may hold points within squared distance
+// bound() of q, nearest child first. leaf(begin, end) is called for the points of each leaf.
+template <typename ArithT, int M, typename Bound, typename Leaf>
+void VisitKd(const KdTree<ArithT, M>& tree, const Vec<ArithT, M>& q, Bound bound, Leaf leaf) {
+  struct Entry {
+    std::size_t node;
+    ArithT d2; // Lower bound of the squared distance to the region of node.
+  };
+  const auto inner = tree.split.size();
+  Entry stack[64];
+  std::size_t top = 0;
+  stack[top++] = {0, ArithT{0}};
+  while (top != 0) {
+    const auto e = stack[--top];
+    if (e.d2 > bound()) {
+      continue;
+    }
+    if (e.node >= inner) {
+      leaf(tree.leaf_begin[e.node - inner], tree.leaf_begin[e.node - inner + 1]);
+      continue;
+    }
+    const auto diff = Comp(q, tree.axis[e.node]) - tree.split[e.node];
+    const auto near = 2 * e.node + (diff < ArithT{0} ? 1 : 2);
+    stack[top++] = {4 * e.node + 3 - near, std::max(e.d2, diff * diff)}; // The other child.
+    stack[top++] = {near, e.d2};
+  }
+}
+
+template <typename ArithT, int M>
+auto KNearestQuery(const KdTree<ArithT, M>& tree,
+                   const Vec<ArithT, M>& q,
+                   const std::size_t k,
+                   Neighbor<ArithT>* out,
+                   QueryScratch* /*scratch*/) -> std::size_t {
+  std::size_t count = 0;
+  if (k == 0 || tree.index.empty()) {
+    return count;
+  }
+  VisitKd(
+      tree, q,
+      [&count, k, out] {
+        return count < k ? numeric_limits<ArithT>::infinity() : out[k - 1].distance2;
+      },
+      [&](const std::size_t begin, const std::size_t end) {
+        ScanNearest(tree.points, tree.index, begin, end, q, k, out, &count);
+      });
+  return count;
+}
+
+template <typename ArithT, int M>
+void RadiusQuery(const KdTree<ArithT, M>& tree,
+                 const Vec<ArithT, M>& q,
+                 const ArithT r,
+                 std::vector<Neighbor<ArithT>>* out,
+                 QueryScratch* /*scratch*/) {
+  if (tree.index.empty()) {
+    return;
+  }
+  const auto r2 = r * r;
+  VisitKd(
+      tree, q, [r2] { return r2; },
+      [&](const std::size_t begin, const std::size_t end) {
+        ScanRadius(tree.points, tree.index, begin, end, q, r2, out);
+      });
+}
+
+template <typename ArithT, int M>
+auto Cell(const Vec<ArithT, M>& p, const ArithT cell_size) noexcept -> Vec<std::int64_t, M> {
+  Vec<std::int64_t, M> c{};
+  for (int j = 0; j < M; ++j) {
+    CompRef(c, j) = static_cast<std::int64_t>(std::floor(Comp(p, j) / cell_size));
+  }
+  return c;
+}
+
+// Bucket of cell c in a table of mask + 1 buckets.
+template <int M>
+auto Bucket(const Vec<std::int64_t, M>& c, const std::size_t mask) noexcept -> std::size_t {
+  constexpr std::uint64_t kPrimes[4] = {0x9E3779B97F4A7C15ULL, 0xC2B2AE3D27D4EB4FULL,
+                                        0x165667B19E3779F9ULL, 0x27D4EB2F165667C5ULL};
+  std::uint64_t h = 0;
+  for (int j = 0; j < M; ++j) {
+    h ^= static_cast<std::uint64_t>(Comp(c, j)) * kPrimes[j];
+  }
+  return static_cast<std::size_t>(h ^ (h >> 32U)) & mask;
+}
+
+// Calls f(c) for each cell c in the box [lo, hi], which must not be empty.
+template <int M, typename F>
+void ForEachCell(const Vec<std::int64_t, M>& lo, const Vec<std::int64_t, M>& hi, F f) {
+  auto c = lo;
+  for (;;) {
+    f(c);
+    int j = 0;
+    for (; j < M && Comp(c, j) == Comp(hi, j); ++j) {
+      CompRef(c, j) = Comp(lo, j);
+    }
+    if (j == M) {
+      return;
+    }
+    ++CompRef(c, j);
+  }
+}
+
+// Number of cells in the box [lo, hi], saturated at limit + 1. 0 if the box is empty.
+template <int M>
+auto CellCount(const Vec<std::int64_t, M>& lo,
+               const Vec<std::int64_t, M>& hi,
+               const std::size_t limit) noexcept -> std::size_t {
+  std::size_t count = 1;
+  for (int j = 0; j < M; ++j) {
+    if (Comp(hi, j) < Comp(lo, j)) {
+      return 0;
+    }
+    const auto extent = static_cast<std::uint64_t>(Comp(hi, j) - Comp(lo, j)) + 1;
+    count = extent > limit / count ? limit + 1 : count * static_cast<std::size_t>(extent);
+  }
+  return count;
+}
+
+template <typename ArithT, int M>
+void FinishGrid(HashedGrid<ArithT, M>* grid, const std::size_t* keys, const std::size_t n) {
+  // Counting sort of the points by bucket, stable so that the order is deterministic.
+  auto& begin = grid->bucket_begin;
+  for (std::size_t i = 0; i < n; ++i) {
+    ++begin[keys[i] + 1];
+  }
+  for (std::size_t b = 1; b < begin.size(); ++b) {
+    begin[b] += begin[b - 1];
+  }
+  std::vector<std::size_t> cursor(begin.begin(), begin.end() - 1);
+  for (std::size_t i = 0; i < n; ++i) {
+    grid->index[cursor[keys[i]]++] = i;
+  }
+}
+
+// Buckets of the cells of the box [lo, hi] clipped to the occupied cells, for which filter(c) is
+// true, minus those in visited, into scratch->buckets sorted. All buckets if the box has more cells
+// than there are buckets.
+template <typename ArithT, int M, typename Filter>
+void BoxBuckets(const HashedGrid<ArithT, M>& grid,
+                const Vec<std::int64_t, M>& lo,
+                const Vec<std::int64_t, M>& hi,
+                Filter filter,
+                QueryScratch* scratch) {
+  auto& buckets = scratch->buckets;
+  buckets.clear();
+  const auto clipped_lo = Max(lo, grid.cell_min);
+  const auto clipped_hi = Min(hi, grid.cell_max);
+  const auto bucket_count = grid.bucket_begin.size() - 1;
+  const auto cells = CellCount(clipped_lo, clipped_hi, bucket_count);
+  if (cells > bucket_count) {
+    for (std::size_t b = 0; b < bucket_count; ++b) {
+      buckets.push_back(b);
+    }
+  } else if (cells != 0) {
+    ForEachCell(clipped_lo, clipped_hi, [&](const Vec<std::int64_t, M>& c) {
+      if (filter(c)) {
+        buckets.push_back(Bucket(c, bucket_count - 1));
+      }
+    });
+    std::sort(buckets.begin(), buckets.end());
+    buckets.erase(std::unique(buckets.begin(), buckets.end()), buckets.end());
+  }
+  if (!scratch->visited.empty()) {
+    scratch->merged.clear();
+    std::set_difference(buckets.begin(), buckets.end(), scratch->visited.begin(),
+                        scratch->visited.end(), std::back_inserter(scratch->merged));
+    buckets.swap(scratch->merged);
+  }
+}
+
+// Expands rings of cells around the cell of q until the k nearest are found: after ring R, the
+// cells not yet visited are at least R + 1 cells away along some axis, so their points are at a
+// distance of at least R * cell_size plus the distance from q to the nearest wall of its cell.
+template <typename ArithT, int M>
+auto KNearestQuery(const HashedGrid<ArithT, M>& grid,
+                   const Vec<ArithT, M>& q,
+                   const std::size_t k,
+                   Neighbor<ArithT>* out,
+                   QueryScratch* scratch) -> std::size_t {
+  std::size_t count = 0;
+  const auto n = grid.index.size();
+  if (k == 0 || n == 0) {
+    return count;
+  }
+  const auto qc = Cell(q, grid.cell_size);
+  auto wall = grid.cell_size;
+  for (int j = 0; j < M; ++j) {
+    const auto t = Comp(q, j) - static_cast<ArithT>(Comp(qc, j)) * grid.cell_size;
+    wall = std::min(wall, std::min(t, grid.cell_size - t));
+  }
+  wall = std::max(wall - grid.cell_size * ArithT(1e-3), ArithT{0}); // Margin for rounding.
+  std::int64_t ring = 0;     // Chebyshev distance from qc to the occupied cells.
+  std::int64_t max_ring = 0; // Chebyshev distance from qc to the farthest occupied cell.
+  for (int j = 0; j < M; ++j) {
+    ring = std::max(ring, std::max(Comp(grid.cell_min, j) - Comp(qc, j),
+                                   Comp(qc, j) - Comp(grid.cell_max, j)));
+    max_ring = std::max(max_ring, std::max(Comp(qc, j) - Comp(grid.cell_min, j),
+                                           Comp(grid.cell_max, j) - Comp(qc, j)));
+  }
+  scratch->visited.clear();
+  std::size_t scanned = 0;
+  for (; ring <= max_ring && scanned < n; ++ring) {
+    Vec<std::int64_t, M> lo{};
+    Vec<std::int64_t, M> hi{};
+    for (int j = 0; j < M; ++j) {
+      CompRef(lo, j) = Comp(qc, j) - ring;
+      CompRef(hi, j) = Comp(qc, j) + ring;
+    }
+    BoxBuckets(
+        grid, lo, hi,
+        [&qc, ring](const Vec<std::int64_t, M>& c) {
+          std::int64_t d = 0;
+          for (int j = 0; j < M; ++j) {
+            d = std::max(d, std::max(Comp(c, j) - Comp(qc, j), Comp(qc, j) - Comp(c, j)));
+          }
+          return d == ring;
+        },
+        scratch);
+    for (const auto b : scratch->buckets) {
+      ScanNearest(grid.points, grid.index, grid.bucket_begin[b], grid.bucket_begin[b + 1], q, k,
+                  out, &count);
+      scanned += grid.bucket_begin[b + 1] - grid.bucket_begin[b];
+    }
+    scratch->merged.clear();
+    std::merge(scratch->visited.begin(), scratch->visited.end(), scratch->buckets.begin(),
+               scratch->buckets.end(), std::back_inserter(scratch->merged));
+    scratch->visited.swap(scratch->merged);
+    const auto reach = static_cast<ArithT>(ring) * grid.cell_size + wall;
+    if (count == k && out[k - 1].distance2 <= reach * reach) {
+      break;
+    }
+  }
+  return count;
+}
+
+template <typename ArithT, int M>
+void RadiusQuery(const HashedGrid<ArithT, M>& grid,
+                 const Vec<ArithT, M>& q,
+                 const ArithT r,
+                 std::vector<Neighbor<ArithT>>* out,
+                 QueryScratch* scratch) {
+  if (grid.index.empty()) {
+    return;
+  }
+  Vec<ArithT, M> offset{};
+  for (int j = 0; j < M; ++j) {
+    CompRef(offset, j) = r;
+  }
+  scratch->visited.clear();
+  BoxBuckets(
+      grid, Cell(q - offset, grid.cell_size), Cell(q + offset, grid.cell_size),
+      [](const Vec<std::int64_t, M>&) { return true; }, scratch);
+  for (const auto b : scratch->buckets) {
+    ScanRadius(grid.points, grid.index, grid.bucket_begin[b], grid.bucket_begin[b + 1], q, r * r,
+               out);
+  }
+}
+
+template <typename ArithT, int M>
+auto MakeGrid(const std::size_t n, const ArithT cell_size) -> HashedGrid<ArithT, M> {
+  HashedGrid<ArithT, M> grid;
+  std::size_t buckets = 1;
+  while (buckets < n) {
+    buckets *= 2;
+  }
+  grid.bucket_begin.resize(buckets + 1);
+  grid.index.resize(n);
+  Resize(grid.points, n);
+  grid.cell_size = cell_size;
+  for (int j = 0; j < M; ++j) {
+    CompRef(grid.cell_min, j) = 0;
+    CompRef(grid.cell_max, j) = -1;
+  }
+  return grid;
+}
+
+// Points of the spatial index in its order, from src.
+template <typename IndexT, typename ArithT, int M>
+void GatherPoints(IndexT* a,
+                  const Vec<ArithT, M>* src,
+                  const std::size_t begin,
+                  const std::size_t end) {
+  const auto p = Lanes(a->points);
+  for (auto i = begin; i < end; ++i) {
+    Store(p, i, src[a->index[i]]);
+  }
+}
+
+// Spreads the low 10 bits of x to every third bit, bit i to bit 3i.
+inline auto SpreadBits3(std::uint32_t x) noexcept -> std::uint32_t {
+  x &= 0x3FFU;
+  x = (x | (x << 16U)) & 0x030000FFU;
+  x = (x | (x << 8U)) & 0x0300F00FU;
+  x = (x | (x << 4U)) & 0x030C30C3U;
+  return (x | (x << 2U)) & 0x09249249U;
+}
+
+// Spreads the low 21 bits of x to every third bit.
+inline auto SpreadBits3(std::uint64_t x) noexcept -> std::uint64_t {
+  x &= 0x1FFFFFULL;
+  x = (x | (x << 32U)) & 0x1F00000000FFFFULL;
+  x = (x | (x << 16U)) & 0x1F0000FF0000FFULL;
+  x = (x | (x << 8U)) & 0x100F00F00F00F00FULL;
+  x = (x | (x << 4U)) & 0x10C30C30C30C30C3ULL;
+  return (x | (x << 2U)) & 0x1249249249249249ULL;
+}
+
+// Bits per axis of the curve keys, 30-bit or 63-bit keys.
+template <typename KeyT>
+constexpr auto AxisBits() noexcept -> int {
+  return sizeof(KeyT) == 4 ? 10 : 21;
+}
+
+// Cell along an axis, in [0, top]. NaN to 0.
+template <typename ArithT>
+auto QuantizeAxis(const ArithT v, const ArithT top) noexcept -> std::uint32_t {
+  return static_cast<std::uint32_t>(v > ArithT{0} ? (v < top ? v : top) : ArithT{0});
+}
+
+// Points per block of the Hilbert transform.
+constexpr std::size_t kCurveBlock = 64;
+
+// Skilling's transform of the cell coordinates x[0], x[1], x[2] of n points to the transposed
+// Hilbert index, whose bits interleaved as for Morton keys, x[0] highest, are the index along the
+// curve. "Programming the Hilbert curve", AIP Conference Proceedings 707, 2004. Each step runs on
+// all the points, so that it is vectorized across them.
+template <int Bits>
+void HilbertTranspose(std::uint32_t (*x)[kCurveBlock], const std::size_t n) noexcept {
+  constexpr std::uint32_t kTop = 1U << (Bits - 1);
+  for (auto q = kTop; q > 1U; q >>= 1U) {
+    const auto p = q - 1U;
+    for (int i = 0; i < 3; ++i) {
+      auto* x0 = x[0];
+      auto* xi = x[i];
+      TPH_IVDEP
+      for (std::size_t j = 0; j < n; ++j) {
+        // Invert the low bits of x[0], or exchange them with those of x[i].
+        const auto invert = (xi[j] & q) != 0U;
+        const auto t = (x0[j] ^ xi[j]) & p;
+        x0[j] ^= invert ? p : t;
+        xi[j] ^= invert ? 0U : t;
+      }
+    }
+  }
+  TPH_IVDEP
+  for (std::size_t j = 0; j < n; ++j) {
+    // Gray encode.
+    x[1][j] ^= x[0][j];
+    x[2][j] ^= x[1][j];
+    std::uint32_t t = 0;
+    for (auto q = kTop; q > 1U; q >>= 1U) {
+      t ^= (x[2][j] & q) != 0U ? q - 1U : 0U;
+    }
+    x[0][j] ^= t;
+    x[1][j] ^= t;
+    x[2][j] ^= t;
+  }
+}
+
+template <typename KeyT, typename ArithT>
+void CurveKeys(const Vec<ArithT, 3>* src,
+               const std::size_t begin,
+               const std::size_t end,
+               const Aabb<ArithT, 3>& bounds,
+               const SpatialCurve curve,
+               KeyT* keys) noexcept {
+  constexpr auto kBits = AxisBits<KeyT>();
+  constexpr auto kTop = static_cast<ArithT>((1U << kBits) - 1U);
+  const auto o = bounds.min;
+  const auto e = bounds.max - bounds.min;
+  const Vec<ArithT, 3> scale = {e.x > ArithT{0} ? kTop / e.x : ArithT{0},
+                                e.y > ArithT{0} ? kTop / e.y : ArithT{0},
+                                e.z > ArithT{0} ? kTop / e.z : ArithT{0}};
+  if (curve == SpatialCurve::kMorton) {
+    TPH_IVDEP
+    for (auto i = begin; i < end; ++i) {
+      const auto x = KeyT{QuantizeAxis((src[i].x - o.x) * scale.x, kTop)};
+      const auto y = KeyT{QuantizeAxis((src[i].y - o.y) * scale.y, kTop)};
+      const auto z = KeyT{QuantizeAxis((src[i].z - o.z) * scale.z, kTop)};
+      keys[i] = SpreadBits3(x) | (SpreadBits3(y) << 1U) | (SpreadBits3(z) << 2U);
+    }
+    return;
+  }
+  std::uint32_t c[3][kCurveBlock];
+  for (auto b = begin; b < end; b += kCurveBlock) {
+    const auto n = std::min(end - b, kCurveBlock);
+    const auto* p = src + b;
+    TPH_IVDEP
+    for (std::size_t j = 0; j < n; ++j) {
+      c[0][j] = QuantizeAxis((p[j].x - o.x) * scale.x, kTop);
+      c[1][j] = QuantizeAxis((p[j].y - o.y) * scale.y, kTop);
+      c[2][j] = QuantizeAxis((p[j].z - o.z) * scale.z, kTop);
+    }
+    HilbertTranspose<kBits>(c, n);
+    auto* k = keys + b;
+    TPH_IVDEP
+    for (std::size_t j = 0; j < n; ++j) {
+      k[j] = (SpreadBits3(KeyT{c[0][j]}) << 2U) | (SpreadBits3(KeyT{c[1][j]}) << 1U) |
+             SpreadBits3(KeyT{c[2][j]});
+    }
+  }
+}
+
+// Digit bits of RadixSort, 3 passes for 30-bit keys.
+constexpr int kRadixBits = 11;
+constexpr std::size_t kRadix = std::size_t{1} << kRadixBits;
+
+// Stable LSD radix sort of keys, and index along with them. Each of the chunks of chunk elements
+// counts its digits and scatters them in a separate task. Passes where all keys have the same
+// digit are skipped.
+
+template <typename KeyT>
+void RadixSort(Scheduler& s,
+               const std::size_t chunk,
+               std::vector<KeyT>* keys,
+               std::vector<std::size_t>* index) {
+  const auto n = keys->size();
+  if (n == 0) {
+    return;
+  }
+  const auto parts = (n + chunk - 1) / chunk;
+  std::vector<KeyT> keys2(n);
+  std::vector<std::size_t> index2(n);
+  std::vector<std::size_t> counts(parts * kRadix);
+  for (int shift = 0; shift < 3 * AxisBits<KeyT>(); shift += kRadixBits) {
+    const auto* k = keys->data();
+    auto* c = counts.data();
+    std::fill(counts.begin(), counts.end(), 0);
+    ParallelFor(s, n, chunk, [k, c, chunk, shift](const std::size_t begin, const std::size_t end) {
+      auto* part = c + begin / chunk * kRadix;
+      for (auto i = begin; i < end; ++i) {
+        ++part[(k[i] >> shift) & (kRadix - 1)];
+      }
+    });
+    // Digit by digit, then part by part, so that equal keys keep their order.
+    std::size_t sum = 0;
+    auto same = false;
+    for (std::size_t d = 0; d < kRadix; ++d) {
+      const auto first = sum;
+      for (std::size_t p = 0; p < parts; ++p) {
+        const auto count = c[p * kRadix + d];
+        c[p * kRadix + d] = sum;
+        sum += count;
+      }
+      same = same || sum - first == n;
+    }
+    if (same) {
+      continue;
+    }
+    const auto* idx = index->data();
+    auto* k2 = keys2.data();
+    auto* idx2 = index2.data();
+    ParallelFor(s, n, chunk, [=](const std::size_t begin, const std::size_t end) {
+      auto* part = c + begin / chunk * kRadix;
+      for (auto i = begin; i < end; ++i) {
+        const auto j = part[(k[i] >> shift) & (kRadix - 1)]++;
+        k2[j] = k[i];
+        idx2[j] = idx[i];
+      }
+    });
+    keys->swap(keys2);
+    index->swap(index2);
+  }
+}
+
+template <typename KeyT, typename ArithT>
+auto SpatialSort(Scheduler& s,
+                 const std::size_t chunk,
+                 const Vec<ArithT, 3>* src,
+                 const std::size_t n,
+                 const Aabb<ArithT, 3>& bounds,
+                 const SpatialCurve curve) -> std::vector<std::size_t> {
+  static_assert(std::is_same<KeyT, std::uint32_t>::value ||
+                    std::is_same<KeyT, std::uint64_t>::value,
+                "30-bit or 63-bit keys");
+  std::vector<KeyT> keys(n);
+  std::vector<std::size_t> index(n);
+  auto* k = keys.data();
+  auto* idx = index.data();
+  ParallelFor(s, n, chunk,
+              [src, &bounds, curve, k, idx](const std::size_t begin, const std::size_t end) {
+                CurveKeys(src, begin, end, bounds, curve, k);
+                for (auto i = begin; i < end; ++i) {
+                  idx[i] = i;
+                }
+              });
+  RadixSort(s, chunk, &keys, &index);
+  return index;
+}
+
+} // namespace tph_linalg_internal
+
+// k-d tree over the n points at src, which are copied. The points must be finite.
+template <typename ArithT, int M>
+TPH_NODISCARD auto MakeKdTree(const Vec<ArithT, M>* src, const std::size_t n) -> KdTree<ArithT, M> {
+  static_assert(M == 2 || M == 3, "2D or 3D points");
+  auto tree = tph_linalg_internal::MakeKdTree(src, n, -1, nullptr);
+  tph_linalg_internal::GatherPoints(&tree, src, 0, n);
+  return tree;
+}
+
+// Hashed grid over the n points at src, which are copied, with cubic cells of cell_size. The
+// points must be finite, and cell_size positive. The table has a bucket per point, rounded up to a
+// power of two. Queries are fastest when about one cell per axis covers the query radius or the
+// distance to the k-th nearest neighbor.
+template <typename ArithT, int M>
+TPH_NODISCARD auto MakeHashedGrid(const Vec<ArithT, M>* src,
+                                  const std::size_t n,
+                                  const ArithT cell_size) -> HashedGrid<ArithT, M> {
+  static_assert(M == 2 || M == 3, "2D or 3D points");
+  namespace internal = tph_linalg_internal;
+  auto grid = internal::MakeGrid<ArithT, M>(n, cell_size);
+  const auto mask = grid.bucket_begin.size() - 2;
+  std::vector<std::size_t> keys(n);
+  for (std::size_t i = 0; i < n; ++i) {
+    const auto c = internal::Cell(src[i], cell_size);
+    grid.cell_min = i == 0 ? c : Min(grid.cell_min, c);
+    grid.cell_max = i == 0 ? c : Max(grid.cell_max, c);
+    keys[i] = internal::Bucket(c, mask);
+  }
+  internal::FinishGrid(&grid, keys.data(), n);
+  internal::GatherPoints(&grid, src, 0, n);
+  return grid;
+}
+
+// The min(k, size) points nearest to q, into out[0, min(k, size)) sorted by increasing distance,
+// returns the count. Points at the same distance are in no particular order.
+template <typename ArithT, int M>
+auto KNearest(const KdTree<ArithT, M>& tree,
+              const Vec<ArithT, M>& q,
+              const std::size_t k,
+              Neighbor<ArithT>* out) -> std::size_t {
+  return tph_linalg_internal::KNearestQuery(tree, q, k, out, nullptr);
+}
+
+template <typename ArithT, int M>
+auto KNearest(const HashedGrid<ArithT, M>& grid,
+              const Vec<ArithT, M>& q,
+              const std::size_t k,
+              Neighbor<ArithT>* out) -> std::size_t {
+  tph_linalg_internal::QueryScratch scratch;
+  return tph_linalg_internal::KNearestQuery(grid, q, k, out, &scratch);
+}
+
+// The points within distance r of q (Distance2 <= r * r), appended to out in no particular order.
+template <typename ArithT, int M>
+void RadiusSearch(const KdTree<ArithT, M>& tree,
+                  const Vec<ArithT, M>& q,
+                  const ArithT r,
+                  std::vector<Neighbor<ArithT>>* out) {
+  tph_linalg_internal::RadiusQuery(tree, q, r, out, nullptr);
+}
+
+template <typename ArithT, int M>
+void RadiusSearch(const HashedGrid<ArithT, M>& grid,
+                  const Vec<ArithT, M>& q,
+                  const ArithT r,
+                  std::vector<Neighbor<ArithT>>* out) {
+  tph_linalg_internal::QueryScratch scratch;
+  tph_linalg_internal::RadiusQuery(grid, q, r, out, &scratch);
+}
+
+// KNearest for each of the nq queries, the neighbors of query i into out[i * k, i * k + k).
+// Returns the count of each query, min(k, size).
+template <template <typename, int> class IndexT, typename ArithT, int M>
+auto KNearestMany(const IndexT<ArithT, M>& index,
+                  const Vec<ArithT, M>* queries,
+                  const std::size_t nq,
+                  const std::size_t k,
+                  Neighbor<ArithT>* out) -> std::size_t {
+  tph_linalg_internal::QueryScratch scratch;
+  for (std::size_t i = 0; i < nq; ++i) {
+    tph_linalg_internal::KNearestQuery(index, queries[i], k, out + i * k, &scratch);
+  }
+  return std::min(k, index.index.size());
+}
+
+// RadiusSearch for each of the nq queries, the neighbors of query i into
+// out[offsets[i], offsets[i + 1]). Replaces the contents of offsets and out.
+template <template <typename, int> class IndexT, typename ArithT, int M>
+void RadiusSearchMany(const IndexT<ArithT, M>& index,
+                      const Vec<ArithT, M>* queries,
+                      const std::size_t nq,
+                      const ArithT r,
+                      std::vector<std::size_t>* offsets,
+                      std::vector<Neighbor<ArithT>>* out) {
+  tph_linalg_internal::QueryScratch scratch;
+  offsets->assign(nq + 1, 0);
+  out->clear();
+  for (std::size_t i = 0; i < nq; ++i) {
+    tph_linalg_internal::RadiusQuery(index, queries[i], r, out, &scratch);
+    (*offsets)[i + 1] = out->size();
+  }
+}
+
+// Curve keys of the n points at src into keys, 10 bits per axis for std::uint32_t keys (30-bit
+// keys) and 21 bits per axis for std::uint64_t keys (63-bit keys). Points are mapped to cells of a
+// uniform grid over bounds, e.g. ComputeBounds(src, n), and clamped to it.
+template <typename KeyT, typename ArithT>
+void SpatialKeys(const Vec<ArithT, 3>* src,
+                 const std::size_t n,
+                 const Aabb<ArithT, 3>& bounds,
+                 const SpatialCurve curve,
+                 KeyT* keys) noexcept {
+  static_assert(std::is_same<KeyT, std::uint32_t>::value ||
+                    std::is_same<KeyT, std::uint64_t>::value,
+                "30-bit or 63-bit keys");
+  tph_linalg_internal::CurveKeys(src, 0, n, bounds, curve, keys);
+}
+
+// Order of the n points at src along the curve over their bounds, perm[i] is the index in src of
+// the i-th point in order. Points with the same key keep their order. 30-bit keys (1024 cells per
+// axis) are enough for locality unless the points are very unevenly spread, e.g.
+// SpatialSort<std::uint64_t>(src, n) for 63-bit keys. Apply the order with ApplyPermutation.
+template <typename KeyT = std::uint32_t, typename ArithT>
+TPH_NODISCARD auto SpatialSort(const Vec<ArithT, 3>* src,
+                               const std::size_t n,
+                               const SpatialCurve curve = SpatialCurve::kHilbert)
+    -> std::vector<std::size_t> {
+  SerialScheduler serial;
+  return tph_linalg_internal::SpatialSort<KeyT>(serial, n > 0 ? n : 1, src, n,
+                                                ComputeBounds(src, n), curve);
+}
+
+// dst[i] = src[perm[i]] for the points or any of their attributes. dst must not overlap src.
+template <typename T>
+void ApplyPermutation(const std::vector<std::size_t>& perm, const T* src, T* dst) noexcept {
+  const auto n = perm.size();
+  for (std::size_t i = 0; i < n; ++i) {
+    dst[i] = src[perm[i]];
+  }
+}
+
+// Parallel versions, see tph_linalg_parallel.hpp. The k-d tree builds the top levels serially and
+// the subtrees below them as separate tasks.
+template <typename ArithT, int M>
+TPH_NODISCARD auto MakeKdTree(Scheduler& s, const Vec<ArithT, M>* src, const std::size_t n)
+    -> KdTree<ArithT, M> {
+  static_assert(M == 2 || M == 3, "2D or 3D points");
+  namespace internal = tph_linalg_internal;
+  std::vector<internal::KdTask> tasks;
+  auto tree = internal::MakeKdTree(src, n, std::min(internal::KdDepth(n), 6), &tasks);
+  s.Run(tasks.size(), [&tree, src, &tasks](const std::size_t i) {
+    internal::BuildKdNode(&tree, src, tasks[i], internal::KdDepth(tree.index.size()), -1, nullptr);
+  });
+  ParallelFor(s, n, internal::ChunkSize(2 * sizeof(Vec<ArithT, M>)),
+              [&tree, src](const std::size_t begin, const std::size_t end) {
+                internal::GatherPoints(&tree, src, begin, end);
+              });
+  return tree;
+}
+
+template <typename ArithT, int M>
+TPH_NODISCARD auto MakeHashedGrid(Scheduler& s,
+                                  const Vec<ArithT, M>* src,
+                                  const std::size_t n,
+                                  const ArithT cell_size) -> HashedGrid<ArithT, M> {
+  static_assert(M == 2 || M == 3, "2D or 3D points");
+  namespace internal = tph_linalg_internal;
+  using Cells = Vec<std::int64_t, M>;
+  struct Range {
+    Cells lo;
+    Cells hi;
+  };
+  auto grid = internal::MakeGrid<ArithT, M>(n, cell_size);
+  const auto mask = grid.bucket_begin.size() - 2;
+  std::vector<std::size_t> keys(n);
+  const auto chunk = internal::ChunkSize(sizeof(Vec<ArithT, M>) + sizeof(std::size_t));
+  const auto range = ParallelReduce(
+      s, n, chunk, Range{grid.cell_min, grid.cell_max},
+      [src, cell_size, mask, &keys](const std::size_t begin, const std::size_t end) {
+        Range r{};
+        for (auto i = begin; i < end; ++i) {
+          const auto c = internal::Cell(src[i], cell_size);
+          r.lo = i == begin ? c : Min(r.lo, c);
+          r.hi = i == begin ? c : Max(r.hi, c);
+          keys[i] = internal::Bucket(c, mask);
+        }
+        return r;
+      },
+      [](const Range& a, const Range& b) {
+        // Empty ranges have hi < lo, from the initial value.
+        return Comp(a.hi, 0) < Comp(a.lo, 0) ? b : Range{Min(a.lo, b.lo), Max(a.hi, b.hi)};
+      });
+  grid.cell_min = range.lo;
+  grid.cell_max = range.hi;
+  internal::FinishGrid(&grid, keys.data(), n);
+  ParallelFor(s, n, internal::ChunkSize(2 * sizeof(Vec<ArithT, M>)),
+              [&grid, src](const std::size_t begin, const std::size_t end) {
+                internal::GatherPoints(&grid, src, begin, end);
+              });
+  return grid;
+}
+
+template <template <typename, int> class IndexT, typename ArithT, int M>
+auto KNearestMany(Scheduler& s,
+                  const IndexT<ArithT, M>& index,
+                  const Vec<ArithT, M>* queries,
+                  const std::size_t nq,
+                  const std::size_t k,
+                  Neighbor<ArithT>* out) -> std::size_t {
+  ParallelFor(s, nq, tph_linalg_internal::kQueryChunk,
+              [&index, queries, k, out](const std::size_t begin, const std::size_t end) {
+                tph_linalg_internal::QueryScratch scratch;
+                for (auto i = begin; i < end; ++i) {
+                  tph_linalg_internal::KNearestQuery(index, queries[i], k, out + i * k, &scratch);
+                }
+              });
+  return std::min(k, index.index.size());
+}
+
+// Each task collects the neighbors of its queries, which are then concatenated in query order.
+template <template <typename, int> class IndexT, typename ArithT, int M>
+void RadiusSearchMany(Scheduler& s,
+                      const IndexT<ArithT, M>& index,
+                      const Vec<ArithT, M>* queries,
+                      const std::size_t nq,
+                      const ArithT r,
+                      std::vector<std::size_t>* offsets,
+                      std::vector<Neighbor<ArithT>>* out) {
+  namespace internal = tph_linalg_internal;
+  const auto chunk = internal::kQueryChunk;
+  std::vector<std::vector<Neighbor<ArithT>>> parts((nq + chunk - 1) / chunk);
+  offsets->assign(nq + 1, 0);
+  auto* counts = offsets->data() + 1;
+  ParallelFor(s, nq, chunk,
+              [&index, queries, r, &parts, chunk, counts](const std::size_t begin,
+                                                         const std::size_t end) {
+                internal::QueryScratch scratch;
+                auto& part = parts[begin / chunk];
+                for (auto i = begin; i < end; ++i) {
+                  const auto before = part.size();
+                  internal::RadiusQuery(index, queries[i], r, &part, &scratch);
+                  counts[i] = part.size() - before;
+                }
+              });
+  for (std::size_t i = 0; i < nq; ++i) {
+    counts[i] += (*offsets)[i];
+  }
+  out->resize(offsets->back());
+  auto* dst = out->data();
+  const auto* first = offsets->data();
+  ParallelFor(s, nq, chunk,
+              [&parts, chunk, dst, first](const std::size_t begin, const std::size_t /*end*/) {
+                const auto& part = parts[begin / chunk];
+                std::copy(part.begin(), part.end(), dst + first[begin]);
+              });
+}
+
+
+// Computes the keys and sorts them in parallel, with the same result as SpatialSort.
+template <typename KeyT = std::uint32_t, typename ArithT>
+TPH_NODISCARD auto SpatialSort(Scheduler& s,
+                               const Vec<ArithT, 3>* src,
+                               const std::size_t n,
+                               const SpatialCurve curve = SpatialCurve::kHilbert)
+    -> std::vector<std::size_t> {
+  namespace internal = tph_linalg_internal;
+  return internal::SpatialSort<KeyT>(s, internal::ChunkSize(sizeof(KeyT) + sizeof(std::size_t)),
+                                     src, n, ComputeBounds(s, src, n), curve);
+}
+
+template <typename T>
+void ApplyPermutation(Scheduler& s, const std::vector<std::size_t>& perm, const T* src, T* dst) {
+  ParallelFor(s, perm.size(), tph_linalg_internal::ChunkSize(2 * sizeof(T)),
+              [&perm, src, dst](const std::size_t begin, const std::size_t end) {
+                for (auto i = begin; i < end; ++i) {
+                  dst[i] = src[perm[i]];
+                }
+              });
+}
+
+} // namespace tph
+
+#undef TPH_NODISCARD
+#undef TPH_IVDEP
@@ -0,0 +1,257 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstddef> // std::size_t
+#include <cstdint> // std::uint64_t
+#include <cstring> // std::memcpy
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "tph_linalg_parallel.hpp"
+
+#if __cplusplus >= 201703L // C++17 or later.
+#define TPH_NODISCARD [[nodiscard]]
+#else
+#define TPH_NODISCARD
+#endif
+
+// Streaming pipeline for point sets that do not fit in memory, or that are too large to keep
+// intermediate arrays for. RunStream pulls vectors from a source into a tile, runs a chain of
+// stages on the tile in place while it is in the L2 cache, and passes the results to a sink. A
+// second tile is read by a separate thread (link with Threads::Threads) while the first one is
+// computed, so reading overlaps computing. Memory use is two tiles whatever the size of the input.
+//
+// Stages are functions of the tile, e.g. made by TransformPointsStage, NormalizedStage or
+// BoundsStage, or any other batch operation that works in place. Stages and the sink run on the
+// calling thread, in tile order, and the source on the reader thread, also in order. Lambdas may
+// be passed for the source and sink when the type is given, e.g. RunStream<float, 3>(...).
+// Exceptions from the source, the stages or the sink stop the stream and are rethrown by
+// RunStream on the calling thread.
+
+namespace tph {
+
+// Reads up to capacity vectors into dst and returns the number read, 0 at the end of the stream.
+// May return fewer than capacity before the end, e.g. for a pipe.
+template <typename ArithT, int M>
+using StreamSource = std::function<std::size_t(Vec<ArithT, M>* dst, std::size_t capacity)>;
+
+// Changes the n vectors of a tile in place.
+template <typename ArithT, int M>
+using StreamStage = std::function<void(Vec<ArithT, M>* tile, std::size_t n)>;
+
+// Consumes the n result vectors of a tile, e.g. writes them to a file.
+template <typename ArithT, int M>
+using StreamSink = std::function<void(const Vec<ArithT, M>* tile, std::size_t n)>;
+
+// Source reading the n vectors at src, e.g. a mapped file from tph_linalg_io.hpp. src must stay
+// valid while the source is used.
+template <typename ArithT, int M>
+TPH_NODISCARD auto ArraySource(const Vec<ArithT, M>* src, const std::size_t n)
+    -> StreamSource<ArithT, M> {
+  std::size_t i = 0;
+  return [src, n, i](Vec<ArithT, M>* dst, const std::size_t capacity) mutable -> std::size_t {
+    const auto count = n - i < capacity ? n - i : capacity;
+    if (count != 0) {
+      std::memcpy(dst, src + i, count * sizeof(*src));
+    }
+    i += count;
+    return count;
+  };
+}
+
+// Sink writing the results to consecutive vectors starting at dst.
+template <typename ArithT, int M>
+TPH_NODISCARD auto ArraySink(Vec<ArithT, M>* dst) -> StreamSink<ArithT, M> {
+  std::size_t i = 0;
+  return [dst, i](const Vec<ArithT, M>* tile, const std::size_t n) mutable {
+    std::memcpy(dst + i, tile, n * sizeof(*tile));
+    i += n;
+  };
+}
+
+// Whether RunStream reads on a separate thread. kAuto does unless there is a single hardware
+// thread, with nothing to overlap reading with.
+enum class StreamOverlap { kAuto, kAlways, kNever };
+
+// Stages for the batch operations of the same names. m is copied into the stage.
+template <typename ArithT>
+TPH_NODISCARD auto TransformPointsStage(const Mat<ArithT, 3, 4>& m) -> StreamStage<ArithT, 3> {
+  return [m](Vec<ArithT, 3>* tile, const std::size_t n) { TransformPoints(m, tile, tile, n); };
+}
+
+template <typename ArithT>
+TPH_NODISCARD auto TransformPointsStage(const Mat<ArithT, 4, 4>& m) -> StreamStage<ArithT, 3> {
+  return [m](Vec<ArithT, 3>* tile, const std::size_t n) { TransformPoints(m, tile, tile, n); };
+}
+
+template <typename ArithT>
+TPH_NODISCARD auto TransformDirectionsStage(const Mat<ArithT, 3, 4>& m)
+    -> StreamStage<ArithT, 3> {
+  return [m](Vec<ArithT, 3>* tile, const std::size_t n) { TransformDirections(m, tile, tile, n); };
+}
+
+template <typename ArithT>
+TPH_NODISCARD auto TransformDirectionsStage(const Mat<ArithT, 4, 4>& m)
+    -> StreamStage<ArithT, 3> {
+  return [m](Vec<ArithT, 3>* tile, const std::size_t n) { TransformDirections(m, tile, tile, n); };
+}
+
+template <typename ArithT>
+TPH_NODISCARD auto ProjectPointsStage(const Mat<ArithT, 4, 4>& m) -> StreamStage<ArithT, 3> {
+  return [m](Vec<ArithT, 3>* tile, const std::size_t n) { ProjectPoints(m, tile, tile, n); };
+}
+
+template <typename ArithT, int M>
+TPH_NODISCARD auto NormalizedStage() -> StreamStage<ArithT, M> {
+  return [](Vec<ArithT, M>* tile, const std::size_t n) {
+    const auto stride = sizeof(*tile);
+    Normalized(MakeStridedView<ArithT, M>(tile, 0, stride, n),
+               MakeStridedSpan<ArithT, M>(tile, 0, stride, n));
+  };
+}
+
+// Accumulates the bounds of the tiles into *bounds with Union, leaving the tiles unchanged. Start
+// from an empty box, e.g. ComputeBounds(src, 0), for the bounds of the stream. bounds must stay
+// valid while the stage is used.
+template <typename ArithT>
+TPH_NODISCARD auto BoundsStage(Aabb<ArithT, 3>* bounds) -> StreamStage<ArithT, 3> {
+  return [bounds](Vec<ArithT, 3>* tile, const std::size_t n) {
+    *bounds = Union(*bounds, ComputeBounds(tile, n));
+  };
+}
+
+namespace tph_linalg_internal {
+
+constexpr auto kFreeTile = static_cast<std::size_t>(-1);
+
+// The two tiles of RunStream, handed between the reader thread and the calling thread. count[k] is
+// the number of vectors read into tile k, or kFreeTile while it is free to be read into. Either
+// thread may stop the other, the reader with the exception thrown by the source, if any.
+struct TileHandoff {
+  std::mutex mutex;
+  std::condition_variable changed;
+  std::size_t count[2] = {kFreeTile, kFreeTile};
+  bool stopped = false;
+  std::exception_ptr error;
+
+  void Set(const std::size_t k, const std::size_t n) {
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      count[k] = n;
+    }
+    changed.notify_one();
+  }
+
+  void Stop(const std::exception_ptr& e = nullptr) {
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      stopped = true;
+      if (e) {
+        error = e;
+      }
+    }
+    changed.notify_all();
+  }
+
+  // Waits until tile k is free (filled = false) or filled (filled = true), returns its count.
+  // Returns 0, as at the end of the stream, once stopped.
+  auto Wait(const std::size_t k, const bool filled) -> std::size_t {
+    std::unique_lock<std::mutex> lock(mutex);
+    changed.wait(lock, [this, k, filled] { return stopped || (count[k] != kFreeTile) == filled; });
+    return stopped ? 0 : count[k];
+  }
+};
+
+// Stops and joins the reader thread when RunStream returns, also when a stage or the sink throws.
+struct ReaderGuard {
+  TileHandoff& handoff;
+  std::thread& reader;
+
+  ~ReaderGuard() {
+    handoff.Stop();
+    reader.join();
+  }
+};
+
+template <typename ArithT, int M>
+void RunTile(const std::vector<StreamStage<ArithT, M>>& stages,
+             const StreamSink<ArithT, M>& sink,
+             Vec<ArithT, M>* tile,
+             const std::size_t n) {
+  for (const auto& stage : stages) {
+    stage(tile, n);
+  }
+  if (sink) {
+    sink(tile, n);
+  }
+}
+
+} // namespace tph_linalg_internal
+
+// Runs the stages in order on each tile of the vectors read from source, then passes the tile to
+// sink, which may be empty if only the effects of the stages are wanted. Tiles hold tile_size
+// vectors, 0 for tiles of 128 KiB so that both fit in the L2 cache with room to spare. Returns the
+// number of vectors streamed. Without overlap, see StreamOverlap, the source is called on the
+// calling thread instead, with one tile.
+template <typename ArithT, int M>
+auto RunStream(const StreamSource<ArithT, M>& source,
+               const std::vector<StreamStage<ArithT, M>>& stages,
+               const StreamSink<ArithT, M>& sink,
+               const std::size_t tile_size = 0,
+               const StreamOverlap overlap_mode = StreamOverlap::kAuto) -> std::uint64_t {
+  namespace internal = tph_linalg_internal;
+  const auto tile = tile_size != 0 ? tile_size : internal::ChunkSize(sizeof(Vec<ArithT, M>));
+  const auto overlap = overlap_mode == StreamOverlap::kAuto
+                           ? std::thread::hardware_concurrency() != 1
+                           : overlap_mode == StreamOverlap::kAlways;
+  std::vector<Vec<ArithT, M>> tiles(overlap ? 2 * tile : tile);
+  std::uint64_t total = 0;
+  if (!overlap) {
+    for (auto n = source(tiles.data(), tile); n != 0; n = source(tiles.data(), tile)) {
+      internal::RunTile(stages, sink, tiles.data(), n);
+      total += n;
+    }
+    return total;
+  }
+
+  internal::TileHandoff handoff;
+  {
+    std::thread reader([&source, &tiles, &handoff, tile] {
+      try {
+        for (std::size_t k = 0;; k ^= 1) {
+          if (handoff.Wait(k, false) == 0) {
+            return; // Stopped by the calling thread.
+          }
+          const auto n = source(tiles.data() + k * tile, tile);
+          handoff.Set(k, n);
+          if (n == 0) {
+            return;
+          }
+        }
+      } catch (...) {
+        handoff.Stop(std::current_exception());
+      }
+    });
+    const internal::ReaderGuard guard{handoff, reader};
+    for (std::size_t k = 0;; k ^= 1) {
+      const auto n = handoff.Wait(k, true);
+      if (n == 0) {
+        break;
+      }
+      internal::RunTile(stages, sink, tiles.data() + k * tile, n);
+      total += n;
+      handoff.Set(k, internal::kFreeTile);
+    }
+  }
+  if (handoff.error) {
+    std::rethrow_exception(handoff.error);
+  }
+  return total;
+}
+
+} // namespace tph
+
+#undef TPH_NODISCARD
@@ -0,0 +1,468 @@
+// Copyright (C) Tommy Hinks <tommy.hinks@gmail.com>
+// This file is subject to the license terms in the LICENSE file
+// found in the top-level directory of this distribution.
+
+// Compile the SIMD kernels for all instruction sets, see tph_linalg_batch.hpp.
+#define TPH_LINALG_ALL_KERNELS
+#include <tph/tph_linalg_kernels.hpp>
+
+#include <atomic>
+#include <cctype>  // std::tolower
+#include <cstdlib> // std::getenv
+
+#include <tph/tph_linalg_batch.hpp>
+
+#if defined(__x86_64__) || defined(__i386__) || defined(_M_X64) || defined(_M_IX86)
+#define TPH_X86 1
+#if defined(_MSC_VER) && !defined(__clang__)
+#include <intrin.h> // __cpuid, __cpuidex, _xgetbv
+#endif
+#else
+#define TPH_X86 0
+#endif
+
+namespace tph {
+namespace kernels {
+namespace {
+
+using AffineFn = void (*)(const Mat<float, 3, 4>&,
+                          const Vec<float, 3>*,
+                          Vec<float, 3>*,
+                          std::size_t);
+using ProjectFn = void (*)(const Mat<float, 4, 4>&,
+                           const Vec<float, 3>*,
+                           Vec<float, 3>*,
+                           std::size_t);
+using AffineHalfFn = void (*)(const Mat<float, 3, 4>&,
+                              const Vec<half, 3>*,
+                              Vec<half, 3>*,
+                              std::size_t);
+using ProjectHalfFn = void (*)(const Mat<float, 4, 4>&,
+                               const Vec<half, 3>*,
+                               Vec<half, 3>*,
+                               std::size_t);
+using WidenFn = void (*)(const half*, float*, std::size_t);
+using NarrowFn = void (*)(const float*, half*, std::size_t);
+template <typename PackedT>
+using EncodeFn = void (*)(const Vec<float, 3>*, PackedT*, std::size_t);
+template <typename PackedT>
+using DecodeFn = void (*)(const PackedT*, Vec<float, 3>*, std::size_t);
+using BoundsFn = auto (*)(const Vec<float, 3>*, std::size_t) -> Aabb<float, 3>;
+using DotRangeFn = auto (*)(const Vec<float, 3>*, std::size_t, const Vec<float, 3>&)
+    -> Vec<float, 2>;
+using SumFn = auto (*)(const Vec<float, 3>*, std::size_t) -> Vec<float, 3>;
+using MomentsFn = auto (*)(const Vec<float, 3>*, std::size_t, const Vec<float, 3>&)
+    -> tph_linalg_internal::Moments<float>;
+using InverseFn = void (*)(const Mat<float, 4, 4>*, Mat<float, 4, 4>*, std::size_t);
+using MulFn = void (*)(const Mat<float, 4, 4>*,
+                       std::size_t,
+                       const Mat<float, 4, 4>*,
+                       Mat<float, 4, 4>*,
+                       std::size_t);
+
+struct Table {
+  Isa isa;
+  AffineFn points;
+  AffineFn directions;
+  ProjectFn project;
+  InverseFn inverse;
+  MulFn mul;
+  AffineHalfFn points_half;
+  AffineHalfFn directions_half;
+  ProjectHalfFn project_half;
+  WidenFn widen;
+  NarrowFn narrow;
+  EncodeFn<Oct16> encode_oct16;
+  EncodeFn<Oct32> encode_oct32;
+  EncodeFn<Snorm1010102> encode_snorm;
+  DecodeFn<Oct16> decode_oct16;
+  DecodeFn<Oct32> decode_oct32;
+  DecodeFn<Snorm1010102> decode_snorm;
+  BoundsFn bounds;
+  DotRangeFn dot_range;
+  SumFn sum;
+  MomentsFn moments;
+};
+
+namespace internal = tph_linalg_internal;
+
+// Indexed by Isa.
+const Table kTables[] = {
+    {Isa::kScalar,
+     &internal::AffineScalar<true, float>,
+     &internal::AffineScalar<false, float>,
+     &internal::ProjectScalar<float>,
+     &internal::InverseScalar<float>,
+     &internal::MulScalar<float>,
+     &internal::AffineScalar<true>,
+     &internal::AffineScalar<false>,
+     &internal::ProjectScalar,
+     &internal::WidenScalar,
+     &internal::NarrowScalar,
+     &internal::EncodeScalar<Oct16>,
+     &internal::EncodeScalar<Oct32>,
+     &internal::EncodeScalar<Snorm1010102>,
+     &internal::DecodeScalar<Oct16>,
+     &internal::DecodeScalar<Oct32>,
+     &internal::DecodeScalar<Snorm1010102>,
+     &internal::BoundsScalar<float>,
+     &internal::DotRangeScalar<float>,
+     &internal::SumScalar<float>,
+     &internal::MomentsScalar<float, float>},
+#if TPH_X86
+    // SSE2 has no half conversions. AVX-512 packs unit vectors with the AVX2 kernels.
+    {Isa::kSse2,
+     &internal::sse2::Affine<true>,
+     &internal::sse2::Affine<false>,
+     &internal::sse2::Project,
+     &internal::sse2::InverseMany,
+     &internal::sse2::MulMany<float>,
+     &internal::AffineScalar<true>,
+     &internal::AffineScalar<false>,
+     &internal::ProjectScalar,
+     &internal::WidenScalar,
+     &internal::NarrowScalar,
+     &internal::sse2::Encode<Oct16>,
+     &internal::sse2::Encode<Oct32>,
+     &internal::sse2::Encode<Snorm1010102>,
+     &internal::sse2::Decode<Oct16>,
+     &internal::sse2::Decode<Oct32>,
+     &internal::sse2::Decode<Snorm1010102>,
+     &internal::sse2::Bounds,
+     &internal::sse2::DotRange,
+     &internal::sse2::Sum,
+     &internal::sse2::CenteredMoments},
+    {Isa::kAvx2,
+     &internal::avx2::Affine<true>,
+     &internal::avx2::Affine<false>,
+     &internal::avx2::Project,
+     &internal::avx2::InverseMany,
+     &internal::avx2::MulMany<float>,
+     &internal::avx2::Affine<true>,
+     &internal::avx2::Affine<false>,
+     &internal::avx2::Project,
+     &internal::avx2::Widen,
+     &internal::avx2::Narrow,
+     &internal::avx2::Encode<Oct16>,
+     &internal::avx2::Encode<Oct32>,
+     &internal::avx2::Encode<Snorm1010102>,
+     &internal::avx2::Decode<Oct16>,
+     &internal::avx2::Decode<Oct32>,
+     &internal::avx2::Decode<Snorm1010102>,
+     &internal::avx2::Bounds,
+     &internal::avx2::DotRange,
+     &internal::avx2::Sum,
+     &internal::avx2::CenteredMoments},
+    {Isa::kAvx512,
+     &internal::avx512::Affine<true>,
+     &internal::avx512::Affine<false>,
+     &internal::avx512::Project,
+     &internal::avx512::InverseMany,
+     &internal::avx512::MulMany<float>,
+     &internal::avx512::Affine<true>,
+     &internal::avx512::Affine<false>,
+     &internal::avx512::Project,
+     &internal::avx512::Widen,
+     &internal::avx512::Narrow,
+     &internal::avx2::Encode<Oct16>,
+     &internal::avx2::Encode<Oct32>,
+     &internal::avx2::Encode<Snorm1010102>,
+     &internal::avx2::Decode<Oct16>,
+     &internal::avx2::Decode<Oct32>,
+     &internal::avx2::Decode<Snorm1010102>,
+     &internal::avx512::Bounds,
+     &internal::avx512::DotRange,
+     &internal::avx512::Sum,
+     &internal::avx512::CenteredMoments},
+#endif
+};
+
+constexpr int kTableCount = static_cast<int>(sizeof(kTables) / sizeof(kTables[0]));
+
+#if TPH_X86 && defined(_MSC_VER) && !defined(__clang__)
+auto DetectIsa() noexcept -> Isa {
+  int r[4] = {};
+  __cpuid(r, 0);
+  const auto max_leaf = r[0];
+  __cpuid(r, 1);
+  const bool sse2 = (r[3] & (1 << 26)) != 0;
+  const bool fma = (r[2] & (1 << 12)) != 0;
+  const bool f16c = (r[2] & (1 << 29)) != 0;
+  const bool osxsave = (r[2] & (1 << 27)) != 0;
+  const bool avx = (r[2] & (1 << 28)) != 0;
+  if (!sse2) {
+    return Isa::kScalar;
+  }
+  if (!osxsave || !avx || !fma || !f16c || max_leaf < 7) {
+    return Isa::kSse2;
+  }
+  // The operating system must save the YMM (and for AVX-512 also the opmask and ZMM) registers.
+  const auto xcr0 = _xgetbv(0);
+  __cpuidex(r, 7, 0);
+  const bool avx2 = (r[1] & (1 << 5)) != 0 && (xcr0 & 0x6) == 0x6;
+  const bool avx512f = (r[1] & (1 << 16)) != 0 && (xcr0 & 0xe6) == 0xe6;
+  if (!avx2) {
+    return Isa::kSse2;
+  }
+  return avx512f ? Isa::kAvx512 : Isa::kAvx2;
+}
+#elif TPH_X86
+// Also checks that the operating system saves the extended registers.
+auto DetectIsa() noexcept -> Isa {
+  __builtin_cpu_init();
+  const bool avx2 = __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma") &&
+                   __builtin_cpu_supports("f16c");
+  if (avx2 && __builtin_cpu_supports("avx512f")) {
+    return Isa::kAvx512;
+  }
+  if (avx2) {
+    return Isa::kAvx2;
+  }
+  return __builtin_cpu_supports("sse2") ? Isa::kSse2 : Isa::kScalar;
+}
+#else
+auto DetectIsa() noexcept -> Isa { return Isa::kScalar; }
+#endif
+
+// True if name equals the lower-case level name in any case.
+auto MatchesName(const char* name, const char* level) noexcept -> bool {
+  for (; *name != '\0' && *level != '\0'; ++name, ++level) {
+    if (std::tolower(static_cast<unsigned char>(*name)) != *level) {
+      return false;
+    }
+  }
+  return *name == *level;
+}
+
+// Returns true and sets isa if name is a valid level name.
+auto ParseIsa(const char* name, Isa* isa) noexcept -> bool {
+  for (int i = 0; i <= static_cast<int>(Isa::kAvx512); ++i) {
+    if (MatchesName(name, IsaName(static_cast<Isa>(i)))) {
+      *isa = static_cast<Isa>(i);
+      return true;
+    }
+  }
+  return false;
+}
+
+auto Select(const Isa isa) noexcept -> const Table* {
+  auto i = static_cast<int>(isa);
+  i = i < static_cast<int>(SupportedIsa()) ? i : static_cast<int>(SupportedIsa());
+  i = i < kTableCount ? i : kTableCount - 1;
+  return &kTables[i];
+}
+
+std::atomic<bool> g_overridden{false};
+
+// Sets g_overridden before the table is published by Active.
+auto InitialTable() noexcept -> const Table* {
+  auto isa = Isa::kAvx512;
+#if defined(_MSC_VER)
+#pragma warning(suppress : 4996) // getenv is fine, the environment is not modified.
+#endif
+  const char* env = std::getenv("TPH_LINALG_ISA");
+  if (env != nullptr && ParseIsa(env, &isa)) {
+    g_overridden.store(true, std::memory_order_relaxed);
+  }
+  return Select(isa);
+}
+
+std::atomic<const Table*> g_active{nullptr};
+
+// Resolved on first use. Concurrent first calls all resolve to the same table.
+auto Active() noexcept -> const Table& {
+  auto* t = g_active.load(std::memory_order_acquire);
+  if (t == nullptr) {
+    t = InitialTable();
+    g_active.store(t, std::memory_order_release);
+  }
+  return *t;
+}
+
+} // namespace
+
+auto SupportedIsa() noexcept -> Isa {
+  static const Isa isa = DetectIsa();
+  return isa;
+}
+
+auto ActiveIsa() noexcept -> Isa { return Active().isa; }
+
+auto IsaOverridden() noexcept -> bool {
+  static_cast<void>(Active());
+  return g_overridden.load(std::memory_order_relaxed);
+}
+
+auto SetIsa(const Isa isa) noexcept -> Isa {
+  const auto* t = Select(isa);
+  g_active.store(t, std::memory_order_release);
+  return t->isa;
+}
+
+auto IsaName(const Isa isa) noexcept -> const char* {
+  switch (isa) {
+  case Isa::kScalar:
+    return "scalar";
+  case Isa::kSse2:
+    return "sse2";
+  case Isa::kAvx2:
+    return "avx2";
+  case Isa::kAvx512:
+    return "avx512";
+  }
+  return "";
+}
+
+void TransformPoints(const Mat<float, 3, 4>& m,
+                     const Vec<float, 3>* src,
+                     Vec<float, 3>* dst,
+                     const std::size_t n) noexcept {
+  Active().points(m, src, dst, n);
+}
+
+void TransformPoints(const Mat<float, 4, 4>& m,
+                     const Vec<float, 3>* src,
+                     Vec<float, 3>* dst,
+                     const std::size_t n) noexcept {
+  Active().points(tph_linalg_internal::UpperRows(m), src, dst, n);
+}
+
+void TransformDirections(const Mat<float, 3, 4>& m,
+                         const Vec<float, 3>* src,
+                         Vec<float, 3>* dst,
+                         const std::size_t n) noexcept {
+  Active().directions(m, src, dst, n);
+}
+
+void TransformDirections(const Mat<float, 4, 4>& m,
+                         const Vec<float, 3>* src,
+                         Vec<float, 3>* dst,
+                         const std::size_t n) noexcept {
+  Active().directions(tph_linalg_internal::UpperRows(m), src, dst, n);
+}
+
+void ProjectPoints(const Mat<float, 4, 4>& m,
+                   const Vec<float, 3>* src,
+                   Vec<float, 3>* dst,
+                   const std::size_t n) noexcept {
+  Active().project(m, src, dst, n);
+}
+
+void TransformPoints(const Mat<float, 3, 4>& m,
+                     const Vec<half, 3>* src,
+                     Vec<half, 3>* dst,
+                     const std::size_t n) noexcept {
+  Active().points_half(m, src, dst, n);
+}
+
+void TransformPoints(const Mat<float, 4, 4>& m,
+                     const Vec<half, 3>* src,
+                     Vec<half, 3>* dst,
+                     const std::size_t n) noexcept {
+  Active().points_half(tph_linalg_internal::UpperRows(m), src, dst, n);
+}
+
+void TransformDirections(const Mat<float, 3, 4>& m,
+                         const Vec<half, 3>* src,
+                         Vec<half, 3>* dst,
+                         const std::size_t n) noexcept {
+  Active().directions_half(m, src, dst, n);
+}
+
+void TransformDirections(const Mat<float, 4, 4>& m,
+                         const Vec<half, 3>* src,
+                         Vec<half, 3>* dst,
+                         const std::size_t n) noexcept {
+  Active().directions_half(tph_linalg_internal::UpperRows(m), src, dst, n);
+}
+
+void ProjectPoints(const Mat<float, 4, 4>& m,
+                   const Vec<half, 3>* src,
+                   Vec<half, 3>* dst,
+                   const std::size_t n) noexcept {
+  Active().project_half(m, src, dst, n);
+}
+
+void Widen(const half* src, float* dst, const std::size_t n) noexcept {
+  Active().widen(src, dst, n);
+}
+
+void Narrow(const float* src, half* dst, const std::size_t n) noexcept {
+  Active().narrow(src, dst, n);
+}
+
+void Encode(const Vec<float, 3>* src, Oct16* dst, const std::size_t n) noexcept {
+  Active().encode_oct16(src, dst, n);
+}
+
+void Encode(const Vec<float, 3>* src, Oct32* dst, const std::size_t n) noexcept {
+  Active().encode_oct32(src, dst, n);
+}
+
+void Encode(const Vec<float, 3>* src, Snorm1010102* dst, const std::size_t n) noexcept {
+  Active().encode_snorm(src, dst, n);
+}
+
+void Decode(const Oct16* src, Vec<float, 3>* dst, const std::size_t n) noexcept {
+  Active().decode_oct16(src, dst, n);
+}
+
+void Decode(const Oct32* src, Vec<float, 3>* dst, const std::size_t n) noexcept {
+  Active().decode_oct32(src, dst, n);
+}
+
+void Decode(const Snorm1010102* src, Vec<float, 3>* dst, const std::size_t n) noexcept {
+  Active().decode_snorm(src, dst, n);
+}
+
+auto ComputeBounds(const Vec<float, 3>* src, const std::size_t n) noexcept -> Aabb<float, 3> {
+  return Active().bounds(src, n);
+}
+
+auto MinMaxDot(const Vec<float, 3>* src, const std::size_t n, const Vec<float, 3>& d) noexcept
+    -> Vec<float, 2> {
+  return Active().dot_range(src, n, d);
+}
+
+auto Centroid(const Vec<float, 3>* src, const std::size_t n) noexcept -> Vec<float, 3> {
+  const auto sum = Active().sum;
+  return internal::Mean(internal::PairwiseSum<Vec<float, 3>>(
+                            0, n, internal::kReduceBlock,
+                            [src, sum](const std::size_t begin, const std::size_t end) {
+                              return sum(src + begin, end - begin);
+                            }),
+                        n);
+}
+
+auto Covariance(const Vec<float, 3>* src, const std::size_t n) noexcept -> Mat<float, 3, 3> {
+  const auto moments = Active().moments;
+  const auto c = Centroid(src, n);
+  return internal::CovarianceMatrix(
+      internal::PairwiseSum<internal::Moments<float>>(
+          0, n, internal::kReduceBlock,
+          [src, moments, &c](const std::size_t begin, const std::size_t end) {
+            return moments(src + begin, end - begin, c);
+          }),
+      n);
+}
+
+void InverseMany(const Mat<float, 4, 4>* src, Mat<float, 4, 4>* dst, const std::size_t n) noexcept {
+  Active().inverse(src, dst, n);
+}
+
+void MulMany(const Mat<float, 4, 4>* a,
+             const Mat<float, 4, 4>* b,
+             Mat<float, 4, 4>* dst,
+             const std::size_t n) noexcept {
+  Active().mul(a, 1, b, dst, n);
+}
+
+void MulMany(const Mat<float, 4, 4>& a,
+             const Mat<float, 4, 4>* b,
+             Mat<float, 4, 4>* dst,
+             const std::size_t n) noexcept {
+  Active().mul(&a, 0, b, dst, n);
+}
+
+} // namespace kernels
+} // namespace tph
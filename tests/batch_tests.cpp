@@ -0,0 +1,1282 @@
+// Copyright (C) Tommy Hinks <tommy.hinks@gmail.com>
+// This file is subject to the license terms in the LICENSE file
+// found in the top-level directory of this distribution.
+
+#include <algorithm> // std::max, std::min
+#include <cmath>     // std::abs, std::acos, std::atan2, std::cos, std::isnan, std::nanf, std::sin
+#include <cstdint>
+#include <cstdio>
+#include <cstring> // std::memcmp, std::memcpy, std::strcmp
+#include <random>
+#include <utility> // std::make_pair
+#include <vector>
+
+#include <tph/tph_linalg_batch.hpp>
+
+namespace {
+
+int g_failures = 0;
+
+#define CHECK(expr)                                                                                \
+  do {                                                                                             \
+    if (!(expr)) {                                                                                 \
+      std::printf("%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #expr);                        \
+      ++g_failures;                                                                                \
+    }                                                                                              \
+  } while (false)
+
+auto Near(const float a, const float b) -> bool { return std::abs(a - b) < 1e-6F; }
+
+auto Near(const tph::float3& a, const tph::float3& b) -> bool {
+  return Near(a.x, b.x) && Near(a.y, b.y) && Near(a.z, b.z);
+}
+
+// Odd count, so that the last AoSoA tile is partially used.
+auto MakePoints(const float offset) -> std::vector<tph::float3> {
+  std::vector<tph::float3> p(13);
+  for (std::size_t i = 0; i < p.size(); ++i) {
+    const auto f = static_cast<float>(i);
+    p[i] = {1.0F + f, offset - f * 0.5F, 0.25F * f + offset};
+  }
+  return p;
+}
+
+template <typename ArrayT>
+void TestBatch(const std::vector<tph::float3>& pa,
+               const std::vector<tph::float3>& pb,
+               const ArrayT& a,
+               const ArrayT& b) {
+  const auto n = pa.size();
+  CHECK(tph::Size(a) == n);
+
+  // Conversion round-trip.
+  {
+    std::vector<tph::float3> back(n);
+    tph::ToAoS(a, back.data());
+    for (std::size_t i = 0; i < n; ++i) {
+      CHECK(back[i] == pa[i]);
+      CHECK(tph::Get(a, i) == pa[i]);
+    }
+  }
+
+  // Scalar-valued.
+  {
+    std::vector<float> dot(n);
+    std::vector<float> len2(n);
+    std::vector<float> len(n);
+    std::vector<float> dist2(n);
+    tph::Dot(a, b, dot.data());
+    tph::Length2(a, len2.data());
+    tph::Length(a, len.data());
+    tph::Distance2(a, b, dist2.data());
+    for (std::size_t i = 0; i < n; ++i) {
+      CHECK(dot[i] == tph::Dot(pa[i], pb[i]));
+      CHECK(len2[i] == tph::Length2(pa[i]));
+      CHECK(Near(len[i], tph::Length(pa[i])));
+      CHECK(dist2[i] == tph::Distance2(pa[i], pb[i]));
+    }
+  }
+
+  // Vector-valued.
+  {
+    ArrayT cross{};
+    ArrayT normalized{};
+    ArrayT mul{};
+    const auto m = tph::Mat<float, 3, 3>{{1.0F, 2.0F, 3.0F}, {-1.0F, 0.5F, 4.0F}, {2.0F, 0.0F, -3.0F}};
+    tph::Cross(a, b, cross);
+    tph::Normalized(a, normalized);
+    tph::Mul(m, a, mul);
+    const auto sum = a + b;
+    const auto diff = a - b;
+    const auto scaled = a * 2.0F;
+    auto acc = a;
+    acc += b;
+    acc -= a;
+    acc *= 3.0F;
+    for (std::size_t i = 0; i < n; ++i) {
+      CHECK(tph::Get(cross, i) == tph::Cross(pa[i], pb[i]));
+      CHECK(Near(tph::Get(normalized, i), tph::Normalized(pa[i])));
+      CHECK(Near(tph::Get(mul, i), tph::Mul(m, pa[i])));
+      CHECK(tph::Get(sum, i) == pa[i] + pb[i]);
+      CHECK(tph::Get(diff, i) == pa[i] - pb[i]);
+      CHECK(tph::Get(scaled, i) == pa[i] * 2.0F);
+      CHECK(Near(tph::Get(acc, i), (pa[i] + pb[i] - pa[i]) * 3.0F));
+    }
+  }
+}
+
+template <typename ArithT>
+auto Near3(const tph::Vec<ArithT, 3>& a, const tph::Vec<ArithT, 3>& b) -> bool {
+  const auto e = ArithT(1e-5) * (ArithT(1) + tph::Length(b));
+  return std::abs(a.x - b.x) < e && std::abs(a.y - b.y) < e && std::abs(a.z - b.z) < e;
+}
+
+// Point counts that cover full SIMD blocks of any width as well as the scalar remainder.
+template <typename ArithT>
+void TestTransforms() {
+  using V3 = tph::Vec<ArithT, 3>;
+  using V4 = tph::Vec<ArithT, 4>;
+  const auto m = tph::MakeMat4x4<ArithT>(ArithT(0.5), ArithT(-1), ArithT(2), ArithT(3),    //
+                                         ArithT(1.5), ArithT(0.25), ArithT(-2), ArithT(-4), //
+                                         ArithT(1), ArithT(2), ArithT(0.75), ArithT(5),     //
+                                         ArithT(0.1), ArithT(-0.2), ArithT(0.05), ArithT(2));
+  const auto m34 = tph::Mat<ArithT, 3, 4>{{m.x.x, m.x.y, m.x.z},
+                                          {m.y.x, m.y.y, m.y.z},
+                                          {m.z.x, m.z.y, m.z.z},
+                                          {m.w.x, m.w.y, m.w.z}};
+
+  for (const std::size_t n : {std::size_t{0}, std::size_t{3}, std::size_t{37}}) {
+    std::vector<V3> src(n);
+    for (std::size_t i = 0; i < n; ++i) {
+      const auto f = static_cast<ArithT>(i);
+      src[i] = {ArithT(1) + f, ArithT(2) - f * ArithT(0.5), ArithT(0.25) * f};
+    }
+    std::vector<V3> points(n);
+    std::vector<V3> points34(n);
+    std::vector<V3> dirs(n);
+    std::vector<V3> dirs34(n);
+    std::vector<V3> projected(n);
+    tph::TransformPoints(m, src.data(), points.data(), n);
+    tph::TransformPoints(m34, src.data(), points34.data(), n);
+    tph::TransformDirections(m, src.data(), dirs.data(), n);
+    tph::TransformDirections(m34, src.data(), dirs34.data(), n);
+    tph::ProjectPoints(m, src.data(), projected.data(), n);
+
+    for (std::size_t i = 0; i < n; ++i) {
+      const auto p = tph::Mul(m, V4{src[i].x, src[i].y, src[i].z, ArithT(1)});
+      const auto d = tph::Mul(m, V4{src[i].x, src[i].y, src[i].z, ArithT(0)});
+      CHECK(Near3(points[i], V3{p.x, p.y, p.z}));
+      CHECK(points34[i] == points[i]);
+      CHECK(Near3(dirs[i], V3{d.x, d.y, d.z}));
+      CHECK(dirs34[i] == dirs[i]);
+      CHECK(Near3(projected[i], V3{p.x / p.w, p.y / p.w, p.z / p.w}));
+    }
+
+    // In-place.
+    auto inplace = src;
+    tph::TransformPoints(m, inplace.data(), inplace.data(), n);
+    CHECK(inplace == points);
+    inplace = src;
+    tph::ProjectPoints(m, inplace.data(), inplace.data(), n);
+    CHECK(inplace == projected);
+  }
+}
+
+template <typename ArithT>
+auto Near4(const tph::Vec<ArithT, 4>& a, const tph::Vec<ArithT, 4>& b) -> bool {
+  const auto e = ArithT(1e-5) * (ArithT(1) + tph::Length(b));
+  return std::abs(a.x - b.x) < e && std::abs(a.y - b.y) < e && std::abs(a.z - b.z) < e &&
+         std::abs(a.w - b.w) < e;
+}
+
+// Same counts as TestTransforms, each matrix different and not symmetric.
+template <typename ArithT>
+void TestInverseMany() {
+  using M4 = tph::Mat<ArithT, 4, 4>;
+  const auto id = tph::MakeMat4x4<ArithT>(ArithT(1), ArithT(0), ArithT(0), ArithT(0), //
+                                          ArithT(0), ArithT(1), ArithT(0), ArithT(0), //
+                                          ArithT(0), ArithT(0), ArithT(1), ArithT(0), //
+                                          ArithT(0), ArithT(0), ArithT(0), ArithT(1));
+
+  for (const std::size_t n : {std::size_t{0}, std::size_t{3}, std::size_t{37}}) {
+    std::vector<M4> src(n);
+    for (std::size_t i = 0; i < n; ++i) {
+      const auto f = static_cast<ArithT>(i) * ArithT(0.125);
+      src[i] = tph::MakeMat4x4<ArithT>(ArithT(4) + f, ArithT(-1), ArithT(2), ArithT(3),   //
+                                       ArithT(1.5), ArithT(3) - f, ArithT(-2), ArithT(-4), //
+                                       ArithT(1), f, ArithT(5), ArithT(0.5),               //
+                                       ArithT(0.1), ArithT(-0.2), ArithT(0.05), ArithT(2));
+    }
+    std::vector<M4> inv(n);
+    tph::InverseMany(src.data(), inv.data(), n);
+
+    for (std::size_t i = 0; i < n; ++i) {
+      const auto expected = tph::Inverse(src[i]);
+      CHECK(Near4(inv[i].x, expected.x));
+      CHECK(Near4(inv[i].y, expected.y));
+      CHECK(Near4(inv[i].z, expected.z));
+      CHECK(Near4(inv[i].w, expected.w));
+      CHECK(Near4(tph::Mul(src[i], inv[i].x), id.x));
+      CHECK(Near4(tph::Mul(src[i], inv[i].w), id.w));
+    }
+
+    // In-place.
+    auto inplace = src;
+    tph::InverseMany(inplace.data(), inplace.data(), n);
+    for (std::size_t i = 0; i < n; ++i) {
+      CHECK((inplace[i].x == inv[i].x && inplace[i].y == inv[i].y && inplace[i].z == inv[i].z &&
+             inplace[i].w == inv[i].w));
+    }
+  }
+}
+
+// Products of per-element and shared left operands, compared with Mul.
+template <typename ArithT>
+void TestMulMany() {
+  using M4 = tph::Mat<ArithT, 4, 4>;
+  const auto a = tph::MakeMat4x4<ArithT>(ArithT(0.5), ArithT(-1), ArithT(2), ArithT(3),    //
+                                         ArithT(1.5), ArithT(0.25), ArithT(-2), ArithT(-4), //
+                                         ArithT(1), ArithT(2), ArithT(0.75), ArithT(5),     //
+                                         ArithT(0.1), ArithT(-0.2), ArithT(0.05), ArithT(2));
+  const auto same = [](const M4& x, const M4& y) {
+    return Near4(x.x, y.x) && Near4(x.y, y.y) && Near4(x.z, y.z) && Near4(x.w, y.w);
+  };
+
+  for (const std::size_t n : {std::size_t{0}, std::size_t{3}, std::size_t{37}}) {
+    std::vector<M4> as(n);
+    std::vector<M4> bs(n);
+    for (std::size_t i = 0; i < n; ++i) {
+      const auto f = static_cast<ArithT>(i) * ArithT(0.125);
+      as[i] = a;
+      as[i].x.x += f;
+      as[i].w.y -= f;
+      bs[i] = tph::Transpose(a);
+      bs[i].y.z += f;
+    }
+    std::vector<M4> each(n);
+    std::vector<M4> shared(n);
+    tph::MulMany(as.data(), bs.data(), each.data(), n);
+    tph::MulMany(a, bs.data(), shared.data(), n);
+    for (std::size_t i = 0; i < n; ++i) {
+      CHECK(same(each[i], tph::Mul(as[i], bs[i])));
+      CHECK(same(shared[i], tph::Mul(a, bs[i])));
+    }
+
+    // In-place, into either operand.
+    auto inplace = bs;
+    tph::MulMany(a, inplace.data(), inplace.data(), n);
+    for (std::size_t i = 0; i < n; ++i) {
+      CHECK(same(inplace[i], shared[i]));
+    }
+    inplace = as;
+    tph::MulMany(inplace.data(), bs.data(), inplace.data(), n);
+    for (std::size_t i = 0; i < n; ++i) {
+      CHECK(same(inplace[i], each[i]));
+    }
+  }
+}
+
+auto Bits(const tph::half h) -> unsigned { return h.bits; }
+
+auto FromBits(const unsigned bits) -> tph::half {
+  tph::half h;
+  h.bits = static_cast<std::uint16_t>(bits);
+  return h;
+}
+
+void TestHalf() {
+  // Conversion from float, rounded to nearest even.
+  CHECK(Bits(1.0F) == 0x3c00);
+  CHECK(Bits(-2.0F) == 0xc000);
+  CHECK(Bits(-0.0F) == 0x8000);
+  CHECK(Bits(65504.0F) == 0x7bff);      // Largest half.
+  CHECK(Bits(65519.0F) == 0x7bff);      // Rounds down to the largest half.
+  CHECK(Bits(65520.0F) == 0x7c00);      // Rounds up to infinity.
+  CHECK(Bits(1.0F / 16777216.0F) == 1); // Smallest subnormal, 2^-24.
+  CHECK(Bits(1.0F / 33554432.0F) == 0); // 2^-25, tie to even.
+  CHECK(Bits(3.0F / 33554432.0F) == 2); // 1.5 * 2^-24, tie to even.
+  CHECK(Bits(1.0F + 1.0F / 2048.0F) == 0x3c00);
+  CHECK(Bits(1.0F + 3.0F / 2048.0F) == 0x3c02);
+  CHECK(Bits(tph::half(1e30F)) == 0x7c00);
+  CHECK(Bits(-1e30F) == 0xfc00);
+  const auto nan = tph::half(std::nanf(""));
+  CHECK((Bits(nan) & 0x7c00) == 0x7c00 && (Bits(nan) & 0x3ff) != 0);
+
+  // Conversion to float is exact, and back again gives the same bits for every half but NaN.
+  CHECK(static_cast<float>(FromBits(0x3555)) == 0.333251953125F);
+  CHECK(static_cast<float>(FromBits(0x0001)) == 1.0F / 16777216.0F);
+  CHECK(static_cast<float>(FromBits(0x7c00)) == INFINITY);
+  CHECK(std::isnan(static_cast<float>(FromBits(0x7e01))));
+  std::vector<tph::half> all(0x10000);
+  for (unsigned i = 0; i < all.size(); ++i) {
+    all[i] = FromBits(i);
+  }
+  std::vector<float> widened(all.size());
+  std::vector<tph::half> narrowed(all.size());
+  tph::Widen(all.data(), widened.data(), all.size());
+  tph::Narrow(widened.data(), narrowed.data(), all.size());
+  bool exact = true;
+  for (unsigned i = 0; i < all.size(); ++i) {
+    const auto f = static_cast<float>(all[i]);
+    if (std::isnan(f)) {
+      exact = exact && std::isnan(widened[i]) && std::isnan(static_cast<float>(narrowed[i]));
+    } else {
+      exact = exact && widened[i] == f && Bits(narrowed[i]) == i;
+    }
+  }
+  CHECK(exact);
+
+  // Arithmetic is done in float.
+  const tph::half3 a{1.0F, 2.0F, 3.0F};
+  const tph::half3 b{0.5F, -1.0F, 4.0F};
+  CHECK(tph::Dot(a, b) == 10.5F);
+  CHECK((a + b == tph::float3{1.5F, 1.0F, 7.0F}));
+  CHECK((tph::Widen(a) == tph::float3{1.0F, 2.0F, 3.0F}));
+  CHECK((tph::Narrow(tph::Widen(b)) == b));
+
+  // Arrays, the same counts as TestTransforms.
+  const auto m = tph::MakeMat4x4<float>(0.5F, -1.0F, 2.0F, 3.0F,   //
+                                        1.5F, 0.25F, -2.0F, -4.0F, //
+                                        1.0F, 2.0F, 0.75F, 5.0F,   //
+                                        0.1F, -0.2F, 0.05F, 2.0F);
+  for (const std::size_t n : {std::size_t{0}, std::size_t{3}, std::size_t{37}}) {
+    std::vector<tph::float3> f(n);
+    for (std::size_t i = 0; i < n; ++i) {
+      const auto k = static_cast<float>(i);
+      f[i] = {1.0F + k * 0.3F, 2.0F - k * 0.7F, 0.1F * k};
+    }
+    std::vector<tph::half3> h(n);
+    std::vector<tph::float3> back(n);
+    tph::Narrow(f.data(), h.data(), n);
+    tph::Widen(h.data(), back.data(), n);
+    for (std::size_t i = 0; i < n; ++i) {
+      CHECK(h[i] == tph::Narrow(f[i]));
+      CHECK(back[i] == tph::Widen(h[i]));
+    }
+
+    tph::half3SoA soa;
+    tph::float3SoA soa_back;
+    tph::Narrow(tph::ToSoA(f.data(), n), soa);
+    tph::Widen(soa, soa_back);
+    CHECK(tph::Size(soa_back) == n);
+    for (std::size_t i = 0; i < n; ++i) {
+      CHECK(tph::Get(soa, i) == h[i]);
+      CHECK(tph::Get(soa_back, i) == back[i]);
+    }
+
+    // Transforms, the float results rounded to half.
+    std::vector<tph::half3> points(n);
+    std::vector<tph::half3> dirs(n);
+    std::vector<tph::half3> projected(n);
+    tph::TransformPoints(m, h.data(), points.data(), n);
+    tph::TransformDirections(m, h.data(), dirs.data(), n);
+    tph::ProjectPoints(m, h.data(), projected.data(), n);
+    std::vector<tph::float3> expected(n);
+    const auto near = [](const tph::half3& x, const tph::float3& y) {
+      const auto e = 1e-3F * (1.0F + tph::Length(y));
+      const auto d = tph::Widen(x) - y;
+      return std::abs(d.x) < e && std::abs(d.y) < e && std::abs(d.z) < e;
+    };
+    tph::TransformPoints(m, back.data(), expected.data(), n);
+    for (std::size_t i = 0; i < n; ++i) {
+      CHECK(near(points[i], expected[i]));
+    }
+    tph::TransformDirections(m, back.data(), expected.data(), n);
+    for (std::size_t i = 0; i < n; ++i) {
+      CHECK(near(dirs[i], expected[i]));
+    }
+    tph::ProjectPoints(m, back.data(), expected.data(), n);
+    for (std::size_t i = 0; i < n; ++i) {
+      CHECK(near(projected[i], expected[i]));
+    }
+
+    // In-place.
+    auto inplace = h;
+    tph::TransformPoints(m, inplace.data(), inplace.data(), n);
+    CHECK(inplace == points);
+  }
+}
+
+// Angle between unit vectors, in degrees.
+auto Degrees(const tph::float3& a, const tph::float3& b) -> float {
+  return std::atan2(tph::Length(tph::Cross(a, b)), tph::Dot(a, b)) * 57.29578F;
+}
+
+template <typename PackedT>
+void TestPacked(const float max_degrees) {
+  // Unit vectors in every octant, including the axes and the octahedron edges.
+  std::vector<tph::float3> all;
+  for (int i = 0; i < 1000; ++i) {
+    const auto t = static_cast<float>(i);
+    all.push_back(tph::Normalized(
+        tph::float3{std::sin(t * 1.3F), std::cos(t * 0.7F), std::sin(t * 2.9F + 1.0F)}));
+  }
+  for (const float s : {1.0F, -1.0F}) {
+    all.push_back({s, 0.0F, 0.0F});
+    all.push_back({0.0F, s, 0.0F});
+    all.push_back({0.0F, 0.0F, s});
+    all.push_back(tph::Normalized(tph::float3{s, -s, 0.0F}));
+    all.push_back(tph::Normalized(tph::float3{0.0F, s, -s}));
+  }
+
+  for (const std::size_t n : {std::size_t{0}, std::size_t{3}, std::size_t{37}, all.size()}) {
+    std::vector<PackedT> packed(n);
+    std::vector<tph::float3> back(n);
+    tph::Encode(all.data(), packed.data(), n);
+    tph::Decode(packed.data(), back.data(), n);
+    for (std::size_t i = 0; i < n; ++i) {
+      // Integers within one of the scalar function, see Encode.
+      const auto scalar = tph::Encode<PackedT>(all[i]);
+      CHECK(std::memcmp(&scalar, &packed[i], sizeof(PackedT)) == 0 ||
+            Degrees(tph::Decode(scalar), tph::Decode(packed[i])) < 2.0F * max_degrees);
+      CHECK(tph::Distance(back[i], tph::Decode(packed[i])) < 1e-6F);
+      CHECK(Degrees(all[i], back[i]) < max_degrees);
+    }
+  }
+}
+
+// Reductions against sums in double, for points far from the origin.
+void TestReductions() {
+  for (const std::size_t n :
+       {std::size_t{0}, std::size_t{3}, std::size_t{37}, std::size_t{100003}}) {
+    std::vector<tph::float3> p(n);
+    for (std::size_t i = 0; i < n; ++i) {
+      const auto t = static_cast<float>(i);
+      p[i] = {1000.0F + std::sin(t),
+              -500.0F + 2.0F * std::cos(t * 0.3F),
+              0.1F * std::sin(t * 7.0F)};
+    }
+
+    auto expected = tph::Aabb<float, 3>{{1e30F, 1e30F, 1e30F}, {-1e30F, -1e30F, -1e30F}};
+    tph::double3 sum = {};
+    for (const auto& q : p) {
+      expected.min = tph::Min(expected.min, q);
+      expected.max = tph::Max(expected.max, q);
+      sum = sum + tph::double3{q.x, q.y, q.z};
+    }
+    const auto c = sum * (n > 0 ? 1.0 / static_cast<double>(n) : 0.0);
+    double cov[3][3] = {};
+    for (const auto& q : p) {
+      const double d[3] = {q.x - c.x, q.y - c.y, q.z - c.z};
+      for (int r = 0; r < 3; ++r) {
+        for (int k = 0; k < 3; ++k) {
+          cov[r][k] += d[r] * d[k] / static_cast<double>(n);
+        }
+      }
+    }
+
+    const auto b = tph::ComputeBounds(p.data(), n);
+    if (n == 0) {
+      CHECK(b.min.x > b.max.x && b.min.y > b.max.y && b.min.z > b.max.z);
+      const auto e = tph::MinMaxDot(p.data(), n, tph::float3{1.0F, 0.0F, 0.0F});
+      CHECK(e.x > e.y);
+    } else {
+      CHECK(b.min == expected.min && b.max == expected.max);
+      // Along the axes the extent is the bounds.
+      const auto e = tph::MinMaxDot(p.data(), n, tph::float3{0.0F, -1.0F, 0.0F});
+      CHECK(e.x == -b.max.y && e.y == -b.min.y);
+    }
+
+    const auto centroid = tph::Centroid(p.data(), n);
+    const auto centroid_d = tph::Centroid<double>(p.data(), n);
+    CHECK(std::abs(centroid.x - c.x) < 2e-4 && std::abs(centroid.y - c.y) < 2e-4 &&
+          std::abs(centroid.z - c.z) < 1e-6);
+    CHECK(std::abs(centroid_d.x - c.x) < 1e-9 && std::abs(centroid_d.y - c.y) < 1e-9);
+
+    const auto cv = tph::Covariance(p.data(), n);
+    const auto cv_d = tph::Covariance<double>(p.data(), n);
+    bool near = true;
+    for (int r = 0; r < 3; ++r) {
+      for (int k = 0; k < 3; ++k) {
+        near = near && std::abs(tph::Comp(tph::Row(cv, r), k) - cov[r][k]) < 1e-4 &&
+               std::abs(tph::Comp(tph::Row(cv_d, r), k) - cov[r][k]) < 1e-9;
+      }
+    }
+    CHECK(near);
+    CHECK(cv.x.y == cv.y.x && cv.x.z == cv.z.x && cv.y.z == cv.z.y);
+  }
+}
+
+// Rotation by the angles a, b and c about the x, y and z axes.
+template <typename ArithT>
+auto Rotation(const ArithT a, const ArithT b, const ArithT c) -> tph::Mat<ArithT, 3, 3> {
+  const auto rx = tph::MakeMat3x3<ArithT>(ArithT(1), ArithT(0), ArithT(0),       //
+                                          ArithT(0), std::cos(a), -std::sin(a), //
+                                          ArithT(0), std::sin(a), std::cos(a));
+  const auto ry = tph::MakeMat3x3<ArithT>(std::cos(b), ArithT(0), std::sin(b), //
+                                          ArithT(0), ArithT(1), ArithT(0),     //
+                                          -std::sin(b), ArithT(0), std::cos(b));
+  const auto rz = tph::MakeMat3x3<ArithT>(std::cos(c), -std::sin(c), ArithT(0), //
+                                          std::sin(c), std::cos(c), ArithT(0),  //
+                                          ArithT(0), ArithT(0), ArithT(1));
+  return tph::Mul(rz, tph::Mul(ry, rx));
+}
+
+// Symmetric matrices R * diag(d) * R^T with distinct, repeated, zero and widely scaled
+// eigenvalues, checked for the residual, orthonormality, orientation and order of the result, and
+// the batch against the scalar version.
+template <typename ArithT>
+void TestEigen(const ArithT tol) {
+  using M3 = tph::Mat<ArithT, 3, 3>;
+  const tph::Vec<ArithT, 3> spectra[] = {{ArithT(1), ArithT(2), ArithT(3)},
+                                         {ArithT(-4), ArithT(0.5), ArithT(0.5)},
+                                         {ArithT(2), ArithT(2), ArithT(2)},
+                                         {ArithT(0), ArithT(0), ArithT(0)},
+                                         {ArithT(0), ArithT(1e-3), ArithT(1)},
+                                         {ArithT(-1e-7), ArithT(1e-7), ArithT(1)},
+                                         {ArithT(3e-20), ArithT(1e-20), ArithT(-2e-20)},
+                                         {ArithT(1e20), ArithT(-1e19), ArithT(5e19)}};
+  constexpr std::size_t kSpectra = sizeof(spectra) / sizeof(spectra[0]);
+
+  for (const std::size_t n : {std::size_t{0}, std::size_t{3}, std::size_t{37}, std::size_t{300}}) {
+    std::vector<M3> src(n);
+    for (std::size_t i = 0; i < n; ++i) {
+      const auto t = static_cast<ArithT>(i);
+      // Every eighth matrix is diagonal, i.e. already solved.
+      const auto r = i % 8 == 0 ? tph::Identity3x3<ArithT>()
+                                : Rotation(ArithT(0.7) * t, ArithT(1.3) * t, ArithT(0.3) * t);
+      const auto d = spectra[i % kSpectra];
+      const auto diag = tph::MakeMat3x3<ArithT>(d.x, ArithT(0), ArithT(0), //
+                                                ArithT(0), d.y, ArithT(0), //
+                                                ArithT(0), ArithT(0), d.z);
+      src[i] = tph::Mul(r, tph::Mul(diag, tph::Transpose(r)));
+    }
+    std::vector<tph::EigenDecomposition<ArithT, 3>> many(n);
+    tph::EigenSymmetricMany(src.data(), many.data(), n);
+
+    for (std::size_t i = 0; i < n; ++i) {
+      const auto& a = src[i];
+      const auto e = tph::EigenSymmetric(a);
+      const auto& v = e.vectors;
+      const auto d = spectra[i % kSpectra];
+      const auto scale =
+          std::max(std::max(std::abs(d.x), std::abs(d.y)), std::max(std::abs(d.z), ArithT(1e-30)));
+
+      CHECK(e.values.x <= e.values.y && e.values.y <= e.values.z);
+      CHECK(std::abs(std::min(std::min(d.x, d.y), d.z) - e.values.x) < tol * scale);
+      CHECK(std::abs(std::max(std::max(d.x, d.y), d.z) - e.values.z) < tol * scale);
+      const auto ea = tph::Mul(a, v);
+      CHECK(tph::Length(ea.x - v.x * e.values.x) < tol * scale);
+      CHECK(tph::Length(ea.y - v.y * e.values.y) < tol * scale);
+      CHECK(tph::Length(ea.z - v.z * e.values.z) < tol * scale);
+      CHECK(std::abs(tph::Dot(v.x, v.x) - ArithT(1)) < tol && std::abs(tph::Dot(v.x, v.y)) < tol &&
+            std::abs(tph::Dot(v.y, v.z)) < tol && std::abs(tph::Dot(v.x, v.z)) < tol);
+      CHECK(std::abs(tph::Determinant(v) - ArithT(1)) < tol);
+
+      CHECK(tph::Length(many[i].values - e.values) < tol * scale);
+      CHECK(Near3(many[i].vectors.x, v.x) && Near3(many[i].vectors.y, v.y) &&
+            Near3(many[i].vectors.z, v.z));
+    }
+  }
+
+  // Constant data matches in the lanes of a packet and in the scalar remainder.
+  std::vector<M3> same(19, tph::MakeMat3x3<ArithT>(ArithT(2), ArithT(1), ArithT(0), //
+                                                    ArithT(1), ArithT(2), ArithT(0), //
+                                                    ArithT(0), ArithT(0), ArithT(5)));
+  std::vector<tph::EigenDecomposition<ArithT, 3>> out(same.size());
+  tph::EigenSymmetricMany(same.data(), out.data(), same.size());
+  for (const auto& e : out) {
+    CHECK(std::abs(e.values.x - ArithT(1)) < tol && std::abs(e.values.y - ArithT(3)) < tol &&
+          std::abs(e.values.z - ArithT(5)) < tol);
+    CHECK(e.values == out[0].values);
+  }
+}
+
+// Largest difference of the elements of a and b.
+template <typename ArithT>
+auto MaxDiff(const tph::Mat<ArithT, 3, 3>& a, const tph::Mat<ArithT, 3, 3>& b) -> ArithT {
+  auto r = ArithT(0);
+  for (int j = 0; j < 3; ++j) {
+    r = std::max(r, std::abs(tph::Comp(a.x, j) - tph::Comp(b.x, j)));
+    r = std::max(r, std::abs(tph::Comp(a.y, j) - tph::Comp(b.y, j)));
+    r = std::max(r, std::abs(tph::Comp(a.z, j) - tph::Comp(b.z, j)));
+  }
+  return r;
+}
+
+// Orthonormal with determinant one.
+template <typename ArithT>
+auto IsRotation(const tph::Mat<ArithT, 3, 3>& r, const ArithT tol) -> bool {
+  return MaxDiff(tph::Mul(tph::Transpose(r), r), tph::Identity3x3<ArithT>()) < tol &&
+         std::abs(tph::Determinant(r) - ArithT(1)) < tol;
+}
+
+// General, rank deficient, nearly singular, reflected, rotation and widely scaled matrices,
+// checked for the reconstruction, the rotations, the order and signs of the singular values, the
+// polar decomposition, and the batch against the scalar versions.
+template <typename ArithT>
+void TestSvd(const ArithT tol) {
+  using M3 = tph::Mat<ArithT, 3, 3>;
+  const auto zero = M3{};
+  const auto reflection = tph::MakeMat3x3<ArithT>(ArithT(1), ArithT(0), ArithT(0), //
+                                                  ArithT(0), ArithT(-1), ArithT(0), //
+                                                  ArithT(0), ArithT(0), ArithT(1));
+  const std::size_t n = 301;
+  std::vector<M3> src(n);
+  for (std::size_t i = 0; i < n; ++i) {
+    const auto t = static_cast<ArithT>(i);
+    const auto r = Rotation(ArithT(0.7) * t, ArithT(1.3) * t, ArithT(0.3) * t);
+    const auto g = tph::MakeMat3x3<ArithT>(std::sin(t), std::cos(ArithT(2) * t), ArithT(0.5), //
+                                           ArithT(-0.25), std::sin(ArithT(3) * t), std::cos(t), //
+                                           std::cos(ArithT(5) * t), ArithT(0.75), std::sin(t * t));
+    switch (i % 10) {
+    case 0: src[i] = g; break;
+    case 1: src[i] = M3{g.x, g.y, g.x * ArithT(0.5) - g.y * ArithT(2)}; break; // Rank two.
+    case 2: src[i] = M3{g.x, g.x * ArithT(-3), g.x * ArithT(0.25)}; break;     // Rank one.
+    case 3: // Nearly singular.
+      src[i] = M3{g.x, g.y, g.x + g.y + tph::Vec<ArithT, 3>{ArithT(1e-6), ArithT(0), ArithT(0)}};
+      break;
+    case 4: src[i] = zero; break;
+    case 5: src[i] = tph::Mul(r, reflection); break; // Improper rotation.
+    case 6: src[i] = r; break;
+    case 7: src[i] = M3{g.x * ArithT(1e18), g.y * ArithT(1e18), g.z * ArithT(1e18)}; break;
+    case 8: src[i] = M3{g.x * ArithT(1e-18), g.y * ArithT(1e-18), g.z * ArithT(1e-18)}; break;
+    default: src[i] = M3{g.x, g.y, -g.z}; break;
+    }
+  }
+  std::vector<tph::SingularValueDecomposition<ArithT, 3>> svds(n);
+  std::vector<tph::PolarDecomposition<ArithT, 3>> polars(n);
+  tph::SvdMany(src.data(), svds.data(), n);
+  tph::PolarDecomposeMany(src.data(), polars.data(), n);
+
+  for (std::size_t i = 0; i < n; ++i) {
+    const auto& a = src[i];
+    const auto d = tph::Svd(a);
+    const auto scale = std::max(ArithT(1e-30), std::abs(d.values.x));
+
+    const auto us = M3{d.u.x * d.values.x, d.u.y * d.values.y, d.u.z * d.values.z};
+    CHECK(MaxDiff(tph::Mul(us, tph::Transpose(d.v)), a) < tol * scale);
+    CHECK(IsRotation(d.u, tol) && IsRotation(d.v, tol));
+    CHECK(d.values.x >= d.values.y - tol * scale &&
+          d.values.y >= std::abs(d.values.z) - tol * scale);
+    const auto inv = ArithT(1) / scale;
+    const auto det = tph::Determinant(M3{a.x * inv, a.y * inv, a.z * inv});
+    CHECK(std::abs(det) < tol || (det < ArithT(0)) == (d.values.z < ArithT(0)));
+
+    const auto p = tph::PolarDecompose(a);
+    CHECK(IsRotation(p.rotation, tol));
+    CHECK(MaxDiff(p.stretch, tph::Transpose(p.stretch)) < tol * scale);
+    CHECK(MaxDiff(tph::Mul(p.rotation, p.stretch), a) < tol * scale);
+
+    CHECK(MaxDiff(svds[i].u, d.u) < tol && MaxDiff(svds[i].v, d.v) < tol &&
+          tph::Length(svds[i].values - d.values) < tol * scale);
+    CHECK(MaxDiff(polars[i].rotation, p.rotation) < tol &&
+          MaxDiff(polars[i].stretch, p.stretch) < tol * scale);
+  }
+
+  // Rotations are their own polar rotation, with no stretch. A reflection maps to a rotation and a
+  // negative stretch.
+  const auto r = Rotation(ArithT(0.1), ArithT(-0.4), ArithT(2));
+  const auto pr = tph::PolarDecompose(r);
+  CHECK(MaxDiff(pr.rotation, r) < tol && MaxDiff(pr.stretch, tph::Identity3x3<ArithT>()) < tol);
+  const auto pf = tph::PolarDecompose(reflection);
+  CHECK(IsRotation(pf.rotation, tol));
+  CHECK(std::abs(tph::Determinant(pf.stretch) + ArithT(1)) < tol);
+  const auto dz = tph::Svd(zero);
+  CHECK(dz.values == (tph::Vec<ArithT, 3>{}) && IsRotation(dz.u, tol) && IsRotation(dz.v, tol));
+}
+
+// Matrix from M * M elements in column order.
+template <typename ArithT, int M>
+auto MatFromElements(const ArithT* e) -> tph::Mat<ArithT, M, M> {
+  tph::Mat<ArithT, M, M> r{};
+  std::memcpy(&r, e, sizeof(r));
+  return r;
+}
+
+template <typename ArithT, int M>
+auto MaxAbs(const tph::Vec<ArithT, M>& a) -> ArithT {
+  auto r = ArithT(0);
+  for (int j = 0; j < M; ++j) {
+    r = std::max(r, std::abs(tph::Comp(a, j)));
+  }
+  return r;
+}
+
+// General, positive definite, singular and indefinite systems of size M, checked for the residual,
+// the singularity reports, and the batch against the scalar versions.
+template <typename ArithT, int M>
+void TestSolve(const ArithT tol) {
+  using MatT = tph::Mat<ArithT, M, M>;
+  using VecT = tph::Vec<ArithT, M>;
+  const std::size_t n = 203;
+  std::vector<MatT> general(n);
+  std::vector<MatT> spd(n);
+  std::vector<VecT> b(n);
+  std::mt19937 rng(12345);
+  std::uniform_real_distribution<ArithT> u(ArithT(-1), ArithT(1));
+  for (std::size_t i = 0; i < n; ++i) {
+    ArithT e[M * M] = {};
+    ArithT f[M] = {};
+    for (int k = 0; k < M * M; ++k) {
+      e[k] = u(rng);
+    }
+    for (int k = 0; k < M; ++k) {
+      f[k] = u(rng);
+      e[k * M + k] += ArithT(2); // Well conditioned, also once squared.
+    }
+    switch (i % 5) {
+    case 1:
+      // Singular, the last column repeats the first.
+      for (int k = 0; k < M; ++k) {
+        e[(M - 1) * M + k] = e[k];
+      }
+      break;
+    case 2:
+      // Zero.
+      for (int k = 0; k < M * M; ++k) {
+        e[k] = ArithT(0);
+      }
+      break;
+    default:
+      break;
+    }
+    general[i] = MatFromElements<ArithT, M>(e);
+    std::memcpy(&b[i], f, sizeof(b[i]));
+    // a^T * d * a is positive definite for d = I unless a is singular, and negative definite for
+    // d = -I.
+    ArithT d[M * M] = {};
+    for (int k = 0; k < M; ++k) {
+      d[k * M + k] = i % 5 == 3 ? ArithT(-1) : ArithT(1);
+    }
+    spd[i] = tph::Mul(tph::Transpose(general[i]),
+                      tph::Mul(MatFromElements<ArithT, M>(d), general[i]));
+  }
+
+  std::vector<tph::LinearSolution<ArithT, M>> lu(n);
+  std::vector<tph::LinearSolution<ArithT, M>> cholesky(n);
+  tph::SolveLUMany(general.data(), b.data(), lu.data(), n);
+  tph::SolveCholeskyMany(spd.data(), b.data(), cholesky.data(), n);
+  for (std::size_t i = 0; i < n; ++i) {
+    const auto s = tph::SolveLU(general[i], b[i]);
+    const auto c = tph::SolveCholesky(spd[i], b[i]);
+    const auto singular = i % 5 == 1 || i % 5 == 2;
+    CHECK(s.solved == !singular);
+    CHECK(c.solved == (!singular && i % 5 != 3));
+    if (s.solved) {
+      const auto scale = std::max(MaxAbs(general[i].x), ArithT(1)) * MaxAbs(s.x);
+      CHECK(MaxAbs(tph::Mul(general[i], s.x) - b[i]) < tol * scale);
+    } else {
+      CHECK(MaxAbs(s.x) == ArithT(0));
+    }
+    if (c.solved) {
+      const auto scale = std::max(MaxAbs(spd[i].x), ArithT(1)) * MaxAbs(c.x);
+      CHECK(MaxAbs(tph::Mul(spd[i], c.x) - b[i]) < tol * scale);
+    }
+    CHECK(lu[i].solved == s.solved && MaxAbs(lu[i].x - s.x) <= tol * MaxAbs(s.x));
+    CHECK(cholesky[i].solved == c.solved && MaxAbs(cholesky[i].x - c.x) <= tol * MaxAbs(c.x));
+  }
+}
+
+template <typename ArithT>
+auto MaxDiff(const tph::Quat<ArithT>& a, const tph::Quat<ArithT>& b) -> ArithT {
+  return std::max(MaxAbs(a.v - b.v), std::abs(a.w - b.w));
+}
+
+// Reference slerp with trigonometry, for the shorter arc.
+template <typename ArithT>
+auto TrigSlerp(const tph::Quat<ArithT>& a, tph::Quat<ArithT> b, const ArithT t)
+    -> tph::Quat<ArithT> {
+  auto d = tph::Dot(a, b);
+  if (d < ArithT(0)) {
+    b = tph::Quat<ArithT>{-b.v, -b.w};
+    d = -d;
+  }
+  const auto theta = std::acos(std::min(d, ArithT(1)));
+  if (theta < ArithT(1e-4)) {
+    return tph::Normalized(tph::Quat<ArithT>{a.v * (ArithT(1) - t) + b.v * t,
+                                             a.w * (ArithT(1) - t) + b.w * t});
+  }
+  const auto sa = std::sin((ArithT(1) - t) * theta) / std::sin(theta);
+  const auto sb = std::sin(t * theta) / std::sin(theta);
+  return tph::Quat<ArithT>{a.v * sa + b.v * sb, a.w * sa + b.w * sb};
+}
+
+// Random unit quaternions, with nearby, opposite and identical pairs, checked for the rotation and
+// composition against the matrices, the matrix round-trip, Slerp against trigonometry, and the
+// batch against the scalar versions.
+template <typename ArithT>
+void TestQuat(const ArithT tol) {
+  using Q = tph::Quat<ArithT>;
+  using V3 = tph::Vec<ArithT, 3>;
+  const std::size_t n = 203;
+  std::vector<Q> a(n);
+  std::vector<Q> b(n);
+  std::vector<V3> p(n);
+  std::mt19937 rng(12345);
+  std::uniform_real_distribution<ArithT> u(ArithT(-1), ArithT(1));
+  for (std::size_t i = 0; i < n; ++i) {
+    a[i] = tph::Normalized(Q{V3{u(rng), u(rng), u(rng)}, u(rng)});
+    b[i] = tph::Normalized(Q{V3{u(rng), u(rng), u(rng)}, u(rng)});
+    p[i] = V3{u(rng), u(rng), u(rng)};
+    switch (i % 7) {
+    case 1:
+      b[i] = tph::Normalized(Q{a[i].v + V3{ArithT(1e-3), ArithT(0), ArithT(0)}, a[i].w});
+      break;
+    case 2:
+      b[i] = Q{-a[i].v, -a[i].w};
+      break;
+    case 3:
+      b[i] = a[i];
+      break;
+    default:
+      break;
+    }
+  }
+
+  for (std::size_t i = 0; i < n; ++i) {
+    const auto ra = tph::ToMat3x3(a[i]);
+    const auto rb = tph::ToMat3x3(b[i]);
+    CHECK(IsRotation(ra, tol));
+    CHECK(MaxAbs(tph::Rotate(a[i], p[i]) - tph::Mul(ra, p[i])) < tol);
+    CHECK(MaxDiff(tph::ToMat3x3(tph::Mul(a[i], b[i])), tph::Mul(ra, rb)) < tol);
+    CHECK(MaxAbs(tph::Rotate(tph::Mul(a[i], b[i]), p[i]) -
+                 tph::Rotate(a[i], tph::Rotate(b[i], p[i]))) < tol);
+    const auto back = tph::ToQuat(ra);
+    CHECK(std::min(MaxDiff(back, a[i]), MaxDiff(back, Q{-a[i].v, -a[i].w})) < tol);
+    CHECK(MaxDiff(tph::ToQuat(tph::ToMat4x4(a[i])), back) == ArithT(0));
+    for (const auto t : {ArithT(0), ArithT(0.25), ArithT(0.5), ArithT(0.8), ArithT(1)}) {
+      CHECK(MaxDiff(tph::Slerp(a[i], b[i], t), TrigSlerp(a[i], b[i], t)) < tol);
+      const auto nl = tph::Nlerp(a[i], b[i], t);
+      CHECK(std::abs(tph::Dot(nl, nl) - ArithT(1)) < tol);
+    }
+  }
+
+  const auto t = ArithT(0.3);
+  std::vector<V3> rotated(n);
+  std::vector<V3> rotated_one(n);
+  std::vector<Q> nlerp(n);
+  std::vector<Q> slerp(n);
+  tph::RotateMany(a.data(), p.data(), rotated.data(), n);
+  tph::RotateMany(a[5], p.data(), rotated_one.data(), n);
+  tph::NlerpMany(a.data(), b.data(), t, nlerp.data(), n);
+  tph::SlerpMany(a.data(), b.data(), t, slerp.data(), n);
+  for (std::size_t i = 0; i < n; ++i) {
+    CHECK(MaxAbs(rotated[i] - tph::Rotate(a[i], p[i])) < tol);
+    CHECK(MaxAbs(rotated_one[i] - tph::Rotate(a[5], p[i])) < tol);
+    CHECK(MaxDiff(nlerp[i], tph::Nlerp(a[i], b[i], t)) < tol);
+    CHECK(MaxDiff(slerp[i], tph::Slerp(a[i], b[i], t)) < tol);
+  }
+
+  // In place.
+  tph::SlerpMany(a.data(), b.data(), t, a.data(), n);
+  CHECK(std::memcmp(a.data(), slerp.data(), n * sizeof(Q)) == 0);
+}
+
+template <typename ArithT>
+auto MaxDiff(const tph::Mat<ArithT, 4, 4>& a, const tph::Mat<ArithT, 4, 4>& b) -> ArithT {
+  return std::max(std::max(MaxAbs(a.x - b.x), MaxAbs(a.y - b.y)),
+                  std::max(MaxAbs(a.z - b.z), MaxAbs(a.w - b.w)));
+}
+
+// World transform by following the chain of parents, parents[i] >= n for the roots.
+template <typename ArithT>
+auto ChainWorld(const std::vector<std::size_t>& parents,
+                const std::vector<tph::Mat<ArithT, 4, 4>>& local,
+                const std::size_t i) -> tph::Mat<ArithT, 4, 4> {
+  return parents[i] < parents.size() ? tph::Mul(ChainWorld(parents, local, parents[i]), local[i])
+                                     : local[i];
+}
+
+// A random forest with wide and deep branches, checked for the level order and the world
+// transforms against the chains of parents, after all and after a few local transforms have
+// changed. A cycle is cut into a tree.
+template <typename ArithT>
+void TestHierarchy(const ArithT tol) {
+  using M4 = tph::Mat<ArithT, 4, 4>;
+  const std::size_t n = 1001;
+  std::mt19937 rng(12345);
+  std::uniform_real_distribution<ArithT> u(ArithT(-1), ArithT(1));
+  // Parents have smaller indices, except for the cycle at the end.
+  std::vector<std::size_t> parents(n);
+  std::vector<M4> local(n);
+  for (std::size_t i = 0; i < n; ++i) {
+    const auto r = Rotation(u(rng), u(rng), u(rng));
+    local[i] = M4{{r.x.x, r.x.y, r.x.z, ArithT(0)},
+                  {r.y.x, r.y.y, r.y.z, ArithT(0)},
+                  {r.z.x, r.z.y, r.z.z, ArithT(0)},
+                  {u(rng), u(rng), u(rng), ArithT(1)}};
+    parents[i] = i < 3 ? tph::kNoParent
+                 : i % 4 == 0 ? i - 1
+                              : static_cast<std::size_t>(rng() % i);
+  }
+  parents[n - 3] = n - 1;
+  parents[n - 2] = n - 3;
+  parents[n - 1] = n - 2;
+
+  auto h = tph::MakeTransformHierarchy(parents.data(), local.data(), n);
+  CHECK(h.node.size() == n && h.levels.front() == 0 && h.levels.back() == n);
+  // The cycle is cut at the node that closes it, n - 3 -> n - 1 -> n - 2 -> n - 3.
+  CHECK(h.parent[h.position[n - 3]] == tph::kNoParent);
+  parents[n - 3] = tph::kNoParent;
+  for (std::size_t l = 0; l + 1 < h.levels.size(); ++l) {
+    for (auto k = h.levels[l]; k < h.levels[l + 1]; ++k) {
+      CHECK(h.position[h.node[k]] == k);
+      CHECK(std::memcmp(&h.local[k], &local[h.node[k]], sizeof(M4)) == 0);
+      const auto p = h.parent[k];
+      CHECK(l == 0 ? p == tph::kNoParent : p >= h.levels[l - 1] && p < h.levels[l]);
+      CHECK(l == 0 || h.node[p] == parents[h.node[k]]);
+      CHECK(k == h.levels[l] || p == tph::kNoParent || h.parent[k - 1] <= p);
+    }
+  }
+
+  tph::UpdateWorld(h);
+  auto near = true;
+  for (std::size_t i = 0; i < n; ++i) {
+    near = near && MaxDiff(tph::GetWorld(h, i), ChainWorld(parents, local, i)) < tol;
+  }
+  CHECK(near);
+  CHECK(std::all_of(h.dirty.begin(), h.dirty.end(), [](unsigned char d) { return d == 0; }));
+
+  // Only the changed subtrees are recomputed, the others keep their exact values.
+  const auto before = h.world;
+  for (const std::size_t i : {std::size_t{1}, std::size_t{500}, n - 2}) {
+    local[i].w = local[i].w + tph::Vec<ArithT, 4>{ArithT(1), ArithT(2), ArithT(3), ArithT(0)};
+    tph::SetLocal(h, i, local[i]);
+  }
+  tph::UpdateWorld(h);
+  near = true;
+  auto kept = true;
+  for (std::size_t i = 0; i < n; ++i) {
+    const auto expected = ChainWorld(parents, local, i);
+    near = near && MaxDiff(tph::GetWorld(h, i), expected) < tol;
+    const auto k = h.position[i];
+    kept = kept && (MaxDiff(before[k], expected) > tol ||
+                     std::memcmp(&h.world[k], &before[k], sizeof(M4)) == 0);
+  }
+  CHECK(near);
+  CHECK(kept);
+}
+
+// Reference closest point on a segment, with a branch for the degenerate segment.
+template <typename ArithT>
+auto RefSegment(const tph::Vec<ArithT, 3>& p,
+                const tph::Vec<ArithT, 3>& a,
+                const tph::Vec<ArithT, 3>& b) -> tph::Vec<ArithT, 3> {
+  const auto len2 = tph::Length2(b - a);
+  if (len2 == ArithT(0)) {
+    return a;
+  }
+  const auto t = tph::Dot(p - a, b - a) / len2;
+  return a + (b - a) * std::min(std::max(t, ArithT(0)), ArithT(1));
+}
+
+// Reference closest point on a triangle, the projection onto the plane if it is inside the
+// triangle, otherwise the closest of the closest points on the edges.
+template <typename ArithT>
+auto RefTriangle(const tph::Vec<ArithT, 3>& p,
+                 const tph::Vec<ArithT, 3>& a,
+                 const tph::Vec<ArithT, 3>& b,
+                 const tph::Vec<ArithT, 3>& c) -> tph::Vec<ArithT, 3> {
+  const auto n = tph::Cross(b - a, c - a);
+  const auto q = p - n * (tph::Dot(p - a, n) / tph::Length2(n));
+  if (tph::Dot(tph::Cross(b - a, q - a), n) >= ArithT(0) &&
+      tph::Dot(tph::Cross(c - b, q - b), n) >= ArithT(0) &&
+      tph::Dot(tph::Cross(a - c, q - c), n) >= ArithT(0)) {
+    return q;
+  }
+  auto best = RefSegment(p, a, b);
+  for (const auto& e : {RefSegment(p, b, c), RefSegment(p, c, a)}) {
+    if (tph::Distance2(p, e) < tph::Distance2(p, best)) {
+      best = e;
+    }
+  }
+  return best;
+}
+
+// Random queries around unit triangles, segments and boxes, with points on the primitives and
+// degenerate segments, checked against the references and the batch against the scalar versions.
+// Distances to the closest points are compared, since near the edges the points themselves may be
+// far apart for nearly equal distances.
+template <typename ArithT>
+void TestClosest(const ArithT tol) {
+  using V3 = tph::Vec<ArithT, 3>;
+  using Box = tph::Aabb<ArithT, 3>;
+  const std::size_t n = 1003;
+  std::vector<V3> p(n);
+  std::vector<V3> a(n);
+  std::vector<V3> b(n);
+  std::vector<V3> c(n);
+  std::vector<Box> boxes(n);
+  std::mt19937 rng(12345);
+  std::uniform_real_distribution<ArithT> u(ArithT(-1), ArithT(1));
+  for (std::size_t i = 0; i < n; ++i) {
+    p[i] = V3{u(rng), u(rng), u(rng)} * ArithT(2);
+    a[i] = V3{u(rng), u(rng), u(rng)};
+    b[i] = V3{u(rng), u(rng), u(rng)};
+    c[i] = V3{u(rng), u(rng), u(rng)};
+    const auto e = V3{u(rng), u(rng), u(rng)};
+    boxes[i] = Box{tph::Min(a[i], e), tph::Max(a[i], e)};
+    switch (i % 5) {
+    case 1:
+      p[i] = b[i];
+      break;
+    case 2:
+      p[i] = (a[i] + b[i] + c[i]) * ArithT(1.0 / 3.0);
+      break;
+    default:
+      break;
+    }
+  }
+
+  std::vector<V3> segment(n);
+  std::vector<V3> triangle(n);
+  std::vector<ArithT> distance(n);
+  for (std::size_t i = 0; i < n; ++i) {
+    const auto bb = i % 7 == 3 ? a[i] : b[i];
+    segment[i] = tph::ClosestPointOnSegment(p[i], a[i], bb);
+    CHECK(MaxAbs(segment[i] - RefSegment(p[i], a[i], bb)) < tol);
+    triangle[i] = tph::ClosestPointOnTriangle(p[i], a[i], b[i], c[i]);
+    CHECK(std::abs(tph::Distance(p[i], triangle[i]) -
+                   tph::Distance(p[i], RefTriangle(p[i], a[i], b[i], c[i]))) < tol);
+    const auto r = tph::Cross(b[i] - a[i], c[i] - a[i]);
+    CHECK(std::abs(tph::Dot(triangle[i] - a[i], r)) < tol * tph::Length(r));
+    distance[i] = tph::DistanceToBox(p[i], boxes[i]);
+    auto d2 = ArithT(0);
+    for (int j = 0; j < 3; ++j) {
+      const auto x = tph::Comp(p[i], j);
+      const auto lo = tph::Comp(boxes[i].min, j);
+      const auto hi = tph::Comp(boxes[i].max, j);
+      const auto d = x < lo ? lo - x : hi < x ? x - hi : ArithT(0);
+      d2 += d * d;
+    }
+    CHECK(std::abs(distance[i] - std::sqrt(d2)) < tol);
+  }
+  CHECK(tph::ClosestPointOnTriangle(b[1], a[1], b[1], c[1]) == b[1]);
+
+  std::vector<V3> b_segment(b);
+  for (std::size_t i = 3; i < n; i += 7) {
+    b_segment[i] = a[i];
+  }
+  std::vector<V3> out(n);
+  std::vector<ArithT> out_distance(n);
+  tph::ClosestPointsOnSegments(p.data(), a.data(), b_segment.data(), out.data(), n);
+  auto same = true;
+  for (std::size_t i = 0; i < n; ++i) {
+    same = same && MaxAbs(out[i] - segment[i]) < tol;
+  }
+  CHECK(same);
+  tph::ClosestPointsOnTriangles(p.data(), a.data(), b.data(), c.data(), out.data(), n);
+  same = true;
+  for (std::size_t i = 0; i < n; ++i) {
+    same = same && MaxAbs(out[i] - triangle[i]) < tol;
+  }
+  CHECK(same);
+  tph::DistancesToBoxes(p.data(), boxes.data(), out_distance.data(), n);
+  same = true;
+  for (std::size_t i = 0; i < n; ++i) {
+    same = same && std::abs(out_distance[i] - distance[i]) < tol;
+  }
+  CHECK(same);
+
+  // In place, and a count below one packet.
+  auto q = p;
+  tph::ClosestPointsOnTriangles(q.data(), a.data(), b.data(), c.data(), q.data(), 3);
+  CHECK(std::memcmp(q.data(), out.data(), 3 * sizeof(V3)) == 0);
+  CHECK(q[3] == p[3]);
+}
+
+// Collinear, coincident-vertex and sliver triangles, where the rounded Voronoi region tests may
+// disagree. The closest point must be on the triangle, i.e. no farther from an edge than the sliver
+// height, and no farther from p than the closest edge point, give or take the sliver height, for
+// both the scalar and the batch version.
+template <typename ArithT>
+void TestClosestDegenerate(const ArithT tol, const ArithT sliver) {
+  using V3 = tph::Vec<ArithT, 3>;
+  const std::size_t n = 20000;
+  std::vector<V3> p(n);
+  std::vector<V3> a(n);
+  std::vector<V3> b(n);
+  std::vector<V3> c(n);
+  std::vector<ArithT> height(n);
+  std::mt19937 rng(54321);
+  std::uniform_real_distribution<ArithT> u(ArithT(-1), ArithT(1));
+  for (std::size_t i = 0; i < n; ++i) {
+    p[i] = V3{u(rng), u(rng), u(rng)} * ArithT(2);
+    a[i] = V3{u(rng), u(rng), u(rng)};
+    const auto d = V3{u(rng), u(rng), u(rng)};
+    b[i] = a[i] + d * u(rng);
+    c[i] = a[i] + d * (u(rng) * ArithT(1.5));
+    switch (i % 4) {
+    case 1: // Coincident vertices.
+      c[i] = i % 8 == 1 ? a[i] : b[i];
+      break;
+    case 2: // All at one point.
+      b[i] = a[i];
+      c[i] = a[i];
+      break;
+    case 3: // Sliver.
+      height[i] = sliver * (ArithT(1) + u(rng));
+      c[i] = c[i] + tph::Normalized(tph::Cross(d, V3{u(rng), u(rng), u(rng)})) * height[i];
+      break;
+    default: // Collinear.
+      break;
+    }
+  }
+
+  const auto check = [&](const std::vector<V3>& q) {
+    auto on = true;
+    auto closest = true;
+    for (std::size_t i = 0; i < n; ++i) {
+      auto to_edge = tph::Distance(q[i], RefSegment(q[i], a[i], b[i]));
+      auto edge = tph::Distance(p[i], RefSegment(p[i], a[i], b[i]));
+      for (const auto& e : {std::make_pair(b[i], c[i]), std::make_pair(c[i], a[i])}) {
+        to_edge = std::min(to_edge, tph::Distance(q[i], RefSegment(q[i], e.first, e.second)));
+        edge = std::min(edge, tph::Distance(p[i], RefSegment(p[i], e.first, e.second)));
+      }
+      on = on && to_edge <= height[i] + tol;
+      closest = closest && tph::Distance(p[i], q[i]) <= edge + height[i] + tol;
+    }
+    CHECK(on);
+    CHECK(closest);
+  };
+  std::vector<V3> q(n);
+  for (std::size_t i = 0; i < n; ++i) {
+    q[i] = tph::ClosestPointOnTriangle(p[i], a[i], b[i], c[i]);
+  }
+  check(q);
+  tph::ClosestPointsOnTriangles(p.data(), a.data(), b.data(), c.data(), q.data(), n);
+  check(q);
+}
+
+// Interleaved vertices, as in a GPU vertex buffer.
+template <typename ArithT>
+struct Vertex {
+  tph::Vec<ArithT, 3> position;
+  tph::Vec<ArithT, 3> normal;
+  tph::Vec<ArithT, 2> uv;
+};
+
+// Strided views of interleaved vertices and of an unaligned byte buffer, with counts that leave a
+// partial last block, checked against the array versions. The other attributes must not change.
+template <typename ArithT>
+void TestStrided() {
+  using V3 = tph::Vec<ArithT, 3>;
+  const auto m = tph::MakeMat4x4<ArithT>(ArithT(0.5), ArithT(-1), ArithT(2), ArithT(3),    //
+                                         ArithT(1.5), ArithT(0.25), ArithT(-2), ArithT(-4), //
+                                         ArithT(1), ArithT(2), ArithT(0.75), ArithT(5),     //
+                                         ArithT(0.1), ArithT(-0.2), ArithT(0.05), ArithT(2));
+  const auto d = V3{ArithT(0.3), ArithT(-1), ArithT(2)};
+  for (const std::size_t n : {std::size_t{0}, std::size_t{5}, std::size_t{203}}) {
+    std::vector<V3> src(n);
+    std::vector<Vertex<ArithT>> vertices(n);
+    for (std::size_t i = 0; i < n; ++i) {
+      const auto f = static_cast<ArithT>(i);
+      src[i] = {ArithT(1) + f, ArithT(2) - f * ArithT(0.5), ArithT(0.25) * f};
+      vertices[i] = {src[i], V3{f, ArithT(1), -f}, tph::Vec<ArithT, 2>{f, f}};
+    }
+    std::vector<V3> points(n);
+    std::vector<V3> dirs(n);
+    std::vector<V3> projected(n);
+    tph::TransformPoints(m, src.data(), points.data(), n);
+    tph::TransformDirections(m, src.data(), dirs.data(), n);
+    tph::ProjectPoints(m, src.data(), projected.data(), n);
+
+    // Positions to normals and back in place, in the same buffer.
+    const auto positions = tph::MakeStridedSpan(vertices.data(), n, &Vertex<ArithT>::position);
+    const auto normals = tph::MakeStridedSpan(vertices.data(), n, &Vertex<ArithT>::normal);
+    CHECK(tph::Size(positions) == n && positions.stride == sizeof(Vertex<ArithT>));
+    tph::TransformDirections(m, tph::ToView(positions), normals);
+    for (std::size_t i = 0; i < n; ++i) {
+      CHECK(Near3(tph::Get(normals, i), dirs[i]) && vertices[i].position == src[i]);
+    }
+    tph::TransformPoints(m, tph::ToView(positions), positions);
+    for (std::size_t i = 0; i < n; ++i) {
+      CHECK(Near3(vertices[i].position, points[i]) && Near3(vertices[i].normal, dirs[i]));
+      CHECK((vertices[i].uv == tph::Vec<ArithT, 2>{ArithT(i), ArithT(i)}));
+    }
+    std::vector<V3> moved(n);
+    for (std::size_t i = 0; i < n; ++i) {
+      moved[i] = vertices[i].position;
+    }
+    const auto b = tph::ComputeBounds(tph::ToView(positions));
+    const auto expected_b = tph::ComputeBounds(moved.data(), n);
+    CHECK(b.min == expected_b.min && b.max == expected_b.max);
+    CHECK(tph::MinMaxDot(tph::ToView(positions), d) == tph::MinMaxDot(moved.data(), n, d));
+    std::vector<V3> normalized(n);
+    for (std::size_t i = 0; i < n; ++i) {
+      normalized[i] = tph::Normalized(vertices[i].normal);
+    }
+    tph::Normalized(tph::ToView(normals), normals);
+    for (std::size_t i = 0; i < n; ++i) {
+      CHECK(tph::Get(normals, i) == normalized[i]);
+    }
+
+    // Vectors one byte into a buffer with a stride of 5 scalars, neither aligned nor packed.
+    const auto stride = 5 * sizeof(ArithT);
+    std::vector<unsigned char> bytes(1 + n * stride);
+    const auto span = tph::MakeStridedSpan<ArithT, 3>(bytes.data(), 1, stride, n);
+    for (std::size_t i = 0; i < n; ++i) {
+      tph::Set(span, i, src[i]);
+    }
+    tph::ProjectPoints(m, tph::ToView(span), span);
+    auto same = true;
+    for (std::size_t i = 0; i < n; ++i) {
+      same = same && Near3(tph::Get(span, i), projected[i]);
+    }
+    CHECK(same);
+
+    // Packed vectors go to the array kernels.
+    auto packed = src;
+    const auto view = tph::MakeStridedView<ArithT, 3>(src.data(), 0, sizeof(V3), n);
+    tph::TransformPoints(m, view, tph::MakeStridedSpan<ArithT, 3>(packed.data(), 0, sizeof(V3), n));
+    CHECK(packed == points);
+  }
+}
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+  // Only the closest-point tests, for the build with fused multiply-add, see CMakeLists.txt.
+  if (argc > 1 && std::strcmp(argv[1], "closest") == 0) {
+#if defined(__FMA__)
+    if (!__builtin_cpu_supports("avx2") || !__builtin_cpu_supports("fma")) {
+      std::printf("skipped, no FMA\n");
+      return 77;
+    }
+#endif
+    TestClosest<float>(2e-5F);
+    TestClosest<double>(1e-12);
+    TestClosestDegenerate<float>(2e-5F, 1e-4F);
+    TestClosestDegenerate<double>(1e-12, 1e-8);
+    return g_failures == 0 ? 0 : 1;
+  }
+
+  const auto pa = MakePoints(2.0F);
+  const auto pb = MakePoints(-3.0F);
+
+  TestBatch(pa, pb, tph::ToSoA(pa.data(), pa.size()), tph::ToSoA(pb.data(), pb.size()));
+  TestBatch(
+      pa, pb, tph::ToAoSoA<4>(pa.data(), pa.size()), tph::ToAoSoA<4>(pb.data(), pb.size()));
+  TestBatch(
+      pa, pb, tph::ToAoSoA<8>(pa.data(), pa.size()), tph::ToAoSoA<8>(pb.data(), pb.size()));
+
+  // Default-constructed arrays are empty.
+  CHECK(tph::Size(tph::float3SoA{}) == 0);
+  CHECK((tph::Size(tph::VecArrayAoSoA<float, 3, 8>()) == 0));
+
+  // Set.
+  {
+    auto a = tph::ToSoA(pa.data(), pa.size());
+    tph::Set(a, 3, tph::float3{7.0F, 8.0F, 9.0F});
+    CHECK((tph::Get(a, 3) == tph::float3{7.0F, 8.0F, 9.0F}));
+    auto b = tph::ToAoSoA<8>(pa.data(), pa.size());
+    tph::Set(b, 12, tph::float3{7.0F, 8.0F, 9.0F});
+    CHECK((tph::Get(b, 12) == tph::float3{7.0F, 8.0F, 9.0F}));
+  }
+
+  TestTransforms<float>();
+  TestTransforms<double>();
+  TestInverseMany<float>();
+  TestInverseMany<double>();
+  TestMulMany<float>();
+  TestMulMany<double>();
+  TestHalf();
+  // The documented bounds, see Encode.
+  TestPacked<tph::Oct16>(0.96F);
+  TestPacked<tph::Oct32>(0.0037F);
+  TestPacked<tph::Snorm1010102>(0.097F);
+  TestReductions();
+  TestEigen<float>(4e-6F);
+  TestEigen<double>(1e-13);
+  TestSvd<float>(4e-6F);
+  TestSvd<double>(1e-13);
+  TestSolve<float, 2>(1e-5F);
+  TestSolve<float, 3>(1e-5F);
+  TestSolve<float, 4>(1e-5F);
+  TestSolve<double, 2>(1e-13);
+  TestSolve<double, 3>(1e-13);
+  TestSolve<double, 4>(1e-13);
+  TestQuat<float>(2e-6F);
+  TestQuat<double>(1e-14);
+  TestHierarchy<float>(1e-4F);
+  TestHierarchy<double>(1e-12);
+  TestClosest<float>(2e-5F);
+  TestClosest<double>(1e-12);
+  TestClosestDegenerate<float>(2e-5F, 1e-4F);
+  TestClosestDegenerate<double>(1e-12, 1e-8);
+  TestStrided<float>();
+  TestStrided<double>();
+
+  return g_failures == 0 ? 0 : 1;
+}
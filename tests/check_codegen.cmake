@@ -0,0 +1,43 @@
+# Copyright (C) Tommy Hinks <tommy.hinks@gmail.com>
+# This file is subject to the license terms in the LICENSE file
+# found in the top-level directory of this distribution.
+
+# Usage: cmake -DASM=<assembly of codegen_tests.cpp> -P check_codegen.cmake
+#
+# Fails if a tph_codegen_* function has a conditional jump, a call, or a jump out of the function,
+# e.g. a tail call to an out-of-line helper, or if one of them is missing. Jumps to local labels
+# (.L* for ELF, LBB* for Mach-O) stay within the function and are allowed.
+
+set(expected
+  comp3 index4 set4 row4 col4 transpose4 transpose3
+)
+
+file(STRINGS "${ASM}" lines)
+set(function "")
+set(found "")
+set(failed FALSE)
+foreach(line IN LISTS lines)
+  if (line MATCHES "^_?tph_codegen_([a-z0-9_]+):")
+    set(function ${CMAKE_MATCH_1})
+    list(APPEND found ${function})
+  elseif (function STREQUAL "")
+  elseif (line MATCHES "\\.cfi_endproc")
+    set(function "")
+  elseif (line MATCHES "^[ \t]+jmp[a-z]*[ \t]+(\\.L[A-Za-z0-9_$.]+|LBB[0-9_]+)[ \t]*(#.*)?$")
+  elseif (line MATCHES "^[ \t]+(j[a-z]+|call[a-z]*)[ \t]")
+    message(SEND_ERROR "tph_codegen_${function}: ${line}")
+    set(failed TRUE)
+  endif()
+endforeach()
+
+foreach(function IN LISTS expected)
+  list(FIND found ${function} index)
+  if (index EQUAL -1)
+    message(SEND_ERROR "tph_codegen_${function}: not found in ${ASM}")
+    set(failed TRUE)
+  endif()
+endforeach()
+
+if (failed)
+  message(FATAL_ERROR "Branches or calls in code that should be straight-line")
+endif()
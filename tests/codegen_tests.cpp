@@ -0,0 +1,41 @@
+// Copyright (C) Tommy Hinks <tommy.hinks@gmail.com>
+// This file is subject to the license terms in the LICENSE file
+// found in the top-level directory of this distribution.
+
+// Compiled to assembly, not run. check_codegen.cmake fails if any of the functions below has a
+// conditional jump or a call, i.e. if indexing with a run-time index does not compile to plain
+// loads and stores, or if Row, Col and Transpose are not straight-line moves and shuffles.
+
+#include <tph/tph_linalg.hpp>
+
+extern "C" {
+
+auto tph_codegen_comp3(const tph::float3* a, const int i) -> float {
+  return tph::Comp(*a, i);
+}
+
+auto tph_codegen_index4(const tph::double4* a, const int i) -> double {
+  return (*a)[i];
+}
+
+void tph_codegen_set4(tph::float4* a, const int i, const float s) {
+  (*a)[i] = s;
+}
+
+void tph_codegen_row4(const tph::float4x4* m, const int i, tph::float4* dst) {
+  *dst = tph::Row(*m, i);
+}
+
+void tph_codegen_col4(const tph::float4x4* m, const int j, tph::float4* dst) {
+  *dst = tph::Col(*m, j);
+}
+
+void tph_codegen_transpose4(const tph::float4x4* m, tph::float4x4* dst) {
+  *dst = tph::Transpose(*m);
+}
+
+void tph_codegen_transpose3(const tph::double3x3* m, tph::double3x3* dst) {
+  *dst = tph::Transpose(*m);
+}
+
+} // extern "C"
@@ -0,0 +1,212 @@
+// Copyright (C) Tommy Hinks <tommy.hinks@gmail.com>
+// This file is subject to the license terms in the LICENSE file
+// found in the top-level directory of this distribution.
+
+#include <cstdint>
+#include <cstdio>
+#include <cstring> // std::memcpy
+#include <vector>
+
+#include <tph/tph_linalg_batch.hpp>
+#include <tph/tph_linalg_io.hpp>
+
+namespace {
+
+int g_failures = 0;
+
+#define CHECK(expr)                                                                                \
+  do {                                                                                             \
+    if (!(expr)) {                                                                                 \
+      std::printf("%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #expr);                        \
+      ++g_failures;                                                                                \
+    }                                                                                              \
+  } while (false)
+
+// Files are written to the working directory, the build directory under CTest.
+constexpr const char* kPath = "io_tests_points.bin";
+
+void WriteBytes(const char* path, const std::vector<unsigned char>& bytes) {
+  const auto f = std::fopen(path, "wb");
+  CHECK(f != nullptr);
+  if (f != nullptr) {
+    CHECK(std::fwrite(bytes.data(), 1, bytes.size(), f) == bytes.size());
+    std::fclose(f);
+  }
+}
+
+auto ReadBytes(const char* path) -> std::vector<unsigned char> {
+  std::vector<unsigned char> bytes;
+  const auto f = std::fopen(path, "rb");
+  CHECK(f != nullptr);
+  if (f != nullptr) {
+    unsigned char buf[4096];
+    std::size_t n;
+    while ((n = std::fread(buf, 1, sizeof(buf), f)) != 0) {
+      bytes.insert(bytes.end(), buf, buf + n);
+    }
+    std::fclose(f);
+  }
+  return bytes;
+}
+
+template <typename ArithT>
+auto MakePoints(const std::size_t n) -> std::vector<tph::Vec<ArithT, 3>> {
+  std::vector<tph::Vec<ArithT, 3>> v(n);
+  for (std::size_t i = 0; i < n; ++i) {
+    const auto f = static_cast<ArithT>(i);
+    v[i] = {f * ArithT{0.5}, ArithT{1} - f, f * f * ArithT{0.25}};
+  }
+  return v;
+}
+
+template <typename ArithT>
+void TestPointCloud() {
+  using tph::IoError;
+  using tph::MapMode;
+  using VecT = tph::Vec<ArithT, 3>;
+
+  // Written in uneven chunks, mapped back unchanged in both modes.
+  const auto src = MakePoints<ArithT>(1001);
+  {
+    tph::PointCloudWriter<ArithT, 3> w;
+    CHECK(w.Open(kPath) == IoError::kNone);
+    for (std::size_t i = 0; i < src.size(); i += 300) {
+      const auto n = src.size() - i < 300 ? src.size() - i : 300;
+      CHECK(w.Write(src.data() + i, n) == IoError::kNone);
+    }
+    CHECK(w.Count() == src.size());
+    CHECK(w.Close() == IoError::kNone);
+  }
+  for (const auto mode : {MapMode::kReadOnly, MapMode::kCopyOnWrite}) {
+    const auto a = tph::MapPointCloud<ArithT, 3>(kPath, mode);
+    CHECK(a.error == IoError::kNone);
+    CHECK(a.size == src.size());
+    CHECK(reinterpret_cast<std::uintptr_t>(a.data) % alignof(VecT) == 0);
+    auto same = a.size == src.size();
+    for (std::size_t i = 0; same && i < a.size; ++i) {
+      same = a.data[i] == src[i];
+    }
+    CHECK(same);
+    CHECK((tph::MutableData(a) != nullptr) == (mode == MapMode::kCopyOnWrite));
+
+    // Batch operations run on the mapping.
+    const auto b = tph::ComputeBounds(a.data, a.size);
+    const auto expected = tph::ComputeBounds(src.data(), src.size());
+    CHECK(b.min == expected.min && b.max == expected.max);
+  }
+
+  // Copy-on-write changes are private to the mapping.
+  const auto bytes = ReadBytes(kPath);
+  {
+    const auto a = tph::MapPointCloud<ArithT, 3>(kPath, MapMode::kCopyOnWrite);
+    const auto dst = tph::MutableData(a);
+    CHECK(dst != nullptr);
+    if (dst != nullptr) {
+      const auto scale = tph::Mat<ArithT, 3, 4>{{2, 0, 0}, {0, 2, 0}, {0, 0, 2}, {0, 0, 0}};
+      tph::TransformDirections(scale, a.data, dst, a.size);
+      CHECK(a.data[1000] == src[1000] * ArithT{2});
+    }
+    CHECK(ReadBytes(kPath) == bytes);
+  }
+
+  // Moving keeps the mapping.
+  {
+    auto a = tph::MapPointCloud<ArithT, 3>(kPath, MapMode::kReadOnly);
+    const auto b = std::move(a);
+    CHECK(a.file.Data() == nullptr);
+    CHECK(b.error == IoError::kNone && b.size == src.size() && b.data[1000] == src[1000]);
+  }
+
+  // Wrong types.
+  CHECK((tph::MapPointCloud<ArithT, 4>(kPath, MapMode::kReadOnly).error == IoError::kType));
+  CHECK((tph::MapPointCloud<std::int32_t, 3>(kPath, MapMode::kReadOnly).error == IoError::kType));
+  if (sizeof(ArithT) == sizeof(float)) {
+    CHECK((tph::MapPointCloud<double, 3>(kPath, MapMode::kReadOnly).error == IoError::kType));
+  } else {
+    CHECK((tph::MapPointCloud<float, 3>(kPath, MapMode::kReadOnly).error == IoError::kType));
+  }
+
+  // Damaged headers.
+  auto damaged = bytes;
+  damaged[0] = 'X';
+  WriteBytes(kPath, damaged);
+  CHECK((tph::MapPointCloud<ArithT, 3>(kPath, MapMode::kReadOnly).error == IoError::kFormat));
+
+  damaged = bytes;
+  std::swap(damaged[4], damaged[7]);
+  std::swap(damaged[5], damaged[6]);
+  WriteBytes(kPath, damaged);
+  const auto swapped = tph::MapPointCloud<ArithT, 3>(kPath, MapMode::kReadOnly);
+  CHECK(swapped.error == IoError::kEndian);
+  CHECK(swapped.data == nullptr && swapped.size == 0 && swapped.file.Data() == nullptr);
+
+  damaged = bytes;
+  damaged[8] = 2; // Version.
+  WriteBytes(kPath, damaged);
+  CHECK((tph::MapPointCloud<ArithT, 3>(kPath, MapMode::kReadOnly).error == IoError::kFormat));
+
+  damaged = bytes;
+  damaged[24] = 65; // Data offset.
+  WriteBytes(kPath, damaged);
+  CHECK((tph::MapPointCloud<ArithT, 3>(kPath, MapMode::kReadOnly).error == IoError::kSize));
+
+  // Truncated, and too short for a header.
+  damaged = bytes;
+  damaged.pop_back();
+  WriteBytes(kPath, damaged);
+  CHECK((tph::MapPointCloud<ArithT, 3>(kPath, MapMode::kReadOnly).error == IoError::kSize));
+  damaged.resize(20);
+  WriteBytes(kPath, damaged);
+  CHECK((tph::MapPointCloud<ArithT, 3>(kPath, MapMode::kReadOnly).error == IoError::kFormat));
+
+  // A writer that was not closed leaves a count of 0.
+  {
+    tph::PointCloudWriter<ArithT, 3> w;
+    CHECK(w.Open(kPath) == IoError::kNone);
+    CHECK(w.Write(src.data(), 10) == IoError::kNone);
+    std::fflush(nullptr);
+    CHECK((tph::MapPointCloud<ArithT, 3>(kPath, MapMode::kReadOnly).error == IoError::kSize));
+  }
+
+  // Empty point clouds.
+  CHECK((tph::WritePointCloud<ArithT, 3>(kPath, nullptr, 0) == IoError::kNone));
+  const auto empty = tph::MapPointCloud<ArithT, 3>(kPath, MapMode::kReadOnly);
+  CHECK(empty.error == IoError::kNone && empty.data == nullptr && empty.size == 0);
+
+  // Raw arrays.
+  std::vector<unsigned char> raw(3 + src.size() * sizeof(VecT));
+  std::memcpy(raw.data() + 3, src.data(), src.size() * sizeof(VecT));
+  WriteBytes(kPath, raw);
+  CHECK((tph::MapRawPoints<ArithT, 3>(kPath, MapMode::kReadOnly).error == IoError::kSize));
+  CHECK((tph::MapRawPoints<ArithT, 3>(kPath, MapMode::kReadOnly, 3).error ==
+         IoError::kAlignment));
+  raw.erase(raw.begin(), raw.begin() + 3);
+  raw.insert(raw.begin(), 2 * sizeof(ArithT), 0);
+  WriteBytes(kPath, raw);
+  const auto r = tph::MapRawPoints<ArithT, 3>(kPath, MapMode::kReadOnly, 2 * sizeof(ArithT));
+  CHECK(r.error == IoError::kNone && r.size == src.size());
+  CHECK(r.size == src.size() && r.data[0] == src[0] && r.data[1000] == src[1000]);
+  CHECK((tph::MapRawPoints<ArithT, 3>(kPath, MapMode::kReadOnly, raw.size() + 1).error ==
+         IoError::kSize));
+
+  std::remove(kPath);
+}
+
+void TestErrors() {
+  using tph::IoError;
+  CHECK((tph::MapPointCloud<float, 3>("io_tests_missing.bin", tph::MapMode::kReadOnly).error ==
+         IoError::kOpen));
+  CHECK((tph::MapRawPoints<float, 3>(".", tph::MapMode::kReadOnly).error == IoError::kOpen));
+  CHECK((tph::WritePointCloud<float, 3>("io_tests_missing/points.bin", nullptr, 0) ==
+         IoError::kOpen));
+  CHECK(std::strcmp(tph::IoErrorName(IoError::kEndian), "endian") == 0);
+}
+
+} // namespace
+
+int main() {
+  TestPointCloud<float>();
+  TestPointCloud<double>();
+  TestErrors();
+  return g_failures == 0 ? 0 : 1;
+}
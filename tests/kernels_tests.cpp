@@ -0,0 +1,244 @@
+// Copyright (C) Tommy Hinks <tommy.hinks@gmail.com>
+// This file is subject to the license terms in the LICENSE file
+// found in the top-level directory of this distribution.
+
+#include <cmath> // std::abs, std::cos, std::isnan, std::sin
+#include <cstdint>
+#include <cstdio>
+#include <cstring> // std::strcmp
+#include <vector>
+
+#include <tph/tph_linalg_kernels.hpp>
+
+namespace {
+
+int g_failures = 0;
+
+#define CHECK(expr)                                                                                \
+  do {                                                                                             \
+    if (!(expr)) {                                                                                 \
+      std::printf("%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #expr);                        \
+      ++g_failures;                                                                                \
+    }                                                                                              \
+  } while (false)
+
+auto Near(const tph::float3& a, const tph::float3& b) -> bool {
+  return std::abs(a.x - b.x) < 1e-4F && std::abs(a.y - b.y) < 1e-4F && std::abs(a.z - b.z) < 1e-4F;
+}
+
+void TestKernels() {
+  const auto m = tph::MakeMat4x4<float>(0.5F, -1.0F, 2.0F, 3.0F,    //
+                                        1.5F, 0.25F, -2.0F, -4.0F,  //
+                                        1.0F, 2.0F, 0.75F, 5.0F,    //
+                                        0.1F, -0.2F, 0.05F, 2.0F);
+  const auto m34 = tph::Mat<float, 3, 4>{
+      {m.x.x, m.x.y, m.x.z}, {m.y.x, m.y.y, m.y.z}, {m.z.x, m.z.y, m.z.z}, {m.w.x, m.w.y, m.w.z}};
+
+  // Counts around the 4, 8 and 16 wide blocks.
+  for (const std::size_t n : {std::size_t{0}, std::size_t{3}, std::size_t{37}}) {
+    std::vector<tph::float3> src(n);
+    for (std::size_t i = 0; i < n; ++i) {
+      const auto f = static_cast<float>(i);
+      src[i] = {1.0F + f, 2.0F - f * 0.5F, 0.25F * f};
+    }
+    std::vector<tph::float3> points(n);
+    std::vector<tph::float3> points34(n);
+    std::vector<tph::float3> dirs(n);
+    std::vector<tph::float3> dirs34(n);
+    std::vector<tph::float3> projected(n);
+    tph::kernels::TransformPoints(m, src.data(), points.data(), n);
+    tph::kernels::TransformPoints(m34, src.data(), points34.data(), n);
+    tph::kernels::TransformDirections(m, src.data(), dirs.data(), n);
+    tph::kernels::TransformDirections(m34, src.data(), dirs34.data(), n);
+    tph::kernels::ProjectPoints(m, src.data(), projected.data(), n);
+
+    for (std::size_t i = 0; i < n; ++i) {
+      const auto p = tph::Mul(m, tph::float4{src[i].x, src[i].y, src[i].z, 1.0F});
+      const auto d = tph::Mul(m, tph::float4{src[i].x, src[i].y, src[i].z, 0.0F});
+      CHECK(Near(points[i], tph::float3{p.x, p.y, p.z}));
+      CHECK(points34[i] == points[i]);
+      CHECK(Near(dirs[i], tph::float3{d.x, d.y, d.z}));
+      CHECK(dirs34[i] == dirs[i]);
+      CHECK(Near(projected[i], tph::float3{p.x / p.w, p.y / p.w, p.z / p.w}));
+    }
+
+    // In-place.
+    auto inplace = src;
+    tph::kernels::TransformPoints(m, inplace.data(), inplace.data(), n);
+    CHECK(inplace == points);
+
+    // Half vectors, the float results rounded to half.
+    std::vector<tph::half3> h(n);
+    std::vector<tph::float3> widened(n);
+    tph::kernels::Narrow(reinterpret_cast<const float*>(src.data()),
+                         reinterpret_cast<tph::half*>(h.data()), 3 * n);
+    tph::kernels::Widen(reinterpret_cast<const tph::half*>(h.data()),
+                        reinterpret_cast<float*>(widened.data()), 3 * n);
+    std::vector<tph::half3> h_points(n);
+    std::vector<tph::half3> h_projected(n);
+    tph::kernels::TransformPoints(m, h.data(), h_points.data(), n);
+    tph::kernels::ProjectPoints(m, h.data(), h_projected.data(), n);
+    for (std::size_t i = 0; i < n; ++i) {
+      CHECK(h[i] == tph::Narrow(src[i]));
+      CHECK(widened[i] == tph::Widen(h[i]));
+      const auto p = tph::Mul(m, tph::float4{widened[i].x, widened[i].y, widened[i].z, 1.0F});
+      // Relative tolerance, half has 11 significant bits.
+      CHECK(Near(tph::Widen(h_points[i]) * 1e-2F, tph::float3{p.x, p.y, p.z} * 1e-2F));
+      CHECK(Near(tph::Widen(h_projected[i]) * 1e-2F,
+                 tph::float3{p.x / p.w, p.y / p.w, p.z / p.w} * 1e-2F));
+    }
+
+    // Inverses of matrices that differ per element, checked by m * inverse = identity.
+    std::vector<tph::float4x4> mats(n);
+    for (std::size_t i = 0; i < n; ++i) {
+      const auto f = static_cast<float>(i) * 0.125F;
+      mats[i] = m;
+      mats[i].x.x += 4.0F + f;
+      mats[i].z.y -= f;
+    }
+    std::vector<tph::float4x4> inv(n);
+    tph::kernels::InverseMany(mats.data(), inv.data(), n);
+    for (std::size_t i = 0; i < n; ++i) {
+      const auto c0 = tph::Mul(mats[i], inv[i].x);
+      const auto c3 = tph::Mul(mats[i], inv[i].w);
+      CHECK(Near(tph::float3{c0.x, c0.y, c0.z}, tph::float3{1.0F, 0.0F, 0.0F}));
+      CHECK(std::abs(c0.w) < 1e-4F);
+      CHECK(Near(tph::float3{c3.x, c3.y, c3.z}, tph::float3{0.0F, 0.0F, 0.0F}));
+      CHECK(std::abs(c3.w - 1.0F) < 1e-4F);
+    }
+
+    // Products, checked by (a * b) * v = a * (b * v).
+    std::vector<tph::float4x4> each(n);
+    std::vector<tph::float4x4> shared(n);
+    tph::kernels::MulMany(mats.data(), inv.data(), each.data(), n);
+    tph::kernels::MulMany(m, mats.data(), shared.data(), n);
+    for (std::size_t i = 0; i < n; ++i) {
+      const auto v = tph::float4{src[i].x, src[i].y, src[i].z, 1.0F};
+      const auto e = tph::Mul(each[i], v);
+      const auto s = tph::Mul(shared[i], v);
+      const auto s_ref = tph::Mul(m, tph::Mul(mats[i], v));
+      CHECK(Near(tph::float3{e.x, e.y, e.z}, src[i]));
+      CHECK(std::abs(e.w - 1.0F) < 1e-4F);
+      // Relative tolerance, the elements are up to about 100.
+      CHECK(Near(tph::float3{s.x, s.y, s.z} * 1e-2F,
+                 tph::float3{s_ref.x, s_ref.y, s_ref.z} * 1e-2F));
+      CHECK(std::abs(s.w - s_ref.w) < 1e-2F);
+    }
+  }
+}
+
+// Every half, the conversions must agree with the scalar ones in tph_linalg.hpp.
+void TestHalfConversions() {
+  std::vector<tph::half> all(0x10000);
+  for (std::size_t i = 0; i < all.size(); ++i) {
+    all[i].bits = static_cast<std::uint16_t>(i);
+  }
+  std::vector<float> widened(all.size());
+  std::vector<tph::half> narrowed(all.size());
+  tph::kernels::Widen(all.data(), widened.data(), all.size());
+  bool exact = true;
+  for (std::size_t i = 0; i < all.size(); ++i) {
+    const auto f = static_cast<float>(all[i]);
+    exact = exact && (std::isnan(f) ? std::isnan(widened[i]) : widened[i] == f);
+  }
+  CHECK(exact);
+  // Halfway between consecutive halves, to check rounding.
+  for (std::size_t i = 0; i + 1 < all.size(); ++i) {
+    widened[i] = 0.5F * (widened[i] + widened[i + 1]);
+  }
+  tph::kernels::Narrow(widened.data(), narrowed.data(), all.size());
+  bool same = true;
+  for (std::size_t i = 0; i < all.size(); ++i) {
+    same = same && (std::isnan(widened[i]) || narrowed[i].bits == tph::half(widened[i]).bits);
+  }
+  CHECK(same);
+}
+
+template <typename PackedT>
+void TestPacked() {
+  std::vector<tph::float3> v(1001);
+  for (std::size_t i = 0; i < v.size(); ++i) {
+    const auto t = static_cast<float>(i);
+    v[i] = tph::Normalized(tph::float3{std::sin(t), std::cos(t * 0.3F), std::sin(t * 1.7F)});
+  }
+  std::vector<PackedT> packed(v.size());
+  std::vector<tph::float3> back(v.size());
+  tph::kernels::Encode(v.data(), packed.data(), v.size());
+  tph::kernels::Decode(packed.data(), back.data(), v.size());
+  bool near = true;
+  for (std::size_t i = 0; i < v.size(); ++i) {
+    near = near && Near(back[i], tph::Decode(tph::Encode<PackedT>(v[i])));
+  }
+  CHECK(near);
+}
+
+void TestReductions() {
+  std::vector<tph::float3> p(10007);
+  auto lo = tph::float3{1e30F, 1e30F, 1e30F};
+  auto hi = -lo;
+  tph::double3 sum = {};
+  for (std::size_t i = 0; i < p.size(); ++i) {
+    const auto t = static_cast<float>(i);
+    p[i] = {10.0F + std::sin(t), std::cos(t * 0.3F), -2.0F * std::sin(t * 1.7F)};
+    lo = tph::Min(lo, p[i]);
+    hi = tph::Max(hi, p[i]);
+    sum = sum + tph::double3{p[i].x, p[i].y, p[i].z};
+  }
+  const auto c = sum * (1.0 / static_cast<double>(p.size()));
+  auto var_x = 0.0;
+  auto cov_yz = 0.0;
+  for (const auto& q : p) {
+    var_x += (q.x - c.x) * (q.x - c.x) / static_cast<double>(p.size());
+    cov_yz += (q.y - c.y) * (q.z - c.z) / static_cast<double>(p.size());
+  }
+
+  const auto b = tph::kernels::ComputeBounds(p.data(), p.size());
+  CHECK(b.min == lo && b.max == hi);
+  const auto e = tph::kernels::MinMaxDot(p.data(), p.size(), tph::float3{0.0F, 0.0F, 1.0F});
+  CHECK(e.x == lo.z && e.y == hi.z);
+  const auto centroid = tph::kernels::Centroid(p.data(), p.size());
+  CHECK(std::abs(centroid.x - c.x) < 1e-5 && std::abs(centroid.y - c.y) < 1e-5 &&
+        std::abs(centroid.z - c.z) < 1e-5);
+  const auto cv = tph::kernels::Covariance(p.data(), p.size());
+  CHECK(std::abs(cv.x.x - var_x) < 1e-5 && std::abs(cv.z.y - cov_yz) < 1e-5 && cv.z.y == cv.y.z);
+}
+
+} // namespace
+
+// With an argument, checks that the level initially selected is the lower of the argument (as set by
+// TPH_LINALG_ISA) and the supported level. Without, that TPH_LINALG_ISA was not applied.
+int main(int argc, char* argv[]) {
+  using tph::kernels::Isa;
+  const auto supported = tph::kernels::SupportedIsa();
+  std::printf("supported: %s\n", tph::kernels::IsaName(supported));
+
+  if (argc > 1) {
+    auto expected = supported;
+    for (auto i = static_cast<int>(Isa::kScalar); i < static_cast<int>(supported); ++i) {
+      if (std::strcmp(argv[1], tph::kernels::IsaName(static_cast<Isa>(i))) == 0) {
+        expected = static_cast<Isa>(i);
+      }
+    }
+    CHECK(tph::kernels::ActiveIsa() == expected);
+  } else {
+    CHECK(tph::kernels::ActiveIsa() == supported);
+  }
+  CHECK(tph::kernels::IsaOverridden() == (argc > 1));
+
+  for (auto i = static_cast<int>(Isa::kScalar); i <= static_cast<int>(supported); ++i) {
+    const auto isa = static_cast<Isa>(i);
+    CHECK(tph::kernels::SetIsa(isa) == isa);
+    CHECK(tph::kernels::ActiveIsa() == isa);
+    TestKernels();
+    TestHalfConversions();
+    TestPacked<tph::Oct16>();
+    TestPacked<tph::Oct32>();
+    TestPacked<tph::Snorm1010102>();
+    TestReductions();
+  }
+
+  // Unsupported levels fall back to the best supported one.
+  CHECK(tph::kernels::SetIsa(Isa::kAvx512) == supported);
+
+  return g_failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,729 @@
+// Copyright (C) Tommy Hinks <tommy.hinks@gmail.com>
+// This file is subject to the license terms in the LICENSE file
+// found in the top-level directory of this distribution.
+
+#include <algorithm> // std::copy, std::min, std::sort
+#include <atomic>
+#include <chrono>
+#include <cmath> // std::abs, std::cos, std::sin
+#include <cstdint> // std::uint32_t, std::uint64_t
+#include <cstdio>
+#include <stdexcept> // std::runtime_error
+#include <thread>
+#include <vector>
+
+#include <tph/tph_linalg_parallel.hpp>
+#include <tph/tph_linalg_spatial.hpp>
+#include <tph/tph_linalg_stream.hpp>
+
+namespace {
+
+int g_failures = 0;
+
+#define CHECK(expr)                                                                                \
+  do {                                                                                             \
+    if (!(expr)) {                                                                                 \
+      std::printf("%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #expr);                        \
+      ++g_failures;                                                                                \
+    }                                                                                              \
+  } while (false)
+
+// Scheduler that counts the tasks it runs, to check that a user scheduler is used.
+class CountingScheduler final : public tph::Scheduler {
+ public:
+  void Run(const std::size_t task_count, const Task& task) override {
+    for (std::size_t i = task_count; i > 0; --i) {
+      task(i - 1);
+      ++count;
+    }
+  }
+
+  std::size_t count = 0;
+};
+
+// Not a multiple of the chunk size.
+constexpr std::size_t kCount = 100003;
+
+auto MakePoints(const std::size_t n) -> std::vector<tph::float3> {
+  std::vector<tph::float3> p(n);
+  for (std::size_t i = 0; i < n; ++i) {
+    const auto f = static_cast<float>(i % 1009);
+    p[i] = {1.0F + f, 2.0F - f * 0.5F, 0.25F * f};
+  }
+  return p;
+}
+
+void TestRun(tph::Scheduler& s) {
+  // Every task runs exactly once.
+  for (const std::size_t n : {std::size_t{0}, std::size_t{1}, std::size_t{7}, std::size_t{1000}}) {
+    std::vector<std::atomic<int>> runs(n);
+    for (auto& r : runs) {
+      r = 0;
+    }
+    s.Run(n, [&runs](const std::size_t i) { ++runs[i]; });
+    bool once = true;
+    for (const auto& r : runs) {
+      once = once && r == 1;
+    }
+    CHECK(once);
+  }
+
+  // A throwing task reaches the caller, after the other started tasks have returned.
+  for (const std::size_t thrower : {std::size_t{0}, std::size_t{500}, std::size_t{999}}) {
+    std::atomic<int> unfinished{0};
+    bool caught = false;
+    try {
+      s.Run(1000, [thrower, &unfinished](const std::size_t i) {
+        ++unfinished;
+        if (i == thrower) {
+          throw std::runtime_error("task");
+        }
+        --unfinished;
+      });
+    } catch (const std::runtime_error&) {
+      caught = true;
+    }
+    CHECK(caught);
+    CHECK(unfinished == 1);
+  }
+  bool caught = false;
+  try {
+    s.Run(8, [&s](const std::size_t i) {
+      s.Run(4, [i](const std::size_t j) {
+        if (i == 5 && j == 2) {
+          throw std::runtime_error("nested task");
+        }
+      });
+    });
+  } catch (const std::runtime_error&) {
+    caught = true;
+  }
+  CHECK(caught);
+
+  // Nested Run.
+  std::atomic<int> inner{0};
+  s.Run(8, [&s, &inner](std::size_t) {
+    s.Run(4, [&inner](std::size_t) { ++inner; });
+  });
+  CHECK(inner == 32);
+}
+
+// The results must be identical for any scheduler, since the chunks depend only on the size.
+void TestOperations(tph::Scheduler& s) {
+  const auto src = MakePoints(kCount);
+  const auto m = tph::MakeMat4x4<float>(0.5F, -1.0F, 2.0F, 3.0F,   //
+                                        1.5F, 0.25F, -2.0F, -4.0F, //
+                                        1.0F, 2.0F, 0.75F, 5.0F,   //
+                                        0.1F, -0.2F, 0.05F, 2.0F);
+  tph::SerialScheduler serial;
+
+  {
+    std::vector<tph::float3> expected(kCount);
+    std::vector<tph::float3> out(kCount);
+    tph::TransformPoints(serial, m, src.data(), expected.data(), kCount);
+    tph::TransformPoints(s, m, src.data(), out.data(), kCount);
+    CHECK(out == expected);
+    tph::TransformDirections(serial, m, src.data(), expected.data(), kCount);
+    tph::TransformDirections(s, m, src.data(), out.data(), kCount);
+    CHECK(out == expected);
+    tph::ProjectPoints(serial, m, src.data(), expected.data(), kCount);
+    tph::ProjectPoints(s, m, src.data(), out.data(), kCount);
+    CHECK(out == expected);
+
+    // Same as the sequential batch function, up to the SIMD remainder of each chunk.
+    std::vector<tph::float3> batch(kCount);
+    tph::ProjectPoints(m, src.data(), batch.data(), kCount);
+    bool near = true;
+    for (std::size_t i = 0; i < kCount; ++i) {
+      near = near && tph::Distance(out[i], batch[i]) < 1e-4F * (1.0F + tph::Length(batch[i]));
+    }
+    CHECK(near);
+
+    // In-place.
+    auto inplace = src;
+    tph::ProjectPoints(s, m, inplace.data(), inplace.data(), kCount);
+    CHECK(inplace == expected);
+  }
+
+  {
+    std::vector<tph::half3> h(kCount);
+    tph::Narrow(src.data(), h.data(), kCount);
+    std::vector<tph::half3> expected(kCount);
+    std::vector<tph::half3> out(kCount);
+    tph::TransformPoints(serial, m, h.data(), expected.data(), kCount);
+    tph::TransformPoints(s, m, h.data(), out.data(), kCount);
+    CHECK(out == expected);
+    tph::ProjectPoints(serial, m, h.data(), expected.data(), kCount);
+    tph::ProjectPoints(s, m, h.data(), out.data(), kCount);
+    CHECK(out == expected);
+  }
+
+  {
+    std::vector<tph::float3> unit(kCount);
+    for (std::size_t i = 0; i < kCount; ++i) {
+      unit[i] = tph::Normalized(src[i] + tph::float3{0.0F, 0.0F, 0.5F});
+    }
+    std::vector<tph::Oct32> expected(kCount);
+    std::vector<tph::Oct32> out(kCount);
+    tph::Encode(serial, unit.data(), expected.data(), kCount);
+    tph::Encode(s, unit.data(), out.data(), kCount);
+    bool same = true;
+    for (std::size_t i = 0; i < kCount; ++i) {
+      same = same && out[i].x == expected[i].x && out[i].y == expected[i].y;
+    }
+    CHECK(same);
+    std::vector<tph::float3> expected_back(kCount);
+    std::vector<tph::float3> back(kCount);
+    tph::Decode(serial, out.data(), expected_back.data(), kCount);
+    tph::Decode(s, out.data(), back.data(), kCount);
+    CHECK(back == expected_back);
+  }
+
+  {
+    const auto b = tph::ComputeBounds(s, src.data(), kCount);
+    const auto expected = tph::ComputeBounds(src.data(), kCount);
+    CHECK(b.min == expected.min && b.max == expected.max);
+    const tph::float3 d = {0.5F, -1.0F, 0.25F};
+    CHECK(tph::MinMaxDot(s, src.data(), kCount, d) == tph::MinMaxDot(src.data(), kCount, d));
+    CHECK(tph::Centroid(s, src.data(), kCount) == tph::Centroid(serial, src.data(), kCount));
+    CHECK(tph::Distance(tph::Centroid(s, src.data(), kCount), tph::Centroid(src.data(), kCount)) <
+          1e-3F);
+    CHECK(tph::Centroid<double>(s, src.data(), kCount) ==
+          tph::Centroid<double>(serial, src.data(), kCount));
+    const auto cv = tph::Covariance(s, src.data(), kCount);
+    const auto cv_serial = tph::Covariance(serial, src.data(), kCount);
+    CHECK(cv.x == cv_serial.x && cv.y == cv_serial.y && cv.z == cv_serial.z);
+    const auto empty = tph::ComputeBounds(s, src.data(), 0);
+    CHECK(empty.min.x > empty.max.x);
+    CHECK((tph::Centroid(s, src.data(), 0) == tph::float3{0.0F, 0.0F, 0.0F}));
+  }
+
+  {
+    const auto a = tph::ToSoA(src.data(), src.size());
+    auto b = a;
+    b *= -0.5F;
+    std::vector<float> expected(kCount);
+    std::vector<float> out(kCount);
+    tph::Dot(a, b, expected.data());
+    tph::Dot(s, a, b, out.data());
+    CHECK(out == expected);
+    tph::Length(a, expected.data());
+    tph::Length(s, a, out.data());
+    CHECK(out == expected);
+
+    tph::float3SoA expected_soa;
+    tph::float3SoA out_soa;
+    tph::Normalized(a, expected_soa);
+    tph::Normalized(s, a, out_soa);
+    CHECK(out_soa.x == expected_soa.x && out_soa.y == expected_soa.y &&
+          out_soa.z == expected_soa.z);
+    tph::Cross(a, b, expected_soa);
+    tph::Cross(s, a, b, out_soa);
+    CHECK(out_soa.x == expected_soa.x && out_soa.y == expected_soa.y &&
+          out_soa.z == expected_soa.z);
+
+    // Reduction, the same bits for any scheduler.
+    const auto sum = [&a, &b](const std::size_t begin, const std::size_t end) {
+      auto r = 0.0F;
+      for (std::size_t i = begin; i < end; ++i) {
+        r += tph::Dot(tph::Get(a, i), tph::Get(b, i));
+      }
+      return r;
+    };
+    const auto add = [](const float x, const float y) { return x + y; };
+    const auto expected_sum = tph::ParallelReduce(serial, kCount, 4096, 0.0F, sum, add);
+    CHECK(tph::ParallelReduce(s, kCount, 4096, 0.0F, sum, add) == expected_sum);
+    CHECK(tph::ParallelReduce(s, 0, 4096, 1.0F, sum, add) == 1.0F);
+  }
+
+  {
+    std::vector<tph::float4x4> mats(1000, m);
+    for (std::size_t i = 0; i < mats.size(); ++i) {
+      mats[i].x.x += static_cast<float>(i) * 0.01F;
+    }
+    std::vector<tph::float4x4> expected(mats.size());
+    std::vector<tph::float4x4> out(mats.size());
+    tph::InverseMany(serial, mats.data(), expected.data(), mats.size());
+    tph::InverseMany(s, mats.data(), out.data(), mats.size());
+    tph::MulMany(s, mats.data(), out.data(), out.data(), mats.size());
+    tph::MulMany(s, m, out.data(), out.data(), mats.size());
+    bool near = true;
+    for (std::size_t i = 0; i < mats.size(); ++i) {
+      // m * mats[i] * inverse(mats[i]) = m.
+      near = near && std::abs(out[i].w.x - m.w.x) < 1e-3F && std::abs(out[i].y.z - m.y.z) < 1e-3F;
+    }
+    CHECK(near);
+  }
+
+  {
+    std::vector<tph::Mat<float, 3, 3>> sym(1000);
+    for (std::size_t i = 0; i < sym.size(); ++i) {
+      const auto t = static_cast<float>(i);
+      sym[i] = tph::MakeMat3x3<float>(2.0F + std::sin(t), 0.5F, std::cos(t), //
+                                      0.5F, -1.0F, 0.25F * t,                 //
+                                      std::cos(t), 0.25F * t, 3.0F);
+    }
+    std::vector<tph::EigenDecomposition<float, 3>> expected(sym.size());
+    std::vector<tph::EigenDecomposition<float, 3>> out(sym.size());
+    tph::EigenSymmetricMany(sym.data(), expected.data(), sym.size());
+    tph::EigenSymmetricMany(s, sym.data(), out.data(), sym.size());
+    bool same = true;
+    for (std::size_t i = 0; i < sym.size(); ++i) {
+      same = same && out[i].values == expected[i].values &&
+             out[i].vectors.x == expected[i].vectors.x && out[i].vectors.z == expected[i].vectors.z;
+    }
+    CHECK(same);
+
+    std::vector<tph::SingularValueDecomposition<float, 3>> svd_expected(sym.size());
+    std::vector<tph::SingularValueDecomposition<float, 3>> svd_out(sym.size());
+    std::vector<tph::PolarDecomposition<float, 3>> polar_expected(sym.size());
+    std::vector<tph::PolarDecomposition<float, 3>> polar_out(sym.size());
+    tph::SvdMany(sym.data(), svd_expected.data(), sym.size());
+    tph::SvdMany(s, sym.data(), svd_out.data(), sym.size());
+    tph::PolarDecomposeMany(sym.data(), polar_expected.data(), sym.size());
+    tph::PolarDecomposeMany(s, sym.data(), polar_out.data(), sym.size());
+    for (std::size_t i = 0; i < sym.size(); ++i) {
+      same = same && svd_out[i].values == svd_expected[i].values &&
+             svd_out[i].u.y == svd_expected[i].u.y && svd_out[i].v.z == svd_expected[i].v.z &&
+             polar_out[i].rotation.x == polar_expected[i].rotation.x &&
+             polar_out[i].stretch.z == polar_expected[i].stretch.z;
+    }
+    CHECK(same);
+
+    std::vector<tph::float3> rhs(sym.size(), tph::float3{1.0F, -2.0F, 0.5F});
+    std::vector<tph::LinearSolution<float, 3>> solve_expected(sym.size());
+    std::vector<tph::LinearSolution<float, 3>> solve_out(sym.size());
+    tph::SolveLUMany(sym.data(), rhs.data(), solve_expected.data(), sym.size());
+    tph::SolveLUMany(s, sym.data(), rhs.data(), solve_out.data(), sym.size());
+    for (std::size_t i = 0; i < sym.size(); ++i) {
+      same = same && solve_out[i].x == solve_expected[i].x &&
+             solve_out[i].solved == solve_expected[i].solved;
+    }
+    tph::SolveCholeskyMany(sym.data(), rhs.data(), solve_expected.data(), sym.size());
+    tph::SolveCholeskyMany(s, sym.data(), rhs.data(), solve_out.data(), sym.size());
+    for (std::size_t i = 0; i < sym.size(); ++i) {
+      same = same && solve_out[i].x == solve_expected[i].x &&
+             solve_out[i].solved == solve_expected[i].solved;
+    }
+    CHECK(same);
+  }
+
+  {
+    std::vector<tph::Quat<float>> qa(src.size());
+    std::vector<tph::Quat<float>> qb(src.size());
+    for (std::size_t i = 0; i < src.size(); ++i) {
+      qa[i] = tph::Normalized(tph::Quat<float>{src[i], 1.0F});
+      qb[i] = tph::Normalized(tph::Quat<float>{tph::float3{src[i].z, -1.0F, src[i].x}, -0.5F});
+    }
+    std::vector<tph::float3> rot_expected(src.size());
+    std::vector<tph::float3> rot_out(src.size());
+    std::vector<tph::Quat<float>> q_expected(src.size());
+    std::vector<tph::Quat<float>> q_out(src.size());
+    auto same = true;
+    tph::RotateMany(qa.data(), src.data(), rot_expected.data(), src.size());
+    tph::RotateMany(s, qa.data(), src.data(), rot_out.data(), src.size());
+    same = same && rot_out == rot_expected;
+    tph::RotateMany(qb[3], src.data(), rot_expected.data(), src.size());
+    tph::RotateMany(s, qb[3], src.data(), rot_out.data(), src.size());
+    same = same && rot_out == rot_expected;
+    tph::NlerpMany(qa.data(), qb.data(), 0.3F, q_expected.data(), src.size());
+    tph::NlerpMany(s, qa.data(), qb.data(), 0.3F, q_out.data(), src.size());
+    for (std::size_t i = 0; i < src.size(); ++i) {
+      same = same && q_out[i].v == q_expected[i].v && q_out[i].w == q_expected[i].w;
+    }
+    tph::SlerpMany(qa.data(), qb.data(), 0.3F, q_expected.data(), src.size());
+    tph::SlerpMany(s, qa.data(), qb.data(), 0.3F, q_out.data(), src.size());
+    for (std::size_t i = 0; i < src.size(); ++i) {
+      same = same && q_out[i].v == q_expected[i].v && q_out[i].w == q_expected[i].w;
+    }
+    CHECK(same);
+  }
+
+  // Strided views of the points in an interleaved buffer.
+  {
+    struct Vertex {
+      tph::float3 position;
+      tph::float3 normal;
+    };
+    std::vector<Vertex> vertices(src.size());
+    for (std::size_t i = 0; i < src.size(); ++i) {
+      vertices[i] = {src[i], src[i]};
+    }
+    auto expected = vertices;
+    const auto positions = tph::MakeStridedSpan(vertices.data(), src.size(), &Vertex::position);
+    const auto normals = tph::MakeStridedSpan(vertices.data(), src.size(), &Vertex::normal);
+    const auto expected_positions =
+        tph::MakeStridedSpan(expected.data(), src.size(), &Vertex::position);
+    const auto expected_normals =
+        tph::MakeStridedSpan(expected.data(), src.size(), &Vertex::normal);
+    tph::TransformPoints(m, tph::ToView(expected_positions), expected_positions);
+    tph::TransformPoints(s, m, tph::ToView(positions), positions);
+    tph::TransformDirections(m, tph::ToView(expected_positions), expected_normals);
+    tph::TransformDirections(s, m, tph::ToView(positions), normals);
+    tph::Normalized(tph::ToView(expected_normals), expected_normals);
+    tph::Normalized(s, tph::ToView(normals), normals);
+    auto same = true;
+    for (std::size_t i = 0; i < src.size(); ++i) {
+      same = same && vertices[i].position == expected[i].position &&
+             vertices[i].normal == expected[i].normal;
+    }
+    const auto b = tph::ComputeBounds(s, tph::ToView(positions));
+    const auto expected_b = tph::ComputeBounds(tph::ToView(expected_positions));
+    same = same && b.min == expected_b.min && b.max == expected_b.max;
+    const auto d = tph::float3{0.5F, -1.0F, 2.0F};
+    same = same && tph::MinMaxDot(s, tph::ToView(normals), d) ==
+                       tph::MinMaxDot(tph::ToView(expected_normals), d);
+    CHECK(same);
+  }
+
+  // Wide levels and a long chain, updated in full and after a few changes.
+  {
+    std::vector<std::size_t> parents(src.size());
+    // Rotations about z, so that the long chain stays finite.
+    const auto r = tph::float4x4{{0.6F, 0.8F, 0.0F, 0.0F},
+                                 {-0.8F, 0.6F, 0.0F, 0.0F},
+                                 {0.0F, 0.0F, 1.0F, 0.0F},
+                                 {0.0F, 0.0F, 0.0F, 1.0F}};
+    std::vector<tph::float4x4> local(src.size(), r);
+    for (std::size_t i = 0; i < src.size(); ++i) {
+      parents[i] = i == 0 ? tph::kNoParent : i < 1000 ? i - 1 : (i * 7919) % (i / 2);
+      local[i].w = tph::float4{src[i].x, src[i].y, src[i].z, 1.0F} * 0.01F;
+    }
+    auto expected = tph::MakeTransformHierarchy(parents.data(), local.data(), src.size());
+    auto out = expected;
+    tph::UpdateWorld(expected);
+    tph::UpdateWorld(s, out);
+    auto same = true;
+    for (const std::size_t i : {std::size_t{0}, std::size_t{2000}, src.size() - 1}) {
+      tph::SetLocal(expected, i, tph::Transpose(r));
+      tph::SetLocal(out, i, tph::Transpose(r));
+    }
+    tph::UpdateWorld(expected);
+    tph::UpdateWorld(s, out);
+    for (std::size_t i = 0; i < src.size(); ++i) {
+      same = same && out.world[i].x == expected.world[i].x &&
+             out.world[i].y == expected.world[i].y && out.world[i].z == expected.world[i].z &&
+             out.world[i].w == expected.world[i].w && out.dirty[i] == 0;
+    }
+    CHECK(same);
+  }
+}
+
+// Streaming pipeline against the same operations as separate passes over the whole array, with and
+// without a reader thread.
+void TestStream(const tph::StreamOverlap overlap) {
+  std::vector<tph::float3> src(100003);
+  for (std::size_t i = 0; i < src.size(); ++i) {
+    const auto f = static_cast<float>(i % 1013);
+    src[i] = {1.0F + f, 2.0F - f * 0.5F, 0.25F * f};
+  }
+  const auto m = tph::MakeMat4x4<float>(0.5F, -1.0F, 2.0F, 3.0F,   //
+                                        1.5F, 0.25F, -2.0F, -4.0F, //
+                                        1.0F, 2.0F, 0.75F, 5.0F,   //
+                                        0.0F, 0.0F, 0.0F, 1.0F);
+  auto expected = src;
+  const auto n = expected.size();
+  tph::TransformPoints(m, expected.data(), expected.data(), n);
+  tph::Normalized(tph::MakeStridedView<float, 3>(expected.data(), 0, sizeof(tph::float3), n),
+                  tph::MakeStridedSpan<float, 3>(expected.data(), 0, sizeof(tph::float3), n));
+  const auto expected_bounds = tph::ComputeBounds(expected.data(), n);
+
+  // Tiles that are multiples of 64 vectors split no SIMD blocks, so the results are exact.
+  for (const std::size_t tile : {std::size_t{0}, std::size_t{64}, std::size_t{960}}) {
+    std::vector<tph::float3> dst(n);
+    auto bounds = tph::ComputeBounds(src.data(), 0);
+    const auto count = tph::RunStream(
+        tph::ArraySource(src.data(), n),
+        {tph::TransformPointsStage(m), tph::NormalizedStage<float, 3>(), tph::BoundsStage(&bounds)},
+        tph::ArraySink(dst.data()), tile, overlap);
+    CHECK(count == n);
+    CHECK(dst == expected);
+    CHECK(bounds.min == expected_bounds.min && bounds.max == expected_bounds.max);
+  }
+
+  // Short reads, no stages and no sink.
+  {
+    std::vector<tph::float3> dst;
+    std::size_t i = 0;
+    const auto count = tph::RunStream<float, 3>(
+        [&src, &i](tph::float3* p, const std::size_t capacity) {
+          const auto k = std::min(src.size() - i, std::min(capacity, std::size_t{77}));
+          std::copy(src.begin() + i, src.begin() + i + k, p);
+          i += k;
+          return k;
+        },
+        {}, [&dst](const tph::float3* p, const std::size_t k) { dst.insert(dst.end(), p, p + k); },
+        100, overlap);
+    CHECK(count == src.size());
+    CHECK(dst == src);
+    auto bounds = tph::ComputeBounds(src.data(), 0);
+    const auto empty = tph::RunStream<float, 3>(tph::ArraySource(src.data(), 0),
+                                                {tph::BoundsStage(&bounds)}, nullptr, 0, overlap);
+    CHECK(empty == 0);
+    CHECK(bounds.min.x > bounds.max.x);
+  }
+
+  // Exceptions from the source, a stage or the sink, thrown at the third tile, reach the caller.
+  for (int thrower = 0; thrower < 3; ++thrower) {
+    std::size_t calls = 0;
+    const auto fail = [&calls, thrower](const int who) {
+      if (who == thrower && ++calls == 3) {
+        throw std::runtime_error("stream");
+      }
+    };
+    auto source = tph::ArraySource(src.data(), src.size());
+    auto caught = false;
+    try {
+      tph::RunStream<float, 3>(
+          [&source, &fail](tph::float3* p, const std::size_t capacity) {
+            fail(0);
+            return source(p, capacity);
+          },
+          {[&fail](tph::float3*, std::size_t) { fail(1); }},
+          [&fail](const tph::float3*, std::size_t) { fail(2); }, 1000, overlap);
+    } catch (const std::runtime_error&) {
+      caught = true;
+    }
+    CHECK(caught);
+    CHECK(calls == 3);
+  }
+}
+
+// Points in [0, 10) from a linear congruential generator, the last quarter all the same point.
+template <typename ArithT, int M>
+auto MakeCloud(const std::size_t n, std::uint32_t seed) -> std::vector<tph::Vec<ArithT, M>> {
+  std::vector<tph::Vec<ArithT, M>> v(n);
+  for (std::size_t i = 0; i < n; ++i) {
+    for (int j = 0; j < M; ++j) {
+      seed = seed * 1664525U + 1013904223U;
+      tph::tph_linalg_internal::CompRef(v[i], j) = static_cast<ArithT>(seed >> 8U) * ArithT(10) /
+                                                   static_cast<ArithT>(1U << 24U);
+    }
+    if (i >= n - n / 4) {
+      v[i] = v[0];
+    }
+  }
+  return v;
+}
+
+// Brute force neighbors of each query against the spatial index, serial and with s. Neighbors at
+// the same distance may be any of them, so the k nearest are compared by distance.
+template <typename IndexT, typename ArithT, int M>
+void CheckSpatial(tph::Scheduler& s,
+                  const IndexT& index,
+                  const std::vector<tph::Vec<ArithT, M>>& src,
+                  const std::vector<tph::Vec<ArithT, M>>& queries,
+                  const ArithT r) {
+  const std::size_t k = 7;
+  const auto nq = queries.size();
+  const auto count = std::min(k, src.size());
+  std::vector<tph::Neighbor<ArithT>> nearest(nq * k);
+  std::vector<tph::Neighbor<ArithT>> nearest_s(nq * k);
+  CHECK(tph::KNearestMany(index, queries.data(), nq, k, nearest.data()) == count);
+  CHECK(tph::KNearestMany(s, index, queries.data(), nq, k, nearest_s.data()) == count);
+  std::vector<std::size_t> offsets;
+  std::vector<std::size_t> offsets_s;
+  std::vector<tph::Neighbor<ArithT>> within;
+  std::vector<tph::Neighbor<ArithT>> within_s;
+  tph::RadiusSearchMany(index, queries.data(), nq, r, &offsets, &within);
+  tph::RadiusSearchMany(s, index, queries.data(), nq, r, &offsets_s, &within_s);
+  CHECK(offsets == offsets_s);
+  CHECK(offsets.size() == nq + 1);
+
+  auto same = offsets.size() == nq + 1 && within.size() == within_s.size();
+  for (std::size_t i = 0; same && i < within.size(); ++i) {
+    same = within[i].index == within_s[i].index && within[i].distance2 == within_s[i].distance2;
+  }
+  std::vector<tph::Neighbor<ArithT>> one(k);
+  std::vector<tph::Neighbor<ArithT>> one_within;
+  for (std::size_t i = 0; same && i < nq; ++i) {
+    const auto& q = queries[i];
+    std::vector<ArithT> d2;
+    std::vector<std::size_t> expected_within;
+    for (std::size_t j = 0; j < src.size(); ++j) {
+      d2.push_back(tph::Distance2(src[j], q));
+      if (d2.back() <= r * r) {
+        expected_within.push_back(j);
+      }
+    }
+    std::sort(d2.begin(), d2.end());
+    same = tph::KNearest(index, q, k, one.data()) == count;
+    for (std::size_t j = 0; same && j < count; ++j) {
+      const auto& a = nearest[i * k + j];
+      const auto& b = nearest_s[i * k + j];
+      same = a.distance2 == d2[j] && tph::Distance2(src[a.index], q) == a.distance2 &&
+             b.index == a.index && b.distance2 == a.distance2 && one[j].index == a.index;
+    }
+
+    std::vector<std::size_t> found;
+    for (auto j = offsets[i]; j < offsets[i + 1]; ++j) {
+      same = same && tph::Distance2(src[within[j].index], q) == within[j].distance2;
+      found.push_back(within[j].index);
+    }
+    std::sort(found.begin(), found.end());
+    one_within.clear();
+    tph::RadiusSearch(index, q, r, &one_within);
+    same = same && found == expected_within && one_within.size() == found.size();
+  }
+  CHECK(same);
+}
+
+template <typename ArithT, int M>
+void TestSpatial(tph::Scheduler& s) {
+  const auto src = MakeCloud<ArithT, M>(5003, 1);
+  auto queries = MakeCloud<ArithT, M>(301, 2);
+  queries.push_back(src[0]);
+  queries.push_back(src[1]);
+  queries.push_back(queries[0] * ArithT(20));  // Far outside.
+  queries.push_back(queries[1] * ArithT(-3));
+  const auto r = ArithT(M == 2 ? 0.3 : 0.7);
+
+  CheckSpatial(s, tph::MakeKdTree(src.data(), src.size()), src, queries, r);
+  CheckSpatial(s, tph::MakeKdTree(s, src.data(), src.size()), src, queries, r);
+  CheckSpatial(s, tph::MakeHashedGrid(src.data(), src.size(), ArithT(0.5)), src, queries, r);
+  CheckSpatial(s, tph::MakeHashedGrid(s, src.data(), src.size(), ArithT(0.5)), src, queries, r);
+  // Cells much smaller and much larger than the distances queried.
+  CheckSpatial(s, tph::MakeHashedGrid(s, src.data(), src.size(), ArithT(0.05)), src, queries, r);
+  CheckSpatial(s, tph::MakeHashedGrid(s, src.data(), src.size(), ArithT(20)), src, queries, r);
+
+  // Built the same serially and in parallel.
+  const auto a = tph::MakeKdTree(src.data(), src.size());
+  const auto b = tph::MakeKdTree(s, src.data(), src.size());
+  CHECK(a.index == b.index && a.split == b.split && a.leaf_begin == b.leaf_begin);
+  const auto c = tph::MakeHashedGrid(src.data(), src.size(), ArithT(0.5));
+  const auto d = tph::MakeHashedGrid(s, src.data(), src.size(), ArithT(0.5));
+  CHECK(c.index == d.index && c.bucket_begin == d.bucket_begin);
+  CHECK(c.cell_min == d.cell_min && c.cell_max == d.cell_max);
+
+  // Fewer points than neighbors, and none.
+  const std::vector<tph::Vec<ArithT, M>> few(src.begin(), src.begin() + 5);
+  CheckSpatial(s, tph::MakeKdTree(s, few.data(), few.size()), few, queries, r);
+  CheckSpatial(s, tph::MakeHashedGrid(s, few.data(), few.size(), ArithT(0.5)), few, queries, r);
+  const std::vector<tph::Vec<ArithT, M>> none;
+  CheckSpatial(s, tph::MakeKdTree(s, none.data(), 0), none, queries, r);
+  CheckSpatial(s, tph::MakeHashedGrid(s, none.data(), 0, ArithT(0.5)), none, queries, r);
+}
+
+// Keys of known cells, orders serial and parallel against the keys.
+template <typename KeyT>
+void TestSpatialSort(tph::Scheduler& s) {
+  using tph::SpatialCurve;
+  const auto top = static_cast<float>((std::uint64_t{1} << (sizeof(KeyT) == 4 ? 10 : 21)) - 1);
+  const tph::Aabb<float, 3> cube = {{0.0F, 0.0F, 0.0F}, {top, top, top}};
+  const std::vector<tph::float3> corners = {{0.0F, 0.0F, 0.0F}, {1.0F, 0.0F, 0.0F},
+                                            {0.0F, 1.0F, 0.0F}, {0.0F, 0.0F, 1.0F},
+                                            {top, top, top},    {-5.0F, 2.0F * top, 0.0F}};
+  std::vector<KeyT> keys(corners.size());
+  tph::SpatialKeys(corners.data(), corners.size(), cube, SpatialCurve::kMorton, keys.data());
+  const auto all = static_cast<KeyT>((KeyT{1} << (sizeof(KeyT) == 4 ? 30 : 63)) - 1);
+  CHECK(keys[0] == 0 && keys[1] == 1 && keys[2] == 2 && keys[3] == 4 && keys[4] == all);
+  CHECK(keys[5] == static_cast<KeyT>(all / 7 * 2)); // Clamped to x = 0, y = top.
+
+  // The first 8^3 cells along the Hilbert curve are the cube of side 8 at the origin, each a step
+  // from the one before.
+  std::vector<tph::float3> cells;
+  for (int i = 0; i < 512; ++i) {
+    cells.push_back({static_cast<float>(i % 8), static_cast<float>(i / 8 % 8),
+                     static_cast<float>(i / 64)});
+  }
+  keys.resize(cells.size());
+  tph::SpatialKeys(cells.data(), cells.size(), cube, SpatialCurve::kHilbert, keys.data());
+  std::vector<std::size_t> at(512, 512);
+  for (std::size_t i = 0; i < keys.size(); ++i) {
+    CHECK(keys[i] < 512);
+    at[keys[i] < 512 ? keys[i] : 0] = i;
+  }
+  auto steps = true;
+  for (std::size_t i = 1; steps && i < at.size(); ++i) {
+    steps = at[i] < 512 && at[i - 1] < 512 &&
+            tph::Distance2(cells[at[i]], cells[at[i - 1]]) == 1.0F;
+  }
+  CHECK(steps);
+
+  const auto src = MakeCloud<float, 3>(100003, 3);
+  const auto bounds = tph::ComputeBounds(src.data(), src.size());
+  keys.resize(src.size());
+  for (const auto curve : {SpatialCurve::kMorton, SpatialCurve::kHilbert}) {
+    tph::SpatialKeys(src.data(), src.size(), bounds, curve, keys.data());
+    const auto perm = tph::SpatialSort<KeyT>(src.data(), src.size(), curve);
+    CHECK(perm == tph::SpatialSort<KeyT>(s, src.data(), src.size(), curve));
+    std::vector<std::size_t> sorted(perm);
+    std::sort(sorted.begin(), sorted.end());
+    auto ordered = perm.size() == src.size();
+    for (std::size_t i = 0; ordered && i < sorted.size(); ++i) {
+      ordered = sorted[i] == i;
+    }
+    for (std::size_t i = 1; ordered && i < perm.size(); ++i) {
+      const auto a = keys[perm[i - 1]];
+      const auto b = keys[perm[i]];
+      ordered = a < b || (a == b && perm[i - 1] < perm[i]);
+    }
+    CHECK(ordered);
+
+    std::vector<tph::float3> dst(src.size());
+    std::vector<tph::float3> dst_s(src.size());
+    tph::ApplyPermutation(perm, src.data(), dst.data());
+    tph::ApplyPermutation(s, perm, src.data(), dst_s.data());
+    CHECK(dst == dst_s);
+    CHECK(dst[0] == src[perm[0]] && dst.back() == src[perm.back()]);
+  }
+  CHECK(tph::SpatialSort<KeyT>(s, src.data(), 0).empty());
+  CHECK(tph::SpatialSort<KeyT>(src.data(), 1) == std::vector<std::size_t>{0});
+}
+
+// True if two tasks of a run are running at the same time, each waits up to 10 s for the other.
+auto RunsConcurrently(tph::Scheduler& s) -> bool {
+  std::atomic<int> started{0};
+  std::atomic<int> met{0};
+  s.Run(2, [&started, &met](std::size_t) {
+    ++started;
+    const auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(10);
+    while (started < 2 && std::chrono::steady_clock::now() < deadline) {
+      std::this_thread::yield();
+    }
+    if (started == 2) {
+      ++met;
+    }
+  });
+  return met == 2;
+}
+
+} // namespace
+
+int main(int /*argc*/, char* /*argv*/[]) {
+  tph::SerialScheduler serial;
+  TestRun(serial);
+  TestOperations(serial);
+
+  CountingScheduler counting;
+  TestOperations(counting);
+  CHECK(counting.count > 0);
+
+  for (const unsigned threads : {1U, 2U, 4U, 7U, 0U}) {
+    tph::ThreadPool pool(threads);
+    CHECK(pool.ThreadCount() >= 1);
+    TestRun(pool);
+    // Throwing tasks in TestRun leave the pool running tasks concurrently.
+    CHECK(pool.ThreadCount() == 1 || RunsConcurrently(pool));
+    TestOperations(pool);
+    // Many short runs, to catch races between consecutive runs.
+    std::atomic<std::size_t> total{0};
+    for (int r = 0; r < 2000; ++r) {
+      pool.Run(3, [&total](std::size_t) { ++total; });
+    }
+    CHECK(total == 6000);
+  }
+
+  TestStream(tph::StreamOverlap::kAlways);
+  TestStream(tph::StreamOverlap::kNever);
+
+  TestSpatial<float, 3>(serial);
+  TestSpatial<double, 2>(serial);
+  tph::ThreadPool pool(4);
+  TestSpatial<float, 3>(pool);
+  TestSpatial<double, 2>(pool);
+  TestSpatialSort<std::uint32_t>(pool);
+  TestSpatialSort<std::uint64_t>(pool);
+
+  return g_failures == 0 ? 0 : 1;
+}
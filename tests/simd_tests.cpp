@@ -0,0 +1,297 @@
+// Copyright (C) Tommy Hinks <tommy.hinks@gmail.com>
+// This file is subject to the license terms in the LICENSE file
+// found in the top-level directory of this distribution.
+
+#include <cmath> // std::abs, std::cos, std::sin
+#include <cstdio>
+#include <limits>
+#include <random>
+#include <vector>
+
+#include <tph/tph_linalg_simd.hpp>
+
+namespace {
+
+int g_failures = 0;
+
+#define CHECK(expr)                                                                                \
+  do {                                                                                             \
+    if (!(expr)) {                                                                                 \
+      std::printf("%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #expr);                        \
+      ++g_failures;                                                                                \
+    }                                                                                              \
+  } while (false)
+
+// Run-time paths (hardware sqrt/rsqrt) give the same results as the scalar functions, lane by lane.
+template <typename PacketT>
+void TestPacket() {
+  using T = typename PacketT::value_type;
+  constexpr auto kN = PacketT::kSize;
+  constexpr auto kTail = kN > 3 ? 3 : 1;
+
+  std::vector<tph::Vec<T, 3>> src(kN + kTail);
+  for (std::size_t i = 0; i < src.size(); ++i) {
+    const auto f = static_cast<T>(i);
+    src[i] = {T(1) + f, T(2) - f * T(0.5), T(0.25) * f};
+  }
+
+  // Full packet and partial (tail) packet.
+  const auto a = tph::simd::LoadVec<PacketT>(src.data());
+  const auto b = tph::simd::LoadVec<PacketT>(src.data() + kN, kTail);
+
+  const auto len = tph::Length(a);
+  const auto inv_len = tph::InvLength(a);
+  const auto n = tph::NormalizedFast(a);
+  const auto c = tph::Cross(a, b);
+  for (int i = 0; i < kN; ++i) {
+    const auto& s = src[static_cast<std::size_t>(i)];
+    CHECK(len[i] == tph::Length(s));
+    CHECK(std::abs(inv_len[i] - tph::InvLength(s)) <= T(5e-7) * tph::InvLength(s));
+    CHECK(std::abs(n.x[i] - tph::NormalizedFast(s).x) <= T(1e-6));
+    const auto sb = i < kTail ? src[static_cast<std::size_t>(kN + i)] : tph::Vec<T, 3>{};
+    CHECK((tph::Vec<T, 3>{c.x[i], c.y[i], c.z[i]} == tph::Cross(s, sb)));
+  }
+
+  std::vector<tph::Vec<T, 3>> dst(kN + kTail);
+  tph::simd::StoreVec(a, dst.data());
+  tph::simd::StoreVec(b, dst.data() + kN, kTail);
+  for (std::size_t i = 0; i < src.size(); ++i) {
+    CHECK(dst[i] == src[i]);
+  }
+}
+
+// Ray/triangle and ray/box tests against hand-computed cases, one ray against N primitives and N
+// rays against one primitive lane by lane.
+template <typename PacketT>
+void TestIntersect() {
+  using T = typename PacketT::value_type;
+  using Vec3 = tph::Vec<T, 3>;
+  using tph::simd::BroadcastVec;
+  constexpr auto kN = PacketT::kSize;
+  const auto inf = std::numeric_limits<T>::infinity();
+
+  // A square in the plane z = 1 split into two triangles along its diagonal, then a fan of N
+  // triangles around the origin of the plane z = 2, both tested with rays in all directions.
+  const Vec3 p0 = {0, 0, 1};
+  const Vec3 p1 = {1, 0, 1};
+  const Vec3 p2 = {1, 1, 1};
+  const Vec3 p3 = {0, 1, 1};
+  std::vector<Vec3> a(kN, p0);
+  std::vector<Vec3> b(kN, p1);
+  std::vector<Vec3> c(kN, p2);
+  a[1] = p0;
+  b[1] = p2;
+  c[1] = p3;
+  const auto pa = tph::simd::LoadVec<PacketT>(a.data());
+  const auto pb = tph::simd::LoadVec<PacketT>(b.data());
+  const auto pc = tph::simd::LoadVec<PacketT>(c.data());
+  // Through the inside of triangle 0, the shared edge, a shared vertex, outside, and backwards.
+  const Vec3 o = {T(0.25), T(0.25), T(-1)};
+  for (const auto& target : {Vec3{T(0.75), T(0.25), T(1)}, Vec3{T(0.5), T(0.5), T(1)},
+                             Vec3{T(0), T(0), T(1)}, Vec3{T(2), T(0.5), T(1)}}) {
+    for (const auto sign : {T(1), T(-1)}) {
+      const auto d = (target - o) * sign;
+      const auto h = tph::simd::IntersectRayTriangle(o, d, pa, pb, pc);
+      const auto inside = target.x <= T(1);
+      CHECK(h.hit[0] == (inside && sign > 0));
+      CHECK(Any(h.hit) == (inside && sign > 0));
+      if (sign < 0) {
+        continue;
+      }
+      const auto nearest = tph::simd::NearestHit(h.hit, h.t);
+      CHECK(inside ? nearest >= 0 : nearest == -1);
+      if (nearest >= 0) {
+        const auto i = static_cast<std::size_t>(nearest);
+        CHECK(std::abs(h.t[nearest] - T(1)) <= T(1e-6));
+        const auto w = tph::Vec<T, 3>{1 - h.u[nearest] - h.v[nearest], h.u[nearest], h.v[nearest]};
+        const auto hit = a[i] * w.x + b[i] * w.y + c[i] * w.z;
+        CHECK(tph::Distance2(hit, target) <= T(1e-10));
+      }
+      // Beyond t_max.
+      CHECK(!Any(tph::simd::IntersectRayTriangle(o, d, pa, pb, pc, T(0.5)).hit));
+    }
+  }
+
+  // Each ray through a vertex or edge of the fan hits at least one triangle, as lanes of one ray
+  // and as a packet of rays against each triangle.
+  std::vector<Vec3> fa(kN);
+  std::vector<Vec3> fb(kN);
+  std::vector<Vec3> fc(kN);
+  std::vector<Vec3> rim(kN);
+  for (int i = 0; i < kN; ++i) {
+    const auto angle = T(6.283185307179586) * static_cast<T>(i) / static_cast<T>(kN);
+    rim[static_cast<std::size_t>(i)] = {T(3) * std::cos(angle), T(2) * std::sin(angle), T(2)};
+  }
+  for (std::size_t i = 0; i < rim.size(); ++i) {
+    fa[i] = {T(0.125), T(-0.375), T(2)};
+    fb[i] = rim[i];
+    fc[i] = rim[(i + 1) % rim.size()];
+  }
+  const auto fpa = tph::simd::LoadVec<PacketT>(fa.data());
+  const auto fpb = tph::simd::LoadVec<PacketT>(fb.data());
+  const auto fpc = tph::simd::LoadVec<PacketT>(fc.data());
+  std::vector<Vec3> targets = {fa[0]};
+  for (std::size_t i = 0; i < rim.size(); ++i) {
+    targets.push_back(fa[0] + (rim[i] - fa[0]) * T(0.3));
+  }
+  auto watertight = true;
+  for (const auto& origin : {Vec3{T(0.3), T(0.1), T(-5)}, Vec3{T(-7), T(4), T(9)}}) {
+    std::vector<Vec3> origins(kN, origin);
+    std::vector<Vec3> dirs(kN);
+    for (std::size_t t = 0; t < targets.size(); ++t) {
+      const auto d = targets[t] - origin;
+      watertight = watertight && Any(tph::simd::IntersectRayTriangle(origin, d, fpa, fpb, fpc).hit);
+      dirs[t % dirs.size()] = d;
+    }
+    const auto po = tph::simd::LoadVec<PacketT>(origins.data());
+    const auto pd = tph::simd::LoadVec<PacketT>(dirs.data());
+    for (std::size_t i = 0; i < fa.size(); ++i) {
+      const auto h = tph::simd::IntersectRayTriangle(po, pd, BroadcastVec<PacketT>(fa[i]),
+                                                     BroadcastVec<PacketT>(fb[i]),
+                                                     BroadcastVec<PacketT>(fc[i]));
+      for (int lane = 0; lane < kN; ++lane) {
+        const auto& d = dirs[static_cast<std::size_t>(lane)];
+        const auto one = tph::simd::IntersectRayTriangle(origin, d, fpa, fpb, fpc);
+        CHECK(h.hit[lane] == one.hit[static_cast<int>(i)]);
+      }
+    }
+  }
+  CHECK(watertight);
+
+  // Boxes [i, i + 1] along x, a ray along x through all, one in the plane of their faces, one that
+  // starts inside the third box, and one that misses.
+  std::vector<Vec3> lo(kN);
+  std::vector<Vec3> hi(kN);
+  for (int i = 0; i < kN; ++i) {
+    lo[static_cast<std::size_t>(i)] = {static_cast<T>(i), T(0), T(0)};
+    hi[static_cast<std::size_t>(i)] = {static_cast<T>(i + 1), T(1), T(1)};
+  }
+  const auto plo = tph::simd::LoadVec<PacketT>(lo.data());
+  const auto phi = tph::simd::LoadVec<PacketT>(hi.data());
+  const auto along = tph::simd::IntersectRayBox(Vec3{T(-1), T(0.5), T(0.5)}, Vec3{T(1), inf, inf},
+                                                plo, phi);
+  CHECK(All(along.hit));
+  CHECK(along.t_near[kN - 1] == static_cast<T>(kN));
+  CHECK(along.t_far[kN - 1] == static_cast<T>(kN + 1));
+  CHECK(tph::simd::NearestHit(along.hit, along.t_near) == 0);
+  CHECK(All(tph::simd::IntersectRayBox(Vec3{T(-1), T(0), T(1)}, Vec3{T(1), inf, inf}, plo, phi)
+                .hit));
+  const auto inside = tph::simd::IntersectRayBox(Vec3{T(2.5), T(0.5), T(0.5)},
+                                                 Vec3{T(-1), inf, inf}, plo, phi);
+  CHECK(inside.hit[0] && inside.hit[2] && inside.t_near[2] == T(0) && inside.t_far[2] == T(0.5));
+  CHECK(!inside.hit[kN - 1]);
+  const auto short_ray = tph::simd::IntersectRayBox(Vec3{T(-1), T(0.5), T(0.5)},
+                                                    Vec3{T(1), inf, inf}, plo, phi, T(1.5));
+  CHECK(short_ray.hit[0] && !short_ray.hit[1]);
+  CHECK(!Any(tph::simd::IntersectRayBox(Vec3{T(-1), T(1.5), T(0.5)},
+                                        Vec3{T(1), inf, inf}, plo, phi).hit));
+  // Diagonal rays as a packet against one box.
+  std::vector<Vec3> origins(kN);
+  std::vector<Vec3> inv_dirs(kN);
+  for (int i = 0; i < kN; ++i) {
+    origins[static_cast<std::size_t>(i)] = {T(-1), T(-1), static_cast<T>(i) - T(1)};
+    inv_dirs[static_cast<std::size_t>(i)] = {T(1), T(1), inf};
+  }
+  const auto diagonal = tph::simd::IntersectRayBox(
+      tph::simd::LoadVec<PacketT>(origins.data()), tph::simd::LoadVec<PacketT>(inv_dirs.data()),
+      BroadcastVec<PacketT>(lo[0]), BroadcastVec<PacketT>(hi[0]));
+  for (int i = 0; i < kN; ++i) {
+    CHECK(diagonal.hit[i] == (i >= 1 && i <= 2));
+  }
+}
+
+// Rays through the inner vertices and edges of a jittered, non-planar grid of triangles each hit at
+// least one triangle, for float and double packets, with and without fused multiply-add. The grid
+// is flat enough for the rays not to graze it.
+template <typename PacketT>
+void TestWatertightMesh() {
+  using T = typename PacketT::value_type;
+  using Vec3 = tph::Vec<T, 3>;
+  constexpr auto kN = PacketT::kSize;
+  constexpr int kG = 8;
+  std::mt19937 rng(2013);
+  std::uniform_real_distribution<T> jitter(T(-0.3), T(0.3));
+  std::uniform_real_distribution<T> height(T(2.95), T(3.05));
+  std::vector<Vec3> grid;
+  for (int y = 0; y <= kG; ++y) {
+    for (int x = 0; x <= kG; ++x) {
+      const auto border = x == 0 || y == 0 || x == kG || y == kG;
+      grid.push_back({static_cast<T>(x) + (border ? T(0) : jitter(rng)),
+                      static_cast<T>(y) + (border ? T(0) : jitter(rng)), height(rng)});
+    }
+  }
+  const auto at = [&grid](const int x, const int y) -> const Vec3& {
+    return grid[static_cast<std::size_t>(y * (kG + 1) + x)];
+  };
+  std::vector<Vec3> a;
+  std::vector<Vec3> b;
+  std::vector<Vec3> c;
+  for (int y = 0; y < kG; ++y) {
+    for (int x = 0; x < kG; ++x) {
+      a.insert(a.end(), {at(x, y), at(x + 1, y + 1)});
+      b.insert(b.end(), {at(x + 1, y), at(x, y + 1)});
+      c.insert(c.end(), {at(x + 1, y + 1), at(x, y)});
+    }
+  }
+  while (a.size() % kN != 0) {
+    a.push_back(a.back());
+    b.push_back(b.back());
+    c.push_back(c.back());
+  }
+
+  // Targets on the inner vertices and edges, the edges at random fractions away from the border.
+  std::vector<Vec3> targets;
+  std::uniform_real_distribution<T> fraction(T(0), T(0.9));
+  for (int y = 1; y < kG; ++y) {
+    for (int x = 1; x < kG; ++x) {
+      targets.push_back(at(x, y));
+      for (int k = 0; k < 8; ++k) {
+        const auto f = fraction(rng);
+        targets.push_back(at(x, y) + (at(x + 1, y) - at(x, y)) * f);
+        targets.push_back(at(x, y) + (at(x, y + 1) - at(x, y)) * f);
+        targets.push_back(at(x, y) + (at(x - 1, y - 1) - at(x, y)) * f);
+      }
+    }
+  }
+  std::size_t misses = 0;
+  for (const auto& origin : {Vec3{T(0.3), T(0.1), T(-5)}, Vec3{T(-3), T(4), T(12)},
+                             Vec3{T(4.1), T(3.7), T(-1.3)}}) {
+    for (const auto& target : targets) {
+      const auto d = target - origin;
+      auto hit = false;
+      for (std::size_t i = 0; i < a.size(); i += kN) {
+        hit = hit || Any(tph::simd::IntersectRayTriangle(
+                         origin, d, tph::simd::LoadVec<PacketT>(&a[i]),
+                         tph::simd::LoadVec<PacketT>(&b[i]), tph::simd::LoadVec<PacketT>(&c[i]))
+                         .hit);
+      }
+      misses += hit ? 0 : 1;
+    }
+  }
+  CHECK(misses == 0);
+}
+
+} // namespace
+
+int main(int /*argc*/, char* /*argv*/[]) {
+  // Built with fused multiply-add as simd_tests_fma, see CMakeLists.txt.
+#if defined(__FMA__)
+  if (!__builtin_cpu_supports("avx2") || !__builtin_cpu_supports("fma")) {
+    std::printf("skipped, no FMA\n");
+    return 77;
+  }
+#endif
+  TestPacket<tph::simd::f32x4>();
+  TestPacket<tph::simd::f32x8>();
+  TestPacket<tph::simd::f32x16>();
+  TestPacket<tph::simd::f64x2>();
+  TestPacket<tph::simd::f64x4>();
+  TestIntersect<tph::simd::f32x4>();
+  TestIntersect<tph::simd::f32x8>();
+  TestIntersect<tph::simd::f32x16>();
+  TestIntersect<tph::simd::f64x4>();
+  TestWatertightMesh<tph::simd::f32x8>();
+  TestWatertightMesh<tph::simd::f64x2>();
+  TestWatertightMesh<tph::simd::f64x4>();
+  return g_failures == 0 ? 0 : 1;
+}
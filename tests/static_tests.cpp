@@ -6,7 +6,9 @@
 #include <type_traits>
 
 #include <tph/tph_linalg.hpp>
+#include <tph/tph_linalg_simd.hpp>
 
+#define HAS_CPP14 (__cplusplus >= 201402L)
 #define HAS_CPP17 (__cplusplus >= 201703L)
 //#define HAS_CPP20 (__cplusplus >= 202002L)
 
@@ -20,6 +22,49 @@ static constexpr auto ce_abs(const ArithT x) noexcept -> ArithT {
                         : x);
 }
 
+template <typename ArithT, int M>
+static constexpr auto MatEq(const tph::Mat<ArithT, M, 2>& a, const tph::Mat<ArithT, M, 2>& b) noexcept
+    -> bool {
+  return a.x == b.x && a.y == b.y;
+}
+
+template <typename ArithT, int M>
+static constexpr auto MatEq(const tph::Mat<ArithT, M, 3>& a, const tph::Mat<ArithT, M, 3>& b) noexcept
+    -> bool {
+  return a.x == b.x && a.y == b.y && a.z == b.z;
+}
+
+template <typename ArithT, int M>
+static constexpr auto MatEq(const tph::Mat<ArithT, M, 4>& a, const tph::Mat<ArithT, M, 4>& b) noexcept
+    -> bool {
+  return a.x == b.x && a.y == b.y && a.z == b.z && a.w == b.w;
+}
+
+// Apply an affine transform to a point.
+template <typename ArithT>
+static constexpr auto Apply(const tph::Mat<ArithT, 3, 4>& m, const tph::Vec<ArithT, 3>& p) noexcept
+    -> tph::Vec<ArithT, 3> {
+  return m.x * p.x + m.y * p.y + m.z * p.z + m.w;
+}
+
+#if HAS_CPP14 // Packet operations are constexpr from C++14.
+// Broadcast a vector to all lanes of a vector of packets.
+template <typename PacketT, typename ArithT>
+static constexpr auto Splat(const tph::Vec<ArithT, 2>& a) noexcept -> tph::Vec<PacketT, 2> {
+  return {PacketT(a.x), PacketT(a.y)};
+}
+
+template <typename PacketT, typename ArithT>
+static constexpr auto Splat(const tph::Vec<ArithT, 3>& a) noexcept -> tph::Vec<PacketT, 3> {
+  return {PacketT(a.x), PacketT(a.y), PacketT(a.z)};
+}
+
+template <typename PacketT, typename ArithT>
+static constexpr auto Splat(const tph::Vec<ArithT, 4>& a) noexcept -> tph::Vec<PacketT, 4> {
+  return {PacketT(a.x), PacketT(a.y), PacketT(a.z), PacketT(a.w)};
+}
+#endif // HAS_CPP14
+
 int main(int /*argc*/, char* /*argv*/[]) {
   static_assert(sizeof(tph::Vec<float, 2>) == 2 * sizeof(float), "");
   static_assert(sizeof(tph::Vec<float, 3>) == 3 * sizeof(float), "");
@@ -33,6 +78,25 @@ int main(int /*argc*/, char* /*argv*/[]) {
   static_assert(a3.x == 1.0F && a3.y == 2.0F && a3.z == 3.0F, "");
   static_assert(a4.x == 1.0F && a4.y == 2.0F && a4.z == 3.0F && a4.w == 4.0F, "");
 
+  // Indexing, by a selection in constant expressions. The layout stays that of an array.
+  static_assert(a2[0] == 1.0F && a2[1] == 2.0F, "");
+  static_assert(a3[0] == 1.0F && a3[1] == 2.0F && a3[2] == 3.0F, "");
+  static_assert(a4[0] == 1.0F && a4[1] == 2.0F && a4[2] == 3.0F && a4[3] == 4.0F, "");
+  static_assert(tph::Comp(a4, 2) == 3.0F, "");
+  static_assert(std::is_standard_layout<tph::Vec<float, 3>>::value &&
+                    std::is_trivially_copyable<tph::Vec<float, 3>>::value,
+                "");
+  static_assert(std::is_standard_layout<tph::Mat<double, 3, 4>>::value &&
+                    std::is_trivially_copyable<tph::Mat<double, 3, 4>>::value,
+                "");
+  static_assert(sizeof(tph::Mat<float, 3, 4>) == 12 * sizeof(float), "");
+  {
+    constexpr auto m23 = tph::Mat<int, 2, 3>{{1, 4}, {2, 5}, {3, 6}};
+    static_assert(m23[0] == tph::Vec<int, 2>{1, 4} && m23[2] == tph::Vec<int, 2>{3, 6}, "");
+    static_assert(m23[1][1] == 5 && tph::Col(m23, 1) == tph::Vec<int, 2>{2, 5}, "");
+    static_assert(tph::Row(m23, 1) == tph::Vec<int, 3>{4, 5, 6}, "");
+  }
+
   // Default initialization.
   {
     constexpr tph::Vec<float, 2> a2_0 = {};
@@ -124,6 +188,200 @@ int main(int /*argc*/, char* /*argv*/[]) {
     static_assert(tph::Normalized(a4) == (a4 * (1.0F / tph::Length(a4))), "");
   }
 
+  // Reciprocal length.
+  {
+    constexpr auto kInvSqrt5 = 0.4472135955F;
+    constexpr auto kInvSqrt14 = 0.2672612419F;
+    constexpr auto kInvSqrt30 = 0.1825741858F;
+    static_assert(ce_abs(tph::InvLength(a2) - kInvSqrt5) < 1e-6F, "");
+    static_assert(ce_abs(tph::InvLength(a3) - kInvSqrt14) < 1e-6F, "");
+    static_assert(ce_abs(tph::InvLength(a4) - kInvSqrt30) < 1e-6F, "");
+  }
+
+  // Normalized (fast).
+  {
+    static_assert(tph::NormalizedFast(a2) == (a2 * tph::InvLength(a2)), "");
+    static_assert(tph::NormalizedFast(a3) == (a3 * tph::InvLength(a3)), "");
+    static_assert(tph::NormalizedFast(a4) == (a4 * tph::InvLength(a4)), "");
+    static_assert(ce_abs(tph::Length(tph::NormalizedFast(a3)) - 1.0F) < 1e-6F, "");
+  }
+
+  // Transpose.
+  {
+    constexpr auto m23 = tph::Mat<int, 2, 3>{{1, 4}, {2, 5}, {3, 6}};
+    static_assert(MatEq(tph::Transpose(m23), tph::Mat<int, 3, 2>{{1, 2, 3}, {4, 5, 6}}), "");
+    static_assert(MatEq(tph::Transpose(tph::Transpose(m23)), m23), "");
+    constexpr auto m44 = tph::MakeMat4x4<int>(1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15, 16);
+    static_assert(
+        MatEq(tph::Transpose(m44),
+              tph::MakeMat4x4<int>(1, 5, 9, 13, 2, 6, 10, 14, 3, 7, 11, 15, 4, 8, 12, 16)),
+        "");
+  }
+
+  // Matrix/matrix multiplication.
+  {
+    constexpr auto m23 = tph::Mat<int, 2, 3>{{1, 4}, {2, 5}, {3, 6}};
+    static_assert(
+        MatEq(tph::Mul(m23, tph::Transpose(m23)), tph::Mat<int, 2, 2>{{14, 32}, {32, 77}}), "");
+    static_assert(MatEq(tph::Mul(tph::Transpose(m23), m23),
+                        tph::Mat<int, 3, 3>{{17, 22, 27}, {22, 29, 36}, {27, 36, 45}}),
+                  "");
+    constexpr auto m44 =
+        tph::MakeMat4x4<int>(1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15, 16);
+    static_assert(MatEq(tph::Mul(m44, tph::Identity4x4<int>()), m44), "");
+    static_assert(MatEq(tph::Mul(tph::Identity4x4<int>(), m44), m44), "");
+    // (a * b) * v == a * (b * v) for mixed sizes.
+    constexpr auto m34 = tph::Mat<int, 3, 4>{{1, 0, 2}, {-1, 3, 1}, {0, 2, 0}, {4, -2, 1}};
+    constexpr auto m42 = tph::Mat<int, 4, 2>{{1, 2, 0, -1}, {3, 0, 1, 2}};
+    constexpr auto v2 = tph::Vec<int, 2>{2, -3};
+    static_assert(tph::Mul(tph::Mul(m34, m42), v2) == tph::Mul(m34, tph::Mul(m42, v2)), "");
+    static_assert(tph::Mul(tph::Mul(m23, m34), tph::Vec<int, 4>{1, 2, 3, 4}) ==
+                      tph::Mul(m23, tph::Mul(m34, tph::Vec<int, 4>{1, 2, 3, 4})),
+                  "");
+  }
+
+  // Determinant and inverse. The matrices have exactly representable inverses.
+  {
+    constexpr auto m2 = tph::MakeMat2x2<double>(2, 1, //
+                                                1, 1);
+    constexpr auto m3 = tph::MakeMat3x3<double>(1, 2, 0, //
+                                                0, 1, 0, //
+                                                3, 0, 2);
+    constexpr auto m4 = tph::MakeMat4x4<double>(1, 1, 0, 0, //
+                                                0, 1, 0, 3, //
+                                                0, 0, 2, 1, //
+                                                1, 0, 0, 1);
+    static_assert(tph::Determinant(m2) == 1.0, "");
+    static_assert(tph::Determinant(m3) == 2.0, "");
+    static_assert(tph::Determinant(m4) == 8.0, "");
+    static_assert(tph::Determinant(tph::Identity4x4<double>()) == 1.0, "");
+    static_assert(MatEq(tph::Inverse(m2), tph::MakeMat2x2<double>(1, -1, -1, 2)), "");
+    static_assert(MatEq(tph::Inverse(m3),
+                        tph::MakeMat3x3<double>(1, -2, 0, //
+                                                0, 1, 0,  //
+                                                -1.5, 3, 0.5)),
+                  "");
+    static_assert(MatEq(tph::Inverse(m4),
+                        tph::MakeMat4x4<double>(0.25, -0.25, 0, 0.75, //
+                                                0.75, 0.25, 0, -0.75, //
+                                                0.125, -0.125, 0.5, -0.125, //
+                                                -0.25, 0.25, 0, 0.25)),
+                  "");
+    static_assert(MatEq(tph::Inverse(tph::Inverse(m4)), m4), "");
+    static_assert(MatEq(tph::Mul(m4, tph::Inverse(m4)), tph::Identity4x4<double>()), "");
+  }
+
+  // Inverse of affine and rigid transforms.
+  {
+    constexpr auto p = tph::double3{1, -2, 3};
+    constexpr auto affine = tph::Mat<double, 3, 4>{{2, 0, 0}, {1, 4, 0}, {0, 0, 0.5}, {1, 2, 3}};
+    static_assert(Apply(tph::InverseAffine(affine), Apply(affine, p)) == p, "");
+    constexpr auto rigid = tph::Mat<double, 3, 4>{{0, 1, 0}, {-1, 0, 0}, {0, 0, 1}, {1, 2, 3}};
+    static_assert(Apply(tph::InverseRigid(rigid), Apply(rigid, p)) == p, "");
+    static_assert(MatEq(tph::InverseRigid(rigid), tph::InverseAffine(rigid)), "");
+    constexpr auto rigid4 = tph::MakeMat4x4<double>(0, -1, 0, 1, //
+                                                    1, 0, 0, 2,  //
+                                                    0, 0, 1, 3,  //
+                                                    0, 0, 0, 1);
+    static_assert(MatEq(tph::InverseRigid(rigid4), tph::Inverse(rigid4)), "");
+    static_assert(MatEq(tph::InverseAffine(rigid4), tph::Inverse(rigid4)), "");
+  }
+
+  // Symmetric eigendecomposition.
+  {
+    // Diagonal matrices are solved exactly, the eigenpairs sorted by eigenvalue.
+    constexpr auto d = tph::EigenSymmetric(tph::MakeMat3x3<double>(3, 0, 0, //
+                                                                   0, 1, 0, //
+                                                                   0, 0, 2));
+    static_assert(d.values == tph::double3{1, 2, 3}, "");
+    static_assert(MatEq(d.vectors, tph::Mat<double, 3, 3>{{0, 1, 0}, {0, 0, 1}, {1, 0, 0}}), "");
+
+    constexpr auto a = tph::MakeMat3x3<double>(2, 1, 0, //
+                                               1, 2, 0, //
+                                               0, 0, 5);
+    constexpr auto e = tph::EigenSymmetric(a);
+    static_assert(ce_abs(e.values.x - 1.0) < 1e-14 && ce_abs(e.values.y - 3.0) < 1e-14 &&
+                      ce_abs(e.values.z - 5.0) < 1e-14,
+                  "");
+    static_assert(ce_abs(tph::Length2(tph::Mul(a, e.vectors.x) - e.vectors.x * e.values.x)) < 1e-28,
+                  "");
+    static_assert(ce_abs(tph::Dot(e.vectors.x, e.vectors.y)) < 1e-14, "");
+    static_assert(ce_abs(tph::Determinant(e.vectors) - 1.0) < 1e-14, "");
+
+    // Zero matrix.
+    constexpr auto z = tph::EigenSymmetric(tph::Mat<float, 3, 3>{});
+    static_assert(z.values == tph::float3{0, 0, 0}, "");
+    static_assert(MatEq(z.vectors, tph::Identity3x3<float>()), "");
+  }
+
+  // Singular value and polar decompositions.
+  {
+    constexpr auto a = tph::MakeMat3x3<double>(2, 0, 0,  //
+                                               0, -3, 0, //
+                                               0, 0, 1);
+    constexpr auto d = tph::Svd(a);
+    static_assert(ce_abs(d.values.x - 3.0) < 1e-14 && ce_abs(d.values.y - 2.0) < 1e-14 &&
+                      ce_abs(d.values.z + 1.0) < 1e-14,
+                  "");
+    static_assert(ce_abs(tph::Determinant(d.u) - 1.0) < 1e-14, "");
+    static_assert(ce_abs(tph::Determinant(d.v) - 1.0) < 1e-14, "");
+
+    // A rotation about z is its own polar rotation.
+    constexpr auto r = tph::MakeMat3x3<double>(0.6, -0.8, 0, //
+                                               0.8, 0.6, 0,  //
+                                               0, 0, 1);
+    constexpr auto p = tph::PolarDecompose(r);
+    static_assert(ce_abs(p.rotation.x.y - 0.8) < 1e-14 && ce_abs(p.rotation.y.x + 0.8) < 1e-14, "");
+    static_assert(ce_abs(p.stretch.x.x - 1.0) < 1e-14 && ce_abs(p.stretch.x.y) < 1e-14, "");
+  }
+
+  // Small linear solvers.
+  {
+    // The zero in the upper-left corner needs a row exchange.
+    constexpr auto a = tph::MakeMat3x3<double>(0, 2, 0, //
+                                               1, 0, 0, //
+                                               0, 0, 4);
+    constexpr auto s = tph::SolveLU(a, tph::double3{2, 3, 8});
+    static_assert(s.solved && s.x == tph::double3{3, 1, 2}, "");
+
+    constexpr auto singular =
+        tph::SolveLU(tph::Mat<double, 2, 2>{{1, 2}, {2, 4}}, tph::double2{1, 1});
+    static_assert(!singular.solved && singular.x == tph::double2{0, 0}, "");
+
+    constexpr auto spd = tph::Mat<double, 2, 2>{{4, 2}, {2, 3}};
+    constexpr auto c = tph::SolveCholesky(spd, tph::double2{2, 1});
+    static_assert(c.solved && ce_abs(c.x.x - 0.5) < 1e-15 && ce_abs(c.x.y) < 1e-15, "");
+    constexpr auto indefinite = tph::Mat<float, 2, 2>{{1, 2}, {2, 1}};
+    static_assert(!tph::SolveCholesky(indefinite, tph::float2{1, 1}).solved, "");
+  }
+
+  // Quaternions.
+  {
+    // Half turn about z.
+    constexpr auto q = tph::Quat<double>{{0, 0, 1}, 0};
+    static_assert(tph::Rotate(q, tph::double3{1, 2, 3}) == tph::double3{-1, -2, 3}, "");
+    constexpr auto r = tph::ToMat3x3(q);
+    static_assert(r.x == tph::double3{-1, 0, 0} && r.y == tph::double3{0, -1, 0} &&
+                      r.z == tph::double3{0, 0, 1},
+                  "");
+    constexpr auto back = tph::ToQuat(tph::ToMat4x4(q));
+    static_assert(back.v == q.v && back.w == q.w, "");
+    constexpr auto qq = tph::Mul(q, q);
+    static_assert(qq.v == tph::double3{0, 0, 0} && qq.w == -1, "");
+    constexpr auto id = tph::Mul(q, tph::Conjugate(q));
+    static_assert(id.v == tph::IdentityQuat<double>().v && id.w == 1, "");
+    constexpr auto iq = tph::Mul(tph::IdentityQuat<double>(), q);
+    static_assert(iq.v == q.v && iq.w == q.w, "");
+
+    // Quarter turn halfway.
+    constexpr auto s = tph::Slerp(tph::IdentityQuat<double>(), q, 0.5);
+    constexpr auto n = tph::Nlerp(tph::IdentityQuat<double>(), q, 0.5);
+    static_assert(ce_abs(s.v.z - 0.7071067811865476) < 1e-15 &&
+                      ce_abs(s.w - 0.7071067811865476) < 1e-15 && s.v.x == 0 && s.v.y == 0,
+                  "");
+    static_assert(ce_abs(n.v.z - s.v.z) < 1e-15 && ce_abs(n.w - s.w) < 1e-15, "");
+  }
+
 #if HAS_CPP17 // Need lambdas to be implicitly constexpr.
   // operator*=(vec, scalar)
   static_assert(
@@ -193,7 +451,230 @@ int main(int /*argc*/, char* /*argv*/[]) {
         return a;
       }() == tph::Vec<float, 4>{-1, 0, 1, 2},
       "");
+
+  // Mutable indexing.
+  static_assert(
+      []() {
+        auto a = tph::Vec<float, 3>{1, 2, 3};
+        a[1] = 5;
+        auto m = tph::Identity3x3<float>();
+        m[2][0] = 4;
+        return a + m[2];
+      }() == tph::Vec<float, 3>{5, 5, 4},
+      "");
+#endif // HAS_CPP17
+
+#if HAS_CPP14
+  // SIMD packets. Every lane holds the same problem, so results can be compared to the scalar
+  // results above. Comparisons give masks, so use Equal/All instead of operator==.
+  {
+    using P = tph::simd::f32x8;
+    using tph::simd::All;
+    using tph::simd::Any;
+    using tph::simd::Equal;
+
+    constexpr auto pa2 = Splat<P>(a2);
+    constexpr auto pa3 = Splat<P>(a3);
+    constexpr auto pa4 = Splat<P>(a4);
+    constexpr auto pb2 = Splat<P>(b2);
+    constexpr auto pb3 = Splat<P>(b3);
+    constexpr auto pb4 = Splat<P>(b4);
+
+    // Packet construction, lane access and masks.
+    constexpr P p{1, 2, 3, 4, 5, 6, 7, 8};
+    static_assert(p[0] == 1.0F && p[7] == 8.0F, "");
+    static_assert(All(P(2.0F) == P(2.0F)) && !Any(P(2.0F) != P(2.0F)), "");
+    static_assert((p < P(4.0F))[2] && !(p < P(4.0F))[3], "");
+    static_assert(All((p <= P(8.0F)) & (p >= P(1.0F))) && !All(p > P(1.0F)), "");
+    static_assert(All(tph::simd::Select(p < P(4.0F), P(0.0F), p) ==
+                      P{0, 0, 0, 4, 5, 6, 7, 8}),
+                  "");
+    static_assert(All(tph::simd::Min(p, P(4.0F)) == P{1, 2, 3, 4, 4, 4, 4, 4}), "");
+    static_assert(All(tph::simd::Max(p, P(4.0F)) == P{4, 4, 4, 4, 5, 6, 7, 8}), "");
+    static_assert(All(tph::simd::Abs(-p) == p), "");
+    static_assert(All(p / 2.0F * 2.0F == p) && All(1.0F + p - 1.0F == p), "");
+
+    // operator==(a, b) as masks.
+    static_assert(All(Equal(pa2, pa2)) && !Any(Equal(pa2, pb2)), "");
+    static_assert(All(Equal(pa3, pa3)) && !Any(Equal(pa3, pb3)), "");
+    static_assert(All(Equal(pa4, pa4)) && !Any(Equal(pa4, pb4)), "");
+
+    // operator*(vec, scalar)
+    static_assert(All(Equal(pa2 * 2.0F, Splat<P>(a2 * 2))), "");
+    static_assert(All(Equal(pa3 * P(2.0F), Splat<P>(a3 * 2))), "");
+    static_assert(All(Equal(pa4 * 2.0F, Splat<P>(a4 * 2))), "");
+
+    // operator+(a, b)
+    static_assert(All(Equal(pa2 + pb2, Splat<P>(a2 + b2))), "");
+    static_assert(All(Equal(pa3 + pb3, Splat<P>(a3 + b3))), "");
+    static_assert(All(Equal(pa4 + pb4, Splat<P>(a4 + b4))), "");
+
+    // operator-(a, b)
+    static_assert(All(Equal(pa2 - pb2, Splat<P>(a2 - b2))), "");
+    static_assert(All(Equal(pa3 - pb3, Splat<P>(a3 - b3))), "");
+    static_assert(All(Equal(pa4 - pb4, Splat<P>(a4 - b4))), "");
+
+    // operator-(a)
+    static_assert(All(Equal(-pa2, Splat<P>(-a2))), "");
+    static_assert(All(Equal(-pa3, Splat<P>(-a3))), "");
+    static_assert(All(Equal(-pa4, Splat<P>(-a4))), "");
+
+    // Cross product.
+    static_assert(All(tph::Cross(pa2, pb2) == P(tph::Cross(a2, b2))), "");
+    static_assert(All(Equal(tph::Cross(pa3, pb3), Splat<P>(tph::Cross(a3, b3)))), "");
+
+    // Dot product, length squared, distance squared.
+    static_assert(All(tph::Dot(pa2, pb2) == P(11.0F)), "");
+    static_assert(All(tph::Dot(pa3, pb3) == P(32.0F)), "");
+    static_assert(All(tph::Dot(pa4, pb4) == P(70.0F)), "");
+    static_assert(All(tph::Length2(pa3) == P(14.0F)), "");
+    static_assert(All(tph::Distance2(pa4, pb4) == P(64.0F)), "");
+
+    // Length, distance, normalized.
+    constexpr auto kSqrt14 = 3.7416573867F;
+    constexpr auto kSqrt27 = 5.1961524227F;
+    static_assert(All(tph::simd::Abs(tph::Length(pa3) - kSqrt14) < P(1e-6F)), "");
+    static_assert(All(tph::simd::Abs(tph::Distance(pa3, pb3) - kSqrt27) < P(1e-6F)), "");
+    static_assert(All(tph::simd::Abs(tph::InvLength(pa3) - 1.0F / kSqrt14) < P(1e-6F)), "");
+    static_assert(All(Equal(tph::Normalized(pa3), Splat<P>(tph::Normalized(a3)))), "");
+    static_assert(All(Equal(tph::NormalizedFast(pa3), Splat<P>(tph::NormalizedFast(a3)))), "");
+
+    // Component access, rows and matrix/vector multiplication.
+    constexpr auto pm = tph::Mat<P, 3, 3>{pa3, pb3, pa3 + pb3};
+    static_assert(All(tph::Comp(pa4, 3) == P(4.0F)), "");
+    static_assert(All(Equal(tph::Row(pm, 1), Splat<P>(tph::float3{2, 5, 7}))), "");
+    static_assert(All(Equal(tph::Mul(tph::Identity3x3<P>(), pa3), pa3)), "");
+    static_assert(All(Equal(tph::Mul(pm, Splat<P>(tph::float3{1, 0, 1})), pa3 + pa3 + pb3)), "");
+
+    // Lanes are independent problems.
+    constexpr auto lanes = tph::Vec<P, 3>{p, P(0.0F), P(0.0F)};
+    static_assert(All(tph::Length(lanes) == p), "");
+    static_assert(All(Equal(tph::Cross(lanes, Splat<P>(tph::float3{0, 1, 0})),
+                            tph::Vec<P, 3>{P(0.0F), P(0.0F), p})),
+                  "");
+
+    // Load/store between arrays of vectors and vectors of packets.
+    static_assert(All(Equal(tph::simd::LoadVec<tph::simd::f32x4>(&a3, 1),
+                            tph::Vec<tph::simd::f32x4, 3>{tph::simd::f32x4{1, 0, 0, 0},
+                                                          tph::simd::f32x4{2, 0, 0, 0},
+                                                          tph::simd::f32x4{3, 0, 0, 0}})),
+                  "");
+
+    // Other packet sizes and double precision.
+    static_assert(All(Equal(tph::Cross(Splat<tph::simd::f32x4>(a3), Splat<tph::simd::f32x4>(b3)),
+                            Splat<tph::simd::f32x4>(tph::Cross(a3, b3)))),
+                  "");
+    static_assert(All(tph::Dot(Splat<tph::simd::f32x16>(a4), Splat<tph::simd::f32x16>(b4)) ==
+                      tph::simd::f32x16(70.0F)),
+                  "");
+    static_assert(All(tph::simd::Abs(tph::Length(Splat<tph::simd::f64x4>(tph::double3{1, 2, 3})) -
+                                     3.7416573867739413) < tph::simd::f64x4(1e-12)),
+                  "");
+
+    // Branch-free decompositions give the scalar results in every lane.
+    constexpr auto sym = tph::MakeMat3x3<double>(2, 1, 0, //
+                                                 1, 2, 0, //
+                                                 0, 0, 5);
+    using P4 = tph::simd::f64x4;
+    constexpr auto psym = tph::Mat<P4, 3, 3>{Splat<P4>(sym.x), Splat<P4>(sym.y), Splat<P4>(sym.z)};
+    static_assert(All(Equal(tph::EigenSymmetric(psym).values,
+                            Splat<P4>(tph::EigenSymmetric(sym).values))),
+                  "");
+    static_assert(All(Equal(tph::Svd(psym).values, Splat<P4>(tph::Svd(sym).values))), "");
+    static_assert(All(Equal(tph::SolveLU(psym, Splat<P4>(tph::double3{1, 2, 3})).x,
+                            Splat<P4>(tph::SolveLU(sym, tph::double3{1, 2, 3}).x))),
+                  "");
+    constexpr auto q = tph::Quat<double>{{0.48, 0.6, 0}, 0.64};
+    constexpr auto pq = tph::Quat<P4>{Splat<P4>(q.v), P4(q.w)};
+    static_assert(All(Equal(tph::Slerp(tph::IdentityQuat<P4>(), pq, P4(0.3)).v,
+                            Splat<P4>(tph::Slerp(tph::IdentityQuat<double>(), q, 0.3).v))),
+                  "");
+    static_assert(All(Equal(tph::Rotate(pq, Splat<P4>(tph::double3{1, 2, 3})),
+                            Splat<P4>(tph::Rotate(q, tph::double3{1, 2, 3})))),
+                  "");
+  }
+#endif // HAS_CPP14
+
+#if HAS_CPP17
+  // Compound assignment on packets.
+  static_assert(tph::simd::All(tph::simd::Equal(
+                    []() {
+                      auto a = Splat<tph::simd::f32x8>(tph::float3{1, 2, 3});
+                      a += Splat<tph::simd::f32x8>(tph::float3{1, 1, 1});
+                      a -= Splat<tph::simd::f32x8>(tph::float3{2, 2, 2});
+                      a *= tph::simd::f32x8(2.0F);
+                      return a;
+                    }(),
+                    Splat<tph::simd::f32x8>(tph::float3{0, 2, 4}))),
+                "");
 #endif // HAS_CPP17
 
+  // Half storage, arithmetic is done in float.
+  static_assert(sizeof(tph::half) == 2, "");
+  static_assert(sizeof(tph::half3) == 3 * sizeof(tph::half), "");
+  static_assert(std::is_trivially_copyable<tph::half>::value, "");
+  static_assert(std::is_same<decltype(tph::half{} + tph::half{}), float>::value, "");
+  static_assert(std::is_same<decltype(tph::half{} * 1.0), double>::value, "");
+  static_assert(std::is_same<decltype(tph::half3{} + tph::half3{}), tph::float3>::value, "");
+  static_assert(std::is_same<decltype(tph::Dot(tph::half4{}, tph::half4{})), float>::value, "");
+  static_assert(std::is_same<decltype(tph::Widen(tph::half2{})), tph::float2>::value, "");
+
+  // Packed unit vectors.
+  static_assert(sizeof(tph::Oct16) == 2 && sizeof(tph::Oct32) == 4, "");
+  static_assert(sizeof(tph::Snorm1010102) == 4, "");
+  static_assert(tph::Encode<tph::Oct32>(tph::float3{0.0F, 0.0F, -1.0F}).x == 32767 &&
+                    tph::Encode<tph::Oct32>(tph::float3{0.0F, 0.0F, -1.0F}).y == 32767,
+                "");
+  static_assert(tph::Encode<tph::Oct16>(tph::float3{0.0F, 0.0F, 1.0F}).x == 0 &&
+                    tph::Encode<tph::Oct16>(tph::float3{0.0F, 0.0F, 1.0F}).y == 0,
+                "");
+  static_assert(tph::Decode(tph::Oct16{-127, 0}) == tph::float3{-1.0F, 0.0F, 0.0F}, "");
+  static_assert(tph::Encode<tph::Snorm1010102>(tph::float3{0.0F, -1.0F, 0.0F}).bits ==
+                    (0x201U << 10),
+                "");
+  static_assert(tph::Decode(tph::Snorm1010102{0x201U << 10}) == tph::float3{0.0F, -1.0F, 0.0F},
+                "");
+
+  // Component-wise minimum and maximum, and boxes.
+  static_assert(tph::Min(tph::float3{1.0F, 5.0F, -2.0F}, tph::float3{2.0F, 4.0F, -3.0F}) ==
+                    tph::float3{1.0F, 4.0F, -3.0F},
+                "");
+  static_assert(tph::Max(tph::float4{1.0F, 5.0F, -2.0F, 0.0F},
+                         tph::float4{2.0F, 4.0F, -3.0F, 0.0F}) ==
+                    tph::float4{2.0F, 5.0F, -2.0F, 0.0F},
+                "");
+  static_assert(tph::Union(tph::Aabb<float, 2>{{0.0F, 1.0F}, {2.0F, 3.0F}},
+                           tph::Aabb<float, 2>{{-1.0F, 2.0F}, {1.0F, 4.0F}})
+                        .min == tph::float2{-1.0F, 1.0F},
+                "");
+
+  // Closest points and distances, each in a different region.
+  static_assert(tph::ClosestPointOnSegment(tph::float3{2.0F, 5.0F, 0.0F}, tph::float3{},
+                                           tph::float3{4.0F, 0.0F, 0.0F}) ==
+                    tph::float3{2.0F, 0.0F, 0.0F},
+                "");
+  static_assert(tph::ClosestPointOnSegment(tph::float3{-1.0F, 1.0F, 0.0F}, tph::float3{},
+                                           tph::float3{4.0F, 0.0F, 0.0F}) == tph::float3{},
+                "");
+  static_assert(tph::ClosestPointOnSegment(tph::float2{1.0F, 1.0F}, tph::float2{2.0F, 2.0F},
+                                           tph::float2{2.0F, 2.0F}) == tph::float2{2.0F, 2.0F},
+                "");
+  static_assert(tph::ClosestPointOnTriangle(tph::float3{0.25F, 0.25F, 1.0F}, tph::float3{},
+                                            tph::float3{1.0F, 0.0F, 0.0F},
+                                            tph::float3{0.0F, 1.0F, 0.0F}) ==
+                    tph::float3{0.25F, 0.25F, 0.0F},
+                "");
+  static_assert(tph::ClosestPointOnTriangle(tph::float3{2.0F, 2.0F, 0.0F}, tph::float3{},
+                                            tph::float3{1.0F, 0.0F, 0.0F},
+                                            tph::float3{0.0F, 1.0F, 0.0F}) ==
+                    tph::float3{0.5F, 0.5F, 0.0F},
+                "");
+  static_assert(tph::DistanceToBox(tph::float3{4.0F, 0.5F, 6.0F},
+                                   tph::Aabb<float, 3>{{}, {1.0F, 1.0F, 2.0F}}) == 5.0F,
+                "");
+  static_assert(tph::DistanceToBox(tph::float2{0.5F, 0.5F},
+                                   tph::Aabb<float, 2>{{}, {1.0F, 1.0F}}) == 0.0F,
+                "");
+
   return 0;
 }